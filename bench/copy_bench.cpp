@@ -0,0 +1,104 @@
+// Сравнение способов копирования CopyEngine на одном большом файле и на дереве мелких файлов.
+// Использование: copy_bench [рабочая_папка] [размер_МБ] [мелких_файлов]
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "copy_engine.hpp"
+
+namespace fs = std::filesystem;
+
+static double seconds(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Строки разделены табуляцией: так таблицу удобно сравнивать между запусками
+static void printRow(const std::string& name, const std::string& used, uintmax_t bytes, uintmax_t files, double elapsed) {
+    std::cout << name << '\t' << used << '\t'
+        << std::fixed << std::setprecision(1) << bytes / elapsed / (1 << 20) << " МБ/с\t"
+        << std::setprecision(0) << files / elapsed << " файл/с\n";
+}
+
+int main(int argc, char** argv) {
+    fs::path workDir = argc > 1 ? fs::path(argv[1]) : fs::temp_directory_path() / "copy_bench";
+    uintmax_t sizeMb = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 512;
+    size_t smallFiles = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 5000;
+
+    fs::remove_all(workDir);
+    fs::create_directories(workDir / "tree");
+
+    // Большой файл с неповторяющимся содержимым
+    fs::path bigFile = workDir / "big.bin";
+    {
+        std::ofstream out(bigFile, std::ios::binary);
+        std::vector<char> block(1 << 20);
+        uint64_t state = 88172645463325252ull;
+        for (uintmax_t mb = 0; mb < sizeMb; mb++) {
+            for (auto& byte : block) {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                byte = static_cast<char>(state);
+            }
+            out.write(block.data(), block.size());
+        }
+    }
+
+    // Дерево мелких файлов по 100 в папке
+    for (size_t i = 0; i < smallFiles; i++) {
+        fs::path dir = workDir / "tree" / ("d" + std::to_string(i / 100));
+        fs::create_directories(dir);
+        std::ofstream(dir / ("f" + std::to_string(i) + ".txt")) << std::string(1 + i % 8192, 'x');
+    }
+
+    std::cout << "Файл " << sizeMb << " МБ, дерево из " << smallFiles << " файлов в " << workDir.string() << "\n\n";
+
+    struct Variant {
+        const char* name;
+        CopyMethod first;
+        bool split;
+    };
+    const Variant variants[] = {
+        { "reflink (авто)", CopyMethod::Reflink, false },
+        { "copy_file_range", CopyMethod::CopyFileRange, false },
+        { "sendfile", CopyMethod::Sendfile, false },
+        { "read/write", CopyMethod::ReadWrite, false },
+        { "диапазоны copy_file_range", CopyMethod::CopyFileRange, true },
+        { "диапазоны read/write", CopyMethod::ReadWrite, true },
+    };
+
+    for (const auto& variant : variants) {
+        CopyOptions options;
+        options.firstMethod = variant.first;
+        options.splitThreshold = variant.split ? 0 : UINTMAX_MAX;
+        CopyEngine engine(options);
+
+        fs::path target = workDir / "big.copy";
+        fs::remove(target);
+        auto start = std::chrono::steady_clock::now();
+        CopyMethod used = engine.copyFile(bigFile, target);
+        printRow(variant.name, copyMethodName(used), engine.progress().bytes, 1, seconds(start));
+    }
+    std::cout << '\n';
+
+    for (unsigned jobs : { 1u, 0u }) {
+        CopyOptions options;
+        options.jobs = jobs;
+        CopyEngine engine(options);
+
+        fs::path target = workDir / "tree.copy";
+        fs::remove_all(target);
+        auto start = std::chrono::steady_clock::now();
+        engine.copyTree(workDir / "tree", target);
+        CopyProgress progress = engine.progress();
+        printRow(jobs == 1 ? "дерево, 1 задача" : "дерево, пул задач", "", progress.bytes, progress.files, seconds(start));
+    }
+
+    fs::remove_all(workDir);
+    return 0;
+}
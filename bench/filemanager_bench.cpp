@@ -0,0 +1,258 @@
+// Бенчмарк операций FileManager на синтетическом дереве: listContents, searchFiles,
+// copyItem и удаление папки (deleteItem -> Directory::deleteDir), с тёплым и холодным кэшем.
+// Вывод - строки JSON (одна на операцию и состояние кэша), чтобы сравнивать коммиты скриптом.
+// Использование: filemanager_bench [--work DIR] [--depth N] [--fanout N] [--files N]
+//     [--sizes small|mixed|large] [--names short|long|unicode] [--runs N] [--seed N] [--no-cold]
+// Холодный кэш - через /proc/sys/vm/drop_caches (нужны права root); без них строки cold не выводятся.
+// p99 считается по рангу: при малом числе замеров он равен максимуму.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "command_line.hpp"
+#include "file_manager.hpp"
+#include "tree_generator.hpp"
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Вывод FileManager во время замеров отбрасывается
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+
+    std::streamsize xsputn(const char*, std::streamsize count) override {
+        return count;
+    }
+};
+
+bool dropCaches() {
+#ifdef __linux__
+    ::sync();
+    std::ofstream control("/proc/sys/vm/drop_caches");
+    control << "3\n";
+    control.flush();
+    return control.good();
+#else
+    return false;
+#endif
+}
+
+// Сбрасывает пик RSS процесса (Linux 4.0+), чтобы мерить пик отдельной операции
+void resetPeakRss() {
+#ifdef __linux__
+    std::ofstream("/proc/self/clear_refs") << "5\n";
+#endif
+}
+
+long peakRssKb() {
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::strtol(line.c_str() + 6, nullptr, 10);
+        }
+    }
+#endif
+#ifndef _WIN32
+    struct rusage usage;
+    if (::getrusage(RUSAGE_SELF, &usage) == 0) {
+        return usage.ru_maxrss;
+    }
+#endif
+    return 0;
+}
+
+double percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t rank = static_cast<size_t>(std::ceil(p * samples.size()));
+    return samples[std::max<size_t>(rank, 1) - 1];
+}
+
+struct Result {
+    std::vector<double> samples;  // секунды
+    uintmax_t items = 0;          // суммарно по всем замерам
+    uintmax_t bytes = 0;
+    long peakRss = 0;
+};
+
+void report(const std::string& operation, const char* cache, const Result& result) {
+    double total = 0;
+    for (double sample : result.samples) {
+        total += sample;
+    }
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(3)
+        << "{\"type\":\"result\",\"op\":" << jsonString(operation) << ",\"cache\":\"" << cache << '"'
+        << ",\"samples\":" << result.samples.size()
+        << ",\"p50_ms\":" << percentile(result.samples, 0.50) * 1000
+        << ",\"p99_ms\":" << percentile(result.samples, 0.99) * 1000
+        << ",\"items_per_s\":" << (total > 0 ? result.items / total : 0)
+        << ",\"mb_per_s\":" << (total > 0 ? result.bytes / total / (1 << 20) : 0)
+        << ",\"peak_rss_kb\":" << result.peakRss << '}';
+    std::cout << line.str() << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    fs::path workDir = fs::temp_directory_path() / "filemanager_bench";
+    TreeSpec spec;
+    unsigned runs = 5;
+    bool cold = true;
+    try {
+        for (int i = 1; i < argc; i++) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument("нет значения для " + arg);
+                }
+                return argv[++i];
+            };
+            if (arg == "--work") workDir = value();
+            else if (arg == "--depth") spec.depth = static_cast<unsigned>(std::stoul(value()));
+            else if (arg == "--fanout") spec.fanout = static_cast<unsigned>(std::stoul(value()));
+            else if (arg == "--files") spec.filesPerDir = static_cast<unsigned>(std::stoul(value()));
+            else if (arg == "--sizes") spec.sizes = TreeSpec::parseSizes(value());
+            else if (arg == "--names") spec.names = TreeSpec::parseNames(value());
+            else if (arg == "--runs") runs = std::max(1u, static_cast<unsigned>(std::stoul(value())));
+            else if (arg == "--seed") spec.seed = std::stoull(value());
+            else if (arg == "--no-cold") cold = false;
+            else throw std::invalid_argument("неизвестный параметр " + arg);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Ошибка: " << e.what() << '\n';
+        return 2;
+    }
+
+    fs::remove_all(workDir);
+    const fs::path tree = workDir / "tree";
+    TreeInfo info = TreeGenerator(spec).generate(tree);
+    cold = cold && dropCaches();
+
+    // Индекс имён пользователя не должен влиять на поиск
+#ifdef _WIN32
+    _putenv_s("FM_INDEX", (workDir / "no-index.bin").string().c_str());
+#else
+    ::setenv("FM_INDEX", (workDir / "no-index.bin").c_str(), 1);
+#endif
+
+    std::cout << "{\"type\":\"config\",\"depth\":" << spec.depth << ",\"fanout\":" << spec.fanout
+        << ",\"files_per_dir\":" << spec.filesPerDir << ",\"sizes\":\"" << TreeSpec::toString(spec.sizes)
+        << "\",\"names\":\"" << TreeSpec::toString(spec.names) << "\",\"seed\":" << spec.seed
+        << ",\"runs\":" << runs << ",\"files\":" << info.files << ",\"directories\":" << info.directories.size()
+        << ",\"bytes\":" << info.bytes << ",\"cold_cache\":" << (cold ? "true" : "false") << '}' << std::endl;
+
+    NullBuffer nullBuffer;
+    std::streambuf* console = std::cout.rdbuf();
+    std::cout.rdbuf(&nullBuffer);
+    FileManager fm;
+    fm.changeDirectory(workDir.string());
+    std::cout.rdbuf(console);
+
+    // Каждая операция: прогрев, затем runs замеров; before() готовит замер и в него не входит
+    auto measure = [&](const std::string& name, bool coldCache, uintmax_t items, uintmax_t bytes,
+        const std::function<void()>& before, const std::function<void()>& operation) {
+        if (!coldCache) {
+            std::cout.rdbuf(&nullBuffer);
+            before();
+            operation();
+            std::cout.rdbuf(console);
+        }
+        Result result;
+        resetPeakRss();
+        for (unsigned run = 0; run < runs; run++) {
+            std::cout.rdbuf(&nullBuffer);
+            before();
+            if (coldCache) {
+                dropCaches();
+            }
+            auto started = std::chrono::steady_clock::now();
+            operation();
+            result.samples.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+            std::cout.rdbuf(console);
+            result.items += items;
+            result.bytes += bytes;
+        }
+        result.peakRss = peakRssKb();
+        report(name, coldCache ? "cold" : "warm", result);
+    };
+
+    for (bool coldCache : { false, true }) {
+        if (coldCache && !cold) {
+            break;
+        }
+        // ls -l: замер - одна папка, поэтому процентили показывают разброс по папкам
+        {
+            if (!coldCache) {
+                std::cout.rdbuf(&nullBuffer);
+                for (const auto& dir : info.directories) {
+                    Directory(dir.string()).listContents(true);
+                }
+                std::cout.rdbuf(console);
+            }
+            Result result;
+            resetPeakRss();
+            for (unsigned run = 0; run < runs; run++) {
+                if (coldCache) {
+                    dropCaches();
+                }
+                for (const auto& dir : info.directories) {
+                    std::cout.rdbuf(&nullBuffer);
+                    auto started = std::chrono::steady_clock::now();
+                    Directory(dir.string()).listContents(true);
+                    result.samples.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+                    std::cout.rdbuf(console);
+                }
+                result.items += info.files + info.directories.size() - 1;
+            }
+            result.peakRss = peakRssKb();
+            report("listContents", coldCache ? "cold" : "warm", result);
+        }
+
+        const uintmax_t entries = info.files + info.directories.size() - 1;
+        measure("searchFiles", coldCache, entries, 0, [] {}, [&] {
+            fm.searchFiles("42");
+            });
+        measure("copyItem", coldCache, info.files, info.bytes, [&] {
+            fs::remove_all(workDir / "tree.copy");
+            }, [&] {
+                fm.copyItem("tree", "tree.copy");
+            });
+        measure("deleteDir", coldCache, entries, 0, [&] {
+            if (!fs::exists(workDir / "tree.copy")) {
+                fm.copyItem("tree", "tree.copy");
+            }
+            }, [&] {
+                fm.deleteItem("tree.copy");
+            });
+    }
+
+    fs::remove_all(workDir);
+    return 0;
+}
@@ -0,0 +1,99 @@
+// Блокирующий путь против io_uring на дереве мелких файлов с холодным кэшем:
+// ls -l (statx всех элементов) и копирование дерева.
+// Использование: io_bench [рабочая_папка] [файлов] [файлов_в_папке]
+// Кэш сбрасывается через /proc/sys/vm/drop_caches (нужны права root), иначе замер идёт по тёплому кэшу.
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "copy_engine.hpp"
+#include "io_ring.hpp"
+#include "listing.hpp"
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static double seconds(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+static bool dropCaches() {
+#ifdef __linux__
+    ::sync();
+    std::ofstream control("/proc/sys/vm/drop_caches");
+    control << "3\n";
+    control.flush();
+    return control.good();
+#else
+    return false;
+#endif
+}
+
+static void printRow(const std::string& name, const std::string& mode, uintmax_t items, double elapsed) {
+    std::cout << name << '\t' << mode << '\t'
+        << std::fixed << std::setprecision(3) << elapsed << " с\t"
+        << std::setprecision(0) << items / elapsed << " элем/с\n";
+}
+
+int main(int argc, char** argv) {
+    fs::path workDir = argc > 1 ? fs::path(argv[1]) : fs::temp_directory_path() / "io_bench";
+    size_t fileCount = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 20000;
+    size_t perDir = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 2000;
+    if (perDir == 0) {
+        perDir = 1;
+    }
+
+    fs::remove_all(workDir);
+    std::vector<fs::path> dirs;
+    for (size_t i = 0; i < fileCount; i++) {
+        if (i % perDir == 0) {
+            dirs.push_back(workDir / "tree" / ("d" + std::to_string(i / perDir)));
+            fs::create_directories(dirs.back());
+        }
+        std::ofstream(dirs.back() / ("f" + std::to_string(i) + ".txt")) << std::string(1 + i % 4096, 'x');
+    }
+
+    std::cout << "Дерево из " << fileCount << " файлов в " << workDir.string()
+        << ", io_uring: " << (IoRing::supported() ? "доступен" : "недоступен") << "\n";
+    if (!dropCaches()) {
+        std::cout << "Сбросить кэш не удалось: замеры по тёплому кэшу\n";
+    }
+    std::cout << '\n';
+
+    for (bool ring : { false, true }) {
+        if (ring && !IoRing::supported()) {
+            break;
+        }
+        IoRing::setEnabled(ring);
+        const char* mode = ring ? "io_uring" : "блокирующий";
+
+        dropCaches();
+        auto start = std::chrono::steady_clock::now();
+        uintmax_t listed = 0;
+        for (const auto& dir : dirs) {
+            DirectoryListing listing;
+            listing.load(dir, true, 1);
+            listed += listing.size();
+        }
+        printRow("ls -l", mode, listed, seconds(start));
+
+        fs::path target = workDir / "tree.copy";
+        fs::remove_all(target);
+        dropCaches();
+        CopyEngine engine;
+        start = std::chrono::steady_clock::now();
+        engine.copyTree(workDir / "tree", target);
+        printRow("копирование", mode, engine.progress().files, seconds(start));
+    }
+
+    fs::remove_all(workDir);
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Сравнение Matcher с прежним путём searchFiles (filename().string() + std::string::find).
+// Использование: match_bench [папка] [шаблон] [повторов]
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "matcher.hpp"
+#include "walker.hpp"
+
+namespace fs = std::filesystem;
+
+template <typename F>
+static void measure(const std::string& name, size_t entries, int repeats, F run) {
+    size_t matched = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        matched = run();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << '\t' << matched << " совпадений\t"
+        << std::fixed << std::setprecision(2) << elapsed * 1e9 / (static_cast<double>(entries) * repeats) << " нс/имя\n";
+}
+
+int main(int argc, char** argv) {
+    fs::path root = argc > 1 ? fs::path(argv[1]) : fs::path("/usr");
+    std::string pattern = argc > 2 ? argv[2] : "conf";
+    int repeats = argc > 3 ? std::atoi(argv[3]) : 20;
+
+    // Полные пути и смещения имён, как их отдаёт обходчик
+    std::vector<std::string> paths;
+    std::vector<size_t> nameOffsets;
+    std::vector<fs::path> fsPaths;
+    ParallelWalker walker(WalkOptions{ 1 });
+    walker.walk(root, [&](const WalkDir&, std::vector<WalkEntry>& entries) {
+        for (const auto& entry : entries) {
+            std::string path = entry.path();
+            nameOffsets.push_back(path.size() - entry.nameLength);
+            fsPaths.emplace_back(path);
+            paths.push_back(std::move(path));
+        }
+        });
+    const size_t count = paths.size();
+    std::cout << count << " имён из " << root.string() << ", шаблон \"" << pattern
+        << "\", лучший SIMD: " << simdLevelName(Matcher::detectSimd()) << "\n\n";
+
+    measure("filename().string().find", count, repeats, [&] {
+        size_t matched = 0;
+        for (const auto& path : fsPaths) {
+            std::string filename = path.filename().string();
+            matched += filename.find(pattern) != std::string::npos;
+        }
+        return matched;
+        });
+
+    auto runMatcher = [&](const Matcher& matcher) {
+        size_t matched = 0;
+        for (size_t i = 0; i < count; i++) {
+            matched += matcher.matches(std::string_view(paths[i]).substr(nameOffsets[i]));
+        }
+        return matched;
+    };
+
+    for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::Sse42, SimdLevel::Avx2 }) {
+        if (level > Matcher::detectSimd()) {
+            continue;
+        }
+        MatchOptions options;
+        options.simd = level;
+        Matcher exact(pattern, options);
+        measure(std::string("подстрока ") + simdLevelName(level), count, repeats, [&] { return runMatcher(exact); });
+
+        options.ignoreCase = true;
+        Matcher folded(pattern, options);
+        measure(std::string("подстрока -i ") + simdLevelName(level), count, repeats, [&] { return runMatcher(folded); });
+    }
+
+    MatchOptions globOptions;
+    globOptions.mode = MatchMode::Glob;
+    Matcher glob("*" + pattern + "*", globOptions);
+    measure("glob *" + pattern + "*", count, repeats, [&] { return runMatcher(glob); });
+
+    MatchOptions regexOptions;
+    regexOptions.mode = MatchMode::Regex;
+    Matcher regex(pattern, regexOptions);
+    measure("regex " + pattern, count, std::max(1, repeats / 10), [&] { return runMatcher(regex); });
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Скорость вывода результатов в строках в секунду: прежний путь (setlocale в каждой
+// команде, cout синхронизирован со stdio) против OutputWriter в разных форматах и потоках.
+// Результаты пишутся в stderr, измеряемый вывод - в stdout, поэтому запускать так:
+// output_bench [строк] > /dev/null   (или > файл, или | cat - тогда это канал)
+#include <chrono>
+#include <clocale>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "console_output.hpp"
+
+static double seconds(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Строки разделены табуляцией, как в copy_bench
+static void printRow(const std::string& name, size_t lines, uintmax_t bytes, double elapsed) {
+    std::cerr << name << '\t'
+        << std::fixed << std::setprecision(0) << lines / elapsed << " строк/с\t"
+        << std::setprecision(1) << bytes / elapsed / (1 << 20) << " МБ/с\n";
+}
+
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+
+    // Пути похожей на search длины
+    std::vector<std::string> paths;
+    paths.reserve(1024);
+    uintmax_t bytes = 0;
+    for (size_t i = 0; i < 1024; i++) {
+        paths.push_back("/home/user/projects/src/module" + std::to_string(i % 37) + "/file_" + std::to_string(i) + ".cpp");
+    }
+    for (size_t i = 0; i < count; i++) {
+        bytes += paths[i % paths.size()].size() + 1;
+    }
+    std::cerr << count << " строк, stdout - " << (Console::interactive() && ::isatty(STDOUT_FILENO) ? "терминал" : "файл или канал")
+        << "\n\n";
+
+    // Прежний путь: cout синхронизирован со stdio
+    {
+        const size_t calls = std::min<size_t>(count, 200000);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < calls; i++) {
+            std::setlocale(LC_ALL, "ru");
+            std::cout << paths[i % paths.size()] << '\n';
+        }
+        std::cout.flush();
+        printRow("setlocale + cout на строку", calls, bytes / count * calls, seconds(start));
+    }
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i++) {
+            std::cout << paths[i % paths.size()] << '\n';
+        }
+        std::cout.flush();
+        printRow("cout, синхронизация со stdio", count, bytes, seconds(start));
+    }
+    {
+        const size_t calls = std::min<size_t>(count, 200000);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < calls; i++) {
+            std::cout << paths[i % paths.size()] << std::endl;
+        }
+        printRow("cout, сброс после каждой строки", calls, bytes / count * calls, seconds(start));
+    }
+    std::cerr << '\n';
+
+    // Новый путь. В libstdc++ отвязка от stdio после начала вывода работает, хотя стандарт
+    // оставляет это на усмотрение реализации; в программе Console::init вызывается до вывода
+    Console::init();
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i++) {
+            std::cout << paths[i % paths.size()] << '\n';
+        }
+        std::cout.flush();
+        printRow("cout без синхронизации", count, bytes, seconds(start));
+    }
+
+    const struct {
+        const char* name;
+        OutputFormat format;
+    } formats[] = {
+        { "OutputWriter, plain", OutputFormat::Plain },
+        { "OutputWriter, json", OutputFormat::Json },
+        { "OutputWriter, nul", OutputFormat::Nul },
+    };
+    for (const auto& variant : formats) {
+        auto start = std::chrono::steady_clock::now();
+        {
+            OutputWriter writer(std::cout, variant.format);
+            std::string block;
+            size_t inBlock = 0;
+            for (size_t i = 0; i < count; i++) {
+                writer.append(block, paths[i % paths.size()]);
+                // Пачка как у обходчика
+                if (++inBlock == 512) {
+                    writer.write(block, inBlock);
+                    inBlock = 0;
+                }
+            }
+            writer.write(block, inBlock);
+        }
+        printRow(variant.name, count, bytes, seconds(start));
+    }
+
+    for (unsigned threads : { 2u, 4u, 8u }) {
+        auto start = std::chrono::steady_clock::now();
+        {
+            OutputWriter writer(std::cout);
+            std::vector<std::thread> workers;
+            for (unsigned t = 0; t < threads; t++) {
+                workers.emplace_back([&, t] {
+                    std::string block;
+                    size_t inBlock = 0;
+                    for (size_t i = t; i < count; i += threads) {
+                        writer.append(block, paths[i % paths.size()]);
+                        if (++inBlock == 512) {
+                            writer.write(block, inBlock);
+                            inBlock = 0;
+                        }
+                    }
+                    writer.write(block, inBlock);
+                    });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+        printRow("OutputWriter, plain, потоков: " + std::to_string(threads), count, bytes, seconds(start));
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+// Генератор синтетического дерева для бенчмарков: глубина, ветвление, распределение
+// размеров файлов и вид имён задаются параметрами, содержимое детерминировано seed
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct TreeSpec {
+    enum class Sizes { Small, Mixed, Large };
+    enum class Names { Short, Long, Unicode };
+
+    unsigned depth = 3;          // уровней папок под корнем
+    unsigned fanout = 4;         // подпапок в каждой папке
+    unsigned filesPerDir = 50;
+    Sizes sizes = Sizes::Mixed;
+    Names names = Names::Short;
+    uint64_t seed = 42;
+
+    static Sizes parseSizes(const std::string& text) {
+        if (text == "small") return Sizes::Small;
+        if (text == "mixed") return Sizes::Mixed;
+        if (text == "large") return Sizes::Large;
+        throw std::invalid_argument("размеры: small | mixed | large");
+    }
+
+    static Names parseNames(const std::string& text) {
+        if (text == "short") return Names::Short;
+        if (text == "long") return Names::Long;
+        if (text == "unicode") return Names::Unicode;
+        throw std::invalid_argument("имена: short | long | unicode");
+    }
+
+    static const char* toString(Sizes sizes) {
+        return sizes == Sizes::Small ? "small" : sizes == Sizes::Mixed ? "mixed" : "large";
+    }
+
+    static const char* toString(Names names) {
+        return names == Names::Short ? "short" : names == Names::Long ? "long" : "unicode";
+    }
+};
+
+struct TreeInfo {
+    uintmax_t files = 0;
+    uintmax_t bytes = 0;
+    std::vector<fs::path> directories;  // включая корень
+};
+
+class TreeGenerator {
+public:
+    explicit TreeGenerator(TreeSpec spec) : spec(spec), random(spec.seed) {
+        // Один буфер случайных байт: файлы берут из него префиксы, сжатие ФС не помогает
+        content.resize(MaxFileSize);
+        std::mt19937_64 bytes(spec.seed ^ 0x5DEECE66Dull);
+        for (size_t i = 0; i + 8 <= content.size(); i += 8) {
+            const uint64_t value = bytes();
+            std::copy(reinterpret_cast<const char*>(&value), reinterpret_cast<const char*>(&value) + 8, content.begin() + i);
+        }
+    }
+
+    TreeInfo generate(const fs::path& root) {
+        TreeInfo info;
+        fs::create_directories(root);
+        fill(root, 0, info);
+        return info;
+    }
+
+private:
+    static constexpr size_t MaxFileSize = 16 << 20;
+
+    TreeSpec spec;
+    std::mt19937_64 random;
+    std::vector<char> content;
+    uintmax_t counter = 0;
+
+    void fill(const fs::path& dir, unsigned level, TreeInfo& info) {
+        info.directories.push_back(dir);
+        for (unsigned i = 0; i < spec.filesPerDir; i++) {
+            const size_t size = nextSize();
+            std::ofstream file(dir / (name("f") + ".dat"), std::ios::binary | std::ios::trunc);
+            file.write(content.data(), static_cast<std::streamsize>(size));
+            if (!file) {
+                throw std::runtime_error("не удалось записать файл в " + dir.string());
+            }
+            info.files++;
+            info.bytes += size;
+        }
+        if (level >= spec.depth) {
+            return;
+        }
+        for (unsigned i = 0; i < spec.fanout; i++) {
+            fs::path child = dir / name("d");
+            fs::create_directory(child);
+            fill(child, level + 1, info);
+        }
+    }
+
+    std::string name(const char* prefix) {
+        std::string result = prefix + std::to_string(counter++);
+        switch (spec.names) {
+        case TreeSpec::Names::Short:
+            break;
+        case TreeSpec::Names::Long:
+            // До предела NAME_MAX (255 байт) с запасом на расширение
+            result += '_';
+            result.append(200 - std::min<size_t>(result.size(), 200), 'n');
+            break;
+        case TreeSpec::Names::Unicode:
+            // Кириллица, CJK и символ вне BMP (4 байта UTF-8)
+            result += "_файл_文件_\xF0\x9F\x93\x84";
+            break;
+        }
+        return result;
+    }
+
+    // small: до 4 КБ; mixed: 80% до 4 КБ, 18% до 256 КБ, 2% до 8 МБ; large: 1-16 МБ
+    size_t nextSize() {
+        auto uniform = [this](size_t low, size_t high) {
+            return std::uniform_int_distribution<size_t>(low, high)(random);
+        };
+        switch (spec.sizes) {
+        case TreeSpec::Sizes::Small:
+            return uniform(0, 4096);
+        case TreeSpec::Sizes::Large:
+            return uniform(1 << 20, MaxFileSize);
+        case TreeSpec::Sizes::Mixed:
+        default:
+            break;
+        }
+        const size_t bucket = uniform(0, 99);
+        if (bucket < 80) return uniform(0, 4096);
+        if (bucket < 98) return uniform(4096, 256 << 10);
+        return uniform(256 << 10, 8 << 20);
+    }
+};
@@ -0,0 +1,138 @@
+// Пропускная способность FileWriter при разных политиках надёжности: много мелких файлов,
+// один большой файл и дописывание записей в журнал.
+// Использование: write_bench [рабочая_папка] [файлов] [размер_файла_КБ] [большой_файл_МБ]
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "file_writer.hpp"
+
+namespace fs = std::filesystem;
+
+static double seconds(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Строки разделены табуляцией, как в copy_bench
+static void printRow(const std::string& name, const std::string& detail, uintmax_t bytes, uintmax_t files, double elapsed) {
+    std::cout << name << '\t' << detail << '\t'
+        << std::fixed << std::setprecision(1) << bytes / elapsed / (1 << 20) << " МБ/с\t"
+        << std::setprecision(0) << files / elapsed << " файл/с\n";
+}
+
+static std::string payload(size_t size) {
+    std::string data(size, '\0');
+    uint64_t state = 88172645463325252ull;
+    for (auto& byte : data) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        byte = static_cast<char>(state);
+    }
+    return data;
+}
+
+struct Variant {
+    const char* name;
+    Durability durability;
+    bool direct;
+};
+
+int main(int argc, char** argv) {
+    fs::path workDir = argc > 1 ? fs::path(argv[1]) : fs::temp_directory_path() / "write_bench";
+    size_t fileCount = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 200;
+    size_t fileKb = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 256;
+    size_t bigMb = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 256;
+
+    fs::remove_all(workDir);
+    fs::create_directories(workDir);
+    const std::string small = payload(fileKb << 10);
+    const std::string chunk = payload(4 << 20);
+
+    std::cout << fileCount << " файлов по " << fileKb << " КБ, файл " << bigMb << " МБ в " << workDir.string() << "\n\n";
+
+    const Variant variants[] = {
+        { "без синхронизации", Durability::None, false },
+        { "fdatasync на файл", Durability::Sync, false },
+        { "групповая фиксация", Durability::Group, false },
+        { "fdatasync + O_DIRECT", Durability::Sync, true },
+        { "групповая + O_DIRECT", Durability::Group, true },
+    };
+
+    // Мелкие файлы: ofstream как было в File::write, затем FileWriter с атомарной заменой
+    {
+        fs::path dir = workDir / "ofstream";
+        fs::create_directories(dir);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < fileCount; i++) {
+            std::ofstream(dir / ("f" + std::to_string(i))) << small;
+        }
+        printRow("ofstream", "без замены", small.size() * fileCount, fileCount, seconds(start));
+    }
+    for (const auto& variant : variants) {
+        fs::path dir = workDir / (std::string("files_") + durabilityName(variant.durability) + (variant.direct ? "_direct" : ""));
+        fs::create_directories(dir);
+        WriteOptions options;
+        options.durability = variant.durability;
+        options.direct = variant.direct;
+        options.expectedSize = small.size();
+        WriteBatch batch;
+        bool direct = false;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < fileCount; i++) {
+            FileWriter writer(dir / ("f" + std::to_string(i)), options);
+            writer.write(small);
+            direct = direct || writer.directIo();
+            writer.commit(&batch);
+        }
+        batch.commit();
+        printRow(variant.name, direct ? "O_DIRECT" : "page cache", small.size() * fileCount, fileCount, seconds(start));
+    }
+    std::cout << '\n';
+
+    // Один большой файл кусками по 4 МБ
+    for (const auto& variant : variants) {
+        if (variant.durability == Durability::Group) {
+            continue;
+        }
+        WriteOptions options;
+        options.durability = variant.durability;
+        options.direct = variant.direct;
+        options.expectedSize = static_cast<uintmax_t>(bigMb) << 20;
+        auto start = std::chrono::steady_clock::now();
+        FileWriter writer(workDir / "big.bin", options);
+        const bool direct = writer.directIo();
+        for (size_t written = 0; written < options.expectedSize; written += chunk.size()) {
+            writer.write(chunk);
+        }
+        writer.commit();
+        printRow(std::string("большой файл, ") + variant.name, direct ? "O_DIRECT" : "page cache",
+            options.expectedSize, 1, seconds(start));
+    }
+    std::cout << '\n';
+
+    // Журнал: записи по 4 КБ, каждая - отдельное открытие в режиме дописывания
+    const std::string record = small.substr(0, std::min<size_t>(small.size(), 4096));
+    for (Durability durability : { Durability::None, Durability::Sync }) {
+        fs::path log = workDir / (std::string("journal_") + durabilityName(durability));
+        WriteOptions options;
+        options.durability = durability;
+        options.append = true;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < fileCount; i++) {
+            FileWriter writer(log, options);
+            writer.write(record);
+            writer.commit();
+        }
+        printRow(std::string("дописывание, ") + durabilityName(durability), "записей", record.size() * fileCount,
+            fileCount, seconds(start));
+    }
+
+    fs::remove_all(workDir);
+    return 0;
+}
@@ -1,636 +1,498 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <string>
-#include <filesystem>
 #include <vector>
-#include <fstream>
-#include <algorithm>
-#include <ctime>
-#include <iomanip>
-#include <sstream>
-#include <chrono>
-
-namespace fs = std::filesystem;
-
-// Функция для преобразования file_time_type в строку (кроссплатформенная версия)
-std::string timeToString(fs::file_time_type ftime) {
-    try {
-        // Преобразуем file_time в system_clock time_point
-        auto sctp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
-            ftime - fs::file_time_type::clock::now() + std::chrono::system_clock::now());
 
-        std::time_t tt = std::chrono::system_clock::to_time_t(sctp);
+#include "batch_runner.hpp"
+#include "command_line.hpp"
+#include "file_manager.hpp"
 
-        std::tm tm = {};
+namespace fs = std::filesystem;
 
-#ifdef _WIN32
-        // Windows: используем localtime_s
-        if (localtime_s(&tm, &tt) != 0) {
-            return "Ошибка преобразования времени";
-        }
-#else
-        // Linux/Unix: используем localtime_r
-        if (localtime_r(&tt, &tm) == nullptr) {
-            return "Ошибка преобразования времени";
-        }
-#endif
+// Функция для отображения помощи
+void showHelp() {
+    std::cout << "Команды файлового менеджера:\n"
+        << "  cd <path>      - сменить директорию\n"
+        << "  ls             - список файлов\n"
+        << "  ls -l          - подробный список\n"
+        << "  ls [-l] --first N | --page N | --next - постранично, без загрузки всей папки\n"
+        << "  mkdir <name>   - создать папку\n"
+        << "  touch <name>   - создать файл\n"
+        << "  rm <name>      - удалить\n"
+        << "  rm -b <name>   - удалить папку в фоне (через корзину)\n"
+        << "  mv <old> <new> - переименовать/переместить\n"
+        << "  cp <src> <dst> - скопировать\n"
+        << "  rm|mv|cp|rename [-E] [-i] <шаблон> ... - сразу по всем совпавшим в папке: rm *.tmp,\n"
+        << "                 mv 'log-*.gz' archive/, rename 'IMG_*.jpeg' 'photo-$1.jpg' ($1..$9 - части шаблона),\n"
+        << "                 -E регулярное выражение, -i без учёта регистра; при конфликте имён ничего не делается\n"
+        << "  sync [-n] [-c] [-d] <src> <dst> - синхронизировать папки (-n план без изменений,\n"
+        << "                 -c сравнивать содержимое, -d удалять лишнее в приёмнике)\n"
+        << "  pack [-N] <path> <archive> - упаковать в .tar или .tar.zst (-N уровень сжатия 1-19)\n"
+        << "  unpack <archive> [dir] - распаковать .tar или .tar.zst\n"
+        << "  info <name>    - информация об объекте\n"
+        << "  search [-i] [-g|-r] [-j|-0] <pattern> - поиск файлов (-i без учёта регистра, -g glob, -r regex,\n"
+        << "                 -j строки JSON, -0 пути через '\\0')\n"
+        << "  find [-j|-0] [path] <выражение> - поиск по условиям: find size>1G mtime<-30d path~**/cache/**\n"
+        << "                 поля name, iname, path, type (f/d/l), depth, size (K/M/G), mtime (-30d или 2024-01-31),\n"
+        << "                 операторы = != < <= > >= ~ (glob) !~, связки and/or/not и скобки\n"
+        << "  grep [-l] [-i] [-E] <pattern> - поиск по содержимому файлов\n"
+        << "  index build [path] - построить индекс имён для быстрого поиска\n"
+        << "  index update   - обновить индекс (перечитать изменённые папки)\n"
+        << "  index stats    - статистика индекса\n"
+        << "  watch [-r] [-w мс] [-t с] [dir] - события в папке (-r с вложенными, -w окно объединения,\n"
+        << "                 -t остановить через t секунд, иначе Enter)\n"
+        << "  du [-r] [path] - занятое место и крупнейшие элементы (-r - пересканировать)\n"
+        << "  dupes [-n] [path] - найти одинаковые файлы (-n - без кэша хэшей)\n"
+        << "  cache stats    - статистика кэша метаданных (cache clear - очистить)\n"
+        << "  cp/rm/search/find/sync/pack/unpack ... & - выполнить в фоне как задачу\n"
+        << "  jobs           - фоновые задачи и их прогресс\n"
+        << "  fg [n]         - дождаться задачи n (по умолчанию последней)\n"
+        << "  kill <n>       - остановить задачу n\n"
+        << "  limit <n> <байт/с> [элем/с] - ограничить скорость задачи (limit 1 20M, 0 - снять)\n"
+        << "  stats          - время по фазам и счётчики последней команды\n"
+        << "  stats trace on|off, stats trace save <file> - трассировка для Perfetto\n"
+        << "  cat <name>     - вывести файл\n"
+        << "  head <name> [n] - первые n строк (по умолчанию 10)\n"
+        << "  tail <name> [n] - последние n строк (по умолчанию 10)\n"
+        << "  pwd           - текущая директория\n"
+        << "  up            - на уровень выше\n"
+        << "  help          - помощь\n"
+        << "  exit          - выход\n"
+        << "Пути с пробелами берутся в кавычки: cp \"мой файл.txt\" 'копия файла.txt'\n"
+        << "Пакетный режим: filemanager --batch [файл|-] [--jobs N] [--stop-on-error], результаты - строки JSON\n"
+        << "Наблюдение для сценариев: filemanager --watch <dir> [-r] [--window мс] [--for с], события - строки JSON\n";
+}
 
-        std::ostringstream oss;
-        oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
-        return oss.str();
-    }
-    catch (const std::exception& e) {
-        return std::string("Ошибка времени: ") + e.what();
+// Флаги из одной буквы перед шаблоном (grep -i -l шаблон); возвращает индекс первого аргумента шаблона
+size_t takeFlags(const std::vector<std::string>& args, const std::string& known, std::string& flags) {
+    size_t i = 1;
+    while (i + 1 < args.size() && args[i].size() == 2 && args[i][0] == '-' && known.find(args[i][1]) != std::string::npos) {
+        flags += args[i][1];
+        i++;
     }
+    return i;
 }
 
-// Базовый класс для работы с файлами и папками
-class FileSystemObject {
-protected:
-    fs::path path;
-
-public:
-    FileSystemObject(const std::string& p) : path(p) {}
-
-    virtual ~FileSystemObject() = default;
-
-    bool exists() const {
-        return fs::exists(path);
+// -j - строки JSON, -0 - пути через '\0'
+OutputFormat outputFormat(const std::string& flags) {
+    if (flags.find('j') != std::string::npos) {
+        return OutputFormat::Json;
     }
-
-    std::string getPath() const {
-        return path.string();
+    if (flags.find('0') != std::string::npos) {
+        return OutputFormat::Nul;
     }
+    return OutputFormat::Plain;
+}
 
-    virtual void showInfo() const = 0;
-};
-
-// Класс для работы с файлами
-class File : public FileSystemObject {
-public:
-    File(const std::string& p) : FileSystemObject(p) {}
+// Шаблон групповых rm, mv, cp и rename: glob, -E - регулярное выражение, -i - без учёта регистра
+MatchOptions bulkMatch(const std::string& flags) {
+    MatchOptions match;
+    match.mode = flags.find('E') != std::string::npos ? MatchMode::Regex : MatchMode::Glob;
+    match.ignoreCase = flags.find('i') != std::string::npos;
+    return match;
+}
 
-    void showInfo() const override {
-        setlocale(LC_ALL, "ru");
-        if (exists()) {
-            try {
-                std::cout << "Файл: " << path.filename().string() << "\n"
-                    << "Размер: " << fs::file_size(path) << " байт\n"
-                    << "Последнее изменение: " << timeToString(fs::last_write_time(path)) << "\n";
-            }
-            catch (const std::exception& e) {
-                std::cout << "Ошибка при получении информации о файле: " << e.what() << "\n";
+// filemanager --batch [файл|-] [--jobs N] [--stop-on-error]
+int runBatch(int argc, char** argv) {
+    std::string script = "-";
+    BatchOptions options;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--batch") {
+            if (i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0) {
+                script = argv[++i];
             }
         }
+        else if (arg == "--jobs" && i + 1 < argc) {
+            options.jobs = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--stop-on-error") {
+            options.stopOnError = true;
+        }
         else {
-            std::cout << "Файл не существует: " << path.filename().string() << "\n";
+            std::cerr << "Неизвестный параметр: " << arg << '\n';
+            return 2;
         }
     }
 
-    void create() {
-        setlocale(LC_ALL, "ru");
-        try {
-            std::ofstream file(path);
-            if (file.is_open()) {
-                file.close();
-                std::cout << "Файл создан: " << path.filename().string() << "\n";
-            }
-        }
-        catch (const std::exception& e) {
-            setlocale(LC_ALL, "ru");
-            std::cout << "Ошибка при создании файла: " << e.what() << "\n";
+    std::ifstream file;
+    if (script != "-") {
+        file.open(script);
+        if (!file.is_open()) {
+            std::cerr << "Не удалось открыть сценарий: " << script << '\n';
+            return 2;
         }
     }
+    std::istream& input = script == "-" ? std::cin : file;
+
+    auto emit = [](const std::string& line) {
+        std::cout << line << '\n';
+    };
+    BatchRunner runner(fs::current_path(), options);
+    if (!runner.parse(input, emit)) {
+        return 2;
+    }
+    BatchSummary summary = runner.run(emit);
+    std::cout.flush();
+    return summary.failed + summary.skipped == 0 ? 0 : 1;
+}
 
-    void deleteFile() {
-        setlocale(LC_ALL, "ru");
-        if (exists()) {
-            try {
-                fs::remove(path);
-                std::cout << "Файл удален: " << path.filename().string() << "\n";
-            }
-            catch (const std::exception& e) {
-                std::cout << "Ошибка при удалении файла: " << e.what() << "\n";
-            }
+// filemanager --watch <dir> [-r] [--window мс] [--for с]: события строками JSON до --for или сигнала
+int runWatch(int argc, char** argv) {
+    fs::path root;
+    WatchOptions options;
+    double seconds = 0;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--watch" && i + 1 < argc) {
+            root = argv[++i];
+        }
+        else if (arg == "-r") {
+            options.recursive = true;
+        }
+        else if (arg == "--window" && i + 1 < argc) {
+            options.window = std::chrono::milliseconds(std::strtoll(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--for" && i + 1 < argc) {
+            seconds = std::strtod(argv[++i], nullptr);
         }
         else {
-            setlocale(LC_ALL, "ru");
-            std::cout << "Файл не существует: " << path.filename().string() << "\n";
+            std::cerr << "Неизвестный параметр: " << arg << '\n';
+            return 2;
         }
     }
+    if (root.empty()) {
+        std::cerr << "Укажите папку: --watch <dir>\n";
+        return 2;
+    }
 
-    void write(const std::string& content) {
-        setlocale(LC_ALL, "ru");
-        try {
-            std::ofstream file(path);
-            if (file.is_open()) {
-                file << content;
-                file.close();
-                std::cout << "Содержимое записано в файл: " << path.filename().string() << "\n";
-            }
-        }
-        catch (const std::exception& e) {
-            std::cout << "Ошибка при записи в файл: " << e.what() << "\n";
+    try {
+        DirectoryWatcher watcher(root, options);
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(static_cast<long long>(seconds * 1000));
+        watcher.start();
+        watcher.consume([](const std::vector<WatchEvent>& events) {
+            std::string out;
+            for (const auto& event : events) {
+                out += watchEventJson(event);
+                out += '\n';
+            }
+            std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+            std::cout.flush();
+            }, [&]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                return seconds > 0 && std::chrono::steady_clock::now() >= deadline;
+            });
+        if (!watcher.failure().empty()) {
+            std::cerr << "Ошибка наблюдения: " << watcher.failure() << '\n';
+            return 1;
         }
     }
+    catch (const std::exception& e) {
+        std::cerr << "Ошибка наблюдения: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
 
-    std::string read() const {
-        setlocale(LC_ALL, "ru");
-        if (exists()) {
-            try {
-                std::ifstream file(path);
-                std::string content((std::istreambuf_iterator<char>(file)),
-                    std::istreambuf_iterator<char>());
-                return content;
-            }
-            catch (const std::exception& e) {
-                std::cout << "Ошибка при чтении файла: " << e.what() << "\n";
-                return "";
-            }
+int main(int argc, char** argv) {
+    Console::init();
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--batch") {
+            return runBatch(argc, argv);
+        }
+        if (std::string(argv[i]) == "--watch") {
+            return runWatch(argc, argv);
         }
-        return "";
     }
-};
 
-// Класс для работы с папками
-class Directory : public FileSystemObject {
-public:
-    Directory(const std::string& p) : FileSystemObject(p) {}
+    FileManager fm;
+    std::string command;
 
-    void showInfo() const override {
-        setlocale(LC_ALL, "ru");
-        if (exists()) {
-            try {
-                int fileCount = 0;
-                int dirCount = 0;
+    std::cout << "Добро пожаловать в файловый менеджер!\n";
+    fm.showCurrentDirectory();
+    showHelp();
 
-                for (const auto& entry : fs::directory_iterator(path)) {
-                    if (entry.is_directory()) {
-                        dirCount++;
-                    }
-                    else {
-                        fileCount++;
-                    }
-                }
+    while (true) {
+        std::cout << "\n> ";
+        if (!std::getline(std::cin, command)) {
+            // Конец ввода (Ctrl+D или конец конвейера) - то же, что exit
+            std::cout << '\n';
+            fm.waitBackground();
+            break;
+        }
+        fm.showBackgroundReports();
 
-                std::cout << "Папка: " << path.filename().string() << '\n'
-                    << "Файлов: " << fileCount << '\n'
-                    << "Папок: " << dirCount << '\n'
-                    << "Последнее изменение: " << timeToString(fs::last_write_time(path)) << "\n";
-            }
-            catch (const std::exception& e) {
-                std::cout << "Ошибка при получении информации о папке: " << e.what() << "\n";
-            }
+        std::vector<std::string> args;
+        try {
+            args = splitCommandLine(command);
         }
-        else {
-            std::cout << "Папка не существует: " << path.filename().string() << "\n";
+        catch (const std::exception& e) {
+            std::cout << "Ошибка в команде: " << e.what() << '\n';
+            continue;
         }
-    }
+        if (args.empty()) continue;
 
-    void create() {
-        setlocale(LC_ALL, "ru");
-        if (!exists()) {
-            try {
-                fs::create_directories(path);
-                std::cout << "Папка создана: " << path.filename().string() << "\n";
-            }
-            catch (const std::exception& e) {
-                std::cout << "Ошибка при создании папки: " << e.what() << "\n";
-            }
+        // "&" последним словом - выполнить команду фоновой задачей
+        bool asJob = false;
+        if (args.size() > 1 && args.back() == "&") {
+            args.pop_back();
+            asJob = true;
         }
-        else {
-            std::cout << "Папка уже существует: " << path.filename().string() << "\n";
+        const std::string& cmd = args[0];
+        if (asJob && cmd != "cp" && cmd != "rm" && cmd != "search" && cmd != "find" && cmd != "sync" && cmd != "pack" && cmd != "unpack") {
+            std::cout << "В фоне (&) выполняются только cp, rm, search, find, sync, pack и unpack\n";
+            continue;
+        }
+        // Команды с одним путём принимают и несколько слов без кавычек, как раньше
+        const std::string rest = joinArguments(args, 1);
+        // stats показывает итог предыдущей команды, поэтому сама не замеряется
+        const bool measured = cmd != "stats" && cmd != "exit";
+        if (measured) {
+            Instrumentation::beginOperation(command);
         }
-    }
 
-    void deleteDir() {
-        setlocale(LC_ALL, "ru");
-        if (exists()) {
-            try {
-                fs::remove_all(path);
-                std::cout << "Папка удалена: " << path.filename().string() << "\n";
-            }
-            catch (const std::exception& e) {
-                std::cout << "Ошибка при удалении папки: " << e.what() << "\n";
-            }
+        if (cmd == "exit") {
+            fm.waitBackground();
+            break;
         }
-        else {
-            std::cout << "Папка не существует: " << path.filename().string() << "\n";
+        else if (cmd == "help") {
+            showHelp();
         }
-    }
-
-    void listContents(bool detailed = false) const {
-        setlocale(LC_ALL, "ru");
-        if (exists()) {
-            try {
-                std::vector<fs::directory_entry> entries;
-                for (const auto& entry : fs::directory_iterator(path)) {
-                    entries.push_back(entry);
-                }
-
-                // Сортировка: сначала папки, потом файлы
-                std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
-                    if (a.is_directory() && !b.is_directory()) return true;
-                    if (!a.is_directory() && b.is_directory()) return false;
-                    return a.path().filename().string() < b.path().filename().string();
-                    });
-
-                for (const auto& entry : entries) {
-                    if (detailed) {
-                        try {
-                            if (entry.is_directory()) {
-                                std::cout << "[DIR]  ";
-                            }
-                            else {
-                                std::cout << "[FILE] ";
-                                std::cout << std::setw(10) << entry.file_size() << " bytes ";
-                            }
-                            std::cout << std::setw(20) << std::left << entry.path().filename().string()
-                                << " " << timeToString(entry.last_write_time()) << '\n';
-                        }
-                        catch (const std::exception& e) {
-                            std::cout << "[ERROR] " << entry.path().filename().string() << " - ошибка доступа\n";
-                        }
-                    }
-                    else {
-                        std::cout << entry.path().filename().string() << '\n';
-                    }
-                }
-            }
-            catch (const std::exception& e) {
-                std::cout << "Ошибка при чтении содержимого папки: " << e.what() << "\n";
-            }
+        else if (cmd == "pwd") {
+            fm.showCurrentDirectory();
         }
-        else {
-            std::cout << "Папка не существует: " << path.filename().string() << "\n";
+        else if (cmd == "up") {
+            fm.goToParent();
         }
-    }
-
-    size_t getFileCount() const {
-        size_t count = 0;
-        if (exists()) {
-            try {
-                for (const auto& entry : fs::directory_iterator(path)) {
-                    if (!entry.is_directory()) {
-                        count++;
-                    }
-                }
+        else if (cmd == "ls") {
+            if (rest.find("--") != std::string::npos) {
+                fm.listPage(std::vector<std::string>(args.begin() + 1, args.end()));
             }
-            catch (const std::exception& e) {
-                std::cout << "Ошибка при подсчете файлов: " << e.what() << "\n";
+            else {
+                fm.listContents(rest == "-l");
             }
         }
-        return count;
-    }
-};
-
-// Класс файлового менеджера
-class FileManager {
-private:
-    fs::path currentPath;
-
-public:
-    FileManager() : currentPath(fs::current_path()) {}
-
-    void showCurrentDirectory() const {
-        setlocale(LC_ALL, "ru");
-        std::cout << "Текущая директория: " << currentPath.string() << '\n';
-    }
-
-    void changeDirectory(const std::string& path) {
-        setlocale(LC_ALL, "ru");
-        try {
-            fs::path newPath;
-            if (fs::path(path).is_absolute()) {
-                newPath = path;
+        else if (cmd == "cd") {
+            if (!rest.empty()) {
+                fm.changeDirectory(rest);
             }
             else {
-                newPath = currentPath / path;
+                std::cout << "Укажите путь для перехода\n";
             }
-
-            if (fs::exists(newPath) && fs::is_directory(newPath)) {
-                currentPath = fs::canonical(newPath);
-                std::cout << "Текущая директория: " << currentPath.string() << '\n';
+        }
+        else if (cmd == "mkdir") {
+            if (!rest.empty()) {
+                fm.createDirectory(rest);
             }
             else {
-                std::cout << "Директория не существует: " << newPath.string() << '\n';
+                std::cout << "Укажите имя папки\n";
             }
         }
-        catch (const std::exception& e) {
-            std::cout << "Ошибка при смене директории: " << e.what() << '\n';
-        }
-    }
-
-    void goToParent() {
-        setlocale(LC_ALL, "ru");
-        if (currentPath.has_parent_path()) {
-            try {
-                currentPath = currentPath.parent_path();
-                std::cout << "Текущая директория: " << currentPath.string() << '\n';
+        else if (cmd == "touch") {
+            if (!rest.empty()) {
+                fm.createFile(rest);
             }
-            catch (const std::exception& e) {
-                std::cout << "Ошибка при переходе в родительскую директорию: " << e.what() << '\n';
+            else {
+                std::cout << "Укажите имя файла\n";
             }
         }
-        else {
-            std::cout << "У текущей директории нет родительской\n";
-        }
-    }
-
-    void createFile(const std::string& name) {
-        File file((currentPath / name).string());
-        file.create();
-    }
-
-    void createDirectory(const std::string& name) {
-        Directory dir((currentPath / name).string());
-        dir.create();
-    }
-
-    void deleteItem(const std::string& name) {
-        fs::path itemPath = currentPath / name;
-
-        if (!fs::exists(itemPath)) {
-            setlocale(LC_ALL, "ru");
-            std::cout << "Объект не существует: " << name << '\n';
-            return;
-        }
-
-        if (fs::is_directory(itemPath)) {
-            Directory dir(itemPath.string());
-            dir.deleteDir();
-        }
-        else {
-            File file(itemPath.string());
-            file.deleteFile();
-        }
-    }
-
-    void renameItem(const std::string& oldName, const std::string& newName) {
-        try {
-            fs::path oldPath = currentPath / oldName;
-            fs::path newPath = currentPath / newName;
-
-            if (!fs::exists(oldPath)) {
-                setlocale(LC_ALL, "ru");
-                std::cout << "Объект не существует: " << oldName << '\n';
-                return;
+        else if (cmd == "rm") {
+            std::string flags;
+            const std::string name = joinArguments(args, takeFlags(args, "bEi", flags));
+            const MatchOptions match = bulkMatch(flags);
+            if (!name.empty() && fm.isBulkPattern(name, match)) {
+                fm.bulkItems(BulkAction::Remove, name, std::string(), match, asJob);
             }
-
-            if (fs::exists(newPath)) {
-                std::cout << "Объект с таким именем уже существует: " << newName << '\n';
-                return;
+            else if (!name.empty()) {
+                fm.deleteItem(name, flags.find('b') != std::string::npos, asJob);
             }
-
-            fs::rename(oldPath, newPath);
-            std::cout << "Переименовано: " << oldName << " -> " << newName << '\n';
-        }
-        catch (const std::exception& e) {
-            std::cout << "Ошибка при переименовании: " << e.what() << '\n';
-        }
-    }
-
-    void copyItem(const std::string& source, const std::string& destination) {
-        setlocale(LC_ALL, "ru");
-        try {
-            fs::path sourcePath = currentPath / source;
-            fs::path destPath = currentPath / destination;
-
-            if (!fs::exists(sourcePath)) {
-                std::cout << "Источник не существует: " << source << '\n';
-                return;
+            else {
+                std::cout << "Укажите имя объекта для удаления\n";
             }
-
-            if (fs::is_directory(sourcePath)) {
-                fs::copy(sourcePath, destPath, fs::copy_options::recursive);
+        }
+        else if (cmd == "info") {
+            if (!rest.empty()) {
+                fm.showItemInfo(rest);
             }
             else {
-                fs::copy(sourcePath, destPath);
+                std::cout << "Укажите имя объекта\n";
             }
-            std::cout << "Скопировано: " << source << " -> " << destination << '\n';
-        }
-        catch (const std::exception& e) {
-            std::cout << "Ошибка копирования: " << e.what() << '\n';
         }
-    }
-
-    void moveItem(const std::string& source, const std::string& destination) {
-        setlocale(LC_ALL, "ru");
-        try {
-            fs::path sourcePath = currentPath / source;
-            fs::path destPath = currentPath / destination;
-
-            if (!fs::exists(sourcePath)) {
-                std::cout << "Источник не существует: " << source << '\n';
-                return;
+        else if (cmd == "grep") {
+            // Флаги перед шаблоном: -l только имена файлов, -i без учёта регистра, -E регулярное выражение
+            std::string flags;
+            const std::string pattern = joinArguments(args, takeFlags(args, "liE", flags));
+            GrepOptions options;
+            options.filesOnly = flags.find('l') != std::string::npos;
+            options.match.ignoreCase = flags.find('i') != std::string::npos;
+            if (flags.find('E') != std::string::npos) {
+                options.match.mode = MatchMode::Regex;
             }
-
-            fs::rename(sourcePath, destPath);
-            std::cout << "Перемещено: " << source << " -> " << destination << '\n';
-        }
-        catch (const std::exception& e) {
-            std::cout << "Ошибка перемещения: " << e.what() << '\n';
-        }
-    }
-
-    void showItemInfo(const std::string& name) {
-        setlocale(LC_ALL, "ru");
-        fs::path itemPath = currentPath / name;
-
-        if (!fs::exists(itemPath)) {
-            std::cout << "Объект не существует: " << name << '\n';
-            return;
-        }
-
-        if (fs::is_directory(itemPath)) {
-            Directory dir(itemPath.string());
-            dir.showInfo();
-        }
-        else {
-            File file(itemPath.string());
-            file.showInfo();
-        }
-    }
-
-    void listContents(bool detailed = false) {
-        setlocale(LC_ALL, "ru");
-        Directory dir(currentPath.string());
-        if (detailed) {
-            std::cout << "Содержимое директории " << currentPath.string() << ":\n";
-        }
-        dir.listContents(detailed);
-    }
-
-    void searchFiles(const std::string& pattern) {
-        setlocale(LC_ALL, "ru");
-        std::cout << "Поиск файлов с шаблоном: " << pattern << "\n";
-
-        try {
-            for (const auto& entry : fs::recursive_directory_iterator(currentPath)) {
-                if (!entry.is_directory()) {
-                    std::string filename = entry.path().filename().string();
-                    if (filename.find(pattern) != std::string::npos) {
-                        std::cout << entry.path().string() << "\n";
-                    }
-                }
+            if (!pattern.empty()) {
+                fm.grepFiles(pattern, options);
+            }
+            else {
+                std::cout << "Укажите шаблон для поиска\n";
             }
         }
-        catch (const std::exception& e) {
-            std::cout << "Ошибка при поиске: " << e.what() << "\n";
+        else if (cmd == "du") {
+            fm.diskUsage(rest);
         }
-    }
-
-    std::string getCurrentPath() const {
-        return currentPath.string();
-    }
-
-    bool itemExists(const std::string& name) const {
-        return fs::exists(currentPath / name);
-    }
-
-    uintmax_t getItemSize(const std::string& name) const {
-        try {
-            return fs::file_size(currentPath / name);
+        else if (cmd == "dupes") {
+            fm.findDuplicates(rest);
         }
-        catch (...) {
-            return 0;
+        else if (cmd == "jobs") {
+            fm.showJobs();
         }
-    }
-};
-
-// Функция для отображения помощи
-void showHelp() {
-    setlocale(LC_ALL, "ru");
-    std::cout << "Команды файлового менеджера:\n"
-        << "  cd <path>      - сменить директорию\n"
-        << "  ls             - список файлов\n"
-        << "  ls -l          - подробный список\n"
-        << "  mkdir <name>   - создать папку\n"
-        << "  touch <name>   - создать файл\n"
-        << "  rm <name>      - удалить\n"
-        << "  mv <old> <new> - переименовать/переместить\n"
-        << "  cp <src> <dst> - скопировать\n"
-        << "  info <name>    - информация об объекте\n"
-        << "  search <pattern> - поиск файлов\n"
-        << "  pwd           - текущая директория\n"
-        << "  up            - на уровень выше\n"
-        << "  help          - помощь\n"
-        << "  exit          - выход\n";
-}
-
-int main() {
-    setlocale(LC_ALL, "ru");
-    FileManager fm;
-    std::string command;
-
-    std::cout << "Добро пожаловать в файловый менеджер!\n";
-    fm.showCurrentDirectory();
-    showHelp();
-
-    while (true) {
-        std::cout << "\n> ";
-        std::getline(std::cin, command);
-
-        if (command.empty()) continue;
-
-        if (command == "exit") {
-            break;
+        else if (cmd == "fg") {
+            fm.foregroundJob(rest);
         }
-        else if (command == "help") {
-            showHelp();
+        else if (cmd == "kill") {
+            fm.killJob(rest);
         }
-        else if (command == "pwd") {
-            fm.showCurrentDirectory();
+        else if (cmd == "limit") {
+            fm.limitJob(rest);
         }
-        else if (command == "up") {
-            fm.goToParent();
+        else if (cmd == "stats") {
+            fm.statsCommand(rest);
         }
-        else if (command == "ls") {
-            fm.listContents();
+        else if (cmd == "cache") {
+            fm.cacheCommand(rest);
         }
-        else if (command == "ls -l") {
-            fm.listContents(true);
+        else if (cmd == "index") {
+            fm.indexCommand(rest);
         }
-        else if (command.find("cd ") == 0) {
-            if (command.length() > 3) {
-                fm.changeDirectory(command.substr(3));
+        else if (cmd == "cat") {
+            if (!rest.empty()) {
+                fm.printFile(rest, 'c');
             }
             else {
-                std::cout << "Укажите путь для перехода\n";
+                std::cout << "Укажите имя файла\n";
             }
         }
-        else if (command.find("mkdir ") == 0) {
-            if (command.length() > 6) {
-                fm.createDirectory(command.substr(6));
+        else if (cmd == "head" || cmd == "tail") {
+            // "имя [n]": последний аргумент из цифр считается числом строк
+            size_t lines = 10;
+            size_t last = args.size();
+            if (args.size() > 2 && std::all_of(args.back().begin(), args.back().end(), [](unsigned char c) { return std::isdigit(c); })) {
+                lines = static_cast<size_t>(std::strtoull(args.back().c_str(), nullptr, 10));
+                last--;
+            }
+            std::vector<std::string> nameParts(args.begin(), args.begin() + last);
+            const std::string name = joinArguments(nameParts, 1);
+            if (!name.empty()) {
+                fm.printFile(name, cmd[0], lines);
             }
             else {
-                std::cout << "Укажите имя папки\n";
+                std::cout << "Укажите имя файла\n";
             }
         }
-        else if (command.find("touch ") == 0) {
-            if (command.length() > 6) {
-                fm.createFile(command.substr(6));
+        else if (cmd == "search") {
+            // Флаги перед шаблоном: -i без учёта регистра, -g glob, -r регулярное выражение
+            std::string flags;
+            const std::string pattern = joinArguments(args, takeFlags(args, "igrj0", flags));
+            MatchOptions options;
+            options.ignoreCase = flags.find('i') != std::string::npos;
+            if (flags.find('g') != std::string::npos) {
+                options.mode = MatchMode::Glob;
+            }
+            if (flags.find('r') != std::string::npos) {
+                options.mode = MatchMode::Regex;
+            }
+            if (!pattern.empty()) {
+                fm.searchFiles(pattern, options, asJob, outputFormat(flags));
             }
             else {
-                std::cout << "Укажите имя файла\n";
+                std::cout << "Укажите шаблон для поиска\n";
             }
         }
-        else if (command.find("rm ") == 0) {
-            if (command.length() > 3) {
-                fm.deleteItem(command.substr(3));
+        else if (cmd == "watch") {
+            fm.watchDirectory(std::vector<std::string>(args.begin() + 1, args.end()));
+        }
+        else if (cmd == "find") {
+            std::string flags;
+            const size_t first = takeFlags(args, "j0", flags);
+            if (args.size() > first) {
+                fm.findFiles(std::vector<std::string>(args.begin() + static_cast<std::ptrdiff_t>(first), args.end()), asJob,
+                    outputFormat(flags));
             }
             else {
-                std::cout << "Укажите имя объекта для удаления\n";
+                std::cout << "Укажите выражение: find size>1G and name~*.tmp\n";
             }
         }
-        else if (command.find("info ") == 0) {
-            if (command.length() > 5) {
-                fm.showItemInfo(command.substr(5));
+        else if (cmd == "sync") {
+            // -n пробный прогон, -c сравнение по содержимому, -d удалять лишнее в приёмнике
+            std::string flags;
+            const size_t first = takeFlags(args, "ncd", flags);
+            SyncOptions options;
+            options.dryRun = flags.find('n') != std::string::npos;
+            options.checksum = flags.find('c') != std::string::npos;
+            options.deleteExtra = flags.find('d') != std::string::npos;
+            if (args.size() != first + 2) {
+                std::cout << "Использование: sync [-n] [-c] [-d] <источник> <приёмник>\n";
             }
             else {
-                std::cout << "Укажите имя объекта\n";
+                fm.syncItem(args[first], args[first + 1], options, asJob);
+            }
+        }
+        else if (cmd == "pack") {
+            // -N перед путями - уровень сжатия zstd
+            int level = 3;
+            size_t first = 1;
+            if (args.size() > 1 && args[1].size() > 1 && args[1][0] == '-'
+                && std::all_of(args[1].begin() + 1, args[1].end(), [](unsigned char c) { return std::isdigit(c); })) {
+                level = std::atoi(args[1].c_str() + 1);
+                first = 2;
+            }
+            if (args.size() != first + 2 || level < 1 || level > 19) {
+                std::cout << "Использование: pack [-1..-19] <путь> <архив.tar|архив.tar.zst>\n";
+            }
+            else {
+                fm.packItem(args[first], args[first + 1], level, asJob);
             }
         }
-        else if (command.find("search ") == 0) {
-            if (command.length() > 7) {
-                fm.searchFiles(command.substr(7));
+        else if (cmd == "unpack") {
+            if (args.size() < 2 || args.size() > 3) {
+                std::cout << "Использование: unpack <архив> [папка]\n";
             }
             else {
-                std::cout << "Укажите шаблон для поиска\n";
+                fm.unpackItem(args[1], args.size() == 3 ? args[2] : std::string(), asJob);
             }
         }
-        else {
-            // Обработка команд с несколькими аргументами
-            size_t space1 = command.find(' ');
-            if (space1 != std::string::npos) {
-                std::string cmd = command.substr(0, space1);
-                std::string args = command.substr(space1 + 1);
-
-                size_t space2 = args.find(' ');
-                if (space2 != std::string::npos) {
-                    std::string arg1 = args.substr(0, space2);
-                    std::string arg2 = args.substr(space2 + 1);
-
-                    if (cmd == "mv") {
-                        fm.moveItem(arg1, arg2);
-                    }
-                    else if (cmd == "cp") {
-                        fm.copyItem(arg1, arg2);
-                    }
-                    else if (cmd == "rename") {
-                        fm.renameItem(arg1, arg2);
-                    }
-                    else {
-                        std::cout << "Неизвестная команда: " << cmd << "\n";
-                    }
-                }
-                else {
-                    std::cout << "Недостаточно аргументов для команды " << cmd << "\n";
-                }
+        else if (cmd == "mv" || cmd == "cp" || cmd == "rename") {
+            std::string flags;
+            const size_t first = takeFlags(args, "Ei", flags);
+            const MatchOptions match = bulkMatch(flags);
+            if (args.size() < first + 2) {
+                std::cout << "Недостаточно аргументов для команды " << cmd << "\n";
+            }
+            else if (args.size() > first + 2) {
+                std::cout << "Слишком много аргументов для команды " << cmd << " (пути с пробелами возьмите в кавычки)\n";
+            }
+            else if (fm.isBulkPattern(args[first], match)) {
+                const BulkAction action = cmd == "mv" ? BulkAction::Move
+                    : cmd == "cp" ? BulkAction::Copy : BulkAction::Rename;
+                fm.bulkItems(action, args[first], args[first + 1], match, asJob);
+            }
+            else if (cmd == "mv") {
+                fm.moveItem(args[first], args[first + 1]);
+            }
+            else if (cmd == "cp") {
+                fm.copyItem(args[first], args[first + 1], asJob);
             }
             else {
-                std::cout << "Неизвестная команда: " << command << "\n";
+                fm.renameItem(args[first], args[first + 1]);
             }
         }
+        else {
+            std::cout << "Неизвестная команда: " << cmd << "\n";
+        }
+        if (measured) {
+            Instrumentation::endOperation();
+        }
     }
 
     std::cout << "До свидания!\n";
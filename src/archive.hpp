@@ -0,0 +1,1185 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "copy_engine.hpp"
+#include "file_view.hpp"
+#include "instrumentation.hpp"
+#include "job_control.hpp"
+#include "progress.hpp"
+#include "thread_pool.hpp"
+
+#ifdef FM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+enum class ArchiveFormat {
+    Tar,      // tar без сжатия
+    TarZstd   // tar, разрезанный на блоки; каждый блок - отдельный кадр zstd
+};
+
+// Формат по расширению: .zst и .tzst - со сжатием, остальное - обычный tar
+inline ArchiveFormat archiveFormatFor(const fs::path& path) {
+    const std::string extension = path.extension().string();
+    return extension == ".zst" || extension == ".tzst" ? ArchiveFormat::TarZstd : ArchiveFormat::Tar;
+}
+
+// zstd подключается при сборке, если найдена libzstd
+inline bool archiveFormatSupported(ArchiveFormat format) {
+#ifdef FM_HAVE_ZSTD
+    (void)format;
+    return true;
+#else
+    return format == ArchiveFormat::Tar;
+#endif
+}
+
+struct ArchiveStats {
+    uintmax_t files = 0;
+    uintmax_t directories = 0;
+    uintmax_t links = 0;          // символьные и жёсткие ссылки
+    uintmax_t skipped = 0;        // устройства, каналы, сокеты, небезопасные пути
+    uintmax_t dataBytes = 0;      // содержимое файлов
+    uintmax_t archiveBytes = 0;   // размер архива: записано при упаковке, прочитано при распаковке
+    uintmax_t errors = 0;
+    double seconds = 0;
+};
+
+struct ArchiveOptions {
+    unsigned jobs = 0;                  // потоков сжатия или записи файлов, 0 - по числу ядер
+    int level = 3;                      // уровень zstd
+    size_t blockSize = 4 << 20;         // блок потока tar, сжимаемый одной задачей
+    size_t readAhead = 16;              // на сколько файлов вперёд запрашивать упреждающее чтение
+    std::chrono::milliseconds progressInterval{ 500 };
+    std::function<void(const ArchiveStats&)> onProgress;
+    JobControl* control = nullptr;      // отмена и лимит скорости фоновой задачи
+};
+
+// Заголовки tar (POSIX ustar с расширенными заголовками pax для длинных путей и больших файлов)
+namespace tar {
+
+constexpr size_t BlockSize = 512;
+
+struct Entry {
+    std::string name;       // путь внутри архива, у папок без завершающего '/'
+    char type = '0';        // '0' файл, '5' папка, '2' символьная ссылка, '1' жёсткая ссылка
+    unsigned mode = 0644;
+    unsigned uid = 0;
+    unsigned gid = 0;
+    uintmax_t size = 0;
+    int64_t mtime = 0;
+    std::string link;
+};
+
+// width - 1 восьмеричных цифр с ведущими нулями и '\0'; значение должно проходить fitsOctal
+inline void putOctal(char* field, size_t width, uintmax_t value) {
+    field[width - 1] = '\0';
+    for (size_t i = width - 1; i > 0; i--) {
+        field[i - 1] = static_cast<char>('0' + (value & 7));
+        value >>= 3;
+    }
+}
+
+inline bool fitsOctal(uintmax_t value, size_t width) {
+    return value < (uintmax_t(1) << (3 * (width - 1)));
+}
+
+// Время: отрицательное в восьмеричное поле не записать
+inline bool fitsOctalTime(int64_t value, size_t width) {
+    return value >= 0 && fitsOctal(static_cast<uintmax_t>(value), width);
+}
+
+// Запись pax "длина ключ=значение\n"; длина включает собственные цифры
+inline void paxRecord(std::string& out, const std::string& key, const std::string& value) {
+    const size_t body = key.size() + value.size() + 3;
+    size_t length = body + 1;
+    while (std::to_string(length).size() + body != length) {
+        length = std::to_string(length).size() + body;
+    }
+    out += std::to_string(length) + ' ' + key + '=' + value + '\n';
+}
+
+// Имя длиннее 100 байт делится на prefix и name по '/'; false - не делится
+inline bool splitName(const std::string& path, std::string& prefix, std::string& name) {
+    if (path.size() <= 100) {
+        prefix.clear();
+        name = path;
+        return true;
+    }
+    for (size_t slash = path.find('/'); slash != std::string::npos && slash <= 155; slash = path.find('/', slash + 1)) {
+        if (path.size() - slash - 1 <= 100 && slash > 0) {
+            prefix = path.substr(0, slash);
+            name = path.substr(slash + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void fillHeader(char* header, const std::string& name, const std::string& prefix, const Entry& entry,
+    char type, uintmax_t size, const std::string& link) {
+    std::memset(header, 0, BlockSize);
+    std::memcpy(header, name.data(), std::min<size_t>(name.size(), 100));
+    putOctal(header + 100, 8, entry.mode & 07777);
+    putOctal(header + 108, 8, fitsOctal(entry.uid, 8) ? entry.uid : 0);
+    putOctal(header + 116, 8, fitsOctal(entry.gid, 8) ? entry.gid : 0);
+    putOctal(header + 124, 12, fitsOctal(size, 12) ? size : 0);
+    putOctal(header + 136, 12, fitsOctalTime(entry.mtime, 12) ? static_cast<uintmax_t>(entry.mtime) : 0);
+    header[156] = type;
+    std::memcpy(header + 157, link.data(), std::min<size_t>(link.size(), 100));
+    std::memcpy(header + 257, "ustar", 6);
+    std::memcpy(header + 263, "00", 2);
+    std::memcpy(header + 345, prefix.data(), std::min<size_t>(prefix.size(), 155));
+
+    std::memset(header + 148, ' ', 8);
+    unsigned sum = 0;
+    for (size_t i = 0; i < BlockSize; i++) {
+        sum += static_cast<unsigned char>(header[i]);
+    }
+    putOctal(header + 148, 7, sum);
+    header[155] = ' ';
+}
+
+// Заголовок (и при необходимости расширенный заголовок pax перед ним) для entry
+inline std::string header(const Entry& entry) {
+    std::string path = entry.name;
+    if (entry.type == '5') {
+        path += '/';
+    }
+    std::string prefix;
+    std::string name;
+    std::string records;
+    if (!splitName(path, prefix, name)) {
+        paxRecord(records, "path", path);
+        prefix.clear();
+        name = path.substr(0, 100);
+    }
+    if (entry.link.size() > 100) {
+        paxRecord(records, "linkpath", entry.link);
+    }
+    if (!fitsOctal(entry.size, 12)) {
+        paxRecord(records, "size", std::to_string(entry.size));
+    }
+    // Время до 1970 или после 2242 года, большие uid и gid в ustar не помещаются
+    if (!fitsOctalTime(entry.mtime, 12)) {
+        paxRecord(records, "mtime", std::to_string(entry.mtime));
+    }
+    if (!fitsOctal(entry.uid, 8)) {
+        paxRecord(records, "uid", std::to_string(entry.uid));
+    }
+    if (!fitsOctal(entry.gid, 8)) {
+        paxRecord(records, "gid", std::to_string(entry.gid));
+    }
+
+    std::string result;
+    if (!records.empty()) {
+        result.resize(BlockSize + (records.size() + BlockSize - 1) / BlockSize * BlockSize + BlockSize);
+        fillHeader(&result[0], "././@PaxHeader", std::string(), entry, 'x', records.size(), std::string());
+        std::memcpy(&result[BlockSize], records.data(), records.size());
+    }
+    else {
+        result.resize(BlockSize);
+    }
+    fillHeader(&result[result.size() - BlockSize], name, prefix, entry, entry.type, entry.size, entry.link.substr(0, 100));
+    return result;
+}
+
+// Число из заголовка: восьмеричное или base-256 (старший бит первого байта)
+inline uintmax_t parseNumber(const char* field, size_t width) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(field);
+    uintmax_t value = 0;
+    if (bytes[0] & 0x80) {
+        value = bytes[0] & 0x7f;
+        for (size_t i = 1; i < width; i++) {
+            value = (value << 8) | bytes[i];
+        }
+        return value;
+    }
+    size_t i = 0;
+    while (i < width && (field[i] == ' ' || field[i] == '\0')) {
+        i++;
+    }
+    for (; i < width && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value * 8 + static_cast<uintmax_t>(field[i] - '0');
+    }
+    return value;
+}
+
+inline bool checksumValid(const char* header) {
+    const uintmax_t stored = parseNumber(header + 148, 8);
+    unsigned sum = 0;
+    int signedSum = 0;
+    for (size_t i = 0; i < BlockSize; i++) {
+        const char c = i >= 148 && i < 156 ? ' ' : header[i];
+        sum += static_cast<unsigned char>(c);
+        signedSum += static_cast<signed char>(c);
+    }
+    return stored == sum || static_cast<int>(stored) == signedSum;
+}
+
+inline std::string field(const char* data, size_t width) {
+    return std::string(data, strnlen(data, width));
+}
+
+}  // namespace tar
+
+// Упаковка дерева в tar или tar.zst одним потоком. Обход идёт по порядку имён, содержимое файлов
+// читается через FileView, а для следующих readAhead файлов папки заранее запрашивается
+// упреждающее чтение, поэтому диск работает одновременно со сжатием. Поток tar режется на блоки
+// по blockSize; каждый блок сжимается в пуле отдельным кадром zstd (склеенные кадры - корректный
+// поток .zst), а готовые кадры пишутся в архив по порядку. В работе не больше 2 * jobs блоков,
+// так что память ограничена независимо от размера дерева.
+// Архив пишется во временный файл и переименовывается после успешного завершения
+class ArchivePacker {
+public:
+    explicit ArchivePacker(ArchiveOptions options = {}) : options(options) {
+        if (this->options.jobs == 0) {
+            this->options.jobs = std::max(1u, std::thread::hardware_concurrency());
+        }
+        this->options.blockSize = std::max<size_t>(this->options.blockSize, 64 << 10);
+    }
+
+    void pack(const fs::path& source, const fs::path& archive) {
+        started = std::chrono::steady_clock::now();
+        format = archiveFormatFor(archive);
+        if (!archiveFormatSupported(format)) {
+            throw std::runtime_error("сжатие zstd недоступно в этой сборке");
+        }
+        ProgressTicker ticker(options.progressInterval, options.onProgress
+            ? std::function<void()>([this] { options.onProgress(stats()); })
+            : std::function<void()>());
+
+        const fs::path root = fs::weakly_canonical(source);
+        const std::string temp = archive.string() + ".part";
+        out.open(temp, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            throw fs::filesystem_error("Не удалось создать архив", temp, std::make_error_code(std::errc::permission_denied));
+        }
+        outputPath = temp;
+#ifdef __linux__
+        struct stat st;
+        if (::stat(temp.c_str(), &st) == 0) {
+            outputDevice = st.st_dev;
+            outputInode = st.st_ino;
+        }
+#endif
+
+        ThreadPool pool(options.jobs, options.jobs * 2);
+        compressor = &pool;
+        try {
+            tar::Entry entry;
+            if (describe(root.string(), root.filename().string(), entry)) {
+                packEntry(root.string(), entry);
+            }
+            // Конец архива - два нулевых блока
+            append(std::string(2 * tar::BlockSize, '\0'));
+            flushBlock();
+            while (!inFlight.empty()) {
+                writeFront();
+            }
+            pool.wait();
+            out.close();
+            if (!out) {
+                throw fs::filesystem_error("Ошибка записи архива", temp, std::make_error_code(std::errc::io_error));
+            }
+            fs::rename(temp, archive);
+        }
+        catch (...) {
+            inFlight.clear();
+            try {
+                pool.wait();
+            }
+            catch (...) {
+            }
+            compressor = nullptr;
+            out.close();
+            std::error_code ec;
+            fs::remove(temp, ec);
+            throw;
+        }
+        compressor = nullptr;
+    }
+
+    ArchiveStats stats() const {
+        ArchiveStats result;
+        result.files = files.load(std::memory_order_relaxed);
+        result.directories = directories.load(std::memory_order_relaxed);
+        result.links = links.load(std::memory_order_relaxed);
+        result.skipped = skipped.load(std::memory_order_relaxed);
+        result.dataBytes = dataBytes.load(std::memory_order_relaxed);
+        result.archiveBytes = archiveBytes.load(std::memory_order_relaxed);
+        result.errors = errorCount.load(std::memory_order_relaxed);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return result;
+    }
+
+    // Первые MaxErrors сообщений об ошибках
+    std::vector<std::string> errors() const {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        return errorMessages;
+    }
+
+private:
+    static constexpr size_t MaxErrors = 20;
+
+    // Блок потока tar и его сжатый кадр
+    struct Block {
+        std::string raw;
+        std::string packed;
+        std::exception_ptr error;
+        bool ready = false;
+    };
+
+    ArchiveOptions options;
+    ArchiveFormat format = ArchiveFormat::Tar;
+    std::ofstream out;
+    std::string outputPath;
+#ifdef __linux__
+    dev_t outputDevice = 0;
+    ino_t outputInode = 0;
+#endif
+    ThreadPool* compressor = nullptr;
+    std::shared_ptr<Block> filling;
+    std::deque<std::shared_ptr<Block>> inFlight;
+    std::mutex blockMutex;
+    std::condition_variable blockReady;
+    std::atomic<uintmax_t> files{ 0 };
+    std::atomic<uintmax_t> directories{ 0 };
+    std::atomic<uintmax_t> links{ 0 };
+    std::atomic<uintmax_t> skipped{ 0 };
+    std::atomic<uintmax_t> dataBytes{ 0 };
+    std::atomic<uintmax_t> archiveBytes{ 0 };
+    std::atomic<uintmax_t> errorCount{ 0 };
+    mutable std::mutex errorMutex;
+    std::vector<std::string> errorMessages;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    void failed(const std::string& what) {
+        errorCount.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (errorMessages.size() < MaxErrors) {
+            errorMessages.push_back(what);
+        }
+    }
+
+    // Атрибуты элемента; false - пропустить (ошибка, неподдерживаемый тип или сам архив)
+    bool describe(const std::string& path, const std::string& name, tar::Entry& entry) {
+        entry.name = name;
+#ifdef __linux__
+        struct stat st;
+        FM_COUNT(Syscalls, 1);
+        if (::lstat(path.c_str(), &st) != 0) {
+            failed(path + ": " + std::strerror(errno));
+            return false;
+        }
+        if (st.st_dev == outputDevice && st.st_ino == outputInode) {
+            return false;
+        }
+        entry.mode = st.st_mode & 07777;
+        entry.uid = st.st_uid;
+        entry.gid = st.st_gid;
+        entry.mtime = st.st_mtime;
+        if (S_ISDIR(st.st_mode)) {
+            entry.type = '5';
+        }
+        else if (S_ISREG(st.st_mode)) {
+            entry.type = '0';
+            entry.size = static_cast<uintmax_t>(st.st_size);
+        }
+        else if (S_ISLNK(st.st_mode)) {
+            entry.type = '2';
+            char buffer[4096];
+            ssize_t n = ::readlink(path.c_str(), buffer, sizeof(buffer));
+            if (n < 0) {
+                failed(path + ": " + std::strerror(errno));
+                return false;
+            }
+            entry.link.assign(buffer, static_cast<size_t>(n));
+        }
+        else {
+            skipped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+#else
+        std::error_code ec;
+        const fs::file_status status = fs::symlink_status(path, ec);
+        if (ec) {
+            failed(path + ": " + ec.message());
+            return false;
+        }
+        if (path == outputPath) {
+            return false;
+        }
+        entry.mode = static_cast<unsigned>(status.permissions()) & 07777;
+        if (fs::is_symlink(status)) {
+            entry.type = '2';
+            entry.link = fs::read_symlink(path, ec).generic_string();
+        }
+        else if (fs::is_directory(status)) {
+            entry.type = '5';
+        }
+        else if (fs::is_regular_file(status)) {
+            entry.type = '0';
+            entry.size = fs::file_size(path, ec);
+        }
+        else {
+            skipped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        const auto modified = fs::last_write_time(path, ec);
+        entry.mtime = std::chrono::duration_cast<std::chrono::seconds>(
+            (modified - fs::file_time_type::clock::now() + std::chrono::system_clock::now()).time_since_epoch()).count();
+#endif
+        return true;
+    }
+
+    void packEntry(const std::string& path, const tar::Entry& entry) {
+        if (options.control) {
+            options.control->checkpoint(1, 0);
+        }
+        FM_COUNT(Entries, 1);
+        switch (entry.type) {
+        case '5':
+            append(tar::header(entry));
+            directories.fetch_add(1, std::memory_order_relaxed);
+            packDirectory(path, entry.name);
+            break;
+        case '2':
+            append(tar::header(entry));
+            links.fetch_add(1, std::memory_order_relaxed);
+            break;
+        default:
+            packFile(path, entry);
+            break;
+        }
+    }
+
+    // Элементы папки по порядку имён: архив одного дерева всегда одинаков
+    void packDirectory(const std::string& path, const std::string& name) {
+        std::vector<std::string> names;
+        {
+            FM_SCOPE(Traversal, "pack list");
+            std::error_code ec;
+            for (fs::directory_iterator it(path, ec), end; !ec && it != end; it.increment(ec)) {
+                names.push_back(it->path().filename().string());
+            }
+            if (ec) {
+                failed(path + ": " + ec.message());
+            }
+        }
+        std::sort(names.begin(), names.end());
+
+        std::vector<tar::Entry> entries(names.size());
+        std::vector<bool> present(names.size());
+        for (size_t i = 0; i < names.size(); i++) {
+            present[i] = describe(path + '/' + names[i], name + '/' + names[i], entries[i]);
+        }
+        size_t prefetched = 0;
+        for (size_t i = 0; i < names.size(); i++) {
+            for (; prefetched < names.size() && prefetched <= i + options.readAhead; prefetched++) {
+                if (present[prefetched] && entries[prefetched].type == '0') {
+                    prefetch(path + '/' + names[prefetched]);
+                }
+            }
+            if (present[i]) {
+                packEntry(path + '/' + names[i], entries[i]);
+            }
+        }
+    }
+
+    // Ядро начинает читать файл заранее и не блокирует вызывающего
+    static void prefetch(const std::string& path) {
+#if defined(__linux__) && defined(POSIX_FADV_WILLNEED)
+        FM_COUNT(Syscalls, 3);
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+            ::close(fd);
+        }
+#else
+        (void)path;
+#endif
+    }
+
+    // Содержимое ровно entry.size байт: выросший после lstat файл обрезается, укоротившийся
+    // дополняется нулями, иначе сбились бы смещения следующих заголовков
+    void packFile(const std::string& path, const tar::Entry& entry) {
+        std::unique_ptr<FileView> view;
+        if (entry.size > 0) {
+            try {
+                view = std::make_unique<FileView>(path, options.blockSize);
+            }
+            catch (const std::exception& e) {
+                failed(e.what());
+                return;
+            }
+        }
+        append(tar::header(entry));
+        uintmax_t written = 0;
+        bool readFailed = false;
+        if (view) {
+            FM_SCOPE(Io, "pack read");
+            try {
+                view->forEachChunk([&](std::string_view chunk) {
+                    const size_t take = static_cast<size_t>(std::min<uintmax_t>(chunk.size(), entry.size - written));
+                    append(chunk.substr(0, take));
+                    written += take;
+                    dataBytes.fetch_add(take, std::memory_order_relaxed);
+                    if (options.control) {
+                        options.control->checkpoint(0, take);
+                    }
+                    return written < entry.size;
+                    });
+            }
+            catch (const OperationCancelled&) {
+                throw;
+            }
+            catch (const std::exception& e) {
+                failed(path + ": " + e.what());
+                readFailed = true;
+            }
+            if (written < entry.size) {
+                if (!readFailed) {
+                    failed(path + ": файл укоротился во время упаковки");
+                }
+                appendZeros(entry.size - written);
+            }
+        }
+        appendZeros((tar::BlockSize - entry.size % tar::BlockSize) % tar::BlockSize);
+        files.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void appendZeros(uintmax_t count) {
+        static const std::string zeros(64 << 10, '\0');
+        while (count > 0) {
+            const size_t take = static_cast<size_t>(std::min<uintmax_t>(count, zeros.size()));
+            append(std::string_view(zeros.data(), take));
+            count -= take;
+        }
+    }
+
+    void append(std::string_view data) {
+        while (!data.empty()) {
+            if (!filling) {
+                filling = std::make_shared<Block>();
+                filling->raw.reserve(options.blockSize);
+            }
+            const size_t take = std::min(data.size(), options.blockSize - filling->raw.size());
+            filling->raw.append(data.data(), take);
+            data.remove_prefix(take);
+            if (filling->raw.size() == options.blockSize) {
+                flushBlock();
+            }
+        }
+    }
+
+    // Заполненный блок уходит в пул; если в работе слишком много, сначала пишется самый старый
+    void flushBlock() {
+        if (!filling || filling->raw.empty()) {
+            return;
+        }
+        std::shared_ptr<Block> block = std::move(filling);
+        filling.reset();
+        if (format == ArchiveFormat::Tar) {
+            block->ready = true;
+            inFlight.push_back(std::move(block));
+            writeFront();
+            return;
+        }
+        inFlight.push_back(block);
+        compressor->submit([this, block] {
+            std::exception_ptr error;
+            try {
+                block->packed = compress(block->raw);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock(blockMutex);
+                block->error = error;
+                block->ready = true;
+            }
+            blockReady.notify_all();
+            });
+        while (inFlight.size() > options.jobs * 2) {
+            writeFront();
+        }
+    }
+
+    void writeFront() {
+        std::shared_ptr<Block> block = inFlight.front();
+        {
+            std::unique_lock<std::mutex> lock(blockMutex);
+            blockReady.wait(lock, [&] { return block->ready; });
+        }
+        inFlight.pop_front();
+        if (block->error) {
+            std::rethrow_exception(block->error);
+        }
+        const std::string& data = format == ArchiveFormat::Tar ? block->raw : block->packed;
+        FM_SCOPE(Output, "pack write");
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!out) {
+            throw fs::filesystem_error("Ошибка записи архива", outputPath, std::make_error_code(std::errc::io_error));
+        }
+        archiveBytes.fetch_add(data.size(), std::memory_order_relaxed);
+        FM_COUNT(Bytes, data.size());
+    }
+
+    std::string compress(const std::string& raw) const {
+#ifdef FM_HAVE_ZSTD
+        FM_SCOPE(Io, "zstd compress");
+        struct ContextDeleter {
+            void operator()(ZSTD_CCtx* context) const {
+                ZSTD_freeCCtx(context);
+            }
+        };
+        // Контекст сжатия свой у каждого потока пула и живёт, пока жив поток
+        thread_local std::unique_ptr<ZSTD_CCtx, ContextDeleter> context(ZSTD_createCCtx());
+        std::string packed(ZSTD_compressBound(raw.size()), '\0');
+        const size_t size = ZSTD_compressCCtx(context.get(), &packed[0], packed.size(), raw.data(), raw.size(), options.level);
+        if (ZSTD_isError(size)) {
+            throw std::runtime_error(std::string("ошибка zstd: ") + ZSTD_getErrorName(size));
+        }
+        packed.resize(size);
+        return packed;
+#else
+        return raw;
+#endif
+    }
+};
+
+// Распаковка tar или tar.zst (формат определяется по сигнатуре, а не по имени). Поток архива
+// читается и разбирается одним потоком; данные файлов уходят в пул задач и пишутся через
+// CopyEngine (createFile/writeAt) параллельно: мелкий файл - одной задачей, крупный - кусками
+// по blockSize с явными смещениями. Очередь пула ограничена, поэтому память тоже.
+// Пути с ".." пропускаются, ведущий '/' отбрасывается. Символьные и жёсткие ссылки создаются
+// после всех файлов, чтобы запись не могла пройти через ссылку из того же архива за пределы
+// приёмника. Время изменения файлов и папок восстанавливается в конце
+class ArchiveUnpacker {
+public:
+    explicit ArchiveUnpacker(ArchiveOptions options = {}) : options(options) {
+        if (this->options.jobs == 0) {
+            this->options.jobs = std::max(1u, std::thread::hardware_concurrency());
+        }
+        this->options.blockSize = std::max<size_t>(this->options.blockSize, 64 << 10);
+    }
+
+    void unpack(const fs::path& archive, const fs::path& destination) {
+        started = std::chrono::steady_clock::now();
+        ProgressTicker ticker(options.progressInterval, options.onProgress
+            ? std::function<void()>([this] { options.onProgress(stats()); })
+            : std::function<void()>());
+
+        Source source(archive, archiveBytes);
+        fs::create_directories(destination);
+        root = destination;
+        ThreadPool pool(options.jobs, options.jobs * 4);
+        try {
+            extract(source, pool);
+            pool.wait();
+        }
+        catch (...) {
+            try {
+                pool.wait();
+            }
+            catch (...) {
+            }
+            throw;
+        }
+        for (const auto& link : hardLinks) {
+            guarded(link.first.string(), [&] {
+                removeExisting(link.first);
+                fs::create_hard_link(link.second, link.first);
+                links.fetch_add(1, std::memory_order_relaxed);
+                });
+        }
+        for (const auto& link : symLinks) {
+            guarded(link.first.string(), [&] {
+                removeExisting(link.first);
+                fs::create_symlink(link.second, link.first);
+                links.fetch_add(1, std::memory_order_relaxed);
+                });
+        }
+        // Папки в конце и от глубоких к корню: запись внутрь меняет время изменения папки
+        for (auto it = modified.rbegin(); it != modified.rend(); ++it) {
+            setModified(it->first, it->second);
+        }
+    }
+
+    ArchiveStats stats() const {
+        ArchiveStats result;
+        result.files = files.load(std::memory_order_relaxed);
+        result.directories = directories.load(std::memory_order_relaxed);
+        result.links = links.load(std::memory_order_relaxed);
+        result.skipped = skipped.load(std::memory_order_relaxed);
+        result.dataBytes = copier.progress().bytes;
+        result.archiveBytes = archiveBytes.load(std::memory_order_relaxed);
+        result.errors = errorCount.load(std::memory_order_relaxed);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return result;
+    }
+
+    std::vector<std::string> errors() const {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        return errorMessages;
+    }
+
+private:
+    static constexpr size_t MaxErrors = 20;
+
+    // Поток байт tar из файла архива: как есть или через потоковую распаковку zstd
+    class Source {
+    public:
+        Source(const fs::path& path, std::atomic<uintmax_t>& consumed) : path(path), consumed(consumed) {
+            in.open(path, std::ios::binary);
+            if (!in.is_open()) {
+                throw fs::filesystem_error("Не удалось открыть архив", path, std::make_error_code(std::errc::no_such_file_or_directory));
+            }
+            char magic[4] = {};
+            in.read(magic, sizeof(magic));
+            const std::streamsize got = in.gcount();
+            in.clear();
+            in.seekg(0);
+            static const unsigned char zstdMagic[4] = { 0x28, 0xb5, 0x2f, 0xfd };
+            compressed = got == 4 && std::memcmp(magic, zstdMagic, 4) == 0;
+#ifdef FM_HAVE_ZSTD
+            if (compressed) {
+                stream.reset(ZSTD_createDStream());
+                ZSTD_initDStream(stream.get());
+                input.resize(ZSTD_DStreamInSize());
+            }
+#else
+            if (compressed) {
+                throw std::runtime_error("архив сжат zstd, а сжатие недоступно в этой сборке");
+            }
+#endif
+        }
+
+        // Ровно length байт; false - поток кончился раньше
+        bool read(char* dest, size_t length) {
+            return readSome(dest, length) == length;
+        }
+
+        bool skip(uintmax_t length) {
+            char buffer[64 << 10];
+            while (length > 0) {
+                const size_t take = static_cast<size_t>(std::min<uintmax_t>(length, sizeof(buffer)));
+                if (!read(buffer, take)) {
+                    return false;
+                }
+                length -= take;
+            }
+            return true;
+        }
+
+    private:
+        fs::path path;
+        std::ifstream in;
+        std::atomic<uintmax_t>& consumed;
+        bool compressed = false;
+#ifdef FM_HAVE_ZSTD
+        struct StreamDeleter {
+            void operator()(ZSTD_DStream* stream) const {
+                ZSTD_freeDStream(stream);
+            }
+        };
+        std::unique_ptr<ZSTD_DStream, StreamDeleter> stream;
+        std::vector<char> input;
+        ZSTD_inBuffer pending{ nullptr, 0, 0 };
+#endif
+
+        size_t readRaw(char* dest, size_t length) {
+            in.read(dest, static_cast<std::streamsize>(length));
+            const size_t got = static_cast<size_t>(in.gcount());
+            consumed.fetch_add(got, std::memory_order_relaxed);
+            FM_COUNT(Bytes, got);
+            return got;
+        }
+
+        size_t readSome(char* dest, size_t length) {
+            if (!compressed) {
+                return readRaw(dest, length);
+            }
+#ifdef FM_HAVE_ZSTD
+            FM_SCOPE(Io, "zstd decompress");
+            ZSTD_outBuffer output{ dest, length, 0 };
+            while (output.pos < output.size) {
+                if (pending.pos == pending.size) {
+                    pending.size = readRaw(input.data(), input.size());
+                    pending.src = input.data();
+                    pending.pos = 0;
+                    if (pending.size == 0) {
+                        break;
+                    }
+                }
+                const size_t result = ZSTD_decompressStream(stream.get(), &output, &pending);
+                if (ZSTD_isError(result)) {
+                    throw std::runtime_error(std::string("повреждённый архив: ") + ZSTD_getErrorName(result));
+                }
+            }
+            return output.pos;
+#else
+            (void)dest;
+            return 0;
+#endif
+        }
+    };
+
+    ArchiveOptions options;
+    CopyEngine copier{ copyOptions(options) };
+    fs::path root;
+    std::vector<std::pair<fs::path, fs::path>> hardLinks;
+    std::vector<std::pair<fs::path, std::string>> symLinks;
+    std::vector<std::pair<fs::path, int64_t>> modified;
+    fs::path lastParent;
+    std::atomic<uintmax_t> files{ 0 };
+    std::atomic<uintmax_t> directories{ 0 };
+    std::atomic<uintmax_t> links{ 0 };
+    std::atomic<uintmax_t> skipped{ 0 };
+    std::atomic<uintmax_t> archiveBytes{ 0 };
+    std::atomic<uintmax_t> errorCount{ 0 };
+    mutable std::mutex errorMutex;
+    std::vector<std::string> errorMessages;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    static CopyOptions copyOptions(const ArchiveOptions& options) {
+        CopyOptions result;
+        result.jobs = options.jobs;
+        result.control = options.control;
+        return result;
+    }
+
+    void failed(const std::string& what) {
+        errorCount.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (errorMessages.size() < MaxErrors) {
+            errorMessages.push_back(what);
+        }
+    }
+
+    // Ошибка одного элемента записывается и не останавливает остальные; отмена - останавливает
+    template <typename F>
+    void guarded(const std::string& what, F f) {
+        try {
+            f();
+        }
+        catch (const OperationCancelled&) {
+            throw;
+        }
+        catch (const std::exception& e) {
+            failed(what + ": " + e.what());
+        }
+    }
+
+    // Путь внутри приёмника; пустой - путь небезопасен (выходит за пределы через "..")
+    fs::path target(const std::string& name) const {
+        fs::path result = root;
+        bool any = false;
+        size_t start = 0;
+        while (start <= name.size()) {
+            size_t slash = name.find('/', start);
+            if (slash == std::string::npos) {
+                slash = name.size();
+            }
+            const std::string part = name.substr(start, slash - start);
+            start = slash + 1;
+            if (part.empty() || part == ".") {
+                continue;
+            }
+            if (part == "..") {
+                return {};
+            }
+            result /= part;
+            any = true;
+        }
+        return any ? result : fs::path();
+    }
+
+    void ensureParent(const fs::path& path) {
+        const fs::path parent = path.parent_path();
+        if (parent != lastParent) {
+            fs::create_directories(parent);
+            lastParent = parent;
+        }
+    }
+
+    static void removeExisting(const fs::path& path) {
+        std::error_code ec;
+        const fs::file_status status = fs::symlink_status(path, ec);
+        if (!ec && fs::exists(status) && !fs::is_directory(status)) {
+            fs::remove(path);
+        }
+    }
+
+    void extract(Source& source, ThreadPool& pool) {
+        char header[tar::BlockSize];
+        std::string longName;
+        std::string longLink;
+        uintmax_t paxSize = 0;
+        bool hasPaxSize = false;
+        int64_t paxMtime = 0;
+        bool hasPaxMtime = false;
+        std::unordered_set<std::string> seen;
+        while (true) {
+            if (!source.read(header, tar::BlockSize)) {
+                throw std::runtime_error("архив обрывается на середине");
+            }
+            if (std::all_of(header, header + tar::BlockSize, [](char c) { return c == '\0'; })) {
+                return;
+            }
+            if (!tar::checksumValid(header)) {
+                throw std::runtime_error("повреждённый заголовок tar");
+            }
+            if (pool.failed()) {
+                return;
+            }
+            const char type = header[156];
+            const uintmax_t headerSize = tar::parseNumber(header + 124, 12);
+
+            // Расширенные заголовки относятся к следующему элементу
+            if (type == 'x' || type == 'L' || type == 'K') {
+                const uintmax_t size = headerSize;
+                std::string data(static_cast<size_t>(size), '\0');
+                if (!source.read(&data[0], data.size()) || !source.skip(padding(size))) {
+                    throw std::runtime_error("архив обрывается на середине");
+                }
+                if (type == 'L') {
+                    longName = data.c_str();
+                }
+                else if (type == 'K') {
+                    longLink = data.c_str();
+                }
+                else {
+                    parsePax(data, longName, longLink, paxSize, hasPaxSize, paxMtime, hasPaxMtime);
+                }
+                continue;
+            }
+            if (type == 'g') {
+                source.skip(headerSize + padding(headerSize));
+                continue;
+            }
+            const uintmax_t size = hasPaxSize ? paxSize : headerSize;
+
+            std::string name = longName;
+            if (name.empty()) {
+                const std::string prefix = tar::field(header + 345, 155);
+                name = tar::field(header, 100);
+                if (!prefix.empty() && std::memcmp(header + 257, "ustar", 5) == 0) {
+                    name = prefix + '/' + name;
+                }
+            }
+            const std::string link = longLink.empty() ? tar::field(header + 157, 100) : longLink;
+            longName.clear();
+            longLink.clear();
+            const int64_t mtime = hasPaxMtime ? paxMtime : static_cast<int64_t>(tar::parseNumber(header + 136, 12));
+            hasPaxSize = false;
+            hasPaxMtime = false;
+
+            const unsigned mode = static_cast<unsigned>(tar::parseNumber(header + 100, 8)) & 07777;
+            const fs::path path = target(name);
+            if (options.control) {
+                options.control->checkpoint(1, 0);
+            }
+            FM_COUNT(Entries, 1);
+            const bool regular = type == '0' || type == '\0' || type == '7';
+            if (path.empty()) {
+                skipped.fetch_add(1, std::memory_order_relaxed);
+                failed(name + ": путь выходит за пределы папки распаковки, пропущен");
+                if (!source.skip(size + padding(size))) {
+                    throw std::runtime_error("архив обрывается на середине");
+                }
+                continue;
+            }
+            if (!seen.insert(path.string()).second) {
+                replaceEarlier(pool, path);
+            }
+
+            if (type == '5') {
+                guarded(name, [&] {
+                    fs::create_directories(path);
+                    fs::permissions(path, static_cast<fs::perms>(mode | 0700));
+                    directories.fetch_add(1, std::memory_order_relaxed);
+                    modified.emplace_back(path, mtime);
+                    });
+            }
+            else if (type == '2') {
+                guarded(name, [&] {
+                    ensureParent(path);
+                    symLinks.emplace_back(path, link);
+                    });
+            }
+            else if (type == '1') {
+                const fs::path existing = target(link);
+                if (existing.empty()) {
+                    skipped.fetch_add(1, std::memory_order_relaxed);
+                    failed(name + ": ссылка выходит за пределы папки распаковки, пропущена");
+                }
+                else {
+                    hardLinks.emplace_back(path, existing);
+                }
+            }
+            else if (regular) {
+                extractFile(source, pool, name, path, size, mode, mtime);
+                continue;
+            }
+            else {
+                // Устройства и каналы не создаются
+                skipped.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (!source.skip(size + padding(size))) {
+                throw std::runtime_error("архив обрывается на середине");
+            }
+        }
+    }
+
+    static uintmax_t padding(uintmax_t size) {
+        return (tar::BlockSize - size % tar::BlockSize) % tar::BlockSize;
+    }
+
+    static void parsePax(const std::string& data, std::string& path, std::string& link, uintmax_t& size, bool& hasSize,
+        int64_t& mtime, bool& hasMtime) {
+        size_t pos = 0;
+        while (pos < data.size()) {
+            const size_t space = data.find(' ', pos);
+            if (space == std::string::npos) {
+                return;
+            }
+            const size_t length = static_cast<size_t>(std::strtoull(data.c_str() + pos, nullptr, 10));
+            if (length == 0 || pos + length > data.size()) {
+                return;
+            }
+            const std::string record = data.substr(space + 1, pos + length - space - 2);
+            pos += length;
+            const size_t equals = record.find('=');
+            if (equals == std::string::npos) {
+                continue;
+            }
+            const std::string key = record.substr(0, equals);
+            const std::string value = record.substr(equals + 1);
+            if (key == "path") {
+                path = value;
+            }
+            else if (key == "linkpath") {
+                link = value;
+            }
+            else if (key == "size") {
+                size = std::strtoull(value.c_str(), nullptr, 10);
+                hasSize = true;
+            }
+            else if (key == "mtime") {
+                // Дробная часть секунд отбрасывается
+                mtime = std::strtoll(value.c_str(), nullptr, 10);
+                hasMtime = true;
+            }
+        }
+    }
+
+    // Путь уже встречался (дописанный tar): более поздний элемент заменяет ранний. Запись раннего
+    // файла ещё может идти в пуле, а его O_EXCL-создание - столкнуться с удалением для позднего,
+    // поэтому сначала пул дорабатывает. Отложенные ссылки и время раннего элемента отменяются
+    void replaceEarlier(ThreadPool& pool, const fs::path& path) {
+        pool.wait();
+        const auto samePath = [&path](const auto& item) {
+            return item.first == path;
+        };
+        hardLinks.erase(std::remove_if(hardLinks.begin(), hardLinks.end(), samePath), hardLinks.end());
+        symLinks.erase(std::remove_if(symLinks.begin(), symLinks.end(), samePath), symLinks.end());
+        modified.erase(std::remove_if(modified.begin(), modified.end(), samePath), modified.end());
+    }
+
+    // Мелкий файл пишется одной задачей пула; крупный создаётся здесь, а куски по blockSize
+    // уходят в пул с явными смещениями
+    void extractFile(Source& source, ThreadPool& pool, const std::string& name, const fs::path& path,
+        uintmax_t size, unsigned mode, int64_t mtime) {
+        const bool created = size > options.blockSize;
+        bool prepared = false;
+        guarded(name, [&] {
+            ensureParent(path);
+            removeExisting(path);
+            if (created) {
+                copier.createFile(path, mode);
+            }
+            prepared = true;
+            });
+        if (!prepared) {
+            if (!source.skip(size + padding(size))) {
+                throw std::runtime_error("архив обрывается на середине");
+            }
+            return;
+        }
+
+        uintmax_t offset = 0;
+        do {
+            const size_t length = static_cast<size_t>(std::min<uintmax_t>(size - offset, options.blockSize));
+            auto data = std::make_shared<std::string>(length, '\0');
+            if (length > 0 && !source.read(&(*data)[0], length)) {
+                throw std::runtime_error("архив обрывается на середине");
+            }
+            pool.submit([this, data, path, name, offset, mode, whole = !created] {
+                guarded(name, [&] {
+                    if (whole) {
+                        copier.createFile(path, mode);
+                    }
+                    if (!data->empty()) {
+                        copier.writeAt(path, *data, offset);
+                    }
+                    });
+                });
+            offset += length;
+        } while (offset < size);
+        if (!source.skip(padding(size))) {
+            throw std::runtime_error("архив обрывается на середине");
+        }
+        files.fetch_add(1, std::memory_order_relaxed);
+        modified.emplace_back(path, mtime);
+    }
+
+    void setModified(const fs::path& path, int64_t mtime) {
+#ifdef __linux__
+        const struct timespec times[2] = { { static_cast<time_t>(mtime), 0 }, { static_cast<time_t>(mtime), 0 } };
+        FM_COUNT(Syscalls, 1);
+        // Ссылку из архива не разыменовываем: её цель может лежать вне папки распаковки
+        ::utimensat(AT_FDCWD, path.c_str(), times, AT_SYMLINK_NOFOLLOW);
+#else
+        std::error_code ec;
+        if (fs::is_symlink(fs::symlink_status(path, ec))) {
+            return;
+        }
+        const auto now = std::chrono::system_clock::now();
+        const auto age = now - std::chrono::system_clock::from_time_t(static_cast<std::time_t>(mtime));
+        fs::last_write_time(path, fs::file_time_type::clock::now()
+            - std::chrono::duration_cast<fs::file_time_type::duration>(age), ec);
+#endif
+    }
+};
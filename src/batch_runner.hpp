@@ -0,0 +1,459 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "command_line.hpp"
+#include "copy_engine.hpp"
+#include "delete_engine.hpp"
+#include "listing.hpp"
+#include "thread_pool.hpp"
+
+namespace fs = std::filesystem;
+
+struct BatchOptions {
+    unsigned jobs = 0;          // 0 - по числу ядер
+    bool stopOnError = false;   // после первой ошибки ещё не начатые команды пропускаются
+};
+
+struct BatchSummary {
+    size_t commands = 0;
+    size_t succeeded = 0;
+    size_t failed = 0;
+    size_t skipped = 0;
+    double seconds = 0;
+};
+
+// Пакетный режим: сценарий разбирается целиком до выполнения (синтаксическая ошибка
+// в любой строке - ничего не выполняется), затем независимые команды идут параллельно.
+// Команда ждёт более раннюю, если их пути пересекаются (совпадают или один внутри другого)
+// и хотя бы одна из них пишет. Пересечение проверяется по путям после lexically_normal,
+// поэтому доступ к одному объекту через разные символические ссылки не распознаётся.
+// cd меняет папку для разбора следующих строк; команды после cd ждут его проверки.
+// Результат каждой строки - одна строка JSON, выдаются в порядке сценария.
+class BatchRunner {
+public:
+    using Emit = std::function<void(const std::string&)>;
+
+    BatchRunner(fs::path workingDirectory, BatchOptions options = {})
+        : cwd(workingDirectory.lexically_normal()), options(options) {}
+
+    // Разбирает сценарий; при ошибках выдаёт их через emit и возвращает false
+    bool parse(std::istream& input, const Emit& emit) {
+        std::string line;
+        size_t lineNumber = 0;
+        bool valid = true;
+        int lastCd = -1;
+        while (std::getline(input, line)) {
+            lineNumber++;
+            std::vector<std::string> args;
+            try {
+                args = splitCommandLine(line);
+            }
+            catch (const std::exception& e) {
+                emit(errorLine(lineNumber, "", "syntax", e.what()));
+                valid = false;
+                continue;
+            }
+            if (args.empty() || args[0][0] == '#') {
+                continue;
+            }
+
+            Operation op;
+            op.line = lineNumber;
+            op.command = args[0];
+            std::string problem = prepare(op, args);
+            if (!problem.empty()) {
+                emit(errorLine(lineNumber, op.command, "syntax", problem));
+                valid = false;
+                continue;
+            }
+            if (lastCd >= 0) {
+                op.dependencies.push_back(static_cast<size_t>(lastCd));
+            }
+            if (op.command == "cd") {
+                lastCd = static_cast<int>(operations.size());
+            }
+            operations.push_back(std::move(op));
+        }
+        if (valid) {
+            linkDependencies();
+        }
+        else {
+            operations.clear();
+        }
+        return valid;
+    }
+
+    BatchSummary run(const Emit& emit) {
+        auto started = std::chrono::steady_clock::now();
+        output = &emit;
+        nextToEmit = 0;
+        {
+            // Очередь вмещает все команды: задачи ставят зависимые из рабочих потоков и не должны ждать места
+            ThreadPool pool(options.jobs, operations.size() + 1);
+            for (size_t i = 0; i < operations.size(); i++) {
+                if (operations[i].remaining.load() == 0) {
+                    pool.submit([this, i, &pool] { execute(i, pool); });
+                }
+            }
+            pool.wait();
+        }
+
+        BatchSummary summary;
+        summary.commands = operations.size();
+        for (const auto& op : operations) {
+            if (op.status == Status::Succeeded) summary.succeeded++;
+            else if (op.status == Status::Failed) summary.failed++;
+            else summary.skipped++;
+        }
+        summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::ostringstream last;
+        last << "{\"summary\":true,\"commands\":" << summary.commands << ",\"succeeded\":" << summary.succeeded
+            << ",\"failed\":" << summary.failed << ",\"skipped\":" << summary.skipped
+            << ",\"seconds\":" << summary.seconds << '}';
+        emit(last.str());
+        return summary;
+    }
+
+    size_t size() const {
+        return operations.size();
+    }
+
+private:
+    enum class Status { Pending, Succeeded, Failed, Skipped };
+
+    struct Access {
+        std::string path;
+        bool write;
+    };
+
+    struct Operation {
+        size_t line = 0;
+        std::string command;
+        std::vector<fs::path> paths;
+        std::vector<Access> accesses;
+        std::vector<size_t> dependencies;
+        std::vector<size_t> dependents;
+        std::atomic<size_t> remaining{ 0 };
+        std::atomic<size_t> failedDependency{ 0 };  // строка команды, из-за которой эта пропускается
+        Status status = Status::Pending;
+        std::string result;
+
+        Operation() = default;
+        Operation(Operation&& other) noexcept
+            : line(other.line), command(std::move(other.command)), paths(std::move(other.paths)),
+            accesses(std::move(other.accesses)), dependencies(std::move(other.dependencies)),
+            dependents(std::move(other.dependents)), remaining(other.remaining.load()),
+            failedDependency(other.failedDependency.load()), status(other.status), result(std::move(other.result)) {}
+    };
+
+    // Кто последним писал путь и кто читал его после этого
+    struct PathState {
+        int lastWriter = -1;
+        std::vector<size_t> readers;
+    };
+
+    fs::path cwd;
+    BatchOptions options;
+    std::vector<Operation> operations;
+    const Emit* output = nullptr;
+    std::mutex orderMutex;
+    size_t nextToEmit = 0;
+    std::atomic<bool> aborted{ false };
+
+    fs::path resolve(const std::string& arg) const {
+        fs::path path(arg);
+        if (path.is_relative()) {
+            path = cwd / path;
+        }
+        path = path.lexically_normal();
+        std::string text = path.string();
+        while (text.size() > 1 && (text.back() == '/' || text.back() == '\\')) {
+            text.pop_back();
+        }
+        return fs::path(text);
+    }
+
+    // Проверяет число аргументов и описывает, какие пути команда читает и пишет
+    std::string prepare(Operation& op, const std::vector<std::string>& args) {
+        const std::string& name = op.command;
+        auto expect = [&](size_t count) {
+            return args.size() == count + 1;
+        };
+        auto use = [&](size_t index, bool write) {
+            op.paths.push_back(resolve(args[index]));
+            op.accesses.push_back(Access{ op.paths.back().string(), write });
+        };
+
+        if (name == "cd") {
+            if (!expect(1)) return "cd: нужен один путь";
+            use(1, false);
+            cwd = op.paths[0];
+        }
+        else if (name == "mkdir" || name == "touch" || name == "rm") {
+            if (!expect(1)) return name + ": нужен один путь";
+            use(1, true);
+        }
+        else if (name == "info") {
+            if (!expect(1)) return "info: нужен один путь";
+            use(1, false);
+        }
+        else if (name == "ls") {
+            if (args.size() > 2) return "ls: не больше одного пути";
+            op.paths.push_back(args.size() == 2 ? resolve(args[1]) : cwd);
+            op.accesses.push_back(Access{ op.paths.back().string(), false });
+        }
+        else if (name == "mv" || name == "rename") {
+            if (!expect(2)) return name + ": нужны источник и назначение";
+            use(1, true);
+            use(2, true);
+        }
+        else if (name == "cp") {
+            if (!expect(2)) return "cp: нужны источник и назначение";
+            use(1, false);
+            use(2, true);
+        }
+        else {
+            return "команда не поддерживается в пакетном режиме: " + name;
+        }
+        return {};
+    }
+
+    // Рёбра "кто кого ждёт": для каждого пути - последний писавший и читавшие после него.
+    // Предки пути находятся подъёмом по родителям, потомки - диапазоном в упорядоченной карте
+    void linkDependencies() {
+        std::map<std::string, PathState> states;
+        for (size_t i = 0; i < operations.size(); i++) {
+            Operation& op = operations[i];
+            auto conflict = [&](const PathState& state, bool write) {
+                if (state.lastWriter >= 0 && static_cast<size_t>(state.lastWriter) != i) {
+                    op.dependencies.push_back(static_cast<size_t>(state.lastWriter));
+                }
+                if (write) {
+                    for (size_t reader : state.readers) {
+                        if (reader != i) {
+                            op.dependencies.push_back(reader);
+                        }
+                    }
+                }
+            };
+            for (const Access& access : op.accesses) {
+                for (fs::path current(access.path);; current = current.parent_path()) {
+                    auto it = states.find(current.string());
+                    if (it != states.end()) {
+                        conflict(it->second, access.write);
+                    }
+                    if (!current.has_relative_path() || current.parent_path() == current) {
+                        break;
+                    }
+                }
+                std::string prefix = access.path;
+                if (prefix.back() != '/' && prefix.back() != '\\') {
+                    prefix += static_cast<char>(fs::path::preferred_separator);
+                }
+                for (auto it = states.lower_bound(prefix); it != states.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+                    conflict(it->second, access.write);
+                }
+            }
+            for (const Access& access : op.accesses) {
+                PathState& state = states[access.path];
+                if (access.write) {
+                    state.lastWriter = static_cast<int>(i);
+                    state.readers.clear();
+                }
+                else {
+                    state.readers.push_back(i);
+                }
+            }
+
+            std::sort(op.dependencies.begin(), op.dependencies.end());
+            op.dependencies.erase(std::unique(op.dependencies.begin(), op.dependencies.end()), op.dependencies.end());
+            op.remaining = op.dependencies.size();
+            for (size_t dependency : op.dependencies) {
+                operations[dependency].dependents.push_back(i);
+            }
+        }
+    }
+
+    void execute(size_t index, ThreadPool& pool) {
+        Operation& op = operations[index];
+        Status status;
+        std::string result;
+        if (size_t blocker = op.failedDependency.load()) {
+            status = Status::Skipped;
+            result = errorLine(op.line, op.command, "skipped", "зависит от строки " + std::to_string(blocker) + ", которая не выполнена");
+        }
+        else if (aborted.load()) {
+            status = Status::Skipped;
+            result = errorLine(op.line, op.command, "skipped", "выполнение остановлено после ошибки");
+        }
+        else {
+            try {
+                result = "{\"line\":" + std::to_string(op.line) + ",\"command\":" + jsonString(op.command)
+                    + ",\"ok\":true" + perform(op) + '}';
+                status = Status::Succeeded;
+            }
+            catch (const fs::filesystem_error& e) {
+                result = errorLine(op.line, op.command, codeFor(e.code()), e.what());
+                status = Status::Failed;
+            }
+            catch (const std::exception& e) {
+                result = errorLine(op.line, op.command, "failed", e.what());
+                status = Status::Failed;
+            }
+            if (status == Status::Failed && options.stopOnError) {
+                aborted = true;
+            }
+        }
+        publish(index, status, std::move(result));
+
+        // Зависимые от неудачной команды пропускаются со ссылкой на исходную ошибку
+        const size_t blocker = status == Status::Failed ? op.line : op.failedDependency.load();
+        for (size_t dependent : op.dependents) {
+            Operation& next = operations[dependent];
+            if (blocker) {
+                size_t expected = 0;
+                next.failedDependency.compare_exchange_strong(expected, blocker);
+            }
+            if (next.remaining.fetch_sub(1) == 1) {
+                pool.submit([this, dependent, &pool] { execute(dependent, pool); });
+            }
+        }
+    }
+
+    // Само действие; возвращает дополнительные поля JSON, начиная с запятой
+    std::string perform(const Operation& op) {
+        const std::string& name = op.command;
+        const fs::path& first = op.paths[0];
+        std::ostringstream fields;
+        if (name == "cd") {
+            if (!fs::is_directory(first)) {
+                throw fs::filesystem_error("Папка не существует", first, std::make_error_code(std::errc::no_such_file_or_directory));
+            }
+            fields << ",\"cwd\":" << jsonString(first.string());
+        }
+        else if (name == "mkdir") {
+            if (fs::exists(first)) {
+                throw fs::filesystem_error("Объект уже существует", first, std::make_error_code(std::errc::file_exists));
+            }
+            fs::create_directories(first);
+            fields << ",\"path\":" << jsonString(first.string());
+        }
+        else if (name == "touch") {
+            // В отличие от интерактивного touch, существующий файл не обрезается
+            std::ofstream file(first, std::ios::app);
+            if (!file.is_open()) {
+                throw fs::filesystem_error("Не удалось создать файл", first, std::error_code(errno, std::generic_category()));
+            }
+            fields << ",\"path\":" << jsonString(first.string());
+        }
+        else if (name == "rm") {
+            if (!fs::exists(fs::symlink_status(first))) {
+                throw fs::filesystem_error("Объект не существует", first, std::make_error_code(std::errc::no_such_file_or_directory));
+            }
+            DeleteEngine engine;
+            engine.remove(first);
+            DeleteProgress done = engine.progress();
+            fields << ",\"path\":" << jsonString(first.string()) << ",\"files\":" << done.files
+                << ",\"directories\":" << done.directories;
+        }
+        else if (name == "mv" || name == "rename") {
+            const fs::path& target = op.paths[1];
+            if (!fs::exists(fs::symlink_status(first))) {
+                throw fs::filesystem_error("Объект не существует", first, std::make_error_code(std::errc::no_such_file_or_directory));
+            }
+            if (name == "rename" && fs::exists(fs::symlink_status(target))) {
+                throw fs::filesystem_error("Объект уже существует", target, std::make_error_code(std::errc::file_exists));
+            }
+            fs::rename(first, target);
+            fields << ",\"from\":" << jsonString(first.string()) << ",\"to\":" << jsonString(target.string());
+        }
+        else if (name == "cp") {
+            fs::path target = op.paths[1];
+            if (!fs::exists(first)) {
+                throw fs::filesystem_error("Источник не существует", first, std::make_error_code(std::errc::no_such_file_or_directory));
+            }
+            CopyEngine engine;
+            if (fs::is_directory(first)) {
+                engine.copyTree(first, target);
+            }
+            else {
+                if (fs::is_directory(target)) {
+                    target /= first.filename();
+                }
+                engine.copyFile(first, target);
+            }
+            CopyProgress done = engine.progress();
+            fields << ",\"from\":" << jsonString(first.string()) << ",\"to\":" << jsonString(target.string())
+                << ",\"files\":" << done.files << ",\"bytes\":" << done.bytes;
+        }
+        else if (name == "info") {
+            fs::file_status status = fs::symlink_status(first);
+            if (!fs::exists(status)) {
+                throw fs::filesystem_error("Объект не существует", first, std::make_error_code(std::errc::no_such_file_or_directory));
+            }
+            const char* type = fs::is_symlink(status) ? "symlink" : fs::is_directory(status) ? "directory"
+                : fs::is_regular_file(status) ? "file" : "other";
+            fields << ",\"path\":" << jsonString(first.string()) << ",\"type\":\"" << type << '"';
+            if (fs::is_regular_file(status)) {
+                fields << ",\"size\":" << fs::file_size(first);
+            }
+            auto modified = std::chrono::time_point_cast<std::chrono::seconds>(
+                fs::last_write_time(first) - fs::file_time_type::clock::now() + std::chrono::system_clock::now());
+            fields << ",\"mtime\":" << modified.time_since_epoch().count();
+        }
+        else if (name == "ls") {
+            DirectoryListing listing;
+            listing.load(first, false);
+            fields << ",\"path\":" << jsonString(first.string()) << ",\"entries\":[";
+            const std::vector<uint32_t> order = listing.sortedOrder();
+            for (size_t i = 0; i < order.size(); i++) {
+                const uint32_t entry = order[i];
+                const char* type = listing.isSymlink(entry) ? "symlink"
+                    : listing.kind(entry) == DirectoryListing::Dir ? "directory" : "file";
+                fields << (i ? "," : "") << "{\"name\":" << jsonString(listing.name(entry)) << ",\"type\":\"" << type << "\"}";
+            }
+            fields << ']';
+        }
+        return fields.str();
+    }
+
+    static const char* codeFor(const std::error_code& code) {
+        if (code == std::errc::no_such_file_or_directory) return "not_found";
+        if (code == std::errc::file_exists || code == std::errc::directory_not_empty) return "exists";
+        if (code == std::errc::permission_denied || code == std::errc::operation_not_permitted) return "permission_denied";
+        if (code == std::errc::not_a_directory || code == std::errc::is_a_directory) return "wrong_type";
+        return "failed";
+    }
+
+    static std::string errorLine(size_t line, const std::string& command, const char* code, const std::string& message) {
+        return "{\"line\":" + std::to_string(line) + ",\"command\":" + jsonString(command)
+            + ",\"ok\":false,\"code\":\"" + code + "\",\"error\":" + jsonString(message) + '}';
+    }
+
+    // Результаты выдаются в порядке строк сценария, как только готово всё предыдущее
+    void publish(size_t index, Status status, std::string result) {
+        std::lock_guard<std::mutex> lock(orderMutex);
+        operations[index].status = status;
+        operations[index].result = std::move(result);
+        while (nextToEmit < operations.size() && operations[nextToEmit].status != Status::Pending) {
+            (*output)(operations[nextToEmit].result);
+            operations[nextToEmit].result.clear();
+            nextToEmit++;
+        }
+    }
+};
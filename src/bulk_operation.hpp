@@ -0,0 +1,546 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_set>
+#include <vector>
+
+#include "copy_engine.hpp"
+#include "delete_engine.hpp"
+#include "instrumentation.hpp"
+#include "job_control.hpp"
+#include "matcher.hpp"
+#include "thread_pool.hpp"
+#include "walker.hpp"
+
+#ifdef __linux__
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+enum class BulkAction {
+    Remove,  // rm: файлы и ссылки - unlinkat, папки - DeleteEngine
+    Move,    // mv: renameat в папку назначения, между файловыми системами - копия и удаление
+    Copy,    // cp: в папку назначения
+    Rename   // rename: новое имя по шаблону замены с группами $1..$9 в той же папке
+};
+
+struct BulkOptions {
+    MatchOptions match{ MatchMode::Glob };  // Regex - шаблон как регулярное выражение
+    unsigned threads = 0;                   // 0 - по числу ядер
+    size_t batchSize = 256;                 // элементов в одной задаче пула
+    JobControl* control = nullptr;          // отмена и лимит скорости фоновой задачи
+};
+
+struct BulkStats {
+    size_t matched = 0;      // элементов под шаблоном
+    size_t files = 0;        // обработано файлов и ссылок
+    size_t directories = 0;  // обработано папок (вместе с содержимым)
+    size_t skipped = 0;      // совпали, но не трогаются (например, сама папка назначения)
+    size_t errors = 0;
+    uintmax_t bytes = 0;     // скопировано байт (cp и mv между файловыми системами)
+    double seconds = 0;
+};
+
+// Групповые операции над элементами одной папки по шаблону (glob или регулярное выражение).
+// plan() раскрывает шаблон одним проходом по папке и заранее проверяет конфликты: занятые
+// имена в папке назначения, совпадающие новые имена, папку назначения внутри источника.
+// При любом конфликте не выполняется ничего. run() делит элементы на пачки и выполняет их
+// в пуле потоков *at-вызовами относительно открытых дескрипторов папок, а не полными путями.
+// Папки при rm и cp обрабатываются после файлов по одной: их движки сами параллельны.
+class BulkOperation {
+public:
+    explicit BulkOperation(BulkAction action, BulkOptions options = {}) : action(action), options(options) {}
+
+    // Есть ли в имени символы glob: иначе это одно имя, и шаблон не нужен
+    static bool isPattern(std::string_view text) {
+        return text.find_first_of("*?[") != std::string_view::npos;
+    }
+
+    // directory - текущая папка; pattern может начинаться с папки без символов шаблона (logs/*.gz).
+    // argument - папка назначения для mv и cp или шаблон нового имени для rename.
+    // false - выполнять нечего или есть конфликты, причины в problems()
+    bool plan(const fs::path& directory, const std::string& pattern, const std::string& argument = {}) {
+        const auto started = std::chrono::steady_clock::now();
+        items.clear();
+        problemList.clear();
+        problemCount = 0;
+        summary = BulkStats();
+
+        std::string namePattern = pattern;
+        sourceDir = directory;
+        const size_t slash = pattern.find_last_of('/');
+        if (slash != std::string::npos && options.match.mode == MatchMode::Glob) {
+            const std::string prefix = pattern.substr(0, slash);
+            if (isPattern(prefix)) {
+                problem("Символы шаблона допускаются только в имени, не в папке: " + pattern);
+                return false;
+            }
+            sourceDir = directory / (prefix.empty() ? "/" : prefix);
+            namePattern = pattern.substr(slash + 1);
+        }
+        sourceDir = sourceDir.lexically_normal();
+        if (!fs::is_directory(sourceDir)) {
+            problem("Папка не существует: " + sourceDir.string());
+            return false;
+        }
+
+        if (action == BulkAction::Move || action == BulkAction::Copy) {
+            destinationDir = (directory / argument).lexically_normal();
+            if (!fs::is_directory(destinationDir)) {
+                problem("Папка назначения не существует: " + argument);
+                return false;
+            }
+            if (fs::equivalent(sourceDir, destinationDir)) {
+                problem("Источник и назначение - одна папка: " + argument);
+                return false;
+            }
+        }
+        else {
+            destinationDir = sourceDir;
+        }
+
+        std::regex replace;
+        if (action == BulkAction::Rename) {
+            auto flags = std::regex::ECMAScript;
+            if (options.match.ignoreCase) {
+                flags |= std::regex::icase;
+            }
+            replace = std::regex(options.match.mode == MatchMode::Glob ? globToRegex(namePattern) : namePattern, flags);
+        }
+
+        // Один проход по папке: совпавшие элементы, а для rename ещё и все занятые имена
+        const Matcher matcher(namePattern, options.match);
+        const bool hiddenAllowed = options.match.mode != MatchMode::Glob || (!namePattern.empty() && namePattern[0] == '.');
+        std::unordered_set<std::string> taken;
+        WalkOptions walkOptions;
+        walkOptions.threads = 1;
+        walkOptions.maxDepth = 1;
+        walkOptions.stopOnError = true;
+        walkOptions.batchSize = 4096;
+        ParallelWalker walker(walkOptions);
+        walker.walk(sourceDir, [&](const WalkDir& dir, std::vector<WalkEntry>& entries) {
+            for (const auto& entry : entries) {
+                const std::string_view name = entry.name();
+                if (action == BulkAction::Rename) {
+                    taken.emplace(name);
+                }
+                if ((name[0] == '.' && !hiddenAllowed) || !matcher.matches(name)) {
+                    continue;
+                }
+                items.push_back(Item{ std::string(name), std::string(), resolveType(dir, entry) });
+            }
+            });
+        summary.matched = items.size();
+        std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+            return a.name < b.name;
+            });
+
+        switch (action) {
+        case BulkAction::Move:
+        case BulkAction::Copy:
+            checkDestination();
+            break;
+        case BulkAction::Rename:
+            checkRenames(replace, argument, taken);
+            break;
+        case BulkAction::Remove:
+            break;
+        }
+        summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return problemCount == 0 && !items.empty();
+    }
+
+    void run() {
+        const auto started = std::chrono::steady_clock::now();
+        if (options.control) {
+            options.control->setTotals(items.size(), 0);
+        }
+        CopyOptions copyOptions;
+        copyOptions.control = options.control;
+        CopyEngine copier(copyOptions);
+        DirFd source(sourceDir);
+        DirFd destination(destinationDir);
+
+        // Файлы и ссылки - пачками в пуле; папки при rm и cp - по одной, их движки параллельны сами
+        std::vector<const Item*> files;
+        std::vector<const Item*> directories;
+        for (const auto& item : items) {
+            const bool serial = item.type == EntryType::Directory
+                && (action == BulkAction::Remove || action == BulkAction::Copy);
+            (serial ? directories : files).push_back(&item);
+        }
+        {
+            ThreadPool pool(options.threads);
+            for (size_t begin = 0; begin < files.size(); begin += options.batchSize) {
+                const size_t end = std::min(files.size(), begin + options.batchSize);
+                pool.submit([&, begin, end] {
+                    for (size_t i = begin; i < end; i++) {
+                        process(*files[i], source.get(), destination.get(), copier);
+                    }
+                    });
+                if (pool.failed()) {
+                    break;
+                }
+            }
+            pool.wait();
+        }
+        for (const Item* item : directories) {
+            process(*item, source.get(), destination.get(), copier);
+        }
+
+        summary.files = filesDone.load(std::memory_order_relaxed);
+        summary.directories = directoriesDone.load(std::memory_order_relaxed);
+        summary.errors = errorCount.load(std::memory_order_relaxed);
+        summary.bytes = copier.progress().bytes;
+        summary.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    }
+
+    size_t size() const {
+        return items.size();
+    }
+
+    BulkStats stats() const {
+        return summary;
+    }
+
+    // Первые MaxMessages конфликтов, найденных plan(); всего - problemsFound()
+    const std::vector<std::string>& problems() const {
+        return problemList;
+    }
+
+    size_t problemsFound() const {
+        return problemCount;
+    }
+
+    // Первые MaxMessages ошибок выполнения
+    std::vector<std::string> errors() const {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        return errorMessages;
+    }
+
+private:
+    static constexpr size_t MaxMessages = 20;
+
+    struct Item {
+        std::string name;
+        std::string target;  // новое имя при rename, иначе пусто - то же имя в папке назначения
+        EntryType type;
+    };
+
+    // Дескриптор открытой папки для *at-вызовов; -1 без Linux
+    class DirFd {
+    public:
+        explicit DirFd(const fs::path& path) {
+#ifdef __linux__
+            fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0) {
+                throw fs::filesystem_error("Не удалось открыть папку", path, std::error_code(errno, std::generic_category()));
+            }
+#else
+            (void)path;
+#endif
+        }
+
+        DirFd(const DirFd&) = delete;
+        DirFd& operator=(const DirFd&) = delete;
+
+        ~DirFd() {
+#ifdef __linux__
+            if (fd >= 0) {
+                ::close(fd);
+            }
+#endif
+        }
+
+        int get() const {
+            return fd;
+        }
+
+    private:
+        int fd = -1;
+    };
+
+    BulkAction action;
+    BulkOptions options;
+    fs::path sourceDir;
+    fs::path destinationDir;
+    std::vector<Item> items;
+    std::vector<std::string> problemList;
+    size_t problemCount = 0;
+    BulkStats summary;
+    std::atomic<size_t> filesDone{ 0 };
+    std::atomic<size_t> directoriesDone{ 0 };
+    std::atomic<size_t> errorCount{ 0 };
+    mutable std::mutex errorMutex;
+    std::vector<std::string> errorMessages;
+
+    void problem(const std::string& what) {
+        if (problemList.size() < MaxMessages) {
+            problemList.push_back(what);
+        }
+        problemCount++;
+    }
+
+    void failed(const std::string& what) {
+        errorCount.fetch_add(1, std::memory_order_relaxed);
+        FM_COUNT(Errors, 1);
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (errorMessages.size() < MaxMessages) {
+            errorMessages.push_back(what);
+        }
+    }
+
+    // Тип из d_type; если файловая система его не сообщает - lstat относительно папки
+    static EntryType resolveType(const WalkDir& dir, const WalkEntry& entry) {
+        if (entry.type != EntryType::Unknown) {
+            return entry.type;
+        }
+#ifdef __linux__
+        struct stat st;
+        const int code = dir.fd >= 0
+            ? ::fstatat(dir.fd, entry.cName(), &st, AT_SYMLINK_NOFOLLOW)
+            : ::lstat(entry.path().c_str(), &st);
+        if (code != 0) {
+            return EntryType::Unknown;
+        }
+        return S_ISDIR(st.st_mode) ? EntryType::Directory
+            : S_ISLNK(st.st_mode) ? EntryType::Symlink
+            : S_ISREG(st.st_mode) ? EntryType::File : EntryType::Other;
+#else
+        (void)dir;
+        const fs::file_status status = fs::symlink_status(entry.path());
+        return fs::is_directory(status) ? EntryType::Directory
+            : fs::is_symlink(status) ? EntryType::Symlink
+            : fs::is_regular_file(status) ? EntryType::File : EntryType::Other;
+#endif
+    }
+
+    // glob имени в регулярное выражение целиком; каждый * ? и [...] - своя группа для $1..$9
+    static std::string globToRegex(const std::string& glob) {
+        std::string result = "^";
+        for (size_t i = 0; i < glob.size(); i++) {
+            const char c = glob[i];
+            if (c == '*') {
+                while (i + 1 < glob.size() && glob[i + 1] == '*') {
+                    i++;
+                }
+                result += "(.*)";
+            }
+            else if (c == '?') {
+                result += "(.)";
+            }
+            else if (c == '[' && glob.find(']', i + 2) != std::string::npos) {
+                size_t j = i + 1;
+                result += "([";
+                if (glob[j] == '!' || glob[j] == '^') {
+                    result += '^';
+                    j++;
+                }
+                for (bool firstInClass = true; j < glob.size() && (glob[j] != ']' || firstInClass); j++) {
+                    firstInClass = false;
+                    if (glob[j] == '\\' || glob[j] == ']' || glob[j] == '[') {
+                        result += '\\';
+                    }
+                    result += glob[j];
+                }
+                result += "])";
+                i = j;
+            }
+            else {
+                const char literal = c == '\\' && i + 1 < glob.size() ? glob[++i] : c;
+                if (std::string_view("\\^$.|+()[]{}*?").find(literal) != std::string_view::npos) {
+                    result += '\\';
+                }
+                result += literal;
+            }
+        }
+        return result + "$";
+    }
+
+    // mv и cp: имена в папке назначения должны быть свободны, сама папка назначения
+    // и папки, внутри которых она лежит, не переносятся
+    void checkDestination() {
+        std::unordered_set<std::string> occupied;
+        WalkOptions walkOptions;
+        walkOptions.threads = 1;
+        walkOptions.maxDepth = 1;
+        walkOptions.stopOnError = true;
+        walkOptions.batchSize = 4096;
+        ParallelWalker walker(walkOptions);
+        walker.walk(destinationDir, [&occupied](const WalkDir&, std::vector<WalkEntry>& entries) {
+            for (const auto& entry : entries) {
+                occupied.emplace(entry.name());
+            }
+            });
+
+        const fs::path relative = destinationDir.lexically_relative(sourceDir);
+        const std::string container = !relative.empty() && *relative.begin() != ".."
+            ? relative.begin()->string() : std::string();
+        std::vector<Item> kept;
+        kept.reserve(items.size());
+        for (auto& item : items) {
+            if (item.name == container) {
+                // mv * archive/: папка назначения попадает под шаблон, её саму не трогаем
+                summary.skipped++;
+                continue;
+            }
+            if (occupied.count(item.name)) {
+                problem("Уже существует в папке назначения: " + item.name);
+            }
+            kept.push_back(std::move(item));
+        }
+        items.swap(kept);
+    }
+
+    // rename: новое имя по шаблону format ($0 - всё совпадение, $1..$9 - группы); не должно
+    // совпадать с существующим или с новым именем другого элемента
+    void checkRenames(const std::regex& replace, const std::string& format, const std::unordered_set<std::string>& taken) {
+        std::unordered_set<std::string> targets;
+        std::vector<Item> kept;
+        kept.reserve(items.size());
+        for (auto& item : items) {
+            item.target = std::regex_replace(item.name, replace, format,
+                std::regex_constants::format_first_only);
+            if (item.target == item.name) {
+                summary.skipped++;
+                continue;
+            }
+            if (item.target.empty() || item.target == "." || item.target == ".."
+                || item.target.find('/') != std::string::npos) {
+                problem("Недопустимое новое имя: " + item.name + " -> " + item.target);
+            }
+            else if (taken.count(item.target)) {
+                problem("Имя уже занято: " + item.name + " -> " + item.target);
+            }
+            else if (!targets.insert(item.target).second) {
+                problem("Новое имя уже получил другой элемент: " + item.name + " -> " + item.target);
+            }
+            kept.push_back(std::move(item));
+        }
+        items.swap(kept);
+    }
+
+    void process(const Item& item, int sourceFd, int destinationFd, CopyEngine& copier) {
+        if (options.control) {
+            options.control->checkpoint(1, 0);
+        }
+        const bool directory = item.type == EntryType::Directory;
+        const std::string& target = item.target.empty() ? item.name : item.target;
+        try {
+            switch (action) {
+            case BulkAction::Remove:
+                if (directory) {
+                    DeleteOptions deleteOptions;
+                    deleteOptions.control = options.control;
+                    DeleteEngine(deleteOptions).remove(sourceDir / item.name);
+                }
+                else {
+                    unlinkOne(sourceFd, item.name);
+                }
+                break;
+            case BulkAction::Copy:
+                copyOne(item, destinationDir / target, copier);
+                break;
+            case BulkAction::Move:
+                if (!renameOne(sourceFd, item.name, destinationFd, target)) {
+                    // Другая файловая система: копия, затем удаление источника
+                    copyOne(item, destinationDir / target, copier);
+                    DeleteOptions deleteOptions;
+                    deleteOptions.control = options.control;
+                    DeleteEngine(deleteOptions).remove(sourceDir / item.name);
+                }
+                break;
+            case BulkAction::Rename:
+                renameOne(sourceFd, item.name, sourceFd, target);
+                break;
+            }
+            (directory ? directoriesDone : filesDone).fetch_add(1, std::memory_order_relaxed);
+        }
+        catch (const OperationCancelled&) {
+            throw;
+        }
+        catch (const std::exception& e) {
+            failed(item.name + ": " + e.what());
+        }
+    }
+
+    void unlinkOne(int dirFd, const std::string& name) {
+        FM_SCOPE(Io, "unlink");
+        FM_COUNT(Syscalls, 1);
+#ifdef __linux__
+        if (::unlinkat(dirFd, name.c_str(), 0) != 0 && errno != ENOENT) {
+            throw fs::filesystem_error("Не удалось удалить", sourceDir / name, std::error_code(errno, std::generic_category()));
+        }
+#else
+        (void)dirFd;
+        fs::remove(sourceDir / name);
+#endif
+    }
+
+    // Переименование без замены существующего: проверка в plan() не защищает от имени,
+    // появившегося позже. false - источник и назначение на разных файловых системах
+    bool renameOne(int fromFd, const std::string& from, int toFd, const std::string& to) {
+        FM_SCOPE(Io, "rename");
+        FM_COUNT(Syscalls, 1);
+#ifdef __linux__
+#if defined(RENAME_NOREPLACE) && defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 28)
+        int code = ::renameat2(fromFd, from.c_str(), toFd, to.c_str(), RENAME_NOREPLACE);
+        if (code != 0 && errno == EINVAL) {
+            // Файловая система без RENAME_NOREPLACE
+            code = ::renameat(fromFd, from.c_str(), toFd, to.c_str());
+        }
+#else
+        const int code = ::renameat(fromFd, from.c_str(), toFd, to.c_str());
+#endif
+        if (code == 0) {
+            return true;
+        }
+        if (errno == EXDEV) {
+            return false;
+        }
+        throw fs::filesystem_error("Не удалось переместить", sourceDir / from, destinationDir / to,
+            std::error_code(errno, std::generic_category()));
+#else
+        (void)fromFd;
+        (void)toFd;
+        std::error_code error;
+        fs::rename(sourceDir / from, destinationDir / to, error);
+        if (error == std::errc::cross_device_link) {
+            return false;
+        }
+        if (error) {
+            throw fs::filesystem_error("Не удалось переместить", sourceDir / from, destinationDir / to, error);
+        }
+        return true;
+#endif
+    }
+
+    void copyOne(const Item& item, const fs::path& destination, CopyEngine& copier) {
+        const fs::path source = sourceDir / item.name;
+        switch (item.type) {
+        case EntryType::Directory:
+            copier.copyTree(source, destination);
+            break;
+        case EntryType::Symlink:
+            fs::copy_symlink(source, destination);
+            break;
+        default:
+            copier.copyEntry(source, destination);
+            break;
+        }
+    }
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Разбор командной строки на аргументы по правилам, близким к sh:
+// пробелы разделяют аргументы, '...' берётся буквально, в "..." экранируются только \" и \\,
+// вне кавычек \ экранирует пробел, кавычку или \ (остальные \ остаются как есть, чтобы
+// не ломать пути Windows вида C:\Users). "" даёт пустой аргумент.
+inline std::vector<std::string> splitCommandLine(std::string_view line) {
+    std::vector<std::string> args;
+    std::string current;
+    bool inToken = false;
+    char quote = 0;
+    for (size_t i = 0; i < line.size(); i++) {
+        const char c = line[i];
+        if (quote) {
+            if (c == quote) {
+                quote = 0;
+            }
+            else if (quote == '"' && c == '\\' && i + 1 < line.size() && (line[i + 1] == '"' || line[i + 1] == '\\')) {
+                current += line[++i];
+            }
+            else {
+                current += c;
+            }
+        }
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            if (inToken) {
+                args.push_back(std::move(current));
+                current.clear();
+                inToken = false;
+            }
+        }
+        else if (c == '\'' || c == '"') {
+            quote = c;
+            inToken = true;
+        }
+        else if (c == '\\' && i + 1 < line.size() && std::string_view(" \t'\"\\").find(line[i + 1]) != std::string_view::npos) {
+            current += line[++i];
+            inToken = true;
+        }
+        else {
+            current += c;
+            inToken = true;
+        }
+    }
+    if (quote) {
+        throw std::invalid_argument(std::string("незакрытая кавычка ") + quote);
+    }
+    if (inToken) {
+        args.push_back(std::move(current));
+    }
+    return args;
+}
+
+// Аргументы начиная с first через пробел: путь из нескольких слов без кавычек
+inline std::string joinArguments(const std::vector<std::string>& args, size_t first) {
+    std::string result;
+    for (size_t i = first; i < args.size(); i++) {
+        if (i > first) {
+            result += ' ';
+        }
+        result += args[i];
+    }
+    return result;
+}
+
+// Строка в кавычках для JSON в конец out; байты UTF-8 передаются как есть.
+// Участки без спецсимволов копируются целиком
+inline void appendJsonString(std::string& out, std::string_view text) {
+    out += '"';
+    size_t plain = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        const unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.append(text.data() + plain, i - plain);
+        plain = i + 1;
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default: {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        }
+        }
+    }
+    out.append(text.data() + plain, text.size() - plain);
+    out += '"';
+}
+
+inline std::string jsonString(std::string_view text) {
+    std::string result;
+    result.reserve(text.size() + 2);
+    appendJsonString(result, text);
+    return result;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <clocale>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "command_line.hpp"
+#include "instrumentation.hpp"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Формат записей-результатов (путей) у search и find
+enum class OutputFormat {
+    Plain,  // путь и перевод строки
+    Json,   // {"path":"..."} построчно
+    Nul     // путь и '\0', как find -print0: годится для xargs -0 и имён с переводом строки
+};
+
+// Настройки консоли процесса. Локаль ставится один раз при запуске, а не в каждой команде:
+// setlocale берёт глобальную блокировку и перечитывает данные локали.
+// cout отвязывается от stdio, чтобы каждая запись не шла через синхронизированный буфер C.
+class Console {
+public:
+    static void init() {
+        std::setlocale(LC_ALL, "ru");
+        std::ios::sync_with_stdio(false);
+#ifdef _WIN32
+        terminal() = ::_isatty(::_fileno(stdout)) != 0;
+#else
+        terminal() = ::isatty(STDOUT_FILENO) != 0;
+#endif
+    }
+
+    // stdout - терминал: можно выводить заголовки, итоги и строку прогресса.
+    // При выводе в канал или файл остаются только сами результаты
+    static bool interactive() {
+        return terminal();
+    }
+
+private:
+    static bool& terminal() {
+        static bool value = true;
+        return value;
+    }
+};
+
+// Буферизованный вывод результатов из нескольких потоков. Рабочий поток собирает
+// записи своей пачки в локальную строку (append) и отдаёт её целиком (write):
+// мьютекс берётся раз на пачку, а в поток уходят блоки по capacity байт.
+// Записи разных потоков не перемешиваются. Остаток выводится в flush или деструкторе.
+class OutputWriter {
+public:
+    explicit OutputWriter(std::ostream& out, OutputFormat format = OutputFormat::Plain, size_t capacity = 256 << 10)
+        : out(out), format(format), capacity(capacity) {
+        buffer.reserve(capacity);
+    }
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    ~OutputWriter() {
+        flush();
+    }
+
+    OutputFormat outputFormat() const {
+        return format;
+    }
+
+    // Одна запись в формате вывода в конец block (без блокировок)
+    void append(std::string& block, std::string_view path) const {
+        switch (format) {
+        case OutputFormat::Plain:
+            block.append(path.data(), path.size());
+            block += '\n';
+            break;
+        case OutputFormat::Nul:
+            block.append(path.data(), path.size());
+            block += '\0';
+            break;
+        case OutputFormat::Json:
+            block += "{\"path\":";
+            appendJsonString(block, path);
+            block += "}\n";
+            break;
+        }
+    }
+
+    // Пачка готовых записей; block очищается
+    void write(std::string& block, size_t records) {
+        if (block.empty()) {
+            return;
+        }
+        count.fetch_add(records, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (buffer.size() + block.size() > capacity) {
+            drain();
+            if (block.size() >= capacity) {
+                FM_SCOPE(Output, "console");
+                out.write(block.data(), static_cast<std::streamsize>(block.size()));
+                block.clear();
+                return;
+            }
+        }
+        buffer += block;
+        block.clear();
+    }
+
+    void record(std::string_view path) {
+        std::string block;
+        append(block, path);
+        write(block, 1);
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> lock(mutex);
+        drain();
+        out.flush();
+    }
+
+    uint64_t records() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::ostream& out;
+    OutputFormat format;
+    size_t capacity;
+    std::mutex mutex;
+    std::string buffer;
+    std::atomic<uint64_t> count{ 0 };
+
+    void drain() {
+        if (!buffer.empty()) {
+            FM_SCOPE(Output, "console");
+            out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+    }
+};
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "file_view.hpp"
+#include "instrumentation.hpp"
+#include "matcher.hpp"
+#include "thread_pool.hpp"
+#include "walker.hpp"
+
+namespace fs = std::filesystem;
+
+struct GrepOptions {
+    bool filesOnly = false;                 // -l: только имена файлов, чтение до первого совпадения
+    MatchOptions match;                     // подстрока/регулярное выражение, -i
+    uintmax_t mmapThreshold = 256 * 1024;   // файлы меньше читаются в буфер потока
+    size_t maxLineLength = 512;             // длинные строки обрезаются при выводе
+    unsigned threads = 0;
+};
+
+struct GrepStats {
+    uintmax_t filesScanned = 0;
+    uintmax_t filesMatched = 0;
+    uintmax_t matches = 0;
+    uintmax_t bytesScanned = 0;
+    uintmax_t binaryFiles = 0;
+    uintmax_t errors = 0;
+};
+
+// Параллельный поиск по содержимому файлов дерева.
+// Файлы нумеруются в порядке обнаружения и сканируются пулом потоков; результат каждого
+// файла собирается целиком и отдаётся в порядке номеров, поэтому вывод не перемешивается.
+// Точная подстрока сначала ищется по всему буферу SIMD-поиском Matcher, строки
+// выделяются только вокруг найденных вхождений.
+class ContentSearch {
+public:
+    using Output = std::function<void(const std::string&)>;
+
+    ContentSearch(const std::string& pattern, GrepOptions options)
+        : options(options), matcher(pattern, options.match) {}
+
+    GrepStats run(const fs::path& root, const Output& output) {
+        emit = &output;
+        nextSequence = 0;
+        nextToEmit = 0;
+        ready.clear();
+
+        ThreadPool pool(options.threads, 256);
+        ParallelWalker walker;
+        try {
+            walker.walk(root, [&](const WalkDir&, std::vector<WalkEntry>& entries) {
+                for (const auto& entry : entries) {
+                    if (entry.type != EntryType::File && entry.type != EntryType::Unknown) {
+                        continue;
+                    }
+                    uint64_t sequence = nextSequence.fetch_add(1);
+                    pool.submit([this, sequence, path = entry.path()] {
+                        std::string result;
+                        scanFile(path, result);
+                        publish(sequence, std::move(result));
+                        });
+                }
+                });
+        }
+        catch (...) {
+            pool.wait();
+            throw;
+        }
+        pool.wait();
+
+        GrepStats result;
+        result.filesScanned = filesScanned.load();
+        result.filesMatched = filesMatched.load();
+        result.matches = matchCount.load();
+        result.bytesScanned = bytesScanned.load();
+        result.binaryFiles = binaryFiles.load();
+        result.errors = errors.load();
+        return result;
+    }
+
+private:
+    GrepOptions options;
+    Matcher matcher;
+    const Output* emit = nullptr;
+    std::atomic<uint64_t> nextSequence{ 0 };
+    std::atomic<uintmax_t> filesScanned{ 0 };
+    std::atomic<uintmax_t> filesMatched{ 0 };
+    std::atomic<uintmax_t> matchCount{ 0 };
+    std::atomic<uintmax_t> bytesScanned{ 0 };
+    std::atomic<uintmax_t> binaryFiles{ 0 };
+    std::atomic<uintmax_t> errors{ 0 };
+
+    std::mutex orderMutex;
+    uint64_t nextToEmit = 0;
+    std::map<uint64_t, std::string> ready;
+
+    // Результат отдаётся, когда готовы все файлы с меньшими номерами
+    void publish(uint64_t sequence, std::string result) {
+        std::lock_guard<std::mutex> lock(orderMutex);
+        if (sequence != nextToEmit) {
+            ready.emplace(sequence, std::move(result));
+            return;
+        }
+        if (!result.empty()) {
+            (*emit)(result);
+        }
+        nextToEmit++;
+        for (auto it = ready.begin(); it != ready.end() && it->first == nextToEmit; it = ready.erase(it)) {
+            if (!it->second.empty()) {
+                (*emit)(it->second);
+            }
+            nextToEmit++;
+        }
+    }
+
+    void scanFile(const std::string& path, std::string& result) {
+        FM_SCOPE(Io, "scan file");
+        try {
+            FileView view(path);
+            filesScanned.fetch_add(1, std::memory_order_relaxed);
+
+            std::string_view data;
+            if (view.hasSize() && view.size() >= options.mmapThreshold && view.mapped()) {
+                data = view.range(0, static_cast<size_t>(view.size()));
+            }
+            else if (!view.hasSize() || view.size() < options.mmapThreshold) {
+                // Мелкие файлы читаются в буфер, который поток переиспользует
+                thread_local std::string buffer;
+                buffer.clear();
+                view.forEachChunk([](std::string_view chunk) {
+                    buffer.append(chunk.data(), chunk.size());
+                    return true;
+                    });
+                data = buffer;
+            }
+            else {
+                scanLines(view, path, result);
+                return;
+            }
+
+            bytesScanned.fetch_add(data.size(), std::memory_order_relaxed);
+            scanBuffer(data, path, result);
+        }
+        catch (const std::exception&) {
+            errors.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Двоичным считается файл с нулевым байтом в первых 8 КБ
+    static bool looksBinary(std::string_view data) {
+        return std::memchr(data.data(), '\0', std::min<size_t>(data.size(), 8192)) != nullptr;
+    }
+
+    void appendLine(std::string& result, const std::string& path, uintmax_t lineNumber, std::string_view line) {
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        result += path;
+        result += ':';
+        result += std::to_string(lineNumber);
+        result += ':';
+        if (line.size() > options.maxLineLength) {
+            result.append(line.data(), options.maxLineLength);
+            result += "...";
+        }
+        else {
+            result.append(line.data(), line.size());
+        }
+        result += '\n';
+    }
+
+    // Возвращает false, если файл дальше можно не читать
+    bool found(std::string& result, const std::string& path, uintmax_t lineNumber, std::string_view line, bool binary, bool first) {
+        matchCount.fetch_add(1, std::memory_order_relaxed);
+        if (first) {
+            filesMatched.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (options.filesOnly) {
+            result = path + '\n';
+            return false;
+        }
+        if (binary) {
+            result = "Двоичный файл " + path + " совпадает\n";
+            return false;
+        }
+        appendLine(result, path, lineNumber, line);
+        return true;
+    }
+
+    void scanBuffer(std::string_view data, const std::string& path, std::string& result) {
+        const bool binary = looksBinary(data);
+        if (binary) {
+            binaryFiles.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (matcher.mode() == MatchMode::Substring) {
+            // Строки считаются только до найденного вхождения
+            uintmax_t lineNumber = 1;
+            size_t counted = 0;
+            size_t from = 0;
+            bool first = true;
+            while (from < data.size()) {
+                size_t hit = matcher.find(data.substr(from));
+                if (hit == std::string_view::npos) {
+                    return;
+                }
+                hit += from;
+                lineNumber += static_cast<uintmax_t>(std::count(data.begin() + counted, data.begin() + hit, '\n'));
+                size_t lineStart = data.rfind('\n', hit);
+                lineStart = lineStart == std::string_view::npos ? 0 : lineStart + 1;
+                size_t lineEnd = data.find('\n', hit);
+                if (lineEnd == std::string_view::npos) {
+                    lineEnd = data.size();
+                }
+                if (!found(result, path, lineNumber, data.substr(lineStart, lineEnd - lineStart), binary, first)) {
+                    return;
+                }
+                first = false;
+                counted = hit;
+                from = lineEnd + 1;
+            }
+            return;
+        }
+
+        uintmax_t lineNumber = 0;
+        bool first = true;
+        while (!data.empty()) {
+            size_t end = data.find('\n');
+            std::string_view line = data.substr(0, end);
+            lineNumber++;
+            if (matcher.matches(line)) {
+                if (!found(result, path, lineNumber, line, binary, first)) {
+                    return;
+                }
+                first = false;
+            }
+            if (end == std::string_view::npos) {
+                break;
+            }
+            data.remove_prefix(end + 1);
+        }
+    }
+
+    // Большие файлы без отображения в память: построчно порциями
+    void scanLines(FileView& view, const std::string& path, std::string& result) {
+        uintmax_t lineNumber = 0;
+        bool first = true;
+        bool checked = false;
+        bool binary = false;
+        view.forEachLine([&](std::string_view line) {
+            if (!checked) {
+                checked = true;
+                binary = looksBinary(line);
+                if (binary) {
+                    binaryFiles.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            lineNumber++;
+            bytesScanned.fetch_add(line.size() + 1, std::memory_order_relaxed);
+            if (!matcher.matches(line)) {
+                return true;
+            }
+            bool more = found(result, path, lineNumber, line, binary, first);
+            first = false;
+            return more;
+            });
+    }
+};
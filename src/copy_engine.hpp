@@ -0,0 +1,808 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "instrumentation.hpp"
+#include "io_ring.hpp"
+#include "job_control.hpp"
+#include "progress.hpp"
+#include "thread_pool.hpp"
+#include "walker.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Способы копирования в порядке предпочтения
+enum class CopyMethod {
+    Reflink,        // FICLONE: общий экстент, данные не копируются
+    CopyFileRange,  // copy_file_range: копирование внутри ядра
+    Sendfile,       // sendfile: ядро, но через page cache
+    ReadWrite,      // pread/pwrite через выровненный буфер
+    Portable,       // fs::copy_file на платформах без системных вызовов Linux
+    IoUring,        // пачка мелких файлов конвейером io_uring
+    Count
+};
+
+inline const char* copyMethodName(CopyMethod method) {
+    switch (method) {
+    case CopyMethod::Reflink: return "reflink";
+    case CopyMethod::CopyFileRange: return "copy_file_range";
+    case CopyMethod::Sendfile: return "sendfile";
+    case CopyMethod::ReadWrite: return "read/write";
+    case CopyMethod::Portable: return "fs::copy_file";
+    case CopyMethod::IoUring: return "io_uring";
+    default: return "?";
+    }
+}
+
+struct CopyProgress {
+    uintmax_t bytes = 0;
+    uintmax_t files = 0;
+    double seconds = 0;
+
+    double bytesPerSecond() const {
+        return seconds > 0 ? bytes / seconds : 0;
+    }
+};
+
+struct CopyOptions {
+    unsigned jobs = 0;                             // одновременных файловых задач, 0 - по числу ядер
+    CopyMethod firstMethod = CopyMethod::Reflink;  // с какого способа начинать цепочку
+    size_t bufferSize = 1 << 20;                   // буфер для read/write
+    uintmax_t splitThreshold = 256ull << 20;       // файлы больше делятся на диапазоны
+    uintmax_t rangeSize = 64ull << 20;             // размер одного диапазона
+    bool useIoUring = true;                        // мелкие файлы дерева копировать пачками через io_uring
+    uintmax_t smallFileLimit = 1 << 20;            // файлы не больше идут в пачку целиком
+    size_t batchBytes = 16 << 20;                  // память под данные одной серии чтений
+    std::chrono::milliseconds progressInterval{ 500 };
+    std::function<void(const CopyProgress&)> onProgress;
+    JobControl* control = nullptr;                 // отмена и лимит скорости фоновой задачи
+};
+
+// Движок копирования: перебирает reflink -> copy_file_range -> sendfile -> read/write,
+// большие файлы копирует параллельными диапазонами, деревья - ограниченным пулом задач.
+// Если доступен io_uring, мелкие файлы дерева копируются пачками: statx, open, read, write
+// и close каждой пачки уходят в кольцо сериями, а не по одному блокирующему вызову
+class CopyEngine {
+public:
+    explicit CopyEngine(CopyOptions options = {}) : options(options) {
+        if (this->options.jobs == 0) {
+            this->options.jobs = std::max(1u, std::thread::hardware_concurrency());
+        }
+#ifdef FM_HAVE_IO_URING
+        // umask нельзя прочитать, не изменив; делается один раз, до запуска рабочих потоков
+        creationMask = ::umask(0);
+        ::umask(creationMask);
+#endif
+    }
+
+    CopyMethod copyFile(const fs::path& source, const fs::path& destination) {
+        ProgressTicker ticker(options.progressInterval, startProgress());
+        return copyOne(source, destination);
+    }
+
+    // Один файл без своего отсчёта времени и прогресса: для движков, которые копируют
+    // файлы по одному и ведут учёт сами
+    CopyMethod copyEntry(const fs::path& source, const fs::path& destination) {
+        return copyOne(source, destination);
+    }
+
+    // Запись данных из памяти, а не из другого файла (распаковка архива). createFile создаёт
+    // пустой файл (O_EXCL) с правами mode, writeAt пишет кусок по смещению; куски одного файла
+    // можно писать из разных потоков. Байты учитываются в прогрессе, отмене и лимите скорости
+    void createFile(const fs::path& destination, unsigned mode) {
+        createOne(destination, mode);
+        finished(CopyMethod::ReadWrite);
+    }
+
+    void writeAt(const fs::path& destination, std::string_view data, uintmax_t offset) {
+        FM_SCOPE(Io, "write data");
+        writeOne(destination, data, offset);
+        moved(data.size());
+    }
+
+    // Рекурсивное копирование: папки создаёт обходчик, файлы уходят в пул
+    void copyTree(const fs::path& source, const fs::path& destination) {
+        ProgressTicker ticker(options.progressInterval, startProgress());
+        fs::create_directory(destination, source);
+        // Обходчик отрезает у корня завершающий разделитель ("src/" -> "src"): длина корня
+        // считается без завершающих разделителей, а ведущие у остатка пути отбрасываются
+        std::string root = source.string();
+        while (root.size() > 1 && (root.back() == '/' || root.back() == '\\')) {
+            root.pop_back();
+        }
+        const size_t prefixLength = root.size();
+
+        ThreadPool pool(options.jobs, options.jobs * 64);
+        WalkOptions walkOptions;
+        walkOptions.threads = options.jobs;
+        walkOptions.stopOnError = true;
+        walkOptions.control = options.control;
+        ParallelWalker walker(walkOptions);
+        const bool batched = options.useIoUring && IoRing::enabled() && IoRing::supported();
+
+        try {
+            walker.walk(source, [&](const WalkDir&, std::vector<WalkEntry>& entries) {
+                if (pool.failed()) {
+                    walker.requestStop();
+                    return;
+                }
+                std::vector<std::pair<std::string, std::string>> files;
+                for (const auto& entry : entries) {
+                    std::string from = entry.path();
+                    const fs::path target = destination / relativeTo(from, prefixLength);
+                    switch (entry.type) {
+                    case EntryType::Directory:
+                        fs::create_directory(target, from);
+                        break;
+                    case EntryType::Symlink:
+                        fs::copy_symlink(from, target);
+                        break;
+                    default:
+                        if (batched) {
+                            files.emplace_back(std::move(from), target.string());
+                            break;
+                        }
+                        pool.submit([this, from = std::move(from), to = std::move(target)] {
+                            copyOne(from, to);
+                            });
+                        break;
+                    }
+                }
+                if (!files.empty()) {
+                    pool.submit([this, files = std::move(files)] {
+                        copyBatch(files);
+                        });
+                }
+                });
+        }
+        catch (...) {
+            try {
+                pool.wait();
+            }
+            catch (...) {
+            }
+            throw;
+        }
+        pool.wait();
+    }
+
+    CopyProgress progress() const {
+        CopyProgress snapshot;
+        snapshot.bytes = bytesCopied.load(std::memory_order_relaxed);
+        snapshot.files = filesCopied.load(std::memory_order_relaxed);
+        snapshot.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return snapshot;
+    }
+
+    // Сколько файлов скопировано каждым способом
+    uintmax_t methodCount(CopyMethod method) const {
+        return methodCounts[static_cast<size_t>(method)].load(std::memory_order_relaxed);
+    }
+
+private:
+    CopyOptions options;
+    std::atomic<uintmax_t> bytesCopied{ 0 };
+    std::atomic<uintmax_t> filesCopied{ 0 };
+    std::array<std::atomic<uintmax_t>, static_cast<size_t>(CopyMethod::Count)> methodCounts{};
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    // Крупные файлы делятся на диапазоны по одному: иначе каждый поток пула дерева
+    // запускал бы ещё jobs своих потоков
+    std::mutex rangeMutex;
+#ifdef FM_HAVE_IO_URING
+    mode_t creationMask = 0;
+#endif
+
+    // Часть пути после корня обхода: не длиннее path и без ведущих разделителей
+    static std::string_view relativeTo(std::string_view path, size_t prefixLength) {
+        path.remove_prefix(std::min(prefixLength, path.size()));
+        while (!path.empty() && (path.front() == '/' || path.front() == '\\')) {
+            path.remove_prefix(1);
+        }
+        return path;
+    }
+
+    // Отсчёт времени операции и периодическая отдача прогресса в onProgress
+    std::function<void()> startProgress() {
+        started = std::chrono::steady_clock::now();
+        if (!options.onProgress) {
+            return {};
+        }
+        return [this] { options.onProgress(progress()); };
+    }
+
+    void moved(uintmax_t bytes) {
+        bytesCopied.fetch_add(bytes, std::memory_order_relaxed);
+        FM_COUNT(Bytes, bytes);
+        if (options.control) {
+            options.control->checkpoint(0, bytes);
+        }
+    }
+
+    void finished(CopyMethod method) {
+        filesCopied.fetch_add(1, std::memory_order_relaxed);
+        FM_COUNT(Entries, 1);
+        methodCounts[static_cast<size_t>(method)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+#ifdef __linux__
+    // Дескриптор, закрывающийся при выходе из области видимости
+    class Fd {
+    public:
+        explicit Fd(int fd) : fd(fd) {}
+        Fd(const Fd&) = delete;
+        Fd& operator=(const Fd&) = delete;
+        ~Fd() {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        int get() const {
+            return fd;
+        }
+
+    private:
+        int fd;
+    };
+
+    struct FreeDeleter {
+        void operator()(char* p) const {
+            std::free(p);
+        }
+    };
+
+    static fs::filesystem_error systemError(const char* what, const fs::path& path, int code) {
+        return fs::filesystem_error(what, path, std::error_code(code, std::generic_category()));
+    }
+
+    // Ошибки, после которых имеет смысл попробовать следующий способ
+    static bool unsupported(int code) {
+        return code == EXDEV || code == ENOSYS || code == EOPNOTSUPP || code == EINVAL
+            || code == EBADF || code == ETXTBSY || code == EPERM;
+    }
+
+    // Выровненный буфер, свой у каждого потока
+    char* threadBuffer() {
+        thread_local std::unique_ptr<char, FreeDeleter> buffer;
+        thread_local size_t capacity = 0;
+        if (capacity < options.bufferSize) {
+            void* memory = nullptr;
+            if (posix_memalign(&memory, 4096, options.bufferSize) != 0) {
+                throw std::bad_alloc();
+            }
+            buffer.reset(static_cast<char*>(memory));
+            capacity = options.bufferSize;
+        }
+        return buffer.get();
+    }
+
+    CopyMethod copyOne(const fs::path& source, const fs::path& destination) {
+        FM_SCOPE(Io, "copy file");
+        FM_COUNT(Syscalls, 4);  // open, fstat, open, fchmod
+        if (options.control) {
+            options.control->checkpoint(0, 0);
+        }
+        // O_NONBLOCK: открытие канала без писателя не должно ждать; для обычных файлов флаг ничего не меняет
+        Fd in(::open(source.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC));
+        if (in.get() < 0) {
+            throw systemError("Не удалось открыть источник", source, errno);
+        }
+        struct stat st;
+        if (::fstat(in.get(), &st) != 0) {
+            throw systemError("Не удалось получить атрибуты", source, errno);
+        }
+        if (!S_ISREG(st.st_mode)) {
+            throw systemError("Не обычный файл (канал, сокет или устройство)", source, EOPNOTSUPP);
+        }
+
+        Fd out(::open(destination.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777));
+        if (out.get() < 0) {
+            throw systemError("Не удалось создать файл", destination, errno);
+        }
+
+        try {
+            uintmax_t size = static_cast<uintmax_t>(st.st_size);
+            CopyMethod method = size >= options.splitThreshold && options.jobs > 1
+                ? copyRanges(in.get(), out.get(), size, destination)
+                : copyStream(in.get(), out.get(), destination);
+            ::fchmod(out.get(), st.st_mode & 07777);
+            finished(method);
+            return method;
+        }
+        catch (...) {
+            ::unlink(destination.c_str());
+            throw;
+        }
+    }
+
+    void writeAll(int out, const char* data, uint64_t length, uint64_t offset, const fs::path& destination) {
+        while (length > 0) {
+            FM_COUNT(Syscalls, 1);
+            ssize_t w = ::pwrite(out, data, static_cast<size_t>(length), static_cast<off_t>(offset));
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw systemError("Ошибка записи", destination, errno);
+            }
+            data += w;
+            offset += static_cast<uint64_t>(w);
+            length -= static_cast<uint64_t>(w);
+        }
+    }
+    // Дочитывает length байт с offset; меньше - только если файл кончился раньше
+    uint64_t readAll(int in, char* data, uint64_t length, uint64_t offset, const fs::path& source) {
+        uint64_t total = 0;
+        while (total < length) {
+            FM_COUNT(Syscalls, 1);
+            ssize_t r = ::pread(in, data + total, static_cast<size_t>(length - total), static_cast<off_t>(offset + total));
+            if (r < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw systemError("Ошибка чтения", source, errno);
+            }
+            if (r == 0) {
+                break;
+            }
+            total += static_cast<uint64_t>(r);
+        }
+        return total;
+    }
+
+    void createOne(const fs::path& destination, unsigned mode) {
+        FM_COUNT(Syscalls, 3);  // open, fchmod, close
+        if (options.control) {
+            options.control->checkpoint(0, 0);
+        }
+        Fd out(::open(destination.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode & 07777));
+        if (out.get() < 0) {
+            throw systemError("Не удалось создать файл", destination, errno);
+        }
+        ::fchmod(out.get(), mode & 07777);
+    }
+
+    void writeOne(const fs::path& destination, std::string_view data, uintmax_t offset) {
+        FM_COUNT(Syscalls, 2);
+        Fd out(::open(destination.c_str(), O_WRONLY | O_CLOEXEC));
+        if (out.get() < 0) {
+            throw systemError("Не удалось открыть файл", destination, errno);
+        }
+        writeAll(out.get(), data.data(), data.size(), offset, destination);
+    }
+
+    // Последовательное копирование до конца файла, начиная с options.firstMethod
+    CopyMethod copyStream(int in, int out, const fs::path& destination) {
+        CopyMethod first = options.firstMethod;
+        off_t offset = 0;
+
+        if (first <= CopyMethod::Reflink && ::ioctl(out, FICLONE, in) == 0) {
+            struct stat st;
+            if (::fstat(out, &st) == 0) {
+                moved(static_cast<uintmax_t>(st.st_size));
+            }
+            return CopyMethod::Reflink;
+        }
+
+        if (first <= CopyMethod::CopyFileRange) {
+            while (true) {
+                off_t inOffset = offset;
+                off_t outOffset = offset;
+                FM_COUNT(Syscalls, 1);
+                ssize_t n = ::copy_file_range(in, &inOffset, out, &outOffset, 16 << 20, 0);
+                if (n > 0) {
+                    offset += n;
+                    moved(static_cast<uintmax_t>(n));
+                    continue;
+                }
+                if (n == 0) {
+                    return CopyMethod::CopyFileRange;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (!unsupported(errno)) {
+                    throw systemError("Ошибка copy_file_range", destination, errno);
+                }
+                break;
+            }
+        }
+
+        if (first <= CopyMethod::Sendfile && ::lseek(out, offset, SEEK_SET) == offset) {
+            while (true) {
+                FM_COUNT(Syscalls, 1);
+                ssize_t n = ::sendfile(out, in, &offset, 16 << 20);
+                if (n > 0) {
+                    moved(static_cast<uintmax_t>(n));
+                    continue;
+                }
+                if (n == 0) {
+                    return CopyMethod::Sendfile;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (!unsupported(errno)) {
+                    throw systemError("Ошибка sendfile", destination, errno);
+                }
+                break;
+            }
+        }
+
+        copyReadWrite(in, out, offset, -1, destination);
+        return CopyMethod::ReadWrite;
+    }
+
+    // pread/pwrite в диапазоне [offset, end); end < 0 - до конца файла
+    void copyReadWrite(int in, int out, off_t offset, off_t end, const fs::path& destination) {
+        char* buffer = threadBuffer();
+        while (end < 0 || offset < end) {
+            size_t want = options.bufferSize;
+            if (end >= 0) {
+                want = static_cast<size_t>(std::min<off_t>(static_cast<off_t>(want), end - offset));
+            }
+            FM_COUNT(Syscalls, 1);
+            ssize_t n = ::pread(in, buffer, want, offset);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw systemError("Ошибка чтения", destination, errno);
+            }
+            if (n == 0) {
+                break;
+            }
+            for (ssize_t written = 0; written < n;) {
+                FM_COUNT(Syscalls, 1);
+                ssize_t w = ::pwrite(out, buffer + written, static_cast<size_t>(n - written), offset + written);
+                if (w < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw systemError("Ошибка записи", destination, errno);
+                }
+                written += w;
+            }
+            offset += n;
+            moved(static_cast<uintmax_t>(n));
+        }
+    }
+
+    // Копирование диапазона с явными смещениями: безопасно из нескольких потоков
+    CopyMethod copyRange(int in, int out, off_t offset, off_t end, const fs::path& destination) {
+        if (options.firstMethod <= CopyMethod::CopyFileRange) {
+            while (offset < end) {
+                off_t inOffset = offset;
+                off_t outOffset = offset;
+                size_t want = static_cast<size_t>(std::min<off_t>(16 << 20, end - offset));
+                FM_COUNT(Syscalls, 1);
+                ssize_t n = ::copy_file_range(in, &inOffset, out, &outOffset, want, 0);
+                if (n > 0) {
+                    offset += n;
+                    moved(static_cast<uintmax_t>(n));
+                    continue;
+                }
+                if (n == 0) {
+                    return CopyMethod::CopyFileRange;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (!unsupported(errno)) {
+                    throw systemError("Ошибка copy_file_range", destination, errno);
+                }
+                break;
+            }
+            if (offset >= end) {
+                return CopyMethod::CopyFileRange;
+            }
+        }
+        copyReadWrite(in, out, offset, end, destination);
+        return CopyMethod::ReadWrite;
+    }
+
+    // Большой файл: сначала reflink целиком, иначе параллельные диапазоны
+    CopyMethod copyRanges(int in, int out, uintmax_t size, const fs::path& destination) {
+        if (options.firstMethod <= CopyMethod::Reflink && ::ioctl(out, FICLONE, in) == 0) {
+            moved(size);
+            return CopyMethod::Reflink;
+        }
+        if (::ftruncate(out, static_cast<off_t>(size)) != 0) {
+            throw systemError("Не удалось задать размер файла", destination, errno);
+        }
+
+        std::lock_guard<std::mutex> rangeLock(rangeMutex);
+        const uintmax_t rangeCount = (size + options.rangeSize - 1) / options.rangeSize;
+        const unsigned threadCount = static_cast<unsigned>(std::min<uintmax_t>(options.jobs, rangeCount));
+        std::atomic<uintmax_t> nextRange{ 0 };
+        std::atomic<bool> usedReadWrite{ false };
+        std::atomic<bool> failed{ false };
+        std::mutex errorMutex;
+        std::exception_ptr error;
+
+        auto worker = [&] {
+            try {
+                for (uintmax_t range = nextRange++; range < rangeCount && !failed; range = nextRange++) {
+                    off_t begin = static_cast<off_t>(range * options.rangeSize);
+                    off_t end = static_cast<off_t>(std::min(size, (range + 1) * options.rangeSize));
+                    if (copyRange(in, out, begin, end, destination) == CopyMethod::ReadWrite) {
+                        usedReadWrite = true;
+                    }
+                }
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed = true;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < threadCount; i++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return usedReadWrite ? CopyMethod::ReadWrite : CopyMethod::CopyFileRange;
+    }
+
+#ifdef FM_HAVE_IO_URING
+    struct BatchFile {
+        const std::string* from = nullptr;
+        const std::string* to = nullptr;
+        struct statx stx;
+        int in = -1;
+        int out = -1;
+        uint64_t size = 0;
+        size_t bufferOffset = 0;
+        int error = 0;
+        bool created = false;
+    };
+
+    // Пачка файлов дерева: statx всех источников одной серией, крупные файлы - обычным путём,
+    // мелкие группами по batchBytes: open источников и приёмников, чтение, запись, close
+    void copyBatch(const std::vector<std::pair<std::string, std::string>>& files) {
+        IoRing* ring = IoRing::forThread();
+        if (!ring) {
+            for (const auto& file : files) {
+                copyOne(file.first, file.second);
+            }
+            return;
+        }
+
+        FM_SCOPE(Io, "copy batch");
+        if (options.control) {
+            options.control->checkpoint(0, 0);
+        }
+        std::vector<BatchFile> batch(files.size());
+        for (size_t i = 0; i < files.size(); i++) {
+            batch[i].from = &files[i].first;
+            batch[i].to = &files[i].second;
+        }
+        ring->run(batch.size(), [&](size_t i, uint32_t, io_uring_sqe& sqe) {
+            IoRing::prepStatx(sqe, AT_FDCWD, batch[i].from->c_str(), 0, STATX_TYPE | STATX_MODE | STATX_SIZE, &batch[i].stx);
+            }, [&](size_t i, uint32_t, int result) {
+                batch[i].error = result < 0 ? -result : 0;
+            });
+
+        std::vector<BatchFile*> group;
+        size_t groupBytes = 0;
+        for (auto& file : batch) {
+            if (file.error) {
+                throw systemError("Не удалось получить атрибуты", *file.from, file.error);
+            }
+            file.size = file.stx.stx_size;
+            // Не обычные файлы copyOne отклоняет, не открывая на чтение с ожиданием
+            if (!S_ISREG(file.stx.stx_mode) || file.size > options.smallFileLimit) {
+                copyOne(*file.from, *file.to);
+                continue;
+            }
+            if (!group.empty() && groupBytes + file.size > options.batchBytes) {
+                copyGroup(*ring, group, groupBytes);
+                group.clear();
+                groupBytes = 0;
+            }
+            file.bufferOffset = groupBytes;
+            groupBytes += static_cast<size_t>(file.size);
+            group.push_back(&file);
+        }
+        if (!group.empty()) {
+            copyGroup(*ring, group, groupBytes);
+        }
+    }
+
+    void copyGroup(IoRing& ring, std::vector<BatchFile*>& group, size_t groupBytes) {
+        thread_local std::vector<char> buffer;
+        if (buffer.size() < groupBytes) {
+            buffer.resize(groupBytes);
+        }
+        const size_t count = group.size();
+
+        // Чётные запросы открывают источники, нечётные создают приёмники
+        ring.run(count * 2, [&](size_t i, uint32_t, io_uring_sqe& sqe) {
+            BatchFile& file = *group[i / 2];
+            if (i % 2 == 0) {
+                IoRing::prepOpenat(sqe, AT_FDCWD, file.from->c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC, 0);
+            }
+            else {
+                IoRing::prepOpenat(sqe, AT_FDCWD, file.to->c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                    file.stx.stx_mode & 07777);
+            }
+            }, [&](size_t i, uint32_t, int result) {
+                BatchFile& file = *group[i / 2];
+                if (result < 0) {
+                    file.error = file.error ? file.error : -result;
+                }
+                else if (i % 2 == 0) {
+                    file.in = result;
+                }
+                else {
+                    file.out = result;
+                    file.created = true;
+                }
+            });
+
+        ring.run(count, [&](size_t i, uint32_t, io_uring_sqe& sqe) {
+            BatchFile& file = *group[i];
+            if (file.error || file.size == 0) {
+                sqe.opcode = IORING_OP_NOP;
+                return;
+            }
+            IoRing::prepRead(sqe, file.in, buffer.data() + file.bufferOffset, static_cast<unsigned>(file.size), 0);
+            }, [&](size_t i, uint32_t, int result) {
+                BatchFile& file = *group[i];
+                if (result < 0) {
+                    file.error = -result;
+                }
+                else if (!file.error && static_cast<uint64_t>(result) < file.size) {
+                    // Короткое чтение дочитывается синхронно; конец файла раньше размера из statx -
+                    // файл укоротился во время копирования, неполную копию не оставляем
+                    try {
+                        const uint64_t rest = file.size - result;
+                        if (readAll(file.in, buffer.data() + file.bufferOffset + result, rest, result, *file.from) < rest) {
+                            file.error = ENODATA;
+                        }
+                    }
+                    catch (const fs::filesystem_error& e) {
+                        file.error = e.code().value();
+                    }
+                }
+            });
+
+        ring.run(count, [&](size_t i, uint32_t, io_uring_sqe& sqe) {
+            BatchFile& file = *group[i];
+            if (file.error || file.size == 0) {
+                sqe.opcode = IORING_OP_NOP;
+                return;
+            }
+            IoRing::prepWrite(sqe, file.out, buffer.data() + file.bufferOffset, static_cast<unsigned>(file.size), 0);
+            }, [&](size_t i, uint32_t, int result) {
+                BatchFile& file = *group[i];
+                if (result < 0) {
+                    file.error = -result;
+                }
+                else if (!file.error && static_cast<uint64_t>(result) < file.size) {
+                    // Короткая запись дописывается синхронно
+                    try {
+                        writeAll(file.out, buffer.data() + file.bufferOffset + result, file.size - result, result, *file.to);
+                    }
+                    catch (const fs::filesystem_error& e) {
+                        file.error = e.code().value();
+                    }
+                }
+            });
+
+        for (BatchFile* file : group) {
+            if (!file->error && file->out >= 0 && (file->stx.stx_mode & 07777 & creationMask) != 0) {
+                ::fchmod(file->out, file->stx.stx_mode & 07777);
+            }
+        }
+
+        ring.run(count * 2, [&](size_t i, uint32_t, io_uring_sqe& sqe) {
+            BatchFile& file = *group[i / 2];
+            int fd = i % 2 == 0 ? file.in : file.out;
+            if (fd < 0) {
+                sqe.opcode = IORING_OP_NOP;
+                return;
+            }
+            IoRing::prepClose(sqe, fd);
+            }, [&](size_t i, uint32_t, int) {
+                BatchFile& file = *group[i / 2];
+                (i % 2 == 0 ? file.in : file.out) = -1;
+            });
+
+        const BatchFile* failed = nullptr;
+        for (BatchFile* file : group) {
+            if (file->error) {
+                // Приёмник мог быть создан до ошибки: недописанный файл не оставляем
+                if (file->created) {
+                    ::unlink(file->to->c_str());
+                }
+                failed = failed ? failed : file;
+                continue;
+            }
+            moved(file->size);
+            finished(CopyMethod::IoUring);
+        }
+        if (failed) {
+            throw systemError("Ошибка копирования", *failed->to, failed->error);
+        }
+    }
+
+#endif
+#else
+    CopyMethod copyOne(const fs::path& source, const fs::path& destination) {
+        FM_SCOPE(Io, "copy file");
+        if (options.control) {
+            options.control->checkpoint(0, 0);
+        }
+        fs::copy_file(source, destination);
+        moved(fs::file_size(destination));
+        finished(CopyMethod::Portable);
+        return CopyMethod::Portable;
+    }
+
+    void createOne(const fs::path& destination, unsigned mode) {
+        if (options.control) {
+            options.control->checkpoint(0, 0);
+        }
+        if (fs::exists(fs::symlink_status(destination))) {
+            throw fs::filesystem_error("Не удалось создать файл", destination, std::make_error_code(std::errc::file_exists));
+        }
+        std::ofstream out(destination, std::ios::binary);
+        if (!out.is_open()) {
+            throw fs::filesystem_error("Не удалось создать файл", destination, std::make_error_code(std::errc::permission_denied));
+        }
+        out.close();
+        fs::permissions(destination, static_cast<fs::perms>(mode & 07777));
+    }
+
+    void writeOne(const fs::path& destination, std::string_view data, uintmax_t offset) {
+        std::fstream out(destination, std::ios::binary | std::ios::in | std::ios::out);
+        out.seekp(static_cast<std::streamoff>(offset));
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!out) {
+            throw fs::filesystem_error("Ошибка записи", destination, std::make_error_code(std::errc::io_error));
+        }
+    }
+#endif
+
+#ifndef FM_HAVE_IO_URING
+    void copyBatch(const std::vector<std::pair<std::string, std::string>>& files) {
+        for (const auto& file : files) {
+            copyOne(file.first, file.second);
+        }
+    }
+#endif
+};
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "instrumentation.hpp"
+#include "io_ring.hpp"
+#include "job_control.hpp"
+#include "path_arena.hpp"
+#include "progress.hpp"
+#include "walker.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+struct DeleteProgress {
+    uintmax_t files = 0;
+    uintmax_t directories = 0;
+    double seconds = 0;
+
+    double entriesPerSecond() const {
+        return seconds > 0 ? (files + directories) / seconds : 0;
+    }
+};
+
+struct DeleteOptions {
+    unsigned threads = 0;  // 0 - по числу ядер
+    std::chrono::milliseconds progressInterval{ 500 };
+    std::function<void(const DeleteProgress&)> onProgress;
+    JobControl* control = nullptr;  // отмена и лимит скорости фоновой задачи
+};
+
+// Рекурсивное удаление. Поддеревья распределяются между потоками обходчика,
+// файлы удаляются unlinkat относительно уже открытого дескриптора родительской папки
+// (с io_uring - сериями), поэтому ядру не нужно заново разбирать полный путь.
+// Опустевшие папки снимаются после обхода уровнями от самых глубоких.
+class DeleteEngine {
+public:
+    explicit DeleteEngine(DeleteOptions options = {}) : options(options) {}
+
+    // Удаляет path со всем содержимым; ссылка на папку удаляется как ссылка
+    void remove(const fs::path& path) {
+        started = std::chrono::steady_clock::now();
+        ProgressTicker ticker(options.progressInterval, options.onProgress
+            ? std::function<void()>([this] { options.onProgress(progress()); })
+            : std::function<void()>());
+
+        if (fs::is_symlink(path) || !fs::is_directory(path)) {
+            fs::remove(path);
+            filesRemoved.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        // Папки копятся узлами PathArena (метка папки - номер узла), путь строится перед rmdir
+        std::string rootPath = path.string();
+        if (rootPath.size() > 1 && (rootPath.back() == '/' || rootPath.back() == '\\')) {
+            rootPath.pop_back();
+        }
+        std::mutex dirsMutex;
+        PathArena dirPaths(rootPath);
+        std::vector<std::pair<unsigned, PathArena::Id>> dirs;  // глубина, узел
+        WalkOptions walkOptions;
+        walkOptions.threads = options.threads;
+        walkOptions.stopOnError = true;
+        walkOptions.control = options.control;
+        ParallelWalker walker(walkOptions);
+        walker.walk(path, [&](const WalkDir& dir, std::vector<WalkEntry>& entries) {
+            std::vector<const char*> files;
+            std::vector<std::string> fullPaths;  // без дескриптора папки - полные пути
+            files.reserve(entries.size());
+            {
+                std::lock_guard<std::mutex> lock(dirsMutex);
+                for (auto& entry : entries) {
+                    if (entry.isDirectory()) {
+                        entry.tag = dirPaths.add(static_cast<PathArena::Id>(dir.tag), entry.name());
+                        dirs.emplace_back(entry.depth, static_cast<PathArena::Id>(entry.tag));
+                    }
+                }
+            }
+            for (const auto& entry : entries) {
+                if (entry.isDirectory()) {
+                    continue;
+                }
+                if (dir.fd >= 0) {
+                    files.push_back(entry.cName());
+                }
+                else {
+                    fullPaths.push_back(entry.path());
+                }
+            }
+            for (const auto& full : fullPaths) {
+                files.push_back(full.c_str());
+            }
+            removeEntries(dir.fd, dir.path, files, false);
+            filesRemoved.fetch_add(files.size(), std::memory_order_relaxed);
+            });
+
+        // Папки одной глубины не зависят друг от друга и удаляются одной серией
+        std::sort(dirs.begin(), dirs.end(), [](const auto& a, const auto& b) {
+            return a.first > b.first;
+            });
+        std::vector<std::string> levelPaths;
+        std::vector<const char*> level;
+        for (size_t i = 0; i < dirs.size(); i++) {
+            levelPaths.push_back(dirPaths.path(dirs[i].second));
+            if (i + 1 == dirs.size() || dirs[i + 1].first != dirs[i].first) {
+                if (options.control) {
+                    options.control->checkpoint(0, 0);
+                }
+                for (const auto& full : levelPaths) {
+                    level.push_back(full.c_str());
+                }
+                removeEntries(-1, rootPath, level, true);
+                directoriesRemoved.fetch_add(level.size(), std::memory_order_relaxed);
+                levelPaths.clear();
+                level.clear();
+            }
+        }
+        fs::remove(path);
+        directoriesRemoved.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    DeleteProgress progress() const {
+        DeleteProgress snapshot;
+        snapshot.files = filesRemoved.load(std::memory_order_relaxed);
+        snapshot.directories = directoriesRemoved.load(std::memory_order_relaxed);
+        snapshot.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return snapshot;
+    }
+
+private:
+    DeleteOptions options;
+    std::atomic<uintmax_t> filesRemoved{ 0 };
+    std::atomic<uintmax_t> directoriesRemoved{ 0 };
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    static void failed(int dirFd, const std::string& dirPath, const char* target, int code) {
+        fs::path full = dirFd >= 0 ? fs::path(dirPath) / target : fs::path(target);
+        throw fs::filesystem_error("Не удалось удалить", full, std::error_code(code, std::generic_category()));
+    }
+
+    // dirFd >= 0 - targets это имена относительно открытой папки dirPath,
+    // иначе - полные пути. Уже исчезнувшие элементы ошибкой не считаются
+    static void removeEntries(int dirFd, const std::string& dirPath, const std::vector<const char*>& targets, bool directories) {
+        FM_SCOPE(Io, "unlink");
+#ifdef __linux__
+        const int flags = directories ? AT_REMOVEDIR : 0;
+        const int base = dirFd >= 0 ? dirFd : AT_FDCWD;
+#ifdef FM_HAVE_IO_URING
+        if (IoRing* ring = IoRing::forThread()) {
+            ring->run(targets.size(), [&](size_t i, uint32_t, io_uring_sqe& sqe) {
+                IoRing::prepUnlinkat(sqe, base, targets[i], flags);
+                }, [&](size_t i, uint32_t, int result) {
+                    if (result < 0 && result != -ENOENT) {
+                        failed(dirFd, dirPath, targets[i], -result);
+                    }
+                });
+            return;
+        }
+#endif
+        FM_COUNT(Syscalls, targets.size());
+        for (const char* target : targets) {
+            if (::unlinkat(base, target, flags) != 0 && errno != ENOENT) {
+                failed(dirFd, dirPath, target, errno);
+            }
+        }
+#else
+        (void)directories;
+        for (const char* target : targets) {
+            fs::remove(dirFd >= 0 ? fs::path(dirPath) / target : fs::path(target));
+        }
+#endif
+    }
+};
+
+// Удаление в фоне: папка сразу переименовывается в скрытую корзину рядом с ней
+// (тот же каталог - та же файловая система, rename атомарен), а содержимое корзины
+// удаляет отдельный поток. Итоги копятся до вызова takeReports().
+class BackgroundDeleter {
+public:
+    static constexpr const char* TrashName = ".fm-trash";
+
+    BackgroundDeleter() = default;
+    BackgroundDeleter(const BackgroundDeleter&) = delete;
+    BackgroundDeleter& operator=(const BackgroundDeleter&) = delete;
+
+    ~BackgroundDeleter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    // Переименовывает path в корзину и ставит в очередь; бросает исключение, если rename не удался
+    void remove(const fs::path& path) {
+        // Под блокировкой: поток очистки не снимет пустую корзину между созданием и rename
+        std::lock_guard<std::mutex> lock(mutex);
+        fs::path trash = path.parent_path() / TrashName;
+        fs::create_directory(trash);
+        fs::path target = trash / (path.filename().string() + "." + std::to_string(
+            std::chrono::steady_clock::now().time_since_epoch().count()));
+        fs::rename(path, target);
+
+        queue.push_back(Job{ target, path.filename().string() });
+        if (!worker.joinable()) {
+            worker = std::thread([this] { run(); });
+        }
+        wakeup.notify_all();
+    }
+
+    bool busy() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return active || !queue.empty();
+    }
+
+    // Текущий прогресс фоновой очистки (для статуса)
+    DeleteProgress progress() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return current ? current->progress() : DeleteProgress{};
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return !active && queue.empty(); });
+    }
+
+    // Сообщения о завершённых удалениях с момента прошлого вызова
+    std::vector<std::string> takeReports() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::string> result;
+        result.swap(reports);
+        return result;
+    }
+
+private:
+    struct Job {
+        fs::path trashed;
+        std::string name;
+    };
+
+    mutable std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable idle;
+    std::deque<Job> queue;
+    std::vector<std::string> reports;
+    std::thread worker;
+    DeleteEngine* current = nullptr;
+    bool active = false;
+    bool stopping = false;
+
+    // Очередь дочищается даже при выходе: иначе корзина останется на диске
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wakeup.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            Job job = std::move(queue.front());
+            queue.pop_front();
+            active = true;
+
+            // Половина ядер: оболочка должна оставаться отзывчивой
+            DeleteOptions options;
+            options.threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+            DeleteEngine engine(options);
+            current = &engine;
+            lock.unlock();
+
+            std::string report;
+            try {
+                engine.remove(job.trashed);
+                DeleteProgress done = engine.progress();
+                report = "Фоновое удаление завершено: " + job.name + " (" + std::to_string(done.files) + " файлов, "
+                    + std::to_string(done.directories) + " папок, " + std::to_string(static_cast<uintmax_t>(done.entriesPerSecond())) + " элем/с)";
+            }
+            catch (const std::exception& e) {
+                report = "Ошибка фонового удаления " + job.name + ": " + e.what();
+            }
+            lock.lock();
+            // Корзина удаляется, только если опустела
+            std::error_code ec;
+            fs::remove(job.trashed.parent_path(), ec);
+            current = nullptr;
+            active = false;
+            reports.push_back(std::move(report));
+            idle.notify_all();
+        }
+    }
+};
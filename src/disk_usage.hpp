@@ -0,0 +1,498 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "instrumentation.hpp"
+#include "io_ring.hpp"
+#include "job_control.hpp"
+#include "walker.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Узел дерева занятого места. Размеры - итог по поддереву
+struct DuNode {
+    static constexpr uint32_t None = UINT32_MAX;
+
+    std::string_view name;          // интернированное имя
+    uint64_t apparent = 0;          // сумма st_size
+    uint64_t allocated = 0;         // сумма st_blocks * 512
+    uint64_t items = 0;             // элементов в поддереве, включая сам узел
+    uint32_t parent = None;
+    uint32_t firstChild = None;
+    uint32_t nextSibling = None;
+    EntryType type = EntryType::Unknown;
+    bool hardlinkDuplicate = false; // повторная жёсткая ссылка: в итогах не учтена
+};
+
+struct DuStats {
+    uintmax_t files = 0;
+    uintmax_t directories = 0;
+    uintmax_t hardlinksSkipped = 0;
+    uintmax_t errors = 0;
+    size_t uniqueNames = 0;
+    size_t memoryBytes = 0;
+    double seconds = 0;
+};
+
+// Хранилище имён: одинаковые имена (node_modules, index.js, .git) хранятся один раз.
+// Набор разбит на сегменты со своими блокировками, строки лежат в блоках по 64 КБ
+class NameInterner {
+public:
+    std::string_view intern(std::string_view name) {
+        Shard& shard = shards[std::hash<std::string_view>()(name) % ShardCount];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.names.find(name);
+        if (it != shard.names.end()) {
+            return *it;
+        }
+        if (shard.blocks.empty() || shard.used + name.size() > shard.blockSize) {
+            shard.blockSize = std::max<size_t>(BlockSize, name.size());
+            shard.blocks.push_back(std::make_unique<char[]>(shard.blockSize));
+            shard.used = 0;
+            shard.bytes += shard.blockSize;
+        }
+        char* place = shard.blocks.back().get() + shard.used;
+        std::memcpy(place, name.data(), name.size());
+        shard.used += name.size();
+        std::string_view stored(place, name.size());
+        shard.names.insert(stored);
+        return stored;
+    }
+
+    size_t uniqueCount() const {
+        size_t total = 0;
+        for (const auto& shard : shards) {
+            total += shard.names.size();
+        }
+        return total;
+    }
+
+    size_t memoryUsage() const {
+        size_t total = 0;
+        for (const auto& shard : shards) {
+            total += shard.bytes + shard.names.size() * (sizeof(std::string_view) + 2 * sizeof(void*));
+        }
+        return total;
+    }
+
+private:
+    static constexpr size_t ShardCount = 64;
+    static constexpr size_t BlockSize = 64 * 1024;
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_set<std::string_view> names;
+        std::vector<std::unique_ptr<char[]>> blocks;
+        size_t blockSize = 0;
+        size_t used = 0;
+        size_t bytes = 0;
+    };
+
+    Shard shards[ShardCount];
+};
+
+// Узлы в блоках фиксированного размера: номер выдаётся атомарным счётчиком,
+// блоки не перемещаются, поэтому потоки заполняют свои узлы без общей блокировки
+class NodeArena {
+public:
+    NodeArena() : chunks(new std::atomic<DuNode*>[MaxChunks]) {
+        for (size_t i = 0; i < MaxChunks; i++) {
+            chunks[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    // Выделяет count подряд идущих узлов и возвращает номер первого
+    uint32_t allocate(uint32_t count) {
+        uint64_t first = next.fetch_add(count, std::memory_order_relaxed);
+        if (first + count > static_cast<uint64_t>(MaxChunks) * ChunkSize) {
+            throw std::length_error("Слишком много элементов для анализа");
+        }
+        for (uint64_t chunk = first / ChunkSize; chunk <= (first + count - 1) / ChunkSize; chunk++) {
+            if (!chunks[chunk].load(std::memory_order_acquire)) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!chunks[chunk].load(std::memory_order_relaxed)) {
+                    owned.push_back(std::make_unique<DuNode[]>(ChunkSize));
+                    chunks[chunk].store(owned.back().get(), std::memory_order_release);
+                }
+            }
+        }
+        return static_cast<uint32_t>(first);
+    }
+
+    DuNode& operator[](uint32_t id) {
+        return chunks[id / ChunkSize].load(std::memory_order_acquire)[id % ChunkSize];
+    }
+
+    const DuNode& operator[](uint32_t id) const {
+        return chunks[id / ChunkSize].load(std::memory_order_acquire)[id % ChunkSize];
+    }
+
+    uint32_t size() const {
+        return static_cast<uint32_t>(next.load());
+    }
+
+    size_t memoryUsage() const {
+        return owned.size() * ChunkSize * sizeof(DuNode);
+    }
+
+private:
+    static constexpr size_t ChunkSize = 1 << 16;
+    static constexpr size_t MaxChunks = 1 << 16;
+
+    std::unique_ptr<std::atomic<DuNode*>[]> chunks;
+    std::vector<std::unique_ptr<DuNode[]>> owned;
+    std::mutex mutex;
+    std::atomic<uint64_t> next{ 0 };
+};
+
+// Анализ занятого места (du/ncdu): параллельный обход, statx каждого элемента
+// (с io_uring - сериями), суммы пачки копятся локально и один раз добавляются к папке,
+// после обхода итоги поднимаются от узлов к корню одним проходом по убыванию номеров
+// (номер вложенного узла всегда больше номера родителя). Жёсткие ссылки учитываются
+// один раз по (устройство, inode). Дерево остаётся в памяти для просмотра без повторного обхода.
+class DiskUsage {
+public:
+    explicit DiskUsage(unsigned threads = 0) : threads(threads) {}
+
+    // control - только для отмены: прогресс задачи предварительный подсчёт не двигает
+    void scan(const fs::path& root, const JobControl* control = nullptr) {
+        auto started = std::chrono::steady_clock::now();
+        rootPath = root.lexically_normal();
+
+        const uint32_t rootId = nodes.allocate(1);
+        DuNode& rootNode = nodes[rootId];
+        rootNode.name = names.intern(rootPath.string());
+        rootNode.type = EntryType::Directory;
+        Measure own;
+        if (measurePath(rootPath, own)) {
+            rootNode.apparent = own.apparent;
+            rootNode.allocated = own.allocated;
+        }
+        rootNode.items = 1;
+
+        WalkOptions options;
+        options.threads = threads;
+        ParallelWalker walker(options);
+        WalkStats walkStats = walker.walk(rootPath, [this, &walker, control](const WalkDir& dir, std::vector<WalkEntry>& entries) {
+            if (control && control->cancelled()) {
+                walker.requestStop();
+                return;
+            }
+            addBatch(dir, entries);
+            });
+        if (control && control->cancelled()) {
+            throw OperationCancelled();
+        }
+        errorCount.fetch_add(walkStats.errors);
+
+        aggregate();
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    }
+
+    const fs::path& root() const {
+        return rootPath;
+    }
+
+    bool empty() const {
+        return nodes.size() == 0;
+    }
+
+    const DuNode& node(uint32_t id) const {
+        return nodes[id];
+    }
+
+    // Вложенные элементы по убыванию занятого места
+    std::vector<uint32_t> children(uint32_t id) const {
+        std::vector<uint32_t> result;
+        for (uint32_t child = nodes[id].firstChild; child != DuNode::None; child = nodes[child].nextSibling) {
+            result.push_back(child);
+        }
+        std::sort(result.begin(), result.end(), [this](uint32_t a, uint32_t b) {
+            return nodes[a].allocated > nodes[b].allocated;
+            });
+        return result;
+    }
+
+    // Узел по пути внутри корня; DuNode::None, если такого нет
+    uint32_t find(const fs::path& path) const {
+        if (empty()) {
+            return DuNode::None;
+        }
+        fs::path relative = path.lexically_normal().lexically_relative(rootPath);
+        if (relative.empty() || *relative.begin() == "..") {
+            return DuNode::None;
+        }
+        uint32_t current = 0;
+        for (const auto& part : relative) {
+            const std::string name = part.string();
+            if (name == "." || name.empty()) {
+                continue;
+            }
+            uint32_t child = nodes[current].firstChild;
+            while (child != DuNode::None && nodes[child].name != name) {
+                child = nodes[child].nextSibling;
+            }
+            if (child == DuNode::None) {
+                return DuNode::None;
+            }
+            current = child;
+        }
+        return current;
+    }
+
+    DuStats stats() const {
+        DuStats result;
+        result.files = fileCount.load();
+        result.directories = directoryCount.load();
+        result.hardlinksSkipped = hardlinkCount.load();
+        result.errors = errorCount.load();
+        result.uniqueNames = names.uniqueCount();
+        result.memoryBytes = nodes.memoryUsage() + names.memoryUsage() + seen.memoryUsage();
+        result.seconds = elapsed;
+        return result;
+    }
+
+private:
+    struct Measure {
+        uint64_t apparent = 0;
+        uint64_t allocated = 0;
+        uint64_t device = 0;
+        uint64_t inode = 0;
+        uint32_t links = 1;
+        EntryType type = EntryType::Unknown;
+    };
+
+    // Набор (устройство, inode) файлов с несколькими жёсткими ссылками, сегменты со своими блокировками
+    class InodeSet {
+    public:
+        // true, если пара встретилась впервые
+        bool insert(uint64_t device, uint64_t inode) {
+            const uint64_t key = device * 0x9E3779B97F4A7C15ull ^ inode;
+            Shard& shard = shards[(key >> 7) % ShardCount];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            return shard.keys.insert(Key{ device, inode }).second;
+        }
+
+        size_t memoryUsage() const {
+            size_t total = 0;
+            for (const auto& shard : shards) {
+                total += shard.keys.size() * (sizeof(Key) + 2 * sizeof(void*));
+            }
+            return total;
+        }
+
+    private:
+        struct Key {
+            uint64_t device;
+            uint64_t inode;
+            bool operator==(const Key& other) const {
+                return device == other.device && inode == other.inode;
+            }
+        };
+        struct KeyHash {
+            size_t operator()(const Key& key) const {
+                return std::hash<uint64_t>()(key.device * 0x9E3779B97F4A7C15ull ^ key.inode);
+            }
+        };
+        struct Shard {
+            std::mutex mutex;
+            std::unordered_set<Key, KeyHash> keys;
+        };
+        static constexpr size_t ShardCount = 64;
+        Shard shards[ShardCount];
+    };
+
+    unsigned threads;
+    fs::path rootPath;
+    NodeArena nodes;
+    NameInterner names;
+    InodeSet seen;
+    std::atomic<uintmax_t> fileCount{ 0 };
+    std::atomic<uintmax_t> directoryCount{ 0 };
+    std::atomic<uintmax_t> hardlinkCount{ 0 };
+    std::atomic<uintmax_t> errorCount{ 0 };
+    double elapsed = 0;
+
+    void addBatch(const WalkDir& dir, std::vector<WalkEntry>& entries) {
+        const uint32_t parentId = static_cast<uint32_t>(dir.tag);
+        const uint32_t first = nodes.allocate(static_cast<uint32_t>(entries.size()));
+
+        std::vector<Measure> measures(entries.size());
+        std::vector<bool> measured(entries.size(), false);
+        measureBatch(dir, entries, measures, measured);
+
+        // Локальные суммы пачки: к папке добавляются один раз
+        uint64_t apparent = 0;
+        uint64_t allocated = 0;
+        uintmax_t files = 0;
+        uintmax_t directories = 0;
+        uintmax_t duplicates = 0;
+        uintmax_t errors = 0;
+        for (size_t i = 0; i < entries.size(); i++) {
+            WalkEntry& entry = entries[i];
+            const uint32_t id = first + static_cast<uint32_t>(i);
+            DuNode& node = nodes[id];
+            node.name = names.intern(entry.name());
+            node.parent = parentId;
+            node.type = entry.type;
+            node.items = 1;
+            if (!measured[i]) {
+                errors++;
+            }
+            else {
+                const Measure& measure = measures[i];
+                if (node.type == EntryType::Unknown) {
+                    node.type = measure.type;
+                }
+                if (measure.links > 1 && node.type != EntryType::Directory && !seen.insert(measure.device, measure.inode)) {
+                    node.hardlinkDuplicate = true;
+                    duplicates++;
+                }
+                else {
+                    node.apparent = measure.apparent;
+                    node.allocated = measure.allocated;
+                }
+            }
+            if (entry.isDirectory()) {
+                entry.tag = id;
+                directories++;
+            }
+            else {
+                apparent += node.apparent;
+                allocated += node.allocated;
+                files++;
+            }
+        }
+
+        // Папку обрабатывает один поток, а её узел заполнен до того, как она попала в очередь
+        DuNode& parent = nodes[parentId];
+        parent.apparent += apparent;
+        parent.allocated += allocated;
+        parent.items += files;
+
+        fileCount.fetch_add(files, std::memory_order_relaxed);
+        directoryCount.fetch_add(directories, std::memory_order_relaxed);
+        hardlinkCount.fetch_add(duplicates, std::memory_order_relaxed);
+        errorCount.fetch_add(errors, std::memory_order_relaxed);
+    }
+
+    // Итоги папок поднимаются к родителям; заодно строятся списки детей
+    void aggregate() {
+        const uint32_t count = nodes.size();
+        for (uint32_t id = count; id-- > 1;) {
+            DuNode& node = nodes[id];
+            DuNode& parent = nodes[node.parent];
+            if (node.type == EntryType::Directory) {
+                parent.apparent += node.apparent;
+                parent.allocated += node.allocated;
+                parent.items += node.items;
+            }
+            node.nextSibling = parent.firstChild;
+            parent.firstChild = id;
+        }
+    }
+
+#ifdef __linux__
+    static constexpr unsigned StatxMask = STATX_TYPE | STATX_SIZE | STATX_BLOCKS | STATX_INO | STATX_NLINK;
+
+    static void fromStatx(const struct statx& stx, Measure& measure) {
+        measure.apparent = stx.stx_size;
+        measure.allocated = stx.stx_blocks * 512;
+        measure.device = (static_cast<uint64_t>(stx.stx_dev_major) << 32) | stx.stx_dev_minor;
+        measure.inode = stx.stx_ino;
+        measure.links = stx.stx_nlink;
+        if (S_ISREG(stx.stx_mode)) measure.type = EntryType::File;
+        else if (S_ISDIR(stx.stx_mode)) measure.type = EntryType::Directory;
+        else if (S_ISLNK(stx.stx_mode)) measure.type = EntryType::Symlink;
+        else measure.type = EntryType::Other;
+    }
+
+    static bool measurePath(const fs::path& path, Measure& measure) {
+        struct statx stx;
+        if (::statx(AT_FDCWD, path.c_str(), AT_SYMLINK_NOFOLLOW, StatxMask, &stx) != 0) {
+            return false;
+        }
+        fromStatx(stx, measure);
+        return true;
+    }
+
+    // statx всех элементов пачки относительно дескриптора папки, ссылки не разыменовываются
+    void measureBatch(const WalkDir& dir, const std::vector<WalkEntry>& entries,
+        std::vector<Measure>& measures, std::vector<bool>& measured) {
+        FM_SCOPE(Stat, "statx");
+        // На Linux обходчик всегда отдаёт открытый дескриптор папки
+        const int base = dir.fd;
+        auto target = [&](size_t i) {
+            return entries[i].cName();
+        };
+#ifdef FM_HAVE_IO_URING
+        if (IoRing* ring = IoRing::forThread()) {
+            std::vector<struct statx> results(ring->depth());
+            ring->run(entries.size(), [&](size_t i, uint32_t slot, io_uring_sqe& sqe) {
+                IoRing::prepStatx(sqe, base, target(i), AT_SYMLINK_NOFOLLOW, StatxMask, &results[slot]);
+                }, [&](size_t i, uint32_t slot, int result) {
+                    if (result >= 0) {
+                        fromStatx(results[slot], measures[i]);
+                        measured[i] = true;
+                    }
+                });
+            return;
+        }
+#endif
+        FM_COUNT(Syscalls, entries.size());
+        for (size_t i = 0; i < entries.size(); i++) {
+            struct statx stx;
+            if (::statx(base, target(i), AT_SYMLINK_NOFOLLOW, StatxMask, &stx) == 0) {
+                fromStatx(stx, measures[i]);
+                measured[i] = true;
+            }
+        }
+    }
+#else
+    // Без statx: занятое место считается равным размеру, жёсткие ссылки не распознаются
+    static bool measurePath(const fs::path& path, Measure& measure) {
+        std::error_code ec;
+        fs::file_status status = fs::symlink_status(path, ec);
+        if (ec) {
+            return false;
+        }
+        if (fs::is_regular_file(status)) {
+            measure.apparent = fs::file_size(path, ec);
+            measure.type = EntryType::File;
+        }
+        else if (fs::is_directory(status)) {
+            measure.type = EntryType::Directory;
+        }
+        else if (fs::is_symlink(status)) {
+            measure.type = EntryType::Symlink;
+        }
+        measure.allocated = measure.apparent;
+        return !ec;
+    }
+
+    void measureBatch(const WalkDir&, const std::vector<WalkEntry>& entries,
+        std::vector<Measure>& measures, std::vector<bool>& measured) {
+        for (size_t i = 0; i < entries.size(); i++) {
+            measured[i] = measurePath(fs::path(entries[i].path()), measures[i]);
+        }
+    }
+#endif
+};
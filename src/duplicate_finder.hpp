@@ -0,0 +1,567 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "file_view.hpp"
+#include "hash.hpp"
+#include "instrumentation.hpp"
+#include "path_arena.hpp"
+#include "thread_pool.hpp"
+#include "walker.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+struct DupeOptions {
+    unsigned threads = 0;        // 0 - по числу ядер
+    uintmax_t minSize = 1;       // файлы меньше не рассматриваются (пустые одинаковы все)
+    bool useCache = true;
+};
+
+struct DupeGroup {
+    uintmax_t size = 0;
+    std::vector<std::string> paths;
+
+    uintmax_t wastedBytes() const {
+        return paths.size() > 1 ? size * (paths.size() - 1) : 0;
+    }
+};
+
+struct DupeStats {
+    uintmax_t files = 0;            // просмотрено обычных файлов
+    uintmax_t sizeCandidates = 0;   // с неуникальным размером
+    uintmax_t partialHashed = 0;
+    uintmax_t fullHashed = 0;
+    uintmax_t hardlinks = 0;        // повторные ссылки на уже учтённый inode
+    uintmax_t cacheHits = 0;
+    uintmax_t errors = 0;
+    uintmax_t bytesRead = 0;
+    uintmax_t groups = 0;
+    uintmax_t duplicates = 0;       // лишних копий во всех группах
+    uintmax_t wastedBytes = 0;
+    double seconds = 0;
+};
+
+// Хэши файлов между запусками: ключ - (устройство, inode, размер, время изменения),
+// поэтому изменённый или заменённый файл в кэш не попадает и пересчитывается
+class HashCache {
+public:
+    struct Key {
+        uint64_t device = 0;
+        uint64_t inode = 0;
+        uint64_t size = 0;
+        int64_t mtime = 0;  // наносекунды
+
+        bool operator==(const Key& other) const {
+            return device == other.device && inode == other.inode && size == other.size && mtime == other.mtime;
+        }
+    };
+
+    struct Value {
+        uint64_t partial = 0;
+        uint64_t full = 0;
+        bool hasFull = false;
+    };
+
+    static fs::path defaultLocation() {
+        if (const char* custom = std::getenv("FM_HASH_CACHE")) {
+            return custom;
+        }
+#ifdef _WIN32
+        const char* base = std::getenv("LOCALAPPDATA");
+        fs::path dir = base ? fs::path(base) : fs::temp_directory_path();
+#else
+        const char* xdg = std::getenv("XDG_CACHE_HOME");
+        const char* home = std::getenv("HOME");
+        fs::path dir = xdg ? fs::path(xdg) : home ? fs::path(home) / ".cache" : fs::temp_directory_path();
+#endif
+        return dir / "filemanager" / "hashes.bin";
+    }
+
+    // Повреждённый или чужой файл просто игнорируется
+    void load(const fs::path& file) {
+        std::ifstream stream(file, std::ios::binary);
+        Header header;
+        if (!stream.read(reinterpret_cast<char*>(&header), sizeof(header))
+            || std::memcmp(header.magic, Magic, sizeof(Magic)) != 0) {
+            return;
+        }
+        std::vector<Record> records(static_cast<size_t>(std::min<uint64_t>(header.count, 1 << 16)));
+        uint64_t left = header.count;
+        std::lock_guard<std::mutex> lock(mutex);
+        while (left > 0) {
+            const size_t chunk = static_cast<size_t>(std::min<uint64_t>(left, records.size()));
+            if (!stream.read(reinterpret_cast<char*>(records.data()), static_cast<std::streamsize>(chunk * sizeof(Record)))) {
+                break;
+            }
+            for (size_t i = 0; i < chunk; i++) {
+                const Record& record = records[i];
+                entries[Key{ record.device, record.inode, record.size, record.mtime }]
+                    = Value{ record.partial, record.full, record.hasFull != 0 };
+            }
+            left -= chunk;
+        }
+    }
+
+    // Запись через временный файл: прерванное сохранение не портит старый кэш
+    void save(const fs::path& file) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!dirty) {
+            return;
+        }
+        fs::create_directories(file.parent_path());
+        fs::path temp = file;
+        temp += ".tmp";
+        {
+            std::ofstream stream(temp, std::ios::binary | std::ios::trunc);
+            Header header;
+            std::memcpy(header.magic, Magic, sizeof(Magic));
+            header.count = entries.size();
+            stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (const auto& [key, value] : entries) {
+                Record record{ key.device, key.inode, key.size, key.mtime, value.partial, value.full, value.hasFull ? 1u : 0u, 0 };
+                stream.write(reinterpret_cast<const char*>(&record), sizeof(record));
+            }
+            if (!stream) {
+                throw std::runtime_error("Не удалось записать кэш хэшей " + temp.string());
+            }
+        }
+        fs::rename(temp, file);
+    }
+
+    bool find(const Key& key, Value& value) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+
+    void storePartial(const Key& key, uint64_t partial) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Value& value = entries[key];
+        if (value.partial != partial || value.hasFull) {
+            value = Value{ partial, 0, false };
+        }
+        dirty = true;
+    }
+
+    void storeFull(const Key& key, uint64_t partial, uint64_t full) {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries[key] = Value{ partial, full, true };
+        dirty = true;
+    }
+
+private:
+    static constexpr char Magic[8] = { 'F', 'M', 'H', 'S', 'H', '0', '1', '\0' };
+
+    struct Header {
+        char magic[8];
+        uint64_t count;
+    };
+
+    struct Record {
+        uint64_t device;
+        uint64_t inode;
+        uint64_t size;
+        int64_t mtime;
+        uint64_t partial;
+        uint64_t full;
+        uint32_t hasFull;
+        uint32_t reserved;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return std::hash<uint64_t>()(key.inode * 0x9E3779B97F4A7C15ull ^ key.device ^ key.size ^ static_cast<uint64_t>(key.mtime));
+        }
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<Key, Value, KeyHash> entries;
+    bool dirty = false;
+};
+
+// Поиск одинаковых файлов в три ступени, каждая отсеивает большую часть кандидатов:
+// 1) обход дерева и группировка по размеру (файл с уникальным размером дубликатом быть не может);
+// 2) XXH64 первых и последних 4 КБ - читается не больше 8 КБ на файл;
+// 3) XXH64 всего содержимого только для совпавших на второй ступени.
+// Ступени 2 и 3 - конвейер из двух пулов с ограниченными очередями: полный хэш группы
+// начинается, как только для неё готовы частичные, а чтение не убегает вперёд обработки.
+// Жёсткие ссылки на один inode считаются одним файлом.
+class DuplicateFinder {
+public:
+    static constexpr size_t EdgeSize = 4096;
+
+    explicit DuplicateFinder(DupeOptions options = {}) : options(options) {
+#ifndef __linux__
+        // Ключ кэша держится на inode
+        this->options.useCache = false;
+#endif
+    }
+
+    std::vector<DupeGroup> find(const fs::path& root) {
+        auto started = std::chrono::steady_clock::now();
+        const fs::path cacheFile = HashCache::defaultLocation();
+        if (options.useCache) {
+            cache.load(cacheFile);
+        }
+
+        collect(root);
+        std::vector<std::vector<FileRecord*>> sizeGroups = groupBySize();
+
+        std::vector<DupeGroup> result;
+        {
+            std::mutex resultMutex;
+            ThreadPool fullPool(options.threads, 64);
+            ThreadPool partialPool(options.threads, 64);
+            for (auto& group : sizeGroups) {
+                auto state = std::make_shared<PartialGroup>();
+                state->files = std::move(group);
+                state->left = state->files.size();
+                for (FileRecord* file : state->files) {
+                    partialPool.submit([this, state, file, &fullPool, &result, &resultMutex] {
+                        hashPartial(*file);
+                        if (state->left.fetch_sub(1) == 1) {
+                            splitByPartial(*state, fullPool, result, resultMutex);
+                        }
+                        });
+                }
+            }
+            partialPool.wait();
+            fullPool.wait();
+        }
+
+        std::sort(result.begin(), result.end(), [](const DupeGroup& a, const DupeGroup& b) {
+            return a.wastedBytes() != b.wastedBytes() ? a.wastedBytes() > b.wastedBytes() : a.paths < b.paths;
+            });
+        for (auto& group : result) {
+            std::sort(group.paths.begin(), group.paths.end());
+            counters.groups++;
+            counters.duplicates += group.paths.size() - 1;
+            counters.wastedBytes += group.wastedBytes();
+        }
+
+        if (options.useCache) {
+            try {
+                cache.save(cacheFile);
+            }
+            catch (const std::exception&) {
+                // Кэш - только ускорение, без него результат тот же
+            }
+        }
+        counters.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return result;
+    }
+
+    DupeStats stats() const {
+        DupeStats result = counters;
+        result.partialHashed = partialHashed.load();
+        result.fullHashed = fullHashed.load();
+        result.cacheHits = cacheHits.load();
+        result.errors += hashErrors.load();
+        result.bytesRead = bytesRead.load();
+        return result;
+    }
+
+private:
+    struct FileRecord {
+        PathArena::Id path = 0;  // узел в paths; строка пути нужна только для чтения и вывода
+        HashCache::Key key;
+        uint64_t partial = 0;
+        uint64_t full = 0;
+        bool failed = false;
+    };
+
+    // Файлы одного размера, ждущие частичных хэшей
+    struct PartialGroup {
+        std::vector<FileRecord*> files;
+        std::atomic<size_t> left{ 0 };
+    };
+
+    // Файлы с одинаковым частичным хэшем, ждущие полного
+    struct FullGroup {
+        std::vector<FileRecord*> files;
+        std::atomic<size_t> left{ 0 };
+    };
+
+    DupeOptions options;
+    HashCache cache;
+    std::vector<FileRecord> files;
+    PathArena paths;
+    DupeStats counters;
+    std::atomic<uintmax_t> partialHashed{ 0 };
+    std::atomic<uintmax_t> fullHashed{ 0 };
+    std::atomic<uintmax_t> cacheHits{ 0 };
+    std::atomic<uintmax_t> hashErrors{ 0 };
+    std::atomic<uintmax_t> bytesRead{ 0 };
+
+    // Ступень 1: размеры и ключи кэша всех обычных файлов; ссылки не разыменовываются
+    // Пути хранятся узлами PathArena: метка директории - номер её узла
+    void collect(const fs::path& root) {
+        std::string rootPath = root.string();
+        if (rootPath.size() > 1 && (rootPath.back() == '/' || rootPath.back() == '\\')) {
+            rootPath.pop_back();
+        }
+        paths = PathArena(rootPath);
+        files.clear();
+
+        std::mutex filesMutex;
+        WalkOptions walkOptions;
+        walkOptions.threads = options.threads;
+        ParallelWalker walker(walkOptions);
+        WalkStats walkStats = walker.walk(root, [&](const WalkDir& dir, std::vector<WalkEntry>& entries) {
+            std::vector<std::pair<size_t, HashCache::Key>> kept;
+            uintmax_t failed = 0;
+            for (size_t i = 0; i < entries.size(); i++) {
+                if (entries[i].type != EntryType::File) {
+                    continue;
+                }
+                HashCache::Key key;
+                if (!describe(dir, entries[i], key)) {
+                    failed++;
+                    continue;
+                }
+                if (key.size >= options.minSize) {
+                    kept.emplace_back(i, key);
+                }
+            }
+            const PathArena::Id parent = static_cast<PathArena::Id>(dir.tag);
+            std::lock_guard<std::mutex> lock(filesMutex);
+            counters.errors += failed;
+            for (auto& entry : entries) {
+                if (entry.isDirectory()) {
+                    entry.tag = paths.add(parent, entry.name());
+                }
+            }
+            for (const auto& item : kept) {
+                FileRecord record;
+                record.path = paths.add(parent, entries[item.first].name());
+                record.key = item.second;
+                files.push_back(record);
+            }
+            });
+        counters.errors += walkStats.errors;
+        counters.files = files.size();
+    }
+
+    static bool describe(const WalkDir& dir, const WalkEntry& entry, HashCache::Key& key) {
+#ifdef __linux__
+        // На Linux обходчик всегда отдаёт открытый дескриптор папки
+        struct stat st;
+        if (::fstatat(dir.fd, entry.cName(), &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) {
+            return false;
+        }
+        key.device = static_cast<uint64_t>(st.st_dev);
+        key.inode = static_cast<uint64_t>(st.st_ino);
+        key.size = static_cast<uint64_t>(st.st_size);
+        key.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        return true;
+#else
+        // Без inode нет ни объединения жёстких ссылок, ни кэша: ключ не различает файлы
+        (void)dir;
+        std::error_code ec;
+        key.size = fs::file_size(fs::path(entry.path()), ec);
+        return !ec;
+#endif
+    }
+
+    // Группы одного размера; повторные ссылки на один inode из групп убираются
+    std::vector<std::vector<FileRecord*>> groupBySize() {
+        std::vector<FileRecord*> order;
+        order.reserve(files.size());
+        for (auto& file : files) {
+            order.push_back(&file);
+        }
+        std::sort(order.begin(), order.end(), [](const FileRecord* a, const FileRecord* b) {
+            if (a->key.size != b->key.size) return a->key.size > b->key.size;
+            if (a->key.device != b->key.device) return a->key.device < b->key.device;
+            if (a->key.inode != b->key.inode) return a->key.inode < b->key.inode;
+            return a->path < b->path;
+        });
+
+        std::vector<std::vector<FileRecord*>> groups;
+        std::vector<FileRecord*> current;
+        auto close = [&] {
+            if (current.size() > 1) {
+                counters.sizeCandidates += current.size();
+                groups.push_back(std::move(current));
+            }
+            current.clear();
+        };
+        for (size_t i = 0; i < order.size(); i++) {
+            if (i > 0 && order[i]->key.size != order[i - 1]->key.size) {
+                close();
+            }
+#ifdef __linux__
+            if (i > 0 && order[i]->key.size == order[i - 1]->key.size
+                && order[i]->key.device == order[i - 1]->key.device && order[i]->key.inode == order[i - 1]->key.inode) {
+                counters.hardlinks++;
+                continue;
+            }
+#endif
+            current.push_back(order[i]);
+        }
+        close();
+        return groups;
+    }
+
+    // Ступень 2: начало и конец файла (у маленьких - всё содержимое, тогда это и полный хэш)
+    void hashPartial(FileRecord& file) {
+        FM_SCOPE(Io, "hash partial");
+        HashCache::Value cached;
+        if (options.useCache && cache.find(file.key, cached)) {
+            file.partial = cached.partial;
+            if (cached.hasFull) {
+                file.full = cached.full;
+            }
+            cacheHits.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        try {
+            FileView view(paths.path(file.path));
+            if (view.size() != file.key.size) {
+                throw std::runtime_error("файл изменился");
+            }
+            view.adviseRandomAccess();
+            Xxh64 state(file.key.size);
+            std::string_view head = view.range(0, EdgeSize);
+            state.update(head);
+            uintmax_t read = head.size();
+            if (file.key.size > EdgeSize) {
+                const uintmax_t tailOffset = std::max<uintmax_t>(EdgeSize, file.key.size - EdgeSize);
+                std::string_view tail = view.range(tailOffset, EdgeSize);
+                state.update(tail);
+                read += tail.size();
+            }
+            file.partial = state.digest();
+            bytesRead.fetch_add(read, std::memory_order_relaxed);
+            partialHashed.fetch_add(1, std::memory_order_relaxed);
+            if (coveredByPartial(file)) {
+                file.full = file.partial;
+            }
+            if (options.useCache) {
+                if (coveredByPartial(file)) {
+                    cache.storeFull(file.key, file.partial, file.full);
+                }
+                else {
+                    cache.storePartial(file.key, file.partial);
+                }
+            }
+        }
+        catch (const std::exception&) {
+            file.failed = true;
+            hashErrors.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Ступень 3: всё содержимое потоково, без загрузки файла в память
+    void hashFull(FileRecord& file) {
+        if (file.failed || file.full != 0 || coveredByPartial(file)) {
+            return;
+        }
+        FM_SCOPE(Io, "hash full");
+        try {
+            FileView view(paths.path(file.path));
+            if (view.size() != file.key.size) {
+                throw std::runtime_error("файл изменился");
+            }
+            Xxh64 state(file.key.size);
+            uintmax_t read = 0;
+            view.forEachChunk([&](std::string_view chunk) {
+                state.update(chunk);
+                read += chunk.size();
+                return true;
+                });
+            if (read != file.key.size) {
+                throw std::runtime_error("файл изменился");
+            }
+            // 0 означает "не посчитан"
+            file.full = state.digest() | 1;
+            bytesRead.fetch_add(read, std::memory_order_relaxed);
+            fullHashed.fetch_add(1, std::memory_order_relaxed);
+            if (options.useCache) {
+                cache.storeFull(file.key, file.partial, file.full);
+            }
+        }
+        catch (const std::exception&) {
+            file.failed = true;
+            hashErrors.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    static bool coveredByPartial(const FileRecord& file) {
+        return file.key.size <= 2 * EdgeSize;
+    }
+
+    // Подгруппы по частичному хэшу; одиночки отсеиваются, остальные идут на полный хэш
+    void splitByPartial(PartialGroup& group, ThreadPool& fullPool, std::vector<DupeGroup>& result, std::mutex& resultMutex) {
+        for (auto& candidates : splitBy(group.files, [](const FileRecord* file) { return file->partial; })) {
+            auto state = std::make_shared<FullGroup>();
+            state->files = std::move(candidates);
+            state->left = state->files.size();
+            for (FileRecord* file : state->files) {
+                fullPool.submit([this, state, file, &result, &resultMutex] {
+                    hashFull(*file);
+                    if (state->left.fetch_sub(1) == 1) {
+                        for (auto& same : splitBy(state->files, [](const FileRecord* item) { return item->full; })) {
+                            DupeGroup found;
+                            found.size = same.front()->key.size;
+                            for (const FileRecord* item : same) {
+                                found.paths.push_back(paths.path(item->path));
+                            }
+                            std::lock_guard<std::mutex> lock(resultMutex);
+                            result.push_back(std::move(found));
+                        }
+                    }
+                    });
+            }
+        }
+    }
+
+    // Группы из двух и более файлов с равным значением key(file); файлы с ошибкой не участвуют
+    template <typename KeyOf>
+    static std::vector<std::vector<FileRecord*>> splitBy(const std::vector<FileRecord*>& files, KeyOf key) {
+        std::vector<FileRecord*> sorted;
+        for (FileRecord* file : files) {
+            if (!file->failed) {
+                sorted.push_back(file);
+            }
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [&](const FileRecord* a, const FileRecord* b) {
+            return key(a) < key(b);
+            });
+        std::vector<std::vector<FileRecord*>> groups;
+        for (size_t begin = 0; begin < sorted.size();) {
+            size_t end = begin + 1;
+            while (end < sorted.size() && key(sorted[end]) == key(sorted[begin])) {
+                end++;
+            }
+            if (end - begin > 1) {
+                groups.emplace_back(sorted.begin() + begin, sorted.begin() + end);
+            }
+            begin = end;
+        }
+        return groups;
+    }
+};
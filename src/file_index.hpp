@@ -0,0 +1,672 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "file_view.hpp"
+#include "matcher.hpp"
+#include "walker.hpp"
+
+#ifdef __linux__
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+struct IndexStats {
+    std::string root;
+    uint64_t nodes = 0;
+    uint64_t directories = 0;
+    uint64_t names = 0;
+    uint64_t trigrams = 0;
+    uint64_t postings = 0;
+    uint64_t fileBytes = 0;
+    int64_t builtAt = 0;
+    uint64_t dirsRescanned = 0;  // только для update
+    uint64_t dirsReused = 0;     // только для update
+};
+
+// Постоянный индекс имён файлов в духе locate/plocate.
+// Дерево хранится в порядке обхода в ширину: у каждой папки дети лежат подряд.
+// Имена компонентов пути интернированы (одинаковые имена хранятся один раз),
+// по каждой триграмме имени есть список идентификаторов имён. Файл индекса отображается
+// в память целиком, поиск подстроки пересекает списки триграмм и проверяет только кандидатов.
+// update перечитывает только папки, у которых изменилось время модификации.
+class FileIndex {
+public:
+    static fs::path defaultLocation() {
+        if (const char* custom = std::getenv("FM_INDEX")) {
+            return custom;
+        }
+#ifdef _WIN32
+        const char* base = std::getenv("LOCALAPPDATA");
+        fs::path dir = base ? fs::path(base) : fs::temp_directory_path();
+#else
+        const char* xdg = std::getenv("XDG_CACHE_HOME");
+        const char* home = std::getenv("HOME");
+        fs::path dir = xdg ? fs::path(xdg) : home ? fs::path(home) / ".cache" : fs::temp_directory_path();
+#endif
+        return dir / "filemanager" / "index.bin";
+    }
+
+    void unload() {
+        header = nullptr;
+        view.reset();
+    }
+
+    bool loaded() const {
+        return header != nullptr;
+    }
+
+    // Загружает индекс; при отсутствии или повреждении файла возвращает false
+    bool load(const fs::path& file) {
+        unload();
+        std::error_code ec;
+        if (!fs::is_regular_file(file, ec)) {
+            return false;
+        }
+        try {
+            auto candidate = std::make_unique<FileView>(file);
+            if (!candidate->hasSize() || candidate->size() < sizeof(Header)) {
+                return false;
+            }
+            candidate->adviseRandomAccess();
+            std::string_view bytes = candidate->range(0, static_cast<size_t>(candidate->size()));
+            if (bytes.size() != candidate->size() || !attach(bytes)) {
+                return false;
+            }
+            view = std::move(candidate);
+            location = file;
+            return true;
+        }
+        catch (const std::exception&) {
+            unload();
+            return false;
+        }
+    }
+
+    std::string rootPath() const {
+        return loaded() ? std::string(nameOf(nodes[0].name)) : std::string();
+    }
+
+    IndexStats stats() const {
+        IndexStats result;
+        if (!loaded()) {
+            return result;
+        }
+        result.root = rootPath();
+        result.nodes = header->nodeCount;
+        result.directories = header->dirCount;
+        result.names = header->nameCount;
+        result.trigrams = header->trigramCount;
+        result.postings = header->postingCount;
+        result.fileBytes = view->size();
+        result.builtAt = header->builtAt;
+        return result;
+    }
+
+    // Покрывает ли индекс папку dir
+    bool covers(const fs::path& dir) const {
+        return loaded() && findDirectory(dir) != NoNode;
+    }
+
+    // Файлы (не папки) под under, имя которых подходит под matcher. onMatch(const std::string& path).
+    // Триграммы используются только для точной подстроки, остальные режимы проверяют
+    // таблицу уникальных имён, которая намного меньше числа файлов
+    template <typename F>
+    void search(const Matcher& matcher, const fs::path& under, F onMatch) const {
+        if (!loaded()) {
+            return;
+        }
+        const uint32_t base = findDirectory(under);
+        if (base == NoNode) {
+            return;
+        }
+
+        auto emitName = [&](uint32_t nameId) {
+            if (!matcher.matches(nameOf(nameId))) {
+                return;
+            }
+            const NameRecord& record = names[nameId];
+            for (uint32_t i = 0; i < record.nodeCount; i++) {
+                uint32_t node = nameNodes[record.firstNode + i];
+                if (static_cast<EntryType>(nodes[node].type) != EntryType::Directory && isUnder(node, base)) {
+                    onMatch(pathOf(node));
+                }
+            }
+        };
+
+        const std::string_view pattern = matcher.literal();
+        if (!matcher.isLiteral() || pattern.size() < 3) {
+            for (uint32_t nameId = 0; nameId < header->nameCount; nameId++) {
+                emitName(nameId);
+            }
+            return;
+        }
+
+        // Списки всех триграмм шаблона; начинаем пересечение с самого короткого
+        std::vector<std::pair<const uint32_t*, uint32_t>> lists;
+        for (size_t i = 0; i + 3 <= pattern.size(); i++) {
+            const TrigramRecord* record = findTrigram(trigramKey(pattern.data() + i));
+            if (!record) {
+                return;
+            }
+            lists.emplace_back(postings + record->firstPosting, record->count);
+        }
+        std::sort(lists.begin(), lists.end(), [](const auto& a, const auto& b) {
+            return a.second != b.second ? a.second < b.second : a.first < b.first;
+            });
+        lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+
+        for (uint32_t i = 0; i < lists[0].second; i++) {
+            uint32_t nameId = lists[0].first[i];
+            bool everywhere = true;
+            for (size_t l = 1; l < lists.size() && everywhere; l++) {
+                everywhere = std::binary_search(lists[l].first, lists[l].first + lists[l].second, nameId);
+            }
+            if (everywhere) {
+                emitName(nameId);
+            }
+        }
+    }
+
+    // Полное построение индекса для root
+    static IndexStats build(const fs::path& root, const fs::path& file) {
+        ScanMap scan;
+        std::mutex scanMutex;
+        const std::string rootPath = normalizeRoot(root);
+
+        ParallelWalker walker;
+        walker.walk(rootPath, [&](const WalkDir& dir, std::vector<WalkEntry>& entries) {
+            int64_t mtime = directoryMtime(dir.path, dir.fd);
+            std::vector<ScannedEntry> children;
+            children.reserve(entries.size());
+            for (const auto& entry : entries) {
+                children.push_back(ScannedEntry{ std::string(entry.name()), entry.type });
+            }
+            std::lock_guard<std::mutex> lock(scanMutex);
+            ScannedDir& scanned = scan[dir.path];
+            scanned.mtime = mtime;
+            scanned.children.insert(scanned.children.end(),
+                std::make_move_iterator(children.begin()), std::make_move_iterator(children.end()));
+            });
+
+        IndexStats result = write(rootPath, scan, file);
+        result.dirsRescanned = result.directories;
+        return result;
+    }
+
+    // Инкрементальное обновление загруженного индекса: папка перечитывается,
+    // только если её mtime отличается от сохранённого
+    IndexStats update() {
+        const std::string root = rootPath();
+        ScanMap scan;
+        uint64_t rescanned = 0;
+        uint64_t reused = 0;
+
+        struct Pending {
+            std::string path;
+            uint32_t oldNode;
+        };
+        std::deque<Pending> queue;
+        queue.push_back(Pending{ root, 0 });
+
+        while (!queue.empty()) {
+            Pending current = std::move(queue.front());
+            queue.pop_front();
+
+            int64_t mtime = directoryMtime(current.path, -1);
+            if (mtime == 0) {
+                continue;
+            }
+            const DirRecord* old = current.oldNode != NoNode ? findDirRecord(current.oldNode) : nullptr;
+            ScannedDir& scanned = scan[current.path];
+            scanned.mtime = mtime;
+
+            std::unordered_map<std::string_view, uint32_t> oldChildren;
+            if (old && old->mtime == mtime) {
+                reused++;
+                for (uint32_t i = 0; i < old->childCount; i++) {
+                    const Node& child = nodes[old->firstChild + i];
+                    scanned.children.push_back(ScannedEntry{ std::string(nameOf(child.name)), static_cast<EntryType>(child.type) });
+                    oldChildren.emplace(nameOf(child.name), old->firstChild + i);
+                }
+            }
+            else {
+                rescanned++;
+                scanned.children = listDirectory(current.path);
+                if (old) {
+                    for (uint32_t i = 0; i < old->childCount; i++) {
+                        oldChildren.emplace(nameOf(nodes[old->firstChild + i].name), old->firstChild + i);
+                    }
+                }
+            }
+
+            for (const auto& child : scanned.children) {
+                if (child.type != EntryType::Directory) {
+                    continue;
+                }
+                auto found = oldChildren.find(child.name);
+                uint32_t oldChild = found != oldChildren.end() && static_cast<EntryType>(nodes[found->second].type) == EntryType::Directory
+                    ? found->second : NoNode;
+                queue.push_back(Pending{ joinPath(current.path, child.name), oldChild });
+            }
+        }
+
+        // Отображение снимается до записи: на Windows открытый файл нельзя заменить
+        fs::path file = location;
+        unload();
+        IndexStats result;
+        try {
+            result = write(root, scan, file);
+        }
+        catch (...) {
+            load(file);
+            throw;
+        }
+        result.dirsRescanned = rescanned;
+        result.dirsReused = reused;
+        load(file);
+        return result;
+    }
+
+private:
+    static constexpr uint32_t NoNode = UINT32_MAX;
+    static constexpr char Magic[8] = { 'F', 'M', 'I', 'D', 'X', '0', '1', '\0' };
+
+    struct Header {
+        char magic[8];
+        uint64_t nodeCount;
+        uint64_t nodesOffset;
+        uint64_t dirCount;
+        uint64_t dirsOffset;
+        uint64_t nameCount;
+        uint64_t namesOffset;
+        uint64_t nameNodesOffset;
+        uint64_t trigramCount;
+        uint64_t trigramsOffset;
+        uint64_t postingCount;
+        uint64_t postingsOffset;
+        uint64_t blobSize;
+        uint64_t blobOffset;
+        int64_t builtAt;
+    };
+
+    struct Node {
+        uint32_t parent;
+        uint32_t name;
+        uint8_t type;
+        uint8_t reserved[3];
+    };
+
+    struct DirRecord {
+        uint32_t node;
+        uint32_t firstChild;
+        uint32_t childCount;
+        uint32_t reserved;
+        int64_t mtime;
+    };
+
+    struct NameRecord {
+        uint32_t offset;
+        uint32_t length;
+        uint32_t firstNode;
+        uint32_t nodeCount;
+    };
+
+    struct TrigramRecord {
+        uint32_t key;
+        uint32_t count;
+        uint64_t firstPosting;
+    };
+
+    struct ScannedEntry {
+        std::string name;
+        EntryType type;
+    };
+
+    struct ScannedDir {
+        int64_t mtime = 0;
+        std::vector<ScannedEntry> children;
+    };
+
+    using ScanMap = std::unordered_map<std::string, ScannedDir>;
+
+    std::unique_ptr<FileView> view;
+    fs::path location;
+    const Header* header = nullptr;
+    const Node* nodes = nullptr;
+    const DirRecord* dirs = nullptr;
+    const NameRecord* names = nullptr;
+    const uint32_t* nameNodes = nullptr;
+    const TrigramRecord* trigrams = nullptr;
+    const uint32_t* postings = nullptr;
+    const char* blob = nullptr;
+
+    bool attach(std::string_view bytes) {
+        const char* base = bytes.data();
+        auto* candidate = reinterpret_cast<const Header*>(base);
+        if (std::memcmp(candidate->magic, Magic, sizeof(Magic)) != 0) {
+            return false;
+        }
+        auto fits = [&](uint64_t offset, uint64_t count, size_t itemSize) {
+            return offset <= bytes.size() && count <= (bytes.size() - offset) / itemSize;
+        };
+        if (!fits(candidate->nodesOffset, candidate->nodeCount, sizeof(Node))
+            || !fits(candidate->dirsOffset, candidate->dirCount, sizeof(DirRecord))
+            || !fits(candidate->namesOffset, candidate->nameCount, sizeof(NameRecord))
+            || !fits(candidate->nameNodesOffset, candidate->nodeCount, sizeof(uint32_t))
+            || !fits(candidate->trigramsOffset, candidate->trigramCount, sizeof(TrigramRecord))
+            || !fits(candidate->postingsOffset, candidate->postingCount, sizeof(uint32_t))
+            || !fits(candidate->blobOffset, candidate->blobSize, 1)
+            || candidate->nodeCount == 0 || candidate->nodeCount >= NoNode) {
+            return false;
+        }
+
+        header = candidate;
+        nodes = reinterpret_cast<const Node*>(base + header->nodesOffset);
+        dirs = reinterpret_cast<const DirRecord*>(base + header->dirsOffset);
+        names = reinterpret_cast<const NameRecord*>(base + header->namesOffset);
+        nameNodes = reinterpret_cast<const uint32_t*>(base + header->nameNodesOffset);
+        trigrams = reinterpret_cast<const TrigramRecord*>(base + header->trigramsOffset);
+        postings = reinterpret_cast<const uint32_t*>(base + header->postingsOffset);
+        blob = base + header->blobOffset;
+        return true;
+    }
+
+    std::string_view nameOf(uint32_t nameId) const {
+        const NameRecord& record = names[nameId];
+        return std::string_view(blob + record.offset, record.length);
+    }
+
+    std::string pathOf(uint32_t node) const {
+        std::vector<uint32_t> chain;
+        for (uint32_t current = node; current != 0; current = nodes[current].parent) {
+            chain.push_back(current);
+        }
+        std::string path(nameOf(nodes[0].name));
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            path = joinPath(path, nameOf(nodes[*it].name));
+        }
+        return path;
+    }
+
+    bool isUnder(uint32_t node, uint32_t base) const {
+        if (base == 0) {
+            return true;
+        }
+        for (uint32_t current = nodes[node].parent; current != 0; current = nodes[current].parent) {
+            if (current == base) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const DirRecord* findDirRecord(uint32_t node) const {
+        const DirRecord* end = dirs + header->dirCount;
+        const DirRecord* found = std::lower_bound(dirs, end, node, [](const DirRecord& record, uint32_t value) {
+            return record.node < value;
+            });
+        return found != end && found->node == node ? found : nullptr;
+    }
+
+    // Узел папки по абсолютному пути; NoNode, если папка вне индекса
+    uint32_t findDirectory(const fs::path& dir) const {
+        fs::path root(rootPath());
+        fs::path relative = dir.lexically_relative(root);
+        if (relative.empty() || *relative.begin() == "..") {
+            return NoNode;
+        }
+        uint32_t node = 0;
+        for (const auto& component : relative) {
+            std::string name = component.string();
+            if (name == ".") {
+                continue;
+            }
+            const DirRecord* record = findDirRecord(node);
+            if (!record) {
+                return NoNode;
+            }
+            uint32_t next = NoNode;
+            for (uint32_t i = 0; i < record->childCount; i++) {
+                if (nameOf(nodes[record->firstChild + i].name) == name) {
+                    next = record->firstChild + i;
+                    break;
+                }
+            }
+            if (next == NoNode) {
+                return NoNode;
+            }
+            node = next;
+        }
+        return node;
+    }
+
+    const TrigramRecord* findTrigram(uint32_t key) const {
+        const TrigramRecord* end = trigrams + header->trigramCount;
+        const TrigramRecord* found = std::lower_bound(trigrams, end, key, [](const TrigramRecord& record, uint32_t value) {
+            return record.key < value;
+            });
+        return found != end && found->key == key ? found : nullptr;
+    }
+
+    static uint32_t trigramKey(const char* p) {
+        return (static_cast<uint32_t>(static_cast<unsigned char>(p[0])) << 16)
+            | (static_cast<uint32_t>(static_cast<unsigned char>(p[1])) << 8)
+            | static_cast<uint32_t>(static_cast<unsigned char>(p[2]));
+    }
+
+    static std::string joinPath(const std::string& dir, std::string_view name) {
+        std::string path;
+        path.reserve(dir.size() + 1 + name.size());
+        path = dir;
+        if (path.empty() || (path.back() != '/' && path.back() != '\\')) {
+            path += fs::path::preferred_separator;
+        }
+        path += name;
+        return path;
+    }
+
+    static std::string normalizeRoot(const fs::path& root) {
+        std::string path = fs::canonical(root).string();
+        if (path.size() > 1 && (path.back() == '/' || path.back() == '\\')) {
+            path.pop_back();
+        }
+        return path;
+    }
+
+    // Время модификации папки в наносекундах; 0, если папка недоступна
+    static int64_t directoryMtime(const std::string& path, int fd) {
+#ifdef __linux__
+        struct stat st;
+        int result = fd >= 0 ? ::fstat(fd, &st) : ::stat(path.c_str(), &st);
+        if (result != 0) {
+            return 0;
+        }
+        return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#else
+        (void)fd;
+        std::error_code ec;
+        auto time = fs::last_write_time(path, ec);
+        return ec ? 0 : static_cast<int64_t>(time.time_since_epoch().count());
+#endif
+    }
+
+    static std::vector<ScannedEntry> listDirectory(const std::string& path) {
+        std::vector<ScannedEntry> children;
+        std::error_code ec;
+        for (fs::directory_iterator it(path, fs::directory_options::skip_permission_denied, ec), end; !ec && it != end; it.increment(ec)) {
+            fs::file_type type = it->symlink_status(ec).type();
+            EntryType entryType = type == fs::file_type::directory ? EntryType::Directory
+                : type == fs::file_type::regular ? EntryType::File
+                : type == fs::file_type::symlink ? EntryType::Symlink
+                : EntryType::Other;
+            children.push_back(ScannedEntry{ it->path().filename().string(), entryType });
+        }
+        return children;
+    }
+
+    template <typename T>
+    static void appendSection(std::string& out, const std::vector<T>& items, uint64_t& offset) {
+        while (out.size() % 8 != 0) {
+            out += '\0';
+        }
+        offset = out.size();
+        out.append(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(T));
+    }
+
+    // Раскладывает результат сканирования в ширину и записывает файл индекса (через временный файл)
+    static IndexStats write(const std::string& root, ScanMap& scan, const fs::path& file) {
+        std::vector<Node> nodeList;
+        std::vector<DirRecord> dirList;
+        std::vector<std::string_view> nameList;
+        std::unordered_map<std::string_view, uint32_t> nameIds;
+
+        auto intern = [&](std::string_view name) {
+            auto found = nameIds.find(name);
+            if (found != nameIds.end()) {
+                return found->second;
+            }
+            uint32_t id = static_cast<uint32_t>(nameList.size());
+            nameList.push_back(name);
+            nameIds.emplace(name, id);
+            return id;
+        };
+
+        nodeList.push_back(Node{ 0, intern(root), static_cast<uint8_t>(EntryType::Directory), {} });
+        std::deque<std::pair<uint32_t, std::string>> queue;
+        queue.emplace_back(0, root);
+
+        while (!queue.empty()) {
+            auto [node, path] = std::move(queue.front());
+            queue.pop_front();
+
+            DirRecord record{ node, static_cast<uint32_t>(nodeList.size()), 0, 0, 0 };
+            auto found = scan.find(path);
+            if (found != scan.end()) {
+                ScannedDir& scanned = found->second;
+                std::sort(scanned.children.begin(), scanned.children.end(), [](const ScannedEntry& a, const ScannedEntry& b) {
+                    return a.name < b.name;
+                    });
+                record.mtime = scanned.mtime;
+                record.childCount = static_cast<uint32_t>(scanned.children.size());
+                for (const auto& child : scanned.children) {
+                    uint32_t id = static_cast<uint32_t>(nodeList.size());
+                    nodeList.push_back(Node{ node, intern(child.name), static_cast<uint8_t>(child.type), {} });
+                    if (child.type == EntryType::Directory) {
+                        queue.emplace_back(id, joinPath(path, child.name));
+                    }
+                }
+            }
+            else {
+                // Пустые папки обходчик не передаёт в обработчик
+                record.mtime = directoryMtime(path, -1);
+            }
+            dirList.push_back(record);
+        }
+
+        // Имена: блоб, списки узлов по имени и триграммы
+        std::string blobData;
+        std::vector<NameRecord> nameRecords(nameList.size());
+        for (size_t i = 0; i < nameList.size(); i++) {
+            nameRecords[i].offset = static_cast<uint32_t>(blobData.size());
+            nameRecords[i].length = static_cast<uint32_t>(nameList[i].size());
+            blobData.append(nameList[i].data(), nameList[i].size());
+        }
+
+        for (const auto& node : nodeList) {
+            nameRecords[node.name].nodeCount++;
+        }
+        uint32_t running = 0;
+        for (auto& record : nameRecords) {
+            record.firstNode = running;
+            running += record.nodeCount;
+            record.nodeCount = 0;
+        }
+        std::vector<uint32_t> nameNodeList(nodeList.size());
+        for (uint32_t id = 0; id < nodeList.size(); id++) {
+            NameRecord& record = nameRecords[nodeList[id].name];
+            nameNodeList[record.firstNode + record.nodeCount++] = id;
+        }
+
+        std::vector<std::pair<uint32_t, uint32_t>> pairs;
+        for (uint32_t id = 0; id < nameList.size(); id++) {
+            std::string_view name = nameList[id];
+            for (size_t i = 0; i + 3 <= name.size(); i++) {
+                pairs.emplace_back(trigramKey(name.data() + i), id);
+            }
+        }
+        std::sort(pairs.begin(), pairs.end());
+        pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+        std::vector<TrigramRecord> trigramList;
+        std::vector<uint32_t> postingList;
+        postingList.reserve(pairs.size());
+        for (const auto& [key, id] : pairs) {
+            if (trigramList.empty() || trigramList.back().key != key) {
+                trigramList.push_back(TrigramRecord{ key, 0, postingList.size() });
+            }
+            trigramList.back().count++;
+            postingList.push_back(id);
+        }
+
+        Header head{};
+        std::memcpy(head.magic, Magic, sizeof(Magic));
+        head.nodeCount = nodeList.size();
+        head.dirCount = dirList.size();
+        head.nameCount = nameRecords.size();
+        head.trigramCount = trigramList.size();
+        head.postingCount = postingList.size();
+        head.blobSize = blobData.size();
+        head.builtAt = static_cast<int64_t>(std::time(nullptr));
+
+        std::string out(sizeof(Header), '\0');
+        appendSection(out, nodeList, head.nodesOffset);
+        appendSection(out, dirList, head.dirsOffset);
+        appendSection(out, nameRecords, head.namesOffset);
+        appendSection(out, nameNodeList, head.nameNodesOffset);
+        appendSection(out, trigramList, head.trigramsOffset);
+        appendSection(out, postingList, head.postingsOffset);
+        head.blobOffset = out.size();
+        out += blobData;
+        std::memcpy(out.data(), &head, sizeof(Header));
+
+        fs::create_directories(file.parent_path());
+        fs::path temp = file;
+        temp += ".tmp";
+        {
+            std::ofstream stream(temp, std::ios::binary | std::ios::trunc);
+            stream.write(out.data(), static_cast<std::streamsize>(out.size()));
+            if (!stream) {
+                throw fs::filesystem_error("Не удалось записать индекс", temp, std::make_error_code(std::errc::io_error));
+            }
+        }
+        fs::rename(temp, file);
+
+        IndexStats result;
+        result.root = root;
+        result.nodes = head.nodeCount;
+        result.directories = head.dirCount;
+        result.names = head.nameCount;
+        result.trigrams = head.trigramCount;
+        result.postings = head.postingCount;
+        result.fileBytes = out.size();
+        result.builtAt = head.builtAt;
+        return result;
+    }
+};
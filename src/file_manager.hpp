@@ -0,0 +1,1876 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "archive.hpp"
+#include "bulk_operation.hpp"
+#include "console_output.hpp"
+#include "content_search.hpp"
+#include "copy_engine.hpp"
+#include "delete_engine.hpp"
+#include "disk_usage.hpp"
+#include "duplicate_finder.hpp"
+#include "file_index.hpp"
+#include "file_view.hpp"
+#include "file_writer.hpp"
+#include "find_query.hpp"
+#include "instrumentation.hpp"
+#include "job_scheduler.hpp"
+#include "listing.hpp"
+#include "matcher.hpp"
+#include "metadata_cache.hpp"
+#include "sync_engine.hpp"
+#include "walker.hpp"
+#include "watcher.hpp"
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Локальное время в виде строки (кроссплатформенная версия)
+inline std::string formatTime(std::time_t tt) {
+    std::tm tm = {};
+
+#ifdef _WIN32
+    // Windows: используем localtime_s
+    if (localtime_s(&tm, &tt) != 0) {
+        return "Ошибка преобразования времени";
+    }
+#else
+    // Linux/Unix: используем localtime_r
+    if (localtime_r(&tt, &tm) == nullptr) {
+        return "Ошибка преобразования времени";
+    }
+#endif
+
+    std::ostringstream oss;
+    oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
+    return oss.str();
+}
+
+// Функция для преобразования file_time_type в строку
+inline std::string timeToString(fs::file_time_type ftime) {
+    try {
+        // Преобразуем file_time в system_clock time_point
+        auto sctp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+            ftime - fs::file_time_type::clock::now() + std::chrono::system_clock::now());
+
+        return formatTime(std::chrono::system_clock::to_time_t(sctp));
+    }
+    catch (const std::exception& e) {
+        return std::string("Ошибка времени: ") + e.what();
+    }
+}
+
+// Размер в читаемом виде: байты, КБ, МБ, ГБ, ТБ
+inline std::string formatSize(uintmax_t bytes) {
+    static const char* units[] = { "Б", "КБ", "МБ", "ГБ", "ТБ" };
+    double value = static_cast<double>(bytes);
+    size_t unit = 0;
+    while (value >= 1024 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+        value /= 1024;
+        unit++;
+    }
+
+    std::ostringstream oss;
+    if (unit == 0) {
+        oss << bytes << ' ' << units[0];
+    }
+    else {
+        oss << std::fixed << std::setprecision(1) << value << ' ' << units[unit];
+    }
+    return oss.str();
+}
+
+// Размер из строки: число с необязательным суффиксом K, M, G (степени 1024)
+inline uint64_t parseSize(const std::string& text) {
+    size_t used = 0;
+    const unsigned long long value = std::stoull(text, &used);
+    uint64_t scale = 1;
+    if (used + 1 == text.size()) {
+        switch (text[used]) {
+        case 'K': case 'k': scale = 1ull << 10; break;
+        case 'M': case 'm': scale = 1ull << 20; break;
+        case 'G': case 'g': scale = 1ull << 30; break;
+        default: throw std::invalid_argument("неизвестный суффикс размера: " + text);
+        }
+    }
+    else if (used != text.size()) {
+        throw std::invalid_argument("неверный размер: " + text);
+    }
+    return value * scale;
+}
+
+// Секунды с момента started, с точностью до тысячных
+inline std::string secondsSince(std::chrono::steady_clock::time_point started) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(3)
+        << std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return oss.str();
+}
+
+// Базовый класс для работы с файлами и папками
+class FileSystemObject {
+protected:
+    fs::path path;
+
+public:
+    FileSystemObject(const std::string& p) : path(p) {}
+
+    virtual ~FileSystemObject() = default;
+
+    bool exists() const {
+        return fs::exists(path);
+    }
+
+    std::string getPath() const {
+        return path.string();
+    }
+
+    virtual void showInfo() const = 0;
+};
+
+// Класс для работы с файлами
+class File : public FileSystemObject {
+public:
+    File(const std::string& p) : FileSystemObject(p) {}
+
+    void showInfo() const override {
+        showInfo(nullptr);
+    }
+
+    // Размер и время берутся из кэша метаданных родительской папки, если он их знает
+    void showInfo(MetadataCache* cache) const {
+        MetadataCache::EntryInfo cached;
+        if (cache) {
+            cached = cache->lookup(path.parent_path(), path.filename().string());
+        }
+        if (cached.presence == MetadataCache::Presence::Present && cached.hasMetadata) {
+            std::cout << "Файл: " << path.filename().string() << "\n"
+                << "Размер: " << cached.size << " байт\n"
+                << "Последнее изменение: " << formatTime(cached.mtime) << "\n";
+            return;
+        }
+        if (exists()) {
+            try {
+                std::cout << "Файл: " << path.filename().string() << "\n"
+                    << "Размер: " << fs::file_size(path) << " байт\n"
+                    << "Последнее изменение: " << timeToString(fs::last_write_time(path)) << "\n";
+            }
+            catch (const std::exception& e) {
+                std::cout << "Ошибка при получении информации о файле: " << e.what() << "\n";
+            }
+        }
+        else {
+            std::cout << "Файл не существует: " << path.filename().string() << "\n";
+        }
+    }
+
+    void create() {
+        try {
+            std::ofstream file(path);
+            if (file.is_open()) {
+                file.close();
+                std::cout << "Файл создан: " << path.filename().string() << "\n";
+            }
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка при создании файла: " << e.what() << "\n";
+        }
+    }
+
+    void deleteFile() {
+        if (exists()) {
+            try {
+                fs::remove(path);
+                std::cout << "Файл удален: " << path.filename().string() << "\n";
+            }
+            catch (const std::exception& e) {
+                std::cout << "Ошибка при удалении файла: " << e.what() << "\n";
+            }
+        }
+        else {
+            std::cout << "Файл не существует: " << path.filename().string() << "\n";
+        }
+    }
+
+    // Запись через временный файл и rename: после сбоя файл либо старый, либо новый целиком.
+    // По умолчанию данные синхронизируются на диск до замены (Durability::Sync)
+    void write(const std::string& content, WriteOptions options = {}) {
+        try {
+            options.expectedSize = content.size();
+            FileWriter writer(path, options);
+            writer.write(content);
+            writer.commit();
+            std::cout << "Содержимое записано в файл: " << path.filename().string() << "\n";
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка при записи в файл: " << e.what() << "\n";
+        }
+    }
+
+    void append(const std::string& content, WriteOptions options = {}) {
+        options.append = true;
+        write(content, options);
+    }
+
+    std::string read() const {
+        if (exists()) {
+            try {
+                FileView view(path);
+                std::string content;
+                if (view.hasSize()) {
+                    content.reserve(static_cast<size_t>(view.size()));
+                }
+                view.forEachChunk([&content](std::string_view chunk) {
+                    content.append(chunk.data(), chunk.size());
+                    return true;
+                    });
+                return content;
+            }
+            catch (const std::exception& e) {
+                std::cout << "Ошибка при чтении файла: " << e.what() << "\n";
+                return "";
+            }
+        }
+        return "";
+    }
+
+    // Вывод файла порциями: память не зависит от размера файла
+    void cat() const {
+        if (!exists()) {
+            std::cout << "Файл не существует: " << path.filename().string() << "\n";
+            return;
+        }
+        try {
+            FileView view(path);
+            view.forEachChunk([](std::string_view chunk) {
+                FM_SCOPE(Output, "console");
+                std::cout.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+                return true;
+                });
+            std::cout << std::flush;
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка при чтении файла: " << e.what() << "\n";
+        }
+    }
+
+    void head(size_t lines) const {
+        if (!exists()) {
+            std::cout << "Файл не существует: " << path.filename().string() << "\n";
+            return;
+        }
+        try {
+            FileView view(path);
+            size_t left = lines;
+            if (left == 0) {
+                return;
+            }
+            view.forEachLine([&left](std::string_view line) {
+                std::cout.write(line.data(), static_cast<std::streamsize>(line.size()));
+                std::cout << '\n';
+                return --left > 0;
+                });
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка при чтении файла: " << e.what() << "\n";
+        }
+    }
+
+    // Хвост файла: начало последних строк ищется чтением с конца файла
+    void tail(size_t lines) const {
+        if (!exists()) {
+            std::cout << "Файл не существует: " << path.filename().string() << "\n";
+            return;
+        }
+        try {
+            FileView view(path);
+            if (view.hasSize()) {
+                view.forEachChunk([](std::string_view chunk) {
+                    FM_SCOPE(Output, "console");
+                    std::cout.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+                    return true;
+                    }, view.tailOffset(lines));
+                std::cout << std::flush;
+                return;
+            }
+
+            // Размер неизвестен (например, файлы /proc): держим только последние строки
+            std::deque<std::string> last;
+            view.forEachLine([&](std::string_view line) {
+                if (lines == 0) {
+                    return false;
+                }
+                if (last.size() == lines) {
+                    last.pop_front();
+                }
+                last.emplace_back(line);
+                return true;
+                });
+            for (const auto& line : last) {
+                std::cout << line << '\n';
+            }
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка при чтении файла: " << e.what() << "\n";
+        }
+    }
+};
+
+// Класс для работы с папками
+class Directory : public FileSystemObject {
+public:
+    Directory(const std::string& p) : FileSystemObject(p) {}
+
+    void showInfo() const override {
+        showInfo(nullptr);
+    }
+
+    void showInfo(MetadataCache* cache) const {
+        if (exists()) {
+            try {
+                int fileCount = 0;
+                int dirCount = 0;
+
+                std::shared_ptr<const DirectoryListing> listing = load(false, cache);
+                for (size_t i = 0; i < listing->size(); i++) {
+                    if (listing->kind(i) == DirectoryListing::Dir) {
+                        dirCount++;
+                    }
+                    else {
+                        fileCount++;
+                    }
+                }
+
+                std::cout << "Папка: " << path.filename().string() << '\n'
+                    << "Файлов: " << fileCount << '\n'
+                    << "Папок: " << dirCount << '\n'
+                    << "Последнее изменение: " << timeToString(fs::last_write_time(path)) << "\n";
+            }
+            catch (const std::exception& e) {
+                std::cout << "Ошибка при получении информации о папке: " << e.what() << "\n";
+            }
+        }
+        else {
+            std::cout << "Папка не существует: " << path.filename().string() << "\n";
+        }
+    }
+
+    void create() {
+        if (!exists()) {
+            try {
+                fs::create_directories(path);
+                std::cout << "Папка создана: " << path.filename().string() << "\n";
+            }
+            catch (const std::exception& e) {
+                std::cout << "Ошибка при создании папки: " << e.what() << "\n";
+            }
+        }
+        else {
+            std::cout << "Папка уже существует: " << path.filename().string() << "\n";
+        }
+    }
+
+    // С control - фоновая задача: прогресс идёт в неё, отмена пробрасывается как OperationCancelled
+    void deleteDir(std::ostream& out = std::cout, JobControl* control = nullptr) {
+        if (exists()) {
+            try {
+                bool progressShown = false;
+                DeleteOptions options;
+                if (control) {
+                    options.control = control;
+                    options.threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+                }
+                else if (Console::interactive()) {
+                    options.onProgress = [&progressShown](const DeleteProgress& progress) {
+                        progressShown = true;
+                        std::cout << "\rУдаление: " << progress.files << " файлов, " << progress.directories << " папок, "
+                            << static_cast<uintmax_t>(progress.entriesPerSecond()) << " элем/с   " << std::flush;
+                    };
+                }
+                DeleteEngine engine(options);
+                engine.remove(path);
+                if (progressShown) {
+                    out << '\n';
+                }
+
+                DeleteProgress total = engine.progress();
+                out << "Папка удалена: " << path.filename().string()
+                    << " (" << total.files << " файлов, " << total.directories << " папок, "
+                    << static_cast<uintmax_t>(total.entriesPerSecond()) << " элем/с)\n";
+            }
+            catch (const OperationCancelled&) {
+                throw;
+            }
+            catch (const std::exception& e) {
+                out << "Ошибка при удалении папки: " << e.what() << "\n";
+            }
+        }
+        else {
+            out << "Папка не существует: " << path.filename().string() << "\n";
+        }
+    }
+
+    std::shared_ptr<const DirectoryListing> load(bool detailed, MetadataCache* cache) const {
+        if (cache) {
+            return cache->listing(path, detailed);
+        }
+        auto listing = std::make_shared<DirectoryListing>();
+        listing->load(path, detailed);
+        return listing;
+    }
+
+    // Строка списка: имя или, в подробном режиме, тип, размер, имя и время изменения
+    static void appendLine(std::string& out, std::string_view name, DirectoryListing::Kind kind, uint64_t size,
+        std::time_t mtime, bool detailed, TimeFormatter& formatter) {
+        if (!detailed) {
+            out.append(name.data(), name.size());
+            out += '\n';
+            return;
+        }
+        if (kind == DirectoryListing::Broken) {
+            out += "[ERROR] ";
+            out.append(name.data(), name.size());
+            out += " - ошибка доступа\n";
+            return;
+        }
+        if (kind == DirectoryListing::Dir) {
+            out += "[DIR]  ";
+        }
+        else {
+            char number[24];
+            out += "[FILE] ";
+            int length = std::snprintf(number, sizeof(number), "%10llu", static_cast<unsigned long long>(size));
+            out.append(number, static_cast<size_t>(length));
+            out += " bytes ";
+        }
+        out.append(name.data(), name.size());
+        if (name.size() < 20) {
+            out.append(20 - name.size(), ' ');
+        }
+        out += ' ';
+        char time[TimeFormatter::Length];
+        formatter.format(mtime, time);
+        out.append(time, TimeFormatter::Length);
+        out += '\n';
+    }
+
+    // cache - содержимое берётся из кэша метаданных, если папка уже читалась и не менялась
+    void listContents(bool detailed = false, MetadataCache* cache = nullptr) const {
+        if (exists()) {
+            try {
+                // Имена читаются пачками getdents64, метаданные - одним statx на элемент;
+                // весь вывод собирается в один буфер и пишется за раз
+                std::shared_ptr<const DirectoryListing> loaded = load(detailed, cache);
+                const DirectoryListing& listing = *loaded;
+
+                TimeFormatter formatter;
+                std::string out;
+                out.reserve(listing.size() * (detailed ? 64 : 16));
+                for (uint32_t i : listing.sortedOrder()) {
+                    appendLine(out, listing.name(i), listing.kind(i), listing.fileSize(i), listing.mtime(i), detailed, formatter);
+                }
+                FM_SCOPE(Output, "console");
+                std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+            }
+            catch (const std::exception& e) {
+                std::cout << "Ошибка при чтении содержимого папки: " << e.what() << "\n";
+            }
+        }
+        else {
+            std::cout << "Папка не существует: " << path.filename().string() << "\n";
+        }
+    }
+
+    // Одна страница отсортированного списка: count элементов после курсора after
+    // (или с начала), пропустив skip. Вся папка в памяти не держится
+    ListingCursor listPage(bool detailed, const ListingCursor* after, size_t skip, size_t count) const {
+        if (!exists()) {
+            std::cout << "Папка не существует: " << path.filename().string() << "\n";
+            return {};
+        }
+        try {
+            ListingPage page = DirectoryPager::read(path, after, skip, count, detailed);
+            TimeFormatter formatter;
+            std::string out;
+            out.reserve(page.items.size() * (detailed ? 64 : 16) + 128);
+            for (const auto& item : page.items) {
+                appendLine(out, item.name, item.kind, item.size, item.mtime, detailed, formatter);
+            }
+            if (page.items.empty()) {
+                out += "Больше элементов нет (всего " + std::to_string(page.total) + ")\n";
+            }
+            else {
+                out += "Элементы " + std::to_string(page.first + 1) + "-" + std::to_string(page.first + page.items.size())
+                    + " из " + std::to_string(page.total);
+                out += page.first + page.items.size() < page.total ? ", ls --next - следующая страница\n" : "\n";
+            }
+            FM_SCOPE(Output, "console");
+            std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+            return page.next;
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка при чтении содержимого папки: " << e.what() << "\n";
+        }
+        return {};
+    }
+
+    // Имена и типы из getdents64 без fs::path на элемент; stat - только там, где нет d_type
+    size_t getFileCount() const {
+        size_t count = 0;
+        if (exists()) {
+            try {
+                auto listing = load(false, nullptr);
+                for (size_t i = 0; i < listing->size(); i++) {
+                    if (listing->kind(i) != DirectoryListing::Dir) {
+                        count++;
+                    }
+                }
+            }
+            catch (const std::exception& e) {
+                std::cout << "Ошибка при подсчете файлов: " << e.what() << "\n";
+            }
+        }
+        return count;
+    }
+};
+
+// Класс файлового менеджера
+class FileManager {
+private:
+    fs::path currentPath;
+    FileIndex index;
+    BackgroundDeleter trash;
+    MetadataCache cache;
+    std::unique_ptr<DiskUsage> usage;  // дерево последнего du, переиспользуется для вложенных папок
+    JobScheduler jobs;                 // команды, запущенные с & в конце
+    ListingCursor pageCursor;          // где остановился постраничный ls
+    size_t pageSize = 100;
+    bool pageDetailed = false;
+
+public:
+    FileManager() : currentPath(fs::current_path()) {
+        // Индекс необязателен: если файла нет, поиск обходит дерево
+        index.load(FileIndex::defaultLocation());
+    }
+
+    void showCurrentDirectory() const {
+        std::cout << "Текущая директория: " << currentPath.string() << '\n';
+    }
+
+    void changeDirectory(const std::string& path) {
+        try {
+            fs::path newPath;
+            if (fs::path(path).is_absolute()) {
+                newPath = path;
+            }
+            else {
+                newPath = currentPath / path;
+            }
+
+            // Кэш только подтверждает, что это папка; путь всегда канонический, так как
+            // компоненты ".." и ссылки в newPath лексически не раскрыть
+            MetadataCache::EntryInfo cached = cache.lookup(newPath.parent_path(), newPath.filename().string());
+            const bool cachedDirectory = cached.presence == MetadataCache::Presence::Present
+                && cached.kind == DirectoryListing::Dir && !cached.symlink;
+            if (cachedDirectory || (fs::exists(newPath) && fs::is_directory(newPath))) {
+                currentPath = fs::canonical(newPath);
+                std::cout << "Текущая директория: " << currentPath.string() << '\n';
+            }
+            else {
+                std::cout << "Директория не существует: " << newPath.string() << '\n';
+            }
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка при смене директории: " << e.what() << '\n';
+        }
+    }
+
+    void goToParent() {
+        if (currentPath.has_parent_path()) {
+            try {
+                currentPath = currentPath.parent_path();
+                std::cout << "Текущая директория: " << currentPath.string() << '\n';
+            }
+            catch (const std::exception& e) {
+                std::cout << "Ошибка при переходе в родительскую директорию: " << e.what() << '\n';
+            }
+        }
+        else {
+            std::cout << "У текущей директории нет родительской\n";
+        }
+    }
+
+    void createFile(const std::string& name) {
+        File file((currentPath / name).string());
+        file.create();
+    }
+
+    void createDirectory(const std::string& name) {
+        Directory dir((currentPath / name).string());
+        dir.create();
+    }
+
+    // viaTrash: папка переносится в корзину и удаляется в фоне, команда возвращается сразу;
+    // asJob: папка удаляется на месте фоновой задачей, которую можно остановить kill; файл и ссылка - сразу
+    void deleteItem(const std::string& name, bool viaTrash = false, bool asJob = false) {
+        fs::path itemPath = currentPath / name;
+
+        if (!itemExists(name)) {
+            std::cout << "Объект не существует: " << name << '\n';
+            return;
+        }
+
+        if (asJob && fs::is_directory(itemPath) && !fs::is_symlink(itemPath)) {
+            startJob("rm " + name, [itemPath](JobControl& control, std::ostream& out) {
+                DiskUsage sizing(std::max(1u, std::thread::hardware_concurrency() / 2));
+                sizing.scan(itemPath, &control);
+                control.setTotals(sizing.node(0).items, 0);
+                Directory(itemPath.string()).deleteDir(out, &control);
+                });
+            return;
+        }
+        if (asJob) {
+            std::cout << "Фоновое удаление (&) только для папок, удаление сразу: " << name << '\n';
+        }
+
+        if (viaTrash && fs::is_directory(itemPath) && !fs::is_symlink(itemPath)) {
+            try {
+                trash.remove(itemPath);
+                std::cout << "Папка перенесена в корзину и удаляется в фоне: " << name << '\n';
+                return;
+            }
+            catch (const std::exception& e) {
+                std::cout << "Не удалось перенести в корзину (" << e.what() << "), удаление на месте\n";
+            }
+        }
+
+        if (fs::is_directory(itemPath)) {
+            Directory dir(itemPath.string());
+            dir.deleteDir();
+        }
+        else {
+            File file(itemPath.string());
+            file.deleteFile();
+        }
+    }
+
+    // Итоги фоновых удалений и задач, завершившихся с прошлой команды
+    void showBackgroundReports() {
+        for (const auto& report : trash.takeReports()) {
+            std::cout << report << '\n';
+        }
+        for (const auto& report : jobs.takeReports()) {
+            std::cout << report << '\n';
+        }
+    }
+
+    void waitBackground() {
+        if (jobs.busy()) {
+            std::cout << "Ожидание фоновых задач (остановить - kill <номер> до выхода)...\n";
+            jobs.waitAll();
+        }
+        if (trash.busy()) {
+            DeleteProgress progress = trash.progress();
+            std::cout << "Ожидание фонового удаления (удалено " << progress.files << " файлов)...\n";
+            trash.wait();
+        }
+        showBackgroundReports();
+    }
+
+    // Ждёт строку ввода не дольше timeoutMs; true - строка прочитана
+    static bool enterPressed(int timeoutMs) {
+#ifdef __linux__
+        if (std::cin.rdbuf()->in_avail() <= 0) {
+            struct pollfd input{ STDIN_FILENO, POLLIN, 0 };
+            if (::poll(&input, 1, timeoutMs) <= 0) {
+                return false;
+            }
+        }
+        std::string line;
+        std::getline(std::cin, line);
+        return true;
+#else
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+        return false;
+#endif
+    }
+
+    void startJob(const std::string& command, JobScheduler::Body body) {
+        unsigned id = jobs.submit(command, std::move(body));
+        std::cout << '[' << id << "] " << command << '\n';
+    }
+
+    void showJobs() const {
+        std::vector<JobInfo> list = jobs.list();
+        if (list.empty()) {
+            std::cout << "Фоновых задач нет\n";
+            return;
+        }
+        for (const auto& job : list) {
+            std::cout << '[' << job.id << "] " << jobStateName(job.state) << "  " << job.command
+                << "  " << describeProgress(job.progress);
+            if (job.bytesPerSecond > 0 || job.entriesPerSecond > 0) {
+                std::cout << " [лимит";
+                if (job.bytesPerSecond > 0) {
+                    std::cout << ' ' << formatSize(job.bytesPerSecond) << "/с";
+                }
+                if (job.entriesPerSecond > 0) {
+                    std::cout << ' ' << job.entriesPerSecond << " элем/с";
+                }
+                std::cout << ']';
+            }
+            std::cout << '\n';
+        }
+    }
+
+    // fg [номер]: ждёт задачу (без номера - последнюю запущенную), показывая прогресс
+    void foregroundJob(const std::string& args) {
+        unsigned id = 0;
+        if (!args.empty()) {
+            id = static_cast<unsigned>(std::strtoul(args.c_str(), nullptr, 10));
+        }
+        else {
+            for (const auto& job : jobs.list()) {
+                id = std::max(id, job.id);
+            }
+        }
+        bool progressShown = false;
+        std::string report = jobs.wait(id, [&progressShown](const JobProgress& progress) {
+            if (!Console::interactive()) {
+                return;
+            }
+            progressShown = true;
+            std::cout << '\r' << describeProgress(progress) << "   " << std::flush;
+            });
+        if (progressShown) {
+            std::cout << '\n';
+        }
+        if (report.empty()) {
+            std::cout << "Нет задачи с номером " << args << '\n';
+            return;
+        }
+        std::cout << report << '\n';
+    }
+
+    void killJob(const std::string& args) {
+        const unsigned id = static_cast<unsigned>(std::strtoul(args.c_str(), nullptr, 10));
+        if (jobs.cancel(id)) {
+            std::cout << '[' << id << "] отмена запрошена\n";
+        }
+        else {
+            std::cout << "Нет задачи с номером " << args << '\n';
+        }
+    }
+
+    // limit <номер> <байт/с> [элем/с]: 0 снимает ограничение; размер с суффиксом K, M или G
+    void limitJob(const std::string& args) {
+        std::istringstream in(args);
+        unsigned id = 0;
+        std::string bytes;
+        std::string entries = "0";
+        if (!(in >> id >> bytes)) {
+            std::cout << "Использование: limit <номер> <байт/с> [элем/с], например limit 1 20M\n";
+            return;
+        }
+        in >> entries;
+        try {
+            const uint64_t bytesPerSecond = parseSize(bytes);
+            const uint64_t entriesPerSecond = parseSize(entries);
+            if (!jobs.setLimits(id, bytesPerSecond, entriesPerSecond)) {
+                std::cout << "Нет задачи с номером " << id << '\n';
+                return;
+            }
+            std::cout << '[' << id << "] лимит: "
+                << (bytesPerSecond ? formatSize(bytesPerSecond) + "/с" : std::string("без ограничения по байтам"));
+            if (entriesPerSecond) {
+                std::cout << ", " << entriesPerSecond << " элем/с";
+            }
+            std::cout << '\n';
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка в лимите: " << e.what() << '\n';
+        }
+    }
+
+    void renameItem(const std::string& oldName, const std::string& newName) {
+        try {
+            fs::path oldPath = currentPath / oldName;
+            fs::path newPath = currentPath / newName;
+
+            if (!itemExists(oldName)) {
+                std::cout << "Объект не существует: " << oldName << '\n';
+                return;
+            }
+
+            if (itemExists(newName)) {
+                std::cout << "Объект с таким именем уже существует: " << newName << '\n';
+                return;
+            }
+
+            fs::rename(oldPath, newPath);
+            std::cout << "Переименовано: " << oldName << " -> " << newName << '\n';
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка при переименовании: " << e.what() << '\n';
+        }
+    }
+
+    // asJob: копирование идёт фоновой задачей, команда возвращается сразу
+    void copyItem(const std::string& source, const std::string& destination, bool asJob = false) {
+        const fs::path sourcePath = currentPath / source;
+        const fs::path destPath = currentPath / destination;
+        if (asJob) {
+            startJob("cp " + source + " " + destination, [=](JobControl& control, std::ostream& out) {
+                copyPaths(sourcePath, destPath, source, destination, out, &control);
+                });
+            return;
+        }
+        copyPaths(sourcePath, destPath, source, destination, std::cout, nullptr);
+    }
+
+    // Общая часть cp; с control прогресс и отмена идут через фоновую задачу, а не на консоль
+    static void copyPaths(const fs::path& sourcePath, fs::path destPath, const std::string& source,
+        const std::string& destination, std::ostream& out, JobControl* control) {
+        try {
+            if (!fs::exists(sourcePath)) {
+                out << "Источник не существует: " << source << '\n';
+                return;
+            }
+
+            bool progressShown = false;
+            CopyOptions options;
+            if (control) {
+                // Фоновое копирование не занимает все ядра: оболочка должна оставаться отзывчивой
+                options.jobs = std::max(1u, std::thread::hardware_concurrency() / 2);
+                options.control = control;
+                // Объём заранее - для оценки оставшегося времени
+                DiskUsage sizing(options.jobs);
+                sizing.scan(sourcePath, control);
+                control->setTotals(sizing.node(0).items, sizing.node(0).apparent);
+            }
+            else if (Console::interactive()) {
+                options.onProgress = [&progressShown](const CopyProgress& progress) {
+                    progressShown = true;
+                    std::cout << "\rКопирование: " << progress.files << " файлов, "
+                        << formatSize(progress.bytes) << ", "
+                        << formatSize(static_cast<uintmax_t>(progress.bytesPerSecond())) << "/с   " << std::flush;
+                };
+            }
+            CopyEngine engine(options);
+
+            if (fs::is_directory(sourcePath)) {
+                engine.copyTree(sourcePath, destPath);
+            }
+            else {
+                if (fs::is_directory(destPath)) {
+                    destPath /= sourcePath.filename();
+                }
+                engine.copyFile(sourcePath, destPath);
+            }
+            if (progressShown) {
+                std::cout << '\n';
+            }
+
+            CopyProgress total = engine.progress();
+            out << "Скопировано: " << source << " -> " << destination
+                << " (" << total.files << " файлов, " << formatSize(total.bytes) << ", "
+                << formatSize(static_cast<uintmax_t>(total.bytesPerSecond())) << "/с)\n";
+        }
+        catch (const OperationCancelled&) {
+            throw;
+        }
+        catch (const std::exception& e) {
+            out << "Ошибка копирования: " << e.what() << '\n';
+        }
+    }
+
+    // sync: приёмник приводится к источнику, копируется только изменившееся
+    void syncItem(const std::string& source, const std::string& destination, SyncOptions options, bool asJob = false) {
+        const fs::path sourcePath = currentPath / source;
+        const fs::path destPath = currentPath / destination;
+        if (asJob) {
+            startJob("sync " + source + " " + destination, [=](JobControl& control, std::ostream& out) {
+                SyncOptions jobOptions = options;
+                jobOptions.jobs = std::max(1u, std::thread::hardware_concurrency() / 2);
+                jobOptions.control = &control;
+                syncPaths(sourcePath, destPath, source, destination, jobOptions, out);
+                });
+            return;
+        }
+        syncPaths(sourcePath, destPath, source, destination, options, std::cout);
+    }
+
+    static void syncPaths(const fs::path& sourcePath, const fs::path& destPath, const std::string& source,
+        const std::string& destination, SyncOptions options, std::ostream& out) {
+        try {
+            if (!fs::is_directory(sourcePath)) {
+                out << "Источник не является папкой: " << source << '\n';
+                return;
+            }
+            if (fs::exists(destPath) && !fs::is_directory(destPath)) {
+                out << "Приёмник не является папкой: " << destination << '\n';
+                return;
+            }
+            // Приёмник внутри источника при следующем запуске скопировался бы сам в себя
+            const std::string sourceText = fs::weakly_canonical(sourcePath).string();
+            const std::string destText = fs::weakly_canonical(destPath).string();
+            if (destText == sourceText || destText.rfind(sourceText + '/', 0) == 0) {
+                out << "Приёмник не может находиться внутри источника\n";
+                return;
+            }
+
+            bool progressShown = false;
+            if (!options.control && !options.dryRun && Console::interactive()) {
+                options.onProgress = [&progressShown](const SyncStats& progress) {
+                    progressShown = true;
+                    std::cout << "\rСинхронизация: сравнено " << progress.compared << ", записано "
+                        << formatSize(progress.bytesWritten) << "   " << std::flush;
+                };
+            }
+            SyncEngine engine(options);
+            const std::vector<SyncAction>& plan = engine.sync(sourcePath, destPath);
+            if (progressShown) {
+                std::cout << '\n';
+            }
+
+            SyncStats stats = engine.stats();
+            if (options.dryRun) {
+                uintmax_t files = 0;
+                uintmax_t updates = 0;
+                uintmax_t removals = 0;
+                for (const auto& action : plan) {
+                    out << "  " << syncActionName(action) << "  " << action.path;
+                    if (action.kind == SyncActionKind::CreateDir || (action.kind == SyncActionKind::Remove && action.directory)) {
+                        out << fs::path::preferred_separator;
+                    }
+                    if (action.kind == SyncActionKind::Copy || action.kind == SyncActionKind::Update) {
+                        out << " (" << formatSize(action.size) << (action.delta ? ", поблочно" : "") << ')';
+                    }
+                    out << '\n';
+                    files += action.kind == SyncActionKind::Copy || action.kind == SyncActionKind::Link;
+                    updates += action.kind == SyncActionKind::Update;
+                    removals += action.kind == SyncActionKind::Remove;
+                }
+                out << "План " << source << " -> " << destination << ": новых " << files << ", изменённых " << updates
+                    << ", удалить " << removals << ", без изменений " << stats.unchanged
+                    << "; будет записано до " << formatSize(stats.bytesPlanned) << " (пробный прогон, ничего не изменено)\n";
+            }
+            else {
+                out << "Синхронизировано: " << source << " -> " << destination << " (новых файлов " << stats.copied
+                    << ", обновлено " << stats.updated;
+                if (stats.deltaUpdated > 0) {
+                    out << ", из них поблочно " << stats.deltaUpdated;
+                }
+                out << ", папок " << stats.directories << ", ссылок " << stats.links << ", удалено " << stats.removed
+                    << ", без изменений " << stats.unchanged << ")\n"
+                    << "Записано " << formatSize(stats.bytesWritten) << " из " << formatSize(stats.bytesPlanned);
+                if (stats.bytesReused > 0) {
+                    out << ", осталось на месте " << formatSize(stats.bytesReused);
+                }
+                out << " за " << std::fixed << std::setprecision(2) << stats.seconds << " с" << std::defaultfloat << '\n';
+            }
+            if (stats.errors > 0) {
+                out << "Ошибок: " << stats.errors << '\n';
+                for (const auto& message : engine.errors()) {
+                    out << "  " << message << '\n';
+                }
+            }
+        }
+        catch (const OperationCancelled&) {
+            throw;
+        }
+        catch (const std::exception& e) {
+            out << "Ошибка синхронизации: " << e.what() << '\n';
+        }
+    }
+
+    static const char* syncActionName(const SyncAction& action) {
+        switch (action.kind) {
+        case SyncActionKind::CreateDir: return "новая папка";
+        case SyncActionKind::Copy: return action.replace ? "заменить   " : "новый файл ";
+        case SyncActionKind::Update: return "изменён    ";
+        case SyncActionKind::Link: return "ссылка     ";
+        case SyncActionKind::Remove: return "удалить    ";
+        default: return "?";
+        }
+    }
+
+    // pack: дерево в tar или tar.zst (по расширению архива), сжатие блоками в пуле
+    void packItem(const std::string& source, const std::string& archive, int level, bool asJob = false) {
+        const fs::path sourcePath = currentPath / source;
+        const fs::path archivePath = currentPath / archive;
+        if (asJob) {
+            startJob("pack " + source + " " + archive, [=](JobControl& control, std::ostream& out) {
+                ArchiveOptions options;
+                options.level = level;
+                options.jobs = std::max(1u, std::thread::hardware_concurrency() / 2);
+                options.control = &control;
+                DiskUsage sizing(options.jobs);
+                sizing.scan(sourcePath, &control);
+                control.setTotals(sizing.node(0).items, sizing.node(0).apparent);
+                packPaths(sourcePath, archivePath, source, archive, options, out);
+                });
+            return;
+        }
+        ArchiveOptions options;
+        options.level = level;
+        packPaths(sourcePath, archivePath, source, archive, options, std::cout);
+    }
+
+    static void packPaths(const fs::path& sourcePath, const fs::path& archivePath, const std::string& source,
+        const std::string& archive, ArchiveOptions options, std::ostream& out) {
+        try {
+            if (!fs::exists(fs::symlink_status(sourcePath))) {
+                out << "Источник не существует: " << source << '\n';
+                return;
+            }
+            if (!archiveFormatSupported(archiveFormatFor(archivePath))) {
+                out << "Сжатие zstd недоступно в этой сборке, укажите архив .tar\n";
+                return;
+            }
+            bool progressShown = false;
+            if (!options.control && Console::interactive()) {
+                options.onProgress = [&progressShown](const ArchiveStats& progress) {
+                    progressShown = true;
+                    std::cout << "\rУпаковка: " << progress.files << " файлов, " << formatSize(progress.dataBytes)
+                        << " -> " << formatSize(progress.archiveBytes) << "   " << std::flush;
+                };
+            }
+            ArchivePacker packer(options);
+            packer.pack(sourcePath, archivePath);
+            if (progressShown) {
+                std::cout << '\n';
+            }
+            const ArchiveStats stats = packer.stats();
+            out << "Упаковано: " << source << " -> " << archive << " (" << stats.files << " файлов, "
+                << stats.directories << " папок, " << stats.links << " ссылок), " << formatSize(stats.dataBytes)
+                << " -> " << formatSize(stats.archiveBytes) << " за " << std::fixed << std::setprecision(2)
+                << stats.seconds << " с" << std::defaultfloat << '\n';
+            printArchiveErrors(stats, packer.errors(), out);
+        }
+        catch (const OperationCancelled&) {
+            throw;
+        }
+        catch (const std::exception& e) {
+            out << "Ошибка упаковки: " << e.what() << '\n';
+        }
+    }
+
+    // unpack: архив tar или tar.zst в папку (по умолчанию текущую), файлы пишутся параллельно
+    void unpackItem(const std::string& archive, const std::string& destination, bool asJob = false) {
+        const fs::path archivePath = currentPath / archive;
+        const fs::path destPath = destination.empty() ? currentPath : currentPath / destination;
+        if (asJob) {
+            startJob("unpack " + archive, [=](JobControl& control, std::ostream& out) {
+                ArchiveOptions options;
+                options.jobs = std::max(1u, std::thread::hardware_concurrency() / 2);
+                options.control = &control;
+                unpackPaths(archivePath, destPath, archive, options, out);
+                });
+            return;
+        }
+        unpackPaths(archivePath, destPath, archive, ArchiveOptions(), std::cout);
+    }
+
+    static void unpackPaths(const fs::path& archivePath, const fs::path& destPath, const std::string& archive,
+        ArchiveOptions options, std::ostream& out) {
+        try {
+            if (!fs::is_regular_file(archivePath)) {
+                out << "Архив не найден: " << archive << '\n';
+                return;
+            }
+            bool progressShown = false;
+            if (!options.control && Console::interactive()) {
+                options.onProgress = [&progressShown](const ArchiveStats& progress) {
+                    progressShown = true;
+                    std::cout << "\rРаспаковка: " << progress.files << " файлов, " << formatSize(progress.dataBytes)
+                        << "   " << std::flush;
+                };
+            }
+            else if (options.control) {
+                options.control->setTotals(0, fs::file_size(archivePath));
+            }
+            ArchiveUnpacker unpacker(options);
+            unpacker.unpack(archivePath, destPath);
+            if (progressShown) {
+                std::cout << '\n';
+            }
+            const ArchiveStats stats = unpacker.stats();
+            out << "Распаковано: " << archive << " -> " << destPath.string() << " (" << stats.files << " файлов, "
+                << stats.directories << " папок, " << stats.links << " ссылок), " << formatSize(stats.dataBytes)
+                << " за " << std::fixed << std::setprecision(2) << stats.seconds << " с" << std::defaultfloat << '\n';
+            printArchiveErrors(stats, unpacker.errors(), out);
+        }
+        catch (const OperationCancelled&) {
+            throw;
+        }
+        catch (const std::exception& e) {
+            out << "Ошибка распаковки: " << e.what() << '\n';
+        }
+    }
+
+    static void printArchiveErrors(const ArchiveStats& stats, const std::vector<std::string>& errors, std::ostream& out) {
+        if (stats.skipped > 0) {
+            out << "Пропущено: " << stats.skipped << '\n';
+        }
+        if (stats.errors > 0) {
+            out << "Ошибок: " << stats.errors << '\n';
+            for (const auto& message : errors) {
+                out << "  " << message << '\n';
+            }
+        }
+    }
+
+    void moveItem(const std::string& source, const std::string& destination) {
+        try {
+            fs::path sourcePath = currentPath / source;
+            fs::path destPath = currentPath / destination;
+
+            if (!fs::exists(sourcePath)) {
+                std::cout << "Источник не существует: " << source << '\n';
+                return;
+            }
+
+            fs::rename(sourcePath, destPath);
+            std::cout << "Перемещено: " << source << " -> " << destination << '\n';
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка перемещения: " << e.what() << '\n';
+        }
+    }
+
+    // Имя для rm, mv, cp и rename - шаблон: -E или символы glob, а объекта с таким именем нет
+    bool isBulkPattern(const std::string& name, const MatchOptions& match) {
+        return match.mode == MatchMode::Regex || (BulkOperation::isPattern(name) && !itemExists(name));
+    }
+
+    // rm, mv, cp и rename по шаблону: один проход по папке, проверка конфликтов до начала,
+    // затем пачки в пуле потоков и одна итоговая строка вместо строки на каждый файл.
+    // argument - папка назначения (mv, cp) или новое имя с $1..$9 (rename)
+    void bulkItems(BulkAction action, const std::string& pattern, const std::string& argument,
+        MatchOptions match, bool asJob = false) {
+        BulkOptions options;
+        options.match = match;
+        if (asJob) {
+            const std::string command = std::string(bulkCommandName(action)) + " " + pattern
+                + (argument.empty() ? std::string() : " " + argument);
+            startJob(command, [=, directory = currentPath](JobControl& control, std::ostream& out) {
+                BulkOptions jobOptions = options;
+                jobOptions.threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+                jobOptions.control = &control;
+                runBulk(action, directory, pattern, argument, jobOptions, out);
+                });
+            return;
+        }
+        runBulk(action, currentPath, pattern, argument, options, std::cout);
+    }
+
+    static const char* bulkCommandName(BulkAction action) {
+        switch (action) {
+        case BulkAction::Remove: return "rm";
+        case BulkAction::Move: return "mv";
+        case BulkAction::Copy: return "cp";
+        case BulkAction::Rename: return "rename";
+        }
+        return "?";
+    }
+
+    static void runBulk(BulkAction action, const fs::path& directory, const std::string& pattern,
+        const std::string& argument, BulkOptions options, std::ostream& out) {
+        try {
+            BulkOperation operation(action, options);
+            if (!operation.plan(directory, pattern, argument)) {
+                if (operation.problemsFound() == 0) {
+                    out << (operation.stats().matched == 0 ? "Нет подходящих элементов: " : "Нечего делать, все совпавшие пропущены: ")
+                        << pattern << '\n';
+                    return;
+                }
+                out << "Ничего не сделано, конфликтов: " << operation.problemsFound() << '\n';
+                for (const auto& message : operation.problems()) {
+                    out << "  " << message << '\n';
+                }
+                if (operation.problemsFound() > operation.problems().size()) {
+                    out << "  ...\n";
+                }
+                return;
+            }
+            operation.run();
+
+            static const char* const verbs[] = { "Удалено", "Перемещено", "Скопировано", "Переименовано" };
+            const BulkStats stats = operation.stats();
+            out << verbs[static_cast<int>(action)] << ": " << stats.files + stats.directories << " из " << operation.size()
+                << " (" << stats.files << " файлов, " << stats.directories << " папок";
+            if (stats.bytes > 0) {
+                out << ", " << formatSize(stats.bytes);
+            }
+            out << ") за " << std::fixed << std::setprecision(2) << stats.seconds << " с" << std::defaultfloat << '\n';
+            if (stats.skipped > 0) {
+                out << "Пропущено: " << stats.skipped << '\n';
+            }
+            if (stats.errors > 0) {
+                out << "Ошибок: " << stats.errors << '\n';
+                for (const auto& message : operation.errors()) {
+                    out << "  " << message << '\n';
+                }
+            }
+        }
+        catch (const OperationCancelled&) {
+            throw;
+        }
+        catch (const std::regex_error& e) {
+            out << "Ошибка в регулярном выражении: " << e.what() << '\n';
+        }
+        catch (const std::exception& e) {
+            out << "Ошибка: " << e.what() << '\n';
+        }
+    }
+
+    // cat/head/tail: lines == 0 для cat
+    void printFile(const std::string& name, char mode, size_t lines = 10) {
+        fs::path itemPath = currentPath / name;
+
+        if (!fs::exists(itemPath)) {
+            std::cout << "Объект не существует: " << name << '\n';
+            return;
+        }
+        if (fs::is_directory(itemPath)) {
+            std::cout << "Это папка, а не файл: " << name << '\n';
+            return;
+        }
+
+        File file(itemPath.string());
+        switch (mode) {
+        case 'h':
+            file.head(lines);
+            break;
+        case 't':
+            file.tail(lines);
+            break;
+        default:
+            file.cat();
+            break;
+        }
+    }
+
+    void showItemInfo(const std::string& name) {
+        fs::path itemPath = currentPath / name;
+
+        MetadataCache::EntryInfo cached = cache.lookup(currentPath, name);
+        if (cached.presence == MetadataCache::Presence::Absent
+            || (cached.presence == MetadataCache::Presence::Unknown && !fs::exists(itemPath))) {
+            std::cout << "Объект не существует: " << name << '\n';
+            return;
+        }
+
+        bool isDirectory = cached.presence == MetadataCache::Presence::Present
+            ? cached.kind == DirectoryListing::Dir
+            : fs::is_directory(itemPath);
+        if (isDirectory) {
+            Directory dir(itemPath.string());
+            dir.showInfo(&cache);
+        }
+        else {
+            File file(itemPath.string());
+            file.showInfo(&cache);
+        }
+    }
+
+    void listContents(bool detailed = false) {
+        Directory dir(currentPath.string());
+        if (detailed) {
+            std::cout << "Содержимое директории " << currentPath.string() << ":\n";
+        }
+        dir.listContents(detailed, &cache);
+    }
+
+    // ls [-l] --first N | --page N | --next: одна страница большой папки.
+    // --first задаёт размер страницы, --next продолжает с места, где остановилась предыдущая
+    void listPage(const std::vector<std::string>& args) {
+        bool detailed = false;
+        bool next = false;
+        size_t page = 1;
+        for (size_t i = 0; i < args.size(); i++) {
+            const std::string& arg = args[i];
+            if (arg == "-l") {
+                detailed = true;
+            }
+            else if (arg == "--next") {
+                next = true;
+            }
+            else if ((arg == "--first" || arg == "--page") && i + 1 < args.size()) {
+                char* end = nullptr;
+                const unsigned long long value = std::strtoull(args[++i].c_str(), &end, 10);
+                if (*end != '\0' || value == 0) {
+                    std::cout << "Ожидалось положительное число: " << args[i] << '\n';
+                    return;
+                }
+                if (arg == "--first") {
+                    pageSize = static_cast<size_t>(value);
+                }
+                else {
+                    page = static_cast<size_t>(value);
+                }
+            }
+            else {
+                std::cout << "Использование: ls [-l] --first N | --page N | --next\n";
+                return;
+            }
+        }
+
+        Directory dir(currentPath.string());
+        if (next) {
+            if (!pageCursor.valid || pageCursor.directory != currentPath) {
+                std::cout << "Нет начатого просмотра этой папки, начните с ls --first N или ls --page N\n";
+                return;
+            }
+            ListingCursor after = pageCursor;
+            ListingCursor moved = dir.listPage(pageDetailed || detailed, &after, 0, pageSize);
+            if (moved.valid) {
+                pageCursor = moved;
+            }
+            return;
+        }
+        pageDetailed = detailed;
+        pageCursor = dir.listPage(detailed, nullptr, (page - 1) * pageSize, pageSize);
+    }
+
+    // asJob: обход идёт фоновой задачей (индекс в ней не используется).
+    // Заголовок выводится только в терминал и только в обычном формате
+    void searchFiles(const std::string& pattern, MatchOptions options = {}, bool asJob = false,
+        OutputFormat format = OutputFormat::Plain) {
+        const bool decorate = format == OutputFormat::Plain && Console::interactive();
+        if (asJob) {
+            startJob("search " + pattern, [root = currentPath, pattern, options, format](JobControl& control, std::ostream& out) {
+                if (format == OutputFormat::Plain) {
+                    out << "Поиск файлов с шаблоном: " << pattern << "\n";
+                }
+                OutputWriter writer(out, format);
+                searchTree(root, Matcher(pattern, options), writer, &control);
+                });
+            return;
+        }
+        if (decorate) {
+            std::cout << "Поиск файлов с шаблоном: " << pattern << "\n";
+        }
+
+        try {
+            const Matcher matcher(pattern, options);
+            OutputWriter writer(std::cout, format);
+            if (!matcher.needsPath() && index.covers(currentPath)) {
+                if (decorate) {
+                    std::cout << "(по индексу от " << formatTime(static_cast<std::time_t>(index.stats().builtAt)) << ")\n";
+                }
+                index.search(matcher, currentPath, [&writer](const std::string& found) {
+                    writer.record(found);
+                    });
+                return;
+            }
+            searchTree(currentPath, matcher, writer, nullptr);
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка при поиске: " << e.what() << "\n";
+        }
+    }
+
+    // Поиск обходом дерева от rootPath
+    static void searchTree(const fs::path& rootPath, const Matcher& matcher, OutputWriter& out, JobControl* control) {
+        // Шаблоны со слешем сравниваются с путём относительно корня поиска
+        std::string root = rootPath.string();
+        const size_t relativeOffset = root.size() + (root.back() == fs::path::preferred_separator ? 0 : 1);
+
+        // Совпадения копятся по пачкам и выводятся целиком, чтобы строки разных потоков не перемешивались
+        WalkOptions walkOptions;
+        if (control) {
+            walkOptions.threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+            walkOptions.control = control;
+        }
+        ParallelWalker walker(walkOptions);
+        walker.walk(rootPath, [&](const WalkDir&, std::vector<WalkEntry>& entries) {
+            // Полный путь собирается только для шаблонов со слешем и для совпадений
+            thread_local std::string fullPath;
+            std::string found;
+            size_t count = 0;
+            for (const auto& entry : entries) {
+                if (entry.isDirectory()) {
+                    continue;
+                }
+                std::string_view subject = entry.name();
+                fullPath.clear();
+                if (matcher.needsPath()) {
+                    entry.appendPath(fullPath);
+                    subject = std::string_view(fullPath).substr(relativeOffset);
+                }
+                if (matcher.matches(subject)) {
+                    if (fullPath.empty()) {
+                        entry.appendPath(fullPath);
+                    }
+                    out.append(found, fullPath);
+                    count++;
+                }
+            }
+            out.write(found, count);
+            });
+        out.flush();
+    }
+
+    // find [path] <выражение>: условия на имя, тип, путь, размер и время изменения.
+    // Выражение разбирается сразу, чтобы ошибка в нём была видна и у фоновой задачи
+    void findFiles(std::vector<std::string> words, bool asJob = false, OutputFormat format = OutputFormat::Plain) {
+        // Первое слово без операторов - папка, с которой начинается поиск
+        fs::path root = currentPath;
+        if (words.size() > 1 && words[0].find_first_of("<>=!~()") == std::string::npos
+            && words[0] != "not" && words[0] != "and" && words[0] != "or") {
+            root = fs::path(words[0]).is_relative() ? currentPath / words[0] : fs::path(words[0]);
+            words.erase(words.begin());
+        }
+
+        std::shared_ptr<const FindQuery> query;
+        try {
+            query = std::make_shared<const FindQuery>(words);
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка в выражении: " << e.what() << '\n';
+            return;
+        }
+        if (!fs::is_directory(root)) {
+            std::cout << "Директория не существует: " << root.string() << '\n';
+            return;
+        }
+
+        // Заголовок и итог - только в обычном формате и в терминал (или в отчёт фоновой задачи)
+        const bool decorate = format == OutputFormat::Plain && (asJob || Console::interactive());
+        auto body = [root, query, format, decorate](JobControl* control, std::ostream& out) {
+            if (decorate) {
+                out << "Поиск: " << query->describe() << '\n';
+            }
+            auto started = std::chrono::steady_clock::now();
+            FindStats stats;
+            {
+                OutputWriter writer(out, format);
+                stats = query->run(root, writer, control, control ? std::max(1u, std::thread::hardware_concurrency() / 2) : 0);
+            }
+            if (!decorate) {
+                return;
+            }
+            out << "Найдено: " << stats.matched << " из " << stats.visited << " за " << secondsSince(started)
+                << " с (stat: " << stats.statCalls << ", пропущено папок: " << stats.pruned;
+            if (stats.errors > 0) {
+                out << ", недоступно: " << stats.errors;
+            }
+            out << ")\n";
+        };
+        if (asJob) {
+            startJob("find " + query->describe(), [body](JobControl& control, std::ostream& out) {
+                body(&control, out);
+                });
+            return;
+        }
+        try {
+            body(nullptr, std::cout);
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка при поиске: " << e.what() << "\n";
+        }
+    }
+
+    // watch [-r] [-w мс] [-t с] [dir]: события папки по мере появления.
+    // Без -t наблюдение идёт до Enter; с -t ввод не читается
+    void watchDirectory(const std::vector<std::string>& args) {
+        WatchOptions options;
+        double seconds = 0;
+        fs::path root = currentPath;
+        for (size_t i = 0; i < args.size(); i++) {
+            const std::string& arg = args[i];
+            if (arg == "-r") {
+                options.recursive = true;
+            }
+            else if ((arg == "-w" || arg == "-t") && i + 1 < args.size()) {
+                char* end = nullptr;
+                const double value = std::strtod(args[++i].c_str(), &end);
+                if (*end != '\0' || value <= 0) {
+                    std::cout << "Ожидалось положительное число: " << args[i] << '\n';
+                    return;
+                }
+                if (arg == "-w") {
+                    options.window = std::chrono::milliseconds(static_cast<long long>(value));
+                }
+                else {
+                    seconds = value;
+                }
+            }
+            else if (!arg.empty() && arg[0] != '-') {
+                root = fs::path(arg).is_relative() ? currentPath / arg : fs::path(arg);
+            }
+            else {
+                std::cout << "Использование: watch [-r] [-w мс] [-t с] [dir]\n";
+                return;
+            }
+        }
+
+        try {
+            DirectoryWatcher watcher(root, options);
+            const WatchStats initial = watcher.stats();
+            std::cout << "Наблюдение за " << root.string();
+            if (options.recursive) {
+                std::cout << " и вложенными папками (" << initial.watches << ")";
+            }
+            std::cout << (seconds > 0 ? "" : ", Enter - остановить") << '\n' << std::flush;
+            if (initial.watchErrors > 0) {
+                std::cout << "Не удалось поставить наблюдение на " << initial.watchErrors
+                    << " папок (предел fs.inotify.max_user_watches?)\n";
+            }
+
+            const auto deadline = std::chrono::steady_clock::now()
+                + std::chrono::milliseconds(static_cast<long long>(seconds * 1000));
+            watcher.start();
+            watcher.consume([](const std::vector<WatchEvent>& events) {
+                std::string out;
+                for (const auto& event : events) {
+                    appendWatchLine(out, event);
+                }
+                FM_SCOPE(Output, "console");
+                std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+                std::cout.flush();
+                }, [&]() {
+                    if (seconds > 0) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                        return std::chrono::steady_clock::now() >= deadline;
+                    }
+                    return enterPressed(50);
+                });
+
+            const WatchStats stats = watcher.stats();
+            std::cout << "Наблюдение остановлено: событий ядра " << stats.kernelEvents << ", выдано " << stats.delivered;
+            if (stats.overflows > 0) {
+                std::cout << ", переполнений " << stats.overflows << " (перечитано папок: " << stats.rescannedDirs << ")";
+            }
+            std::cout << '\n';
+            if (!watcher.failure().empty()) {
+                std::cout << "Ошибка наблюдения: " << watcher.failure() << '\n';
+            }
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка наблюдения: " << e.what() << '\n';
+        }
+    }
+
+    // Поиск по содержимому файлов под текущей папкой
+    void grepFiles(const std::string& pattern, const GrepOptions& options) {
+        try {
+            auto started = std::chrono::steady_clock::now();
+            ContentSearch search(pattern, options);
+            GrepStats stats = search.run(currentPath, [](const std::string& lines) {
+                FM_SCOPE(Output, "console");
+                std::cout << lines;
+                });
+            if (!Console::interactive()) {
+                return;
+            }
+            std::cout << "Совпадений: " << stats.matches << " в " << stats.filesMatched << " файлах (просмотрено "
+                << stats.filesScanned << " файлов, " << formatSize(stats.bytesScanned) << " за "
+                << secondsSince(started) << " с";
+            if (stats.errors > 0) {
+                std::cout << ", не прочитано: " << stats.errors;
+            }
+            std::cout << ")\n";
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка при поиске: " << e.what() << "\n";
+        }
+    }
+
+    // index build [path] | index update | index stats
+    void indexCommand(const std::string& args) {
+        const fs::path location = FileIndex::defaultLocation();
+        try {
+            if (args == "build" || args.find("build ") == 0) {
+                fs::path root = args.size() > 6 ? fs::path(args.substr(6)) : currentPath;
+                if (root.is_relative()) {
+                    root = currentPath / root;
+                }
+                std::cout << "Построение индекса для " << root.string() << "...\n";
+                index.unload();
+                auto started = std::chrono::steady_clock::now();
+                IndexStats stats = FileIndex::build(root, location);
+                index.load(location);
+                std::cout << "Индекс построен за " << secondsSince(started) << " с: "
+                    << stats.nodes << " объектов, " << formatSize(stats.fileBytes) << '\n';
+            }
+            else if (args == "update") {
+                if (!index.loaded()) {
+                    std::cout << "Индекс не построен, выполните index build\n";
+                    return;
+                }
+                auto started = std::chrono::steady_clock::now();
+                IndexStats stats = index.update();
+                std::cout << "Индекс обновлён за " << secondsSince(started) << " с: перечитано папок "
+                    << stats.dirsRescanned << ", без изменений " << stats.dirsReused
+                    << ", объектов " << stats.nodes << '\n';
+            }
+            else if (args == "stats") {
+                if (!index.loaded()) {
+                    std::cout << "Индекс не построен (" << location.string() << ")\n";
+                    return;
+                }
+                IndexStats stats = index.stats();
+                std::cout << "Файл индекса: " << location.string() << '\n'
+                    << "Корень: " << stats.root << '\n'
+                    << "Построен: " << formatTime(static_cast<std::time_t>(stats.builtAt)) << '\n'
+                    << "Объектов: " << stats.nodes << " (папок " << stats.directories << ")\n"
+                    << "Уникальных имён: " << stats.names << '\n'
+                    << "Триграмм: " << stats.trigrams << ", ссылок: " << stats.postings << '\n'
+                    << "Размер: " << formatSize(stats.fileBytes) << '\n';
+            }
+            else {
+                std::cout << "Использование: index build [path] | index update | index stats\n";
+            }
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка индекса: " << e.what() << '\n';
+        }
+    }
+
+    // du [-r] [path]: занятое место под папкой и самые большие вложенные элементы
+    void diskUsage(const std::string& args) {
+        std::string rest = args;
+        bool rescan = false;
+        if (rest == "-r" || rest.find("-r ") == 0) {
+            rescan = true;
+            rest = rest.size() > 3 ? rest.substr(3) : std::string();
+        }
+        try {
+            fs::path target = rest.empty() ? currentPath : fs::path(rest);
+            if (target.is_relative()) {
+                target = currentPath / target;
+            }
+            target = fs::weakly_canonical(target);
+            if (!fs::is_directory(target)) {
+                std::cout << "Папка не найдена: " << target.string() << '\n';
+                return;
+            }
+
+            // Папка внутри уже просканированного дерева показывается без повторного обхода
+            uint32_t id = usage && !rescan ? usage->find(target) : DuNode::None;
+            if (id == DuNode::None) {
+                auto started = std::chrono::steady_clock::now();
+                usage = std::make_unique<DiskUsage>();
+                usage->scan(target);
+                id = 0;
+                DuStats stats = usage->stats();
+                std::cout << "Просканировано за " << secondsSince(started) << " с: " << stats.files << " файлов, "
+                    << stats.directories << " папок";
+                if (stats.hardlinksSkipped > 0) {
+                    std::cout << ", повторных жёстких ссылок: " << stats.hardlinksSkipped;
+                }
+                if (stats.errors > 0) {
+                    std::cout << ", ошибок: " << stats.errors;
+                }
+                std::cout << " (память: " << formatSize(stats.memoryBytes) << ", уникальных имён: " << stats.uniqueNames << ")\n";
+            }
+
+            const DuNode& node = usage->node(id);
+            std::cout << target.string() << ": " << formatSize(node.allocated) << " на диске, "
+                << formatSize(node.apparent) << " по размеру файлов, элементов: " << node.items << '\n';
+            std::vector<uint32_t> children = usage->children(id);
+            const size_t shown = std::min<size_t>(children.size(), 20);
+            for (size_t i = 0; i < shown; i++) {
+                const DuNode& child = usage->node(children[i]);
+                std::cout << std::setw(12) << formatSize(child.allocated) << "  " << child.name
+                    << (child.type == EntryType::Directory ? "/" : "")
+                    << (child.hardlinkDuplicate ? "  (жёсткая ссылка, учтена ранее)" : "") << '\n';
+            }
+            if (children.size() > shown) {
+                std::cout << "... и ещё " << children.size() - shown << '\n';
+            }
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка при подсчёте места: " << e.what() << '\n';
+        }
+    }
+
+    // dupes [-n] [path]: группы файлов с одинаковым содержимым; -n - без кэша хэшей
+    void findDuplicates(const std::string& args) {
+        std::string rest = args;
+        DupeOptions options;
+        if (rest == "-n" || rest.find("-n ") == 0) {
+            options.useCache = false;
+            rest = rest.size() > 3 ? rest.substr(3) : std::string();
+        }
+        try {
+            fs::path root = rest.empty() ? currentPath : fs::path(rest);
+            if (root.is_relative()) {
+                root = currentPath / root;
+            }
+            if (!fs::is_directory(root)) {
+                std::cout << "Папка не найдена: " << root.string() << '\n';
+                return;
+            }
+            DuplicateFinder finder(options);
+            std::vector<DupeGroup> groups = finder.find(root);
+            for (const auto& group : groups) {
+                std::cout << group.paths.size() << " x " << formatSize(group.size) << ":\n";
+                for (const auto& path : group.paths) {
+                    std::cout << "    " << path << '\n';
+                }
+            }
+            DupeStats stats = finder.stats();
+            std::cout << "Групп дубликатов: " << stats.groups << ", лишних копий: " << stats.duplicates
+                << ", можно освободить " << formatSize(stats.wastedBytes) << '\n'
+                << "Файлов: " << stats.files << ", одинаковых по размеру: " << stats.sizeCandidates
+                << ", хэшировано начало/конец: " << stats.partialHashed << ", целиком: " << stats.fullHashed
+                << ", из кэша: " << stats.cacheHits << '\n'
+                << "Прочитано " << formatSize(stats.bytesRead) << " за " << std::fixed << std::setprecision(3)
+                << stats.seconds << " с" << std::defaultfloat;
+            if (stats.hardlinks > 0) {
+                std::cout << ", жёстких ссылок пропущено: " << stats.hardlinks;
+            }
+            if (stats.errors > 0) {
+                std::cout << ", ошибок: " << stats.errors;
+            }
+            std::cout << '\n';
+        }
+        catch (const std::exception& e) {
+            std::cout << "Ошибка при поиске дубликатов: " << e.what() << '\n';
+        }
+    }
+
+    void cacheCommand(const std::string& args) {
+        if (args == "stats") {
+            MetadataCacheStats stats = cache.stats();
+            const uintmax_t requests = stats.hits + stats.misses;
+            std::cout << "Кэш метаданных: " << (cache.enabled() ? "включён (inotify)" : "выключен") << '\n'
+                << "Попаданий: " << stats.hits << ", промахов: " << stats.misses;
+            if (requests > 0) {
+                std::cout << " (" << stats.hits * 100 / requests << "% попаданий)";
+            }
+            std::cout << '\n'
+                << "Папок в кэше: " << stats.directories << ", наблюдений inotify: " << stats.watches << '\n'
+                << "Память: " << formatSize(stats.bytes) << " из " << formatSize(stats.budget) << '\n'
+                << "Сброшено по событиям: " << stats.invalidations << ", вытеснено: " << stats.evictions
+                << ", переполнений очереди: " << stats.overflows << '\n';
+        }
+        else if (args == "clear") {
+            cache.clear();
+            std::cout << "Кэш метаданных очищен\n";
+        }
+        else {
+            std::cout << "Использование: cache stats | cache clear\n";
+        }
+    }
+
+    // stats - разбор последней команды; stats trace on|off; stats trace save <file>
+    void statsCommand(const std::string& args) {
+        if (!Instrumentation::enabled()) {
+            std::cout << "Замеры отключены при сборке (ENABLE_INSTRUMENTATION=OFF)\n";
+            return;
+        }
+        if (args.empty()) {
+            OperationReport report;
+            if (!Instrumentation::lastOperation(report)) {
+                std::cout << "Ещё не выполнено ни одной команды\n";
+                return;
+            }
+            std::cout << "Команда: " << report.name << '\n'
+                << "Время: " << std::fixed << std::setprecision(3) << report.seconds * 1000 << " мс\n"
+                << "Фазы (сумма по потокам):\n";
+            for (size_t i = 0; i < PhaseCount; i++) {
+                std::cout << "  " << std::left << std::setw(10) << phaseName(static_cast<Phase>(i)) << std::right
+                    << std::setw(12) << report.phaseNanos[i] / 1e6 << " мс\n";
+            }
+            std::cout.unsetf(std::ios::floatfield);
+            for (size_t i = 0; i < CounterCount; i++) {
+                std::cout << "  " << counterName(static_cast<Counter>(i)) << ": " << report.counters[i] << '\n';
+            }
+            std::cout << std::setprecision(6);
+        }
+        else if (args == "trace on" || args == "trace off") {
+            Instrumentation::setTracing(args == "trace on");
+            std::cout << "Трассировка " << (Instrumentation::tracingEnabled() ? "включена" : "выключена") << '\n';
+        }
+        else if (args.rfind("trace save ", 0) == 0 && args.size() > 11) {
+            fs::path file = args.substr(11);
+            if (file.is_relative()) {
+                file = currentPath / file;
+            }
+            try {
+                size_t events = Instrumentation::saveTrace(file.string());
+                std::cout << "Записано событий: " << events << " в " << file.string()
+                    << " (открывается в ui.perfetto.dev или chrome://tracing)\n";
+            }
+            catch (const std::exception& e) {
+                std::cout << "Ошибка при записи трассировки: " << e.what() << '\n';
+            }
+        }
+        else {
+            std::cout << "Использование: stats | stats trace on|off | stats trace save <file>\n";
+        }
+    }
+
+    // "1234 элем., 1.5 ГБ из 3.0 ГБ, 120.0 МБ/с, осталось 12 с"
+    static std::string describeProgress(const JobProgress& progress) {
+        std::ostringstream text;
+        text << progress.entries << " элем.";
+        if (progress.totalEntries > 0 && progress.totalBytes == 0) {
+            text << " из " << progress.totalEntries;
+        }
+        if (progress.bytes > 0 || progress.totalBytes > 0) {
+            text << ", " << formatSize(progress.bytes);
+            if (progress.totalBytes > 0) {
+                text << " из " << formatSize(progress.totalBytes);
+            }
+            if (progress.seconds > 0) {
+                text << ", " << formatSize(static_cast<uintmax_t>(progress.bytes / progress.seconds)) << "/с";
+            }
+        }
+        const double eta = progress.etaSeconds();
+        if (eta >= 0) {
+            text << ", осталось " << static_cast<uintmax_t>(eta + 0.5) << " с";
+        }
+        return text.str();
+    }
+
+    std::string getCurrentPath() const {
+        return currentPath.string();
+    }
+
+    // Сначала спрашивается кэш текущей папки, к ФС - только если он не знает ответа
+    bool itemExists(const std::string& name) {
+        MetadataCache::EntryInfo cached = cache.lookup(currentPath, name);
+        if (cached.presence != MetadataCache::Presence::Unknown) {
+            return cached.presence == MetadataCache::Presence::Present;
+        }
+        return fs::exists(currentPath / name);
+    }
+
+    uintmax_t getItemSize(const std::string& name) {
+        MetadataCache::EntryInfo cached = cache.lookup(currentPath, name);
+        if (cached.presence == MetadataCache::Presence::Present && cached.hasMetadata
+            && cached.kind == DirectoryListing::File) {
+            return cached.size;
+        }
+        try {
+            return fs::file_size(currentPath / name);
+        }
+        catch (...) {
+            return 0;
+        }
+    }
+};
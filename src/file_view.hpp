@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "instrumentation.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Представление файла для чтения без загрузки целиком в память.
+// На Linux файл отображается через mmap с MADV_SEQUENTIAL; если отобразить нельзя
+// (пустой файл, /proc, pipe, нехватка адресного пространства) - читается порциями через pread.
+// string_view, полученные из range/forEachChunk/forEachLine, действительны до следующего вызова.
+class FileView {
+public:
+    explicit FileView(const fs::path& path, size_t chunkSize = 1 << 20) : chunkSize(chunkSize) {
+#ifdef __linux__
+        FM_COUNT(Syscalls, 3);  // open, fstat, mmap
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw fs::filesystem_error("Не удалось открыть файл", path, std::error_code(errno, std::generic_category()));
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            fileSize = static_cast<uintmax_t>(st.st_size);
+            knownSize = true;
+        }
+        if (knownSize && fileSize > 0 && fileSize <= SIZE_MAX) {
+            void* address = ::mmap(nullptr, static_cast<size_t>(fileSize), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address != MAP_FAILED) {
+                data = static_cast<const char*>(address);
+                ::madvise(address, static_cast<size_t>(fileSize), MADV_SEQUENTIAL);
+            }
+        }
+#else
+        stream.open(path, std::ios::binary);
+        if (!stream.is_open()) {
+            throw fs::filesystem_error("Не удалось открыть файл", path, std::make_error_code(std::errc::no_such_file_or_directory));
+        }
+        std::error_code ec;
+        fileSize = fs::file_size(path, ec);
+        knownSize = !ec && fileSize > 0;
+#endif
+    }
+
+    FileView(const FileView&) = delete;
+    FileView& operator=(const FileView&) = delete;
+
+    ~FileView() {
+#ifdef __linux__
+        if (data) {
+            ::munmap(const_cast<char*>(data), static_cast<size_t>(fileSize));
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+#endif
+    }
+
+    // Размер известен только для непустых обычных файлов (у файлов /proc он нулевой)
+    bool hasSize() const {
+        return knownSize;
+    }
+
+    uintmax_t size() const {
+        return fileSize;
+    }
+
+    bool mapped() const {
+        return data != nullptr;
+    }
+
+    // Для произвольного доступа (индексы, хвосты) упреждающее чтение только мешает
+    void adviseRandomAccess() {
+#ifdef __linux__
+        if (data) {
+            ::madvise(const_cast<char*>(data), static_cast<size_t>(fileSize), MADV_RANDOM);
+        }
+#endif
+    }
+
+    // Диапазон байт: из отображения без копирования, иначе через внутренний буфер
+    std::string_view range(uintmax_t offset, size_t length) {
+        if (data) {
+            if (offset >= fileSize) {
+                return {};
+            }
+            length = static_cast<size_t>(std::min<uintmax_t>(length, fileSize - offset));
+            FM_COUNT(Bytes, length);
+            return std::string_view(data + offset, length);
+        }
+        buffer.resize(length);
+        size_t got = readAt(offset, buffer.data(), length);
+        return std::string_view(buffer.data(), got);
+    }
+
+    // Последовательный обход содержимого начиная с offset; f возвращает false для остановки
+    template <typename F>
+    void forEachChunk(F f, uintmax_t offset = 0) {
+        while (true) {
+            std::string_view chunk = range(offset, chunkSize);
+            if (chunk.empty() || !f(chunk)) {
+                return;
+            }
+            offset += chunk.size();
+        }
+    }
+
+    // Обход строк без символа '\n'. Строка копируется только если разорвана границей порции
+    template <typename F>
+    void forEachLine(F f, uintmax_t offset = 0) {
+        std::string carry;
+        bool stopped = false;
+        forEachChunk([&](std::string_view chunk) {
+            while (!chunk.empty()) {
+                const char* newline = static_cast<const char*>(std::memchr(chunk.data(), '\n', chunk.size()));
+                if (!newline) {
+                    carry.append(chunk.data(), chunk.size());
+                    return true;
+                }
+                std::string_view line(chunk.data(), static_cast<size_t>(newline - chunk.data()));
+                chunk.remove_prefix(line.size() + 1);
+                bool more;
+                if (carry.empty()) {
+                    more = f(line);
+                }
+                else {
+                    carry.append(line.data(), line.size());
+                    more = f(std::string_view(carry));
+                    carry.clear();
+                }
+                if (!more) {
+                    stopped = true;
+                    return false;
+                }
+            }
+            return true;
+            }, offset);
+
+        if (!stopped && !carry.empty()) {
+            f(std::string_view(carry));
+        }
+    }
+
+    // Смещение начала последних lines строк; файл читается с конца, а не целиком
+    uintmax_t tailOffset(size_t lines) {
+        if (!knownSize || lines == 0) {
+            return fileSize;
+        }
+        uintmax_t end = fileSize;
+        bool skipTrailing = true;
+        while (end > 0) {
+            uintmax_t begin = end > chunkSize ? end - chunkSize : 0;
+            std::string_view chunk = range(begin, static_cast<size_t>(end - begin));
+            for (size_t i = chunk.size(); i-- > 0;) {
+                if (chunk[i] != '\n') {
+                    skipTrailing = false;
+                    continue;
+                }
+                if (skipTrailing) {
+                    skipTrailing = false;
+                    continue;
+                }
+                if (--lines == 0) {
+                    return begin + i + 1;
+                }
+            }
+            end = begin;
+        }
+        return 0;
+    }
+
+private:
+    size_t chunkSize;
+    uintmax_t fileSize = 0;
+    bool knownSize = false;
+    const char* data = nullptr;
+    std::vector<char> buffer;
+#ifdef __linux__
+    int fd = -1;
+
+    size_t readAt(uintmax_t offset, char* dest, size_t length) {
+        size_t total = 0;
+        while (total < length) {
+            FM_COUNT(Syscalls, 1);
+            ssize_t n = ::pread(fd, dest + total, length - total, static_cast<off_t>(offset + total));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "Ошибка чтения файла");
+            }
+            if (n == 0) {
+                break;
+            }
+            total += static_cast<size_t>(n);
+        }
+        FM_COUNT(Bytes, total);
+        return total;
+    }
+#else
+    std::ifstream stream;
+
+    size_t readAt(uintmax_t offset, char* dest, size_t length) {
+        stream.clear();
+        stream.seekg(static_cast<std::streamoff>(offset));
+        stream.read(dest, static_cast<std::streamsize>(length));
+        FM_COUNT(Bytes, stream.gcount());
+        return static_cast<size_t>(stream.gcount());
+    }
+#endif
+};
@@ -0,0 +1,542 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "instrumentation.hpp"
+#include "io_ring.hpp"
+#include "thread_pool.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+
+namespace fs = std::filesystem;
+
+// Когда данные считаются записанными на диск
+enum class Durability {
+    None,   // остаются в page cache, как после ofstream
+    Sync,   // fdatasync файла при commit, после rename - fsync папки
+    Group   // fdatasync откладывается до WriteBatch::commit: одна серия на много файлов
+};
+
+inline const char* durabilityName(Durability durability) {
+    switch (durability) {
+    case Durability::None: return "none";
+    case Durability::Sync: return "fdatasync";
+    case Durability::Group: return "group";
+    default: return "?";
+    }
+}
+
+struct WriteOptions {
+    Durability durability = Durability::Sync;
+    bool append = false;           // дописывать в конец файла; временный файл не используется
+    bool atomicReplace = true;     // писать во временный файл рядом и ставить его на место renameat2
+    bool noReplace = false;        // RENAME_NOREPLACE: не затирать файл, появившийся за время записи
+    bool direct = false;           // O_DIRECT мимо page cache; если ФС не умеет - обычная запись
+    size_t bufferSize = 1 << 20;   // выровненный буфер, округляется до 4096
+    uintmax_t expectedSize = 0;    // известный заранее размер: место выделяется fallocate
+    unsigned mode = 0644;          // права нового файла; при замене сохраняются права старого
+};
+
+class WriteBatch;
+
+// Запись файла через большой выровненный буфер. При atomicReplace данные пишутся во временный
+// файл в той же папке и встают на место одним renameat2 в commit(), поэтому после сбоя на месте
+// цели остаётся либо старый файл целиком, либо новый. Без commit() временный файл удаляется,
+// а цель не меняется. Все операции идут относительно дескриптора папки, так что переименование
+// папки во время записи не уводит файл в другое место
+class FileWriter {
+public:
+    explicit FileWriter(const fs::path& path, WriteOptions options = {}) : path(path), options(options) {
+        this->options.bufferSize = std::max<size_t>((options.bufferSize + Alignment - 1) / Alignment * Alignment, Alignment);
+        if (this->options.append) {
+            this->options.atomicReplace = false;
+            this->options.direct = false;  // смещение конца файла не обязано быть выровненным
+        }
+        open();
+    }
+
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+
+    ~FileWriter() {
+        abandon();
+    }
+
+    void write(std::string_view data) {
+        FM_SCOPE(Io, "file write");
+        while (!data.empty()) {
+            // Крупный кусок при пустом буфере пишется напрямую, без копирования: буфер нужен,
+            // чтобы собирать мелкие записи, а не чтобы перекладывать крупные
+            if (used == 0 && !directActive && data.size() >= DirectWriteMin) {
+                writeOut(data.data(), data.size());
+                return;
+            }
+            if (!buffer) {
+                allocateBuffer();
+            }
+            const size_t take = std::min(data.size(), options.bufferSize - used);
+            std::memcpy(buffer.get() + used, data.data(), take);
+            used += take;
+            data.remove_prefix(take);
+            if (used == options.bufferSize) {
+                flushBuffer();
+            }
+        }
+    }
+
+    // Дописывает буфер, синхронизирует по options.durability и ставит файл на место.
+    // С Durability::Group и batch синхронизация и rename откладываются до batch->commit()
+    void commit(WriteBatch* batch = nullptr);
+
+    uintmax_t written() const {
+        return total + used;
+    }
+
+    bool directIo() const {
+        return directActive;
+    }
+
+private:
+    static constexpr size_t Alignment = 4096;
+    static constexpr size_t DirectWriteMin = 64 << 10;
+
+    struct FreeDeleter {
+        void operator()(char* p) const {
+            std::free(p);
+        }
+    };
+
+    fs::path path;
+    WriteOptions options;
+    std::unique_ptr<char, FreeDeleter> buffer;
+    size_t used = 0;
+    uintmax_t total = 0;
+    bool directActive = false;
+    bool committed = false;
+#ifdef __linux__
+    int dirFd = -1;
+    int fd = -1;
+    std::string name;
+    std::string tempName;
+    bool created = false;  // файла не было: после commit нужен fsync папки
+
+    static fs::filesystem_error systemError(const char* what, const fs::path& path, int code) {
+        return fs::filesystem_error(what, path, std::error_code(code, std::generic_category()));
+    }
+
+    void allocateBuffer() {
+        void* memory = nullptr;
+        if (posix_memalign(&memory, Alignment, options.bufferSize) != 0) {
+            throw std::bad_alloc();
+        }
+        buffer.reset(static_cast<char*>(memory));
+    }
+
+    void open() {
+        const fs::path parent = path.has_parent_path() ? path.parent_path() : fs::path(".");
+        name = path.filename().string();
+        FM_COUNT(Syscalls, 3);
+        dirFd = ::open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd < 0) {
+            throw systemError("Не удалось открыть папку", parent, errno);
+        }
+        struct stat existing;
+        const bool exists = ::fstatat(dirFd, name.c_str(), &existing, 0) == 0;
+        created = !exists;
+        const unsigned mode = exists ? existing.st_mode & 07777 : options.mode & 07777;
+
+        int flags = O_WRONLY | O_CLOEXEC;
+        const char* target = name.c_str();
+        if (options.append) {
+            flags |= O_CREAT | O_APPEND;
+        }
+        else if (options.atomicReplace) {
+            static std::atomic<unsigned> counter{ 0 };
+            tempName = ".~" + name + ".tmp" + std::to_string(::getpid()) + "-" + std::to_string(counter++);
+            target = tempName.c_str();
+            flags |= O_CREAT | O_EXCL;
+        }
+        else {
+            flags |= O_CREAT | O_TRUNC;
+        }
+
+#ifdef O_DIRECT
+        if (options.direct) {
+            fd = ::openat(dirFd, target, flags | O_DIRECT, mode);
+            directActive = fd >= 0;
+        }
+#endif
+        if (fd < 0) {
+            fd = ::openat(dirFd, target, flags, mode);
+        }
+        if (fd < 0) {
+            const int code = errno;
+            ::close(dirFd);
+            dirFd = -1;
+            throw systemError("Не удалось создать файл", path, code);
+        }
+        if (exists && options.atomicReplace) {
+            ::fchmod(fd, mode);
+        }
+        if (options.expectedSize > 0) {
+            // Место одним куском: меньше фрагментации и ENOSPC сразу, а не в середине записи
+            struct stat st;
+            const off_t start = options.append && ::fstat(fd, &st) == 0 ? st.st_size : 0;
+            FM_COUNT(Syscalls, 1);
+            ::fallocate(fd, options.append ? FALLOC_FL_KEEP_SIZE : 0, start, static_cast<off_t>(options.expectedSize));
+        }
+    }
+
+    void writeOut(const char* data, size_t length) {
+        while (length > 0) {
+            FM_COUNT(Syscalls, 1);
+            const ssize_t n = ::write(fd, data, length);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw systemError("Ошибка записи", path, errno);
+            }
+            data += n;
+            length -= static_cast<size_t>(n);
+            total += static_cast<uintmax_t>(n);
+            FM_COUNT(Bytes, n);
+        }
+    }
+
+    void flushBuffer() {
+        if (used == 0) {
+            return;
+        }
+        // O_DIRECT требует длины, кратной блоку: невыровненный хвост пишется уже без него
+        if (directActive && used % Alignment != 0) {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_DIRECT);
+            directActive = false;
+        }
+        const size_t length = used;
+        used = 0;
+        writeOut(buffer.get(), length);
+    }
+
+    void abandon() {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        if (!committed && !tempName.empty() && dirFd >= 0) {
+            ::unlinkat(dirFd, tempName.c_str(), 0);
+        }
+        if (dirFd >= 0) {
+            ::close(dirFd);
+            dirFd = -1;
+        }
+    }
+
+    static int renameInto(int dirFd, const char* from, const char* to, bool noReplace) {
+        const unsigned flags = noReplace ? RENAME_NOREPLACE : 0;
+#ifdef SYS_renameat2
+        FM_COUNT(Syscalls, 1);
+        if (::syscall(SYS_renameat2, dirFd, from, dirFd, to, flags) == 0) {
+            return 0;
+        }
+        if ((errno != ENOSYS && errno != EINVAL) || noReplace) {
+            return errno;
+        }
+#else
+        if (noReplace) {
+            return ENOSYS;
+        }
+#endif
+        return ::renameat(dirFd, from, dirFd, to) == 0 ? 0 : errno;
+    }
+
+    friend class WriteBatch;
+#else
+    std::ofstream stream;
+    fs::path tempPath;
+
+    void allocateBuffer() {
+        buffer.reset(static_cast<char*>(std::malloc(options.bufferSize)));
+        if (!buffer) {
+            throw std::bad_alloc();
+        }
+    }
+
+    void open() {
+        fs::path target = path;
+        if (options.atomicReplace) {
+            tempPath = path.parent_path() / (".~" + path.filename().string() + ".tmp");
+            target = tempPath;
+        }
+        stream.open(target, std::ios::binary | (options.append ? std::ios::app : std::ios::trunc));
+        if (!stream.is_open()) {
+            throw fs::filesystem_error("Не удалось создать файл", path, std::make_error_code(std::errc::permission_denied));
+        }
+    }
+
+    void writeOut(const char* data, size_t length) {
+        stream.write(data, static_cast<std::streamsize>(length));
+        if (!stream) {
+            throw fs::filesystem_error("Ошибка записи", path, std::make_error_code(std::errc::io_error));
+        }
+        total += length;
+    }
+
+    void flushBuffer() {
+        const size_t length = used;
+        used = 0;
+        writeOut(buffer.get(), length);
+    }
+
+    void abandon() {
+        if (stream.is_open()) {
+            stream.close();
+        }
+        if (!committed && !tempPath.empty()) {
+            std::error_code ec;
+            fs::remove(tempPath, ec);
+        }
+    }
+
+    friend class WriteBatch;
+#endif
+};
+
+// Групповая фиксация: файлы, закрытые через commit(&batch) с Durability::Group, синхронизируются
+// одной серией fdatasync (через io_uring, если доступен, иначе параллельно в пуле), затем
+// переименовываются, и каждая затронутая папка получает один fsync. Стоимость ожидания диска
+// делится на все файлы пачки. Если синхронизировать не удалось хотя бы один файл, ни один
+// временный файл не встаёт на место. Незафиксированная пачка при разрушении удаляет свои файлы
+class WriteBatch {
+public:
+    explicit WriteBatch(unsigned jobs = 0) : jobs(jobs ? jobs : std::max(1u, std::thread::hardware_concurrency())) {}
+
+    WriteBatch(const WriteBatch&) = delete;
+    WriteBatch& operator=(const WriteBatch&) = delete;
+
+    ~WriteBatch() {
+        discard();
+    }
+
+    size_t size() const {
+        return pending.size();
+    }
+
+    void commit() {
+        FM_SCOPE(Io, "group commit");
+#ifdef __linux__
+        std::vector<int> errors(pending.size(), 0);
+        syncAll(errors);
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (errors[i] != 0) {
+                const fs::path failedPath = pending[i].path;
+                const int code = errors[i];
+                discard();
+                throw FileWriter::systemError("Не удалось синхронизировать файл", failedPath, code);
+            }
+        }
+
+        std::vector<const Pending*> directories;
+        for (auto& file : pending) {
+            ::close(file.fd);
+            file.fd = -1;
+            if (!file.temp.empty()) {
+                const int code = FileWriter::renameInto(file.dirFd, file.temp.c_str(), file.name.c_str(), file.noReplace);
+                if (code != 0) {
+                    const fs::path failedPath = file.path;
+                    discard();
+                    throw FileWriter::systemError("Не удалось заменить файл", failedPath, code);
+                }
+                file.temp.clear();
+            }
+            if (file.needsDirSync && std::none_of(directories.begin(), directories.end(),
+                [&](const Pending* other) { return other->device == file.device && other->inode == file.inode; })) {
+                directories.push_back(&file);
+            }
+        }
+        for (const Pending* directory : directories) {
+            FM_COUNT(Syscalls, 1);
+            ::fsync(directory->dirFd);
+        }
+#else
+        for (auto& file : pending) {
+            if (!file.temp.empty()) {
+                fs::rename(file.temp, file.path);
+                file.temp.clear();
+            }
+        }
+#endif
+        discard();
+    }
+
+private:
+    friend class FileWriter;
+
+    struct Pending {
+        fs::path path;
+#ifdef __linux__
+        int fd = -1;
+        int dirFd = -1;
+        std::string name;
+        dev_t device = 0;  // папки: одна и та же папка синхронизируется один раз
+        ino_t inode = 0;
+        bool needsDirSync = false;
+#endif
+        std::string temp;  // пусто - файл уже на месте
+        bool noReplace = false;
+    };
+
+    unsigned jobs;
+    std::vector<Pending> pending;
+
+    void add(Pending file) {
+        pending.push_back(std::move(file));
+    }
+
+    void discard() {
+        for (auto& file : pending) {
+#ifdef __linux__
+            if (file.fd >= 0) {
+                ::close(file.fd);
+            }
+            if (!file.temp.empty()) {
+                ::unlinkat(file.dirFd, file.temp.c_str(), 0);
+            }
+            ::close(file.dirFd);
+#else
+            if (!file.temp.empty()) {
+                std::error_code ec;
+                fs::remove(file.temp, ec);
+            }
+#endif
+        }
+        pending.clear();
+    }
+
+#ifdef __linux__
+    void syncAll(std::vector<int>& errors) {
+#ifdef FM_HAVE_IO_URING
+        if (IoRing* ring = IoRing::forThread()) {
+            ring->run(pending.size(), [&](size_t i, uint32_t, io_uring_sqe& sqe) {
+                IoRing::prepFsync(sqe, pending[i].fd, true);
+                }, [&](size_t i, uint32_t, int result) {
+                    errors[i] = result < 0 ? -result : 0;
+                });
+            return;
+        }
+#endif
+        const unsigned threads = static_cast<unsigned>(std::min<size_t>(jobs, pending.size()));
+        if (threads <= 1) {
+            for (size_t i = 0; i < pending.size(); i++) {
+                FM_COUNT(Syscalls, 1);
+                errors[i] = ::fdatasync(pending[i].fd) == 0 ? 0 : errno;
+            }
+            return;
+        }
+        ThreadPool pool(threads);
+        for (size_t i = 0; i < pending.size(); i++) {
+            pool.submit([this, &errors, i] {
+                FM_COUNT(Syscalls, 1);
+                errors[i] = ::fdatasync(pending[i].fd) == 0 ? 0 : errno;
+                });
+        }
+        pool.wait();
+    }
+#endif
+};
+
+inline void FileWriter::commit(WriteBatch* batch) {
+    FM_SCOPE(Io, "file commit");
+    flushBuffer();
+#ifdef __linux__
+    if (!options.append && options.expectedSize > total) {
+        // fallocate выделил больше, чем записано
+        ::ftruncate(fd, static_cast<off_t>(total));
+    }
+    if (options.durability == Durability::Group && batch) {
+        WriteBatch::Pending file;
+        file.path = path;
+        file.fd = fd;
+        file.dirFd = dirFd;
+        file.name = name;
+        file.temp = tempName;
+        file.noReplace = options.noReplace;
+        file.needsDirSync = !tempName.empty() || created;
+        struct stat st;
+        if (::fstat(dirFd, &st) == 0) {
+            file.device = st.st_dev;
+            file.inode = st.st_ino;
+        }
+        fd = -1;
+        dirFd = -1;
+        committed = true;
+        batch->add(std::move(file));
+        return;
+    }
+    if (options.durability != Durability::None) {
+        FM_COUNT(Syscalls, 1);
+        if (::fdatasync(fd) != 0) {
+            throw systemError("Не удалось синхронизировать файл", path, errno);
+        }
+    }
+    FM_COUNT(Syscalls, 1);
+    const int closeResult = ::close(fd);
+    fd = -1;
+    if (closeResult != 0) {
+        throw systemError("Ошибка записи", path, errno);
+    }
+    if (!tempName.empty()) {
+        const int code = renameInto(dirFd, tempName.c_str(), name.c_str(), options.noReplace);
+        if (code != 0) {
+            throw systemError("Не удалось заменить файл", path, code);
+        }
+    }
+    committed = true;
+    if (options.durability != Durability::None && (!tempName.empty() || created)) {
+        // Новое имя в папке переживает сбой только после fsync самой папки
+        FM_COUNT(Syscalls, 1);
+        ::fsync(dirFd);
+    }
+    abandon();
+#else
+    stream.close();
+    if (!stream) {
+        throw fs::filesystem_error("Ошибка записи", path, std::make_error_code(std::errc::io_error));
+    }
+    if (!tempPath.empty()) {
+        if (options.durability == Durability::Group && batch) {
+            WriteBatch::Pending file;
+            file.path = path;
+            file.temp = tempPath.string();
+            committed = true;
+            batch->add(std::move(file));
+            return;
+        }
+        fs::rename(tempPath, path);
+    }
+    committed = true;
+#endif
+}
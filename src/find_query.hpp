@@ -0,0 +1,762 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <initializer_list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "console_output.hpp"
+#include "instrumentation.hpp"
+#include "job_control.hpp"
+#include "matcher.hpp"
+#include "walker.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Поле условия: name~*.tmp, size>1G, mtime<-30d, type=f, path~**/cache/**, depth<=3
+enum class FindField : unsigned char {
+    Name,
+    IName,   // имя без учёта регистра
+    Path,    // путь относительно корня поиска
+    Type,
+    Depth,   // 1 - элементы самого корня
+    Size,
+    Mtime
+};
+
+enum class FindOp : unsigned char {
+    Less,
+    LessEq,
+    Equal,
+    NotEqual,
+    GreaterEq,
+    Greater,
+    Match,    // ~ glob
+    NotMatch  // !~
+};
+
+struct FindStats {
+    uintmax_t visited = 0;   // элементов проверено условием
+    uintmax_t matched = 0;
+    uintmax_t statCalls = 0; // сколько элементов дошло до проверок размера и времени
+    uintmax_t pruned = 0;    // папок, в которые обход не спускался
+    uintmax_t errors = 0;    // не удалось получить метаданные
+};
+
+// Элемент обхода, для которого вычисляется условие. Путь собирается и stat выполняется
+// не больше одного раза и только когда до них дошли проверки.
+class FindSubject {
+public:
+    FindSubject(const WalkDir& dir, const WalkEntry& entry, size_t relativeOffset)
+        : dir(dir), entry(entry), relativeOffset(relativeOffset) {}
+
+    const WalkEntry& item() const {
+        return entry;
+    }
+
+    // Путь относительно корня; действителен до следующего FindSubject в этом потоке
+    std::string_view relativePath() {
+        if (!pathReady) {
+            thread_local std::string buffer;
+            buffer.clear();
+            entry.appendPath(buffer);
+            path = std::string_view(buffer).substr(std::min(relativeOffset, buffer.size()));
+            pathReady = true;
+        }
+        return path;
+    }
+
+    // false - элемент исчез или недоступен
+    bool loadStat() {
+        if (statState == StatState::NotLoaded) {
+            statState = readStat() ? StatState::Loaded : StatState::Failed;
+        }
+        return statState == StatState::Loaded;
+    }
+
+    bool statAttempted() const {
+        return statState != StatState::NotLoaded;
+    }
+
+    bool statFailed() const {
+        return statState == StatState::Failed;
+    }
+
+    uint64_t size() const {
+        return fileSize;
+    }
+
+    int64_t mtime() const {
+        return modified;
+    }
+
+private:
+    enum class StatState : unsigned char { NotLoaded, Loaded, Failed };
+
+    const WalkDir& dir;
+    const WalkEntry& entry;
+    size_t relativeOffset;
+    std::string_view path;
+    bool pathReady = false;
+    StatState statState = StatState::NotLoaded;
+    uint64_t fileSize = 0;
+    int64_t modified = 0;
+
+    // Ссылки не разыменовываются: размер и время самой ссылки, как у find -P
+    bool readStat() {
+        FM_SCOPE(Stat, "find stat");
+#ifdef __linux__
+        if (dir.fd >= 0) {
+            FM_COUNT(Syscalls, 1);
+#ifdef STATX_SIZE
+            struct statx stx;
+            if (::statx(dir.fd, entry.cName(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, STATX_SIZE | STATX_MTIME, &stx) != 0) {
+                return false;
+            }
+            fileSize = stx.stx_size;
+            modified = stx.stx_mtime.tv_sec;
+#else
+            struct stat st;
+            if (::fstatat(dir.fd, entry.cName(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                return false;
+            }
+            fileSize = static_cast<uint64_t>(st.st_size);
+            modified = st.st_mtime;
+#endif
+            return true;
+        }
+#endif
+        std::string full = entry.path();
+        std::error_code ec;
+        fs::file_status status = fs::symlink_status(full, ec);
+        if (ec) {
+            return false;
+        }
+        fileSize = fs::is_regular_file(status) ? fs::file_size(full, ec) : 0;
+        auto time = fs::last_write_time(full, ec);
+        if (ec) {
+            return false;
+        }
+        modified = std::chrono::system_clock::to_time_t(std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+            time - fs::file_time_type::clock::now() + std::chrono::system_clock::now()));
+        return true;
+    }
+};
+
+// Выражение find, разобранное один раз в дерево условий.
+// Грамматика: выражение из условий "поле оператор значение", соединённых and/or
+// (and можно не писать), с not/! и скобками. Внутри and/or дешёвые проверки
+// (имя, тип из d_type, глубина) переставляются раньше пути, а путь - раньше stat,
+// поэтому stat выполняется только для элементов, прошедших остальные проверки.
+// По условиям на путь и глубину заранее видно, что внутри папки ничего не подойдёт:
+// такие папки обход пропускает целиком.
+class FindQuery {
+public:
+    // words - слова выражения; ошибки разбора - std::invalid_argument с описанием
+    explicit FindQuery(const std::vector<std::string>& words) {
+        for (const auto& word : words) {
+            splitWord(word);
+        }
+        if (tokens.empty()) {
+            throw std::invalid_argument("пустое выражение");
+        }
+        root = parseOr();
+        if (position < tokens.size()) {
+            throw std::invalid_argument("лишнее слово: " + tokens[position]);
+        }
+        order(root);
+    }
+
+    bool matches(FindSubject& subject) const {
+        return evaluate(root, subject);
+    }
+
+    // false - ни один элемент внутри папки (путь от корня, её глубина) не подойдёт
+    bool mayMatchInside(std::string_view relativeDir, unsigned depth) const {
+        return descend(root, relativeDir, depth) != Tri::Never;
+    }
+
+    // Выражение в том порядке, в котором будут выполняться проверки
+    std::string describe() const {
+        std::string out;
+        describe(root, out, true);
+        return out;
+    }
+
+    // Обход от rootPath; совпадения уходят в output пачками из рабочих потоков
+    FindStats run(const fs::path& rootPath, OutputWriter& output, JobControl* control = nullptr, unsigned threads = 0) const {
+        std::string rootString = rootPath.string();
+        const size_t relativeOffset = rootString.size()
+            + (rootString.empty() || rootString.back() == fs::path::preferred_separator ? 0 : 1);
+
+        std::atomic<uintmax_t> visited{ 0 }, matched{ 0 }, statCalls{ 0 }, pruned{ 0 }, errors{ 0 };
+        const bool canPrune = hasPruningTests(root);
+
+        WalkOptions walkOptions;
+        walkOptions.threads = threads;
+        walkOptions.control = control;
+        ParallelWalker walker(walkOptions);
+        walker.walk(rootPath, [&](const WalkDir& dir, std::vector<WalkEntry>& entries) {
+            std::string found;
+            uintmax_t batchMatched = 0, batchStats = 0, batchPruned = 0, batchErrors = 0;
+            for (auto& entry : entries) {
+                FindSubject subject(dir, entry, relativeOffset);
+                if (evaluate(root, subject)) {
+                    thread_local std::string path;
+                    path.clear();
+                    entry.appendPath(path);
+                    output.append(found, path);
+                    batchMatched++;
+                }
+                if (subject.statAttempted()) {
+                    batchStats++;
+                    batchErrors += subject.statFailed() ? 1 : 0;
+                }
+                if (canPrune && entry.isDirectory() && descend(root, subject.relativePath(), entry.depth) == Tri::Never) {
+                    entry.prune = true;
+                    batchPruned++;
+                }
+            }
+            visited.fetch_add(entries.size(), std::memory_order_relaxed);
+            matched.fetch_add(batchMatched, std::memory_order_relaxed);
+            statCalls.fetch_add(batchStats, std::memory_order_relaxed);
+            pruned.fetch_add(batchPruned, std::memory_order_relaxed);
+            errors.fetch_add(batchErrors, std::memory_order_relaxed);
+            output.write(found, batchMatched);
+            });
+        output.flush();
+
+        FindStats stats;
+        stats.visited = visited.load();
+        stats.matched = matched.load();
+        stats.statCalls = statCalls.load();
+        stats.pruned = pruned.load();
+        stats.errors = errors.load();
+        return stats;
+    }
+
+private:
+    // Результат условия для всех элементов внутри папки
+    enum class Tri : unsigned char { Never, Maybe, Always };
+
+    struct Node {
+        enum class Kind : unsigned char { And, Or, Not, Test };
+
+        Kind kind = Kind::Test;
+        FindField field = FindField::Name;
+        FindOp op = FindOp::Equal;
+        EntryType type = EntryType::Unknown;
+        int64_t number = 0;                 // байты, секунды эпохи или глубина
+        std::string text;                   // значение как в запросе
+        std::string folded;                 // iname=: значение в нижнем регистре
+        std::unique_ptr<Matcher> matcher;   // ~ и !~
+        std::vector<Node> children;
+        unsigned cost = 0;                  // 0 - имя/тип/глубина, 1 - путь, 2 - stat
+    };
+
+    std::vector<std::string> tokens;
+    size_t position = 0;
+    Node root;
+
+    // Скобки и ! в начале слова и лишние ) в конце - отдельные лексемы: (name~a or name~b)
+    void splitWord(const std::string& word) {
+        size_t begin = 0;
+        while (begin < word.size() && (word[begin] == '(' || (word[begin] == '!' && word.size() > begin + 1
+            && word[begin + 1] != '=' && word[begin + 1] != '~'))) {
+            tokens.emplace_back(1, word[begin]);
+            begin++;
+        }
+        size_t end = word.size();
+        long balance = 0;
+        for (size_t i = begin; i < end; i++) {
+            balance += word[i] == '(' ? 1 : word[i] == ')' ? -1 : 0;
+        }
+        size_t closing = 0;
+        while (balance < 0 && end > begin && word[end - 1] == ')') {
+            end--;
+            closing++;
+            balance++;
+        }
+        if (end > begin) {
+            tokens.push_back(word.substr(begin, end - begin));
+        }
+        tokens.insert(tokens.end(), closing, ")");
+    }
+
+    bool peekIs(std::initializer_list<const char*> words) const {
+        if (position >= tokens.size()) {
+            return false;
+        }
+        for (const char* word : words) {
+            if (tokens[position] == word) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Node parseOr() {
+        Node first = parseAnd();
+        if (!peekIs({ "or", "||" })) {
+            return first;
+        }
+        Node node;
+        node.kind = Node::Kind::Or;
+        node.children.push_back(std::move(first));
+        while (peekIs({ "or", "||" })) {
+            position++;
+            node.children.push_back(parseAnd());
+        }
+        return node;
+    }
+
+    Node parseAnd() {
+        Node first = parseUnary();
+        Node node;
+        node.kind = Node::Kind::And;
+        node.children.push_back(std::move(first));
+        while (position < tokens.size() && !peekIs({ "or", "||", ")" })) {
+            if (peekIs({ "and", "&&" })) {
+                position++;
+            }
+            node.children.push_back(parseUnary());
+        }
+        if (node.children.size() == 1) {
+            return std::move(node.children.front());
+        }
+        return node;
+    }
+
+    Node parseUnary() {
+        if (position >= tokens.size()) {
+            throw std::invalid_argument("выражение оборвано");
+        }
+        if (peekIs({ "not", "!" })) {
+            position++;
+            Node node;
+            node.kind = Node::Kind::Not;
+            node.children.push_back(parseUnary());
+            return node;
+        }
+        if (peekIs({ "(" })) {
+            position++;
+            Node inner = parseOr();
+            if (!peekIs({ ")" })) {
+                throw std::invalid_argument("не закрыта скобка");
+            }
+            position++;
+            return inner;
+        }
+        if (peekIs({ "and", "&&", "or", "||", ")" })) {
+            throw std::invalid_argument("неожиданное слово: " + tokens[position]);
+        }
+        return parseTest(tokens[position++]);
+    }
+
+    static Node parseTest(const std::string& word) {
+        const size_t opAt = word.find_first_of("<>=!~");
+        if (opAt == std::string::npos || opAt == 0) {
+            throw std::invalid_argument("ожидалось условие вида поле<значение: " + word);
+        }
+        std::string field = word.substr(0, opAt);
+        std::transform(field.begin(), field.end(), field.begin(), [](unsigned char c) {
+            return static_cast<char>(std::tolower(c));
+            });
+
+        Node node;
+        const std::string_view rest = std::string_view(word).substr(opAt);
+        size_t opLength = 1;
+        if (rest.substr(0, 2) == "<=") { node.op = FindOp::LessEq; opLength = 2; }
+        else if (rest.substr(0, 2) == ">=") { node.op = FindOp::GreaterEq; opLength = 2; }
+        else if (rest.substr(0, 2) == "!=") { node.op = FindOp::NotEqual; opLength = 2; }
+        else if (rest.substr(0, 2) == "!~") { node.op = FindOp::NotMatch; opLength = 2; }
+        else if (rest[0] == '<') { node.op = FindOp::Less; }
+        else if (rest[0] == '>') { node.op = FindOp::Greater; }
+        else if (rest[0] == '=') { node.op = FindOp::Equal; }
+        else if (rest[0] == '~') { node.op = FindOp::Match; }
+        else {
+            throw std::invalid_argument("неизвестный оператор в условии: " + word);
+        }
+        node.text = std::string(rest.substr(opLength));
+        if (node.text.empty()) {
+            throw std::invalid_argument("нет значения в условии: " + word);
+        }
+
+        const bool textOp = node.op == FindOp::Match || node.op == FindOp::NotMatch
+            || node.op == FindOp::Equal || node.op == FindOp::NotEqual;
+        auto requireTextOp = [&]() {
+            if (!textOp) {
+                throw std::invalid_argument("для поля " + field + " допустимы только =, !=, ~ и !~");
+            }
+        };
+        auto requireNumberOp = [&]() {
+            if (node.op == FindOp::Match || node.op == FindOp::NotMatch) {
+                throw std::invalid_argument("для поля " + field + " нельзя использовать ~");
+            }
+        };
+
+        if (field == "name" || field == "iname" || field == "path") {
+            requireTextOp();
+            node.field = field == "name" ? FindField::Name : field == "iname" ? FindField::IName : FindField::Path;
+            node.cost = node.field == FindField::Path ? 1 : 0;
+            if (node.op == FindOp::Match || node.op == FindOp::NotMatch) {
+                MatchOptions options;
+                options.mode = MatchMode::Glob;
+                options.ignoreCase = node.field == FindField::IName;
+                node.matcher = std::make_unique<Matcher>(node.text, options);
+            }
+            else if (node.field == FindField::IName) {
+                foldCase(node.text, node.folded);
+            }
+        }
+        else if (field == "type") {
+            if (node.op != FindOp::Equal && node.op != FindOp::NotEqual) {
+                throw std::invalid_argument("для поля type допустимы только = и !=");
+            }
+            node.field = FindField::Type;
+            node.type = parseType(node.text);
+        }
+        else if (field == "depth") {
+            requireNumberOp();
+            node.field = FindField::Depth;
+            char* end = nullptr;
+            node.number = std::strtoll(node.text.c_str(), &end, 10);
+            if (*end != '\0' || node.number < 0) {
+                throw std::invalid_argument("глубина должна быть числом: " + node.text);
+            }
+        }
+        else if (field == "size") {
+            requireNumberOp();
+            node.field = FindField::Size;
+            node.cost = 2;
+            node.number = parseSize(node.text);
+        }
+        else if (field == "mtime") {
+            requireNumberOp();
+            node.field = FindField::Mtime;
+            node.cost = 2;
+            node.number = parseTime(node.text);
+        }
+        else {
+            throw std::invalid_argument("неизвестное поле: " + field + " (есть name, iname, path, type, depth, size, mtime)");
+        }
+        return node;
+    }
+
+    static EntryType parseType(const std::string& text) {
+        if (text == "f" || text == "file") return EntryType::File;
+        if (text == "d" || text == "dir") return EntryType::Directory;
+        if (text == "l" || text == "link") return EntryType::Symlink;
+        if (text == "o" || text == "other") return EntryType::Other;
+        throw std::invalid_argument("тип должен быть f, d, l или o: " + text);
+    }
+
+    // 1G, 1.5M, 100K, 512 (байты); множители двоичные
+    static int64_t parseSize(const std::string& text) {
+        char* end = nullptr;
+        double value = std::strtod(text.c_str(), &end);
+        if (end == text.c_str() || value < 0) {
+            throw std::invalid_argument("размер должен быть числом с необязательным K/M/G/T: " + text);
+        }
+        std::string suffix(end);
+        std::transform(suffix.begin(), suffix.end(), suffix.begin(), [](unsigned char c) {
+            return static_cast<char>(std::toupper(c));
+            });
+        static const char* const units[] = { "B", "K", "M", "G", "T" };
+        double multiplier = 0;
+        for (unsigned i = 0; i < 5; i++) {
+            const std::string unit = units[i];
+            if (suffix.empty() && i == 0) {
+                multiplier = 1;
+                break;
+            }
+            if (suffix == unit || (i > 0 && (suffix == unit + "B" || suffix == unit + "IB"))) {
+                multiplier = static_cast<double>(uint64_t(1) << (10 * i));
+                break;
+            }
+        }
+        if (multiplier == 0) {
+            throw std::invalid_argument("неизвестная единица размера: " + suffix);
+        }
+        return static_cast<int64_t>(value * multiplier);
+    }
+
+    // -30d, 12h, 90m (назад от текущего момента; знак можно не писать) или 2024-01-31[THH:MM]
+    static int64_t parseTime(const std::string& text) {
+        int year = 0, month = 0, day = 0, hour = 0, minute = 0;
+        char separator = 0;
+        const int fields = std::sscanf(text.c_str(), "%4d-%2d-%2d%c%2d:%2d", &year, &month, &day, &separator, &hour, &minute);
+        if (fields == 3 || (fields == 6 && (separator == 'T' || separator == ' '))) {
+            std::tm tm{};
+            tm.tm_year = year - 1900;
+            tm.tm_mon = month - 1;
+            tm.tm_mday = day;
+            tm.tm_hour = hour;
+            tm.tm_min = minute;
+            tm.tm_isdst = -1;
+            const std::time_t result = std::mktime(&tm);
+            if (result == static_cast<std::time_t>(-1) || month < 1 || month > 12 || day < 1 || day > 31) {
+                throw std::invalid_argument("неверная дата: " + text);
+            }
+            return static_cast<int64_t>(result);
+        }
+
+        const char* start = text.c_str() + (text[0] == '-' || text[0] == '+' ? 1 : 0);
+        char* end = nullptr;
+        const double amount = std::strtod(start, &end);
+        if (end == start) {
+            throw std::invalid_argument("время должно быть вида -30d или ГГГГ-ММ-ДД: " + text);
+        }
+        const std::string unit(end);
+        double seconds = 0;
+        if (unit == "s" || unit.empty()) seconds = 1;
+        else if (unit == "m") seconds = 60;
+        else if (unit == "h") seconds = 3600;
+        else if (unit == "d") seconds = 86400;
+        else if (unit == "w") seconds = 7 * 86400;
+        else {
+            throw std::invalid_argument("единица времени должна быть s, m, h, d или w: " + text);
+        }
+        return static_cast<int64_t>(std::time(nullptr)) - static_cast<int64_t>(amount * seconds);
+    }
+
+    // Перестановка детей and/or по стоимости; порядок равных по стоимости сохраняется
+    static unsigned order(Node& node) {
+        if (node.kind == Node::Kind::Test) {
+            return node.cost;
+        }
+        unsigned cost = 0;
+        for (auto& child : node.children) {
+            child.cost = order(child);
+            cost = std::max(cost, child.cost);
+        }
+        std::stable_sort(node.children.begin(), node.children.end(), [](const Node& a, const Node& b) {
+            return a.cost < b.cost;
+            });
+        node.cost = cost;
+        return cost;
+    }
+
+    static bool compare(int64_t value, FindOp op, int64_t bound) {
+        switch (op) {
+        case FindOp::Less: return value < bound;
+        case FindOp::LessEq: return value <= bound;
+        case FindOp::Equal: return value == bound;
+        case FindOp::NotEqual: return value != bound;
+        case FindOp::GreaterEq: return value >= bound;
+        case FindOp::Greater: return value > bound;
+        default: return false;
+        }
+    }
+
+    static bool compareText(const Node& node, std::string_view text) {
+        switch (node.op) {
+        case FindOp::Match: return node.matcher->matches(text);
+        case FindOp::NotMatch: return !node.matcher->matches(text);
+        default: break;
+        }
+        bool equal = false;
+        if (node.field == FindField::IName) {
+            thread_local std::string folded;
+            foldCase(text, folded);
+            equal = folded == node.folded;
+        }
+        else {
+            equal = text == node.text;
+        }
+        return node.op == FindOp::Equal ? equal : !equal;
+    }
+
+    static bool evaluate(const Node& node, FindSubject& subject) {
+        switch (node.kind) {
+        case Node::Kind::And:
+            for (const auto& child : node.children) {
+                if (!evaluate(child, subject)) {
+                    return false;
+                }
+            }
+            return true;
+        case Node::Kind::Or:
+            for (const auto& child : node.children) {
+                if (evaluate(child, subject)) {
+                    return true;
+                }
+            }
+            return false;
+        case Node::Kind::Not:
+            return !evaluate(node.children.front(), subject);
+        case Node::Kind::Test:
+            break;
+        }
+
+        const WalkEntry& entry = subject.item();
+        switch (node.field) {
+        case FindField::Name:
+        case FindField::IName:
+            return compareText(node, entry.name());
+        case FindField::Path:
+            return compareText(node, subject.relativePath());
+        case FindField::Type:
+            return (entry.type == node.type) == (node.op == FindOp::Equal);
+        case FindField::Depth:
+            return compare(static_cast<int64_t>(entry.depth), node.op, node.number);
+        case FindField::Size:
+            return subject.loadStat() && compare(static_cast<int64_t>(subject.size()), node.op, node.number);
+        case FindField::Mtime:
+            return subject.loadStat() && compare(subject.mtime(), node.op, node.number);
+        }
+        return false;
+    }
+
+    static Tri invert(Tri value) {
+        return value == Tri::Never ? Tri::Always : value == Tri::Always ? Tri::Never : Tri::Maybe;
+    }
+
+    // Значение условия сразу для всех элементов внутри папки глубины depth
+    static Tri descend(const Node& node, std::string_view dir, unsigned depth) {
+        switch (node.kind) {
+        case Node::Kind::And: {
+            Tri result = Tri::Always;
+            for (const auto& child : node.children) {
+                Tri value = descend(child, dir, depth);
+                if (value == Tri::Never) {
+                    return Tri::Never;
+                }
+                if (value == Tri::Maybe) {
+                    result = Tri::Maybe;
+                }
+            }
+            return result;
+        }
+        case Node::Kind::Or: {
+            Tri result = Tri::Never;
+            for (const auto& child : node.children) {
+                Tri value = descend(child, dir, depth);
+                if (value == Tri::Always) {
+                    return Tri::Always;
+                }
+                if (value == Tri::Maybe) {
+                    result = Tri::Maybe;
+                }
+            }
+            return result;
+        }
+        case Node::Kind::Not:
+            return invert(descend(node.children.front(), dir, depth));
+        case Node::Kind::Test:
+            break;
+        }
+
+        if (node.field == FindField::Depth) {
+            // Глубины элементов внутри: от depth + 1 и без ограничения сверху
+            const int64_t nearest = static_cast<int64_t>(depth) + 1;
+            switch (node.op) {
+            case FindOp::Less: return nearest < node.number ? Tri::Maybe : Tri::Never;
+            case FindOp::LessEq:
+            case FindOp::Equal: return nearest <= node.number ? Tri::Maybe : Tri::Never;
+            case FindOp::Greater:
+            case FindOp::NotEqual: return nearest > node.number ? Tri::Always : Tri::Maybe;
+            case FindOp::GreaterEq: return nearest >= node.number ? Tri::Always : Tri::Maybe;
+            default: return Tri::Maybe;
+            }
+        }
+        if (node.field == FindField::Path) {
+            bool possible = true;
+            if (node.matcher) {
+                possible = node.matcher->mayMatchInside(dir);
+            }
+            else {
+                possible = node.text.size() > dir.size() && node.text.compare(0, dir.size(), dir) == 0
+                    && node.text[dir.size()] == '/';
+            }
+            const bool positive = node.op == FindOp::Match || node.op == FindOp::Equal;
+            if (possible) {
+                return Tri::Maybe;
+            }
+            return positive ? Tri::Never : Tri::Always;
+        }
+        return Tri::Maybe;
+    }
+
+    static bool hasPruningTests(const Node& node) {
+        if (node.kind == Node::Kind::Test) {
+            return node.field == FindField::Depth || node.field == FindField::Path;
+        }
+        return std::any_of(node.children.begin(), node.children.end(), [](const Node& child) {
+            return hasPruningTests(child);
+            });
+    }
+
+    static const char* opText(FindOp op) {
+        switch (op) {
+        case FindOp::Less: return "<";
+        case FindOp::LessEq: return "<=";
+        case FindOp::Equal: return "=";
+        case FindOp::NotEqual: return "!=";
+        case FindOp::GreaterEq: return ">=";
+        case FindOp::Greater: return ">";
+        case FindOp::Match: return "~";
+        case FindOp::NotMatch: return "!~";
+        }
+        return "?";
+    }
+
+    static const char* fieldText(FindField field) {
+        switch (field) {
+        case FindField::Name: return "name";
+        case FindField::IName: return "iname";
+        case FindField::Path: return "path";
+        case FindField::Type: return "type";
+        case FindField::Depth: return "depth";
+        case FindField::Size: return "size";
+        case FindField::Mtime: return "mtime";
+        }
+        return "?";
+    }
+
+    static void describe(const Node& node, std::string& out, bool top) {
+        switch (node.kind) {
+        case Node::Kind::Test:
+            out += fieldText(node.field);
+            out += opText(node.op);
+            out += node.text;
+            return;
+        case Node::Kind::Not:
+            out += "not ";
+            describe(node.children.front(), out, false);
+            return;
+        case Node::Kind::And:
+        case Node::Kind::Or:
+            break;
+        }
+        if (!top) {
+            out += '(';
+        }
+        for (size_t i = 0; i < node.children.size(); i++) {
+            if (i > 0) {
+                out += node.kind == Node::Kind::And ? " and " : " or ";
+            }
+            describe(node.children[i], out, false);
+        }
+        if (!top) {
+            out += ')';
+        }
+    }
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Потоковый XXH64 (https://github.com/Cyan4973/xxHash): некриптографический хэш,
+// который считается быстрее, чем читается диск. Результат совпадает с эталонной реализацией.
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed = 0) {
+        reset(seed);
+    }
+
+    void reset(uint64_t seed = 0) {
+        acc[0] = seed + Prime1 + Prime2;
+        acc[1] = seed + Prime2;
+        acc[2] = seed;
+        acc[3] = seed - Prime1;
+        this->seed = seed;
+        total = 0;
+        buffered = 0;
+    }
+
+    void update(const void* data, size_t length) {
+        const unsigned char* input = static_cast<const unsigned char*>(data);
+        total += length;
+        if (buffered + length < StripeSize) {
+            std::memcpy(buffer + buffered, input, length);
+            buffered += length;
+            return;
+        }
+        if (buffered > 0) {
+            const size_t fill = StripeSize - buffered;
+            std::memcpy(buffer + buffered, input, fill);
+            consumeStripe(buffer);
+            input += fill;
+            length -= fill;
+            buffered = 0;
+        }
+        while (length >= StripeSize) {
+            consumeStripe(input);
+            input += StripeSize;
+            length -= StripeSize;
+        }
+        std::memcpy(buffer, input, length);
+        buffered = length;
+    }
+
+    void update(std::string_view data) {
+        update(data.data(), data.size());
+    }
+
+    uint64_t digest() const {
+        uint64_t hash;
+        if (total >= StripeSize) {
+            hash = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+            for (uint64_t lane : acc) {
+                hash = mergeRound(hash, lane);
+            }
+        }
+        else {
+            hash = seed + Prime5;
+        }
+        hash += total;
+
+        const unsigned char* tail = buffer;
+        size_t left = buffered;
+        for (; left >= 8; tail += 8, left -= 8) {
+            hash ^= round(0, read64(tail));
+            hash = rotl(hash, 27) * Prime1 + Prime4;
+        }
+        if (left >= 4) {
+            hash ^= static_cast<uint64_t>(read32(tail)) * Prime1;
+            hash = rotl(hash, 23) * Prime2 + Prime3;
+            tail += 4;
+            left -= 4;
+        }
+        for (; left > 0; tail++, left--) {
+            hash ^= *tail * Prime5;
+            hash = rotl(hash, 11) * Prime1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= Prime2;
+        hash ^= hash >> 29;
+        hash *= Prime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    static uint64_t hash(std::string_view data, uint64_t seed = 0) {
+        Xxh64 state(seed);
+        state.update(data);
+        return state.digest();
+    }
+
+private:
+    static constexpr uint64_t Prime1 = 11400714785074694791ull;
+    static constexpr uint64_t Prime2 = 14029467366897019727ull;
+    static constexpr uint64_t Prime3 = 1609587929392839161ull;
+    static constexpr uint64_t Prime4 = 9650029242287828579ull;
+    static constexpr uint64_t Prime5 = 2870177450012600261ull;
+    static constexpr size_t StripeSize = 32;
+
+    uint64_t acc[4];
+    uint64_t seed = 0;
+    uint64_t total = 0;
+    unsigned char buffer[StripeSize];
+    size_t buffered = 0;
+
+    static uint64_t rotl(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    // Порядок байт little-endian, как в эталоне; на big-endian байты переставляются
+    static uint64_t read64(const unsigned char* p) {
+        uint64_t value = 0;
+        for (int i = 7; i >= 0; i--) {
+            value = (value << 8) | p[i];
+        }
+        return value;
+    }
+
+    static uint32_t read32(const unsigned char* p) {
+        return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8
+            | static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+    }
+
+    static uint64_t round(uint64_t accumulator, uint64_t input) {
+        accumulator += input * Prime2;
+        accumulator = rotl(accumulator, 31);
+        return accumulator * Prime1;
+    }
+
+    static uint64_t mergeRound(uint64_t hash, uint64_t lane) {
+        hash ^= round(0, lane);
+        return hash * Prime1 + Prime4;
+    }
+
+    void consumeStripe(const unsigned char* stripe) {
+        for (int lane = 0; lane < 4; lane++) {
+            acc[lane] = round(acc[lane], read64(stripe + lane * 8));
+        }
+    }
+};
@@ -0,0 +1,324 @@
+#pragma once
+
+// Встроенные замеры горячих путей: время по фазам (обход, stat, ввод-вывод, вывод на консоль)
+// и счётчики (элементы, байты, системные вызовы, операции io_uring, ошибки).
+// Счётчики - в блоке каждого потока, запись без атомарных read-modify-write: блок пишет
+// только его поток, остальные лишь читают при подведении итогов. Блоки завершившихся
+// потоков сворачиваются в общий итог.
+// При выключенной опции ENABLE_INSTRUMENTATION (нет FM_INSTRUMENTATION) макросы
+// FM_COUNT и FM_SCOPE раскрываются в пустоту, а Instrumentation ничего не хранит.
+
+#include <cstdint>
+#include <string>
+
+#ifdef FM_INSTRUMENTATION
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#endif
+
+enum class Counter : unsigned {
+    Entries,    // обработанные элементы (записи директорий, файлы)
+    Bytes,      // прочитанные, записанные или скопированные байты
+    Syscalls,
+    RingOps,    // операции, выполненные через io_uring (каждый io_uring_enter - один Syscall)
+    Errors,
+    Count
+};
+
+enum class Phase : unsigned {
+    Traversal,
+    Stat,
+    Io,
+    Output,
+    Count
+};
+
+inline const char* counterName(Counter counter) {
+    switch (counter) {
+    case Counter::Entries: return "элементов";
+    case Counter::Bytes: return "байт";
+    case Counter::Syscalls: return "системных вызовов";
+    case Counter::RingOps: return "операций io_uring";
+    case Counter::Errors: return "ошибок";
+    default: return "?";
+    }
+}
+
+inline const char* phaseName(Phase phase) {
+    switch (phase) {
+    case Phase::Traversal: return "traversal";
+    case Phase::Stat: return "stat";
+    case Phase::Io: return "io";
+    case Phase::Output: return "output";
+    default: return "?";
+    }
+}
+
+constexpr size_t CounterCount = static_cast<size_t>(Counter::Count);
+constexpr size_t PhaseCount = static_cast<size_t>(Phase::Count);
+
+// Итог одной операции (команды)
+struct OperationReport {
+    std::string name;
+    double seconds = 0;                 // по часам
+    uint64_t counters[CounterCount] = {};
+    uint64_t phaseNanos[PhaseCount] = {};  // сумма по потокам, может превышать seconds
+};
+
+#ifdef FM_INSTRUMENTATION
+
+class Instrumentation {
+public:
+    struct Totals {
+        uint64_t counters[CounterCount] = {};
+        uint64_t phaseNanos[PhaseCount] = {};
+    };
+
+    static void count(Counter counter, uint64_t amount) {
+        std::atomic<uint64_t>& slot = local().counters[static_cast<size_t>(counter)];
+        slot.store(slot.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    // Время фазы; при включённой трассировке - ещё и событие для Perfetto
+    class Scope {
+    public:
+        Scope(Phase phase, const char* name) : phase(phase), name(name), started(now()) {}
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope() {
+            const uint64_t finished = now();
+            ThreadBlock& block = local();
+            std::atomic<uint64_t>& slot = block.phaseNanos[static_cast<size_t>(phase)];
+            slot.store(slot.load(std::memory_order_relaxed) + (finished - started), std::memory_order_relaxed);
+            if (tracing().load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> lock(block.eventsMutex);
+                if (block.events.size() < MaxEventsPerThread) {
+                    block.events.push_back(TraceEvent{ name, phase, started, finished - started });
+                }
+            }
+        }
+
+    private:
+        Phase phase;
+        const char* name;
+        uint64_t started;
+    };
+
+    // Границы команды: итог считается как разность сумм до и после
+    static void beginOperation(const std::string& name) {
+        Registry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.operationName = name;
+        registry.operationStart = collect(registry);
+        registry.operationStarted = std::chrono::steady_clock::now();
+    }
+
+    static void endOperation() {
+        Registry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        Totals finished = collect(registry);
+        OperationReport report;
+        report.name = registry.operationName;
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - registry.operationStarted).count();
+        for (size_t i = 0; i < CounterCount; i++) {
+            report.counters[i] = finished.counters[i] - registry.operationStart.counters[i];
+        }
+        for (size_t i = 0; i < PhaseCount; i++) {
+            report.phaseNanos[i] = finished.phaseNanos[i] - registry.operationStart.phaseNanos[i];
+        }
+        registry.last = report;
+        registry.hasLast = true;
+    }
+
+    static bool lastOperation(OperationReport& report) {
+        Registry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        report = registry.last;
+        return registry.hasLast;
+    }
+
+    static bool enabled() {
+        return true;
+    }
+
+    static void setTracing(bool value) {
+        tracing().store(value);
+    }
+
+    static bool tracingEnabled() {
+        return tracing().load();
+    }
+
+    // Записывает накопленные события в формате Chrome trace-event и очищает их; возвращает число событий
+    static size_t saveTrace(const std::string& file) {
+        std::vector<std::pair<uint64_t, TraceEvent>> events;
+        {
+            Registry& registry = instance();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            events.swap(registry.retiredEvents);
+            for (ThreadBlock* block : registry.live) {
+                std::lock_guard<std::mutex> eventsLock(block->eventsMutex);
+                for (const auto& event : block->events) {
+                    events.emplace_back(block->id, event);
+                }
+                block->events.clear();
+            }
+        }
+        std::sort(events.begin(), events.end(), [](const auto& a, const auto& b) {
+            return a.second.start < b.second.start;
+            });
+
+        std::ofstream out(file, std::ios::trunc);
+        if (!out.is_open()) {
+            throw std::runtime_error("Не удалось создать файл трассировки " + file);
+        }
+        out << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        const uint64_t origin = events.empty() ? 0 : events.front().second.start;
+        for (size_t i = 0; i < events.size(); i++) {
+            const TraceEvent& event = events[i].second;
+            // ts и dur - в микросекундах
+            out << (i ? ",\n" : "") << "{\"name\":\"" << event.name << "\",\"cat\":\"" << phaseName(event.phase)
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << events[i].first
+                << ",\"ts\":" << (event.start - origin) / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << '}';
+        }
+        out << "\n]}\n";
+        if (!out) {
+            throw std::runtime_error("Ошибка записи трассировки " + file);
+        }
+        return events.size();
+    }
+
+private:
+    static constexpr size_t MaxEventsPerThread = 1 << 20;
+
+    struct TraceEvent {
+        const char* name;  // строковый литерал из FM_SCOPE
+        Phase phase;
+        uint64_t start;
+        uint64_t duration;
+    };
+
+    struct ThreadBlock;
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<ThreadBlock*> live;
+        Totals retired;           // потоки, которые уже завершились
+        std::vector<std::pair<uint64_t, TraceEvent>> retiredEvents;
+        uint64_t nextId = 1;
+
+        std::string operationName;
+        Totals operationStart;
+        std::chrono::steady_clock::time_point operationStarted;
+        OperationReport last;
+        bool hasLast = false;
+    };
+
+    struct ThreadBlock {
+        std::atomic<uint64_t> counters[CounterCount] = {};
+        std::atomic<uint64_t> phaseNanos[PhaseCount] = {};
+        std::mutex eventsMutex;
+        std::vector<TraceEvent> events;
+        uint64_t id = 0;
+
+        ThreadBlock() {
+            Registry& registry = instance();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            id = registry.nextId++;
+            registry.live.push_back(this);
+        }
+
+        ~ThreadBlock() {
+            Registry& registry = instance();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            for (size_t i = 0; i < CounterCount; i++) {
+                registry.retired.counters[i] += counters[i].load();
+            }
+            for (size_t i = 0; i < PhaseCount; i++) {
+                registry.retired.phaseNanos[i] += phaseNanos[i].load();
+            }
+            for (const auto& event : events) {
+                registry.retiredEvents.emplace_back(id, event);
+            }
+            registry.live.erase(std::remove(registry.live.begin(), registry.live.end(), this), registry.live.end());
+        }
+    };
+
+    // Реестр не уничтожается: потоки могут завершаться после выхода из main
+    static Registry& instance() {
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+
+    static std::atomic<bool>& tracing() {
+        static std::atomic<bool> flag{ false };
+        return flag;
+    }
+
+    static ThreadBlock& local() {
+        thread_local ThreadBlock block;
+        return block;
+    }
+
+    static uint64_t now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // Вызывается под registry.mutex
+    static Totals collect(Registry& registry) {
+        Totals totals = registry.retired;
+        for (ThreadBlock* block : registry.live) {
+            for (size_t i = 0; i < CounterCount; i++) {
+                totals.counters[i] += block->counters[i].load(std::memory_order_relaxed);
+            }
+            for (size_t i = 0; i < PhaseCount; i++) {
+                totals.phaseNanos[i] += block->phaseNanos[i].load(std::memory_order_relaxed);
+            }
+        }
+        return totals;
+    }
+};
+
+#define FM_CONCAT_INNER(a, b) a##b
+#define FM_CONCAT(a, b) FM_CONCAT_INNER(a, b)
+#define FM_COUNT(counter, amount) Instrumentation::count(Counter::counter, static_cast<uint64_t>(amount))
+#define FM_SCOPE(phase, name) Instrumentation::Scope FM_CONCAT(fmScope, __LINE__)(Phase::phase, name)
+
+#else
+
+// Заглушка: тот же интерфейс для команды stats, без хранения и без затрат
+class Instrumentation {
+public:
+    static void beginOperation(const std::string&) {}
+    static void endOperation() {}
+    static bool lastOperation(OperationReport&) {
+        return false;
+    }
+    static bool enabled() {
+        return false;
+    }
+    static void setTracing(bool) {}
+    static bool tracingEnabled() {
+        return false;
+    }
+    static size_t saveTrace(const std::string&) {
+        return 0;
+    }
+};
+
+#define FM_COUNT(counter, amount) ((void)0)
+#define FM_SCOPE(phase, name) ((void)0)
+
+#endif
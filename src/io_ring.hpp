@@ -0,0 +1,375 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#include "instrumentation.hpp"
+
+#ifdef FM_HAVE_IO_URING
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Кольцо io_uring на прямых системных вызовах (без liburing).
+// Запросы отправляются сериями: run() держит в очереди до depth() операций,
+// поэтому задержка одной операции (сетевая ФС, холодный кэш) перекрывается остальными.
+// Кольцо не потокобезопасно: у каждого потока своё, см. forThread().
+// Если ядро не поддерживает io_uring или нужные операции, forThread() возвращает nullptr
+// и вызывающий код идёт обычным блокирующим путём.
+class IoRing {
+public:
+#ifdef FM_HAVE_IO_URING
+    explicit IoRing(unsigned entries = 256) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd < 0) {
+            throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+        }
+        try {
+            mapRings(params);
+        }
+        catch (...) {
+            unmapRings();
+            ::close(ringFd);
+            throw;
+        }
+    }
+
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    ~IoRing() {
+        unmapRings();
+        ::close(ringFd);
+    }
+
+    // Кольцо текущего потока или nullptr, если io_uring недоступен или выключен
+    static IoRing* forThread() {
+        if (!enabled() || !supported()) {
+            return nullptr;
+        }
+        thread_local std::unique_ptr<IoRing> ring;
+        thread_local bool failed = false;
+        if (!ring && !failed) {
+            try {
+                ring = std::make_unique<IoRing>();
+            }
+            catch (const std::exception&) {
+                failed = true;
+            }
+        }
+        return ring.get();
+    }
+
+    unsigned depth() const {
+        return sqEntries;
+    }
+
+    // Заполнение запросов. Строки и буферы должны жить до получения результата
+    static void prepStatx(io_uring_sqe& sqe, int dirFd, const char* path, int flags, unsigned mask, struct statx* result) {
+        sqe.opcode = IORING_OP_STATX;
+        sqe.fd = dirFd;
+        sqe.addr = reinterpret_cast<uintptr_t>(path);
+        sqe.len = mask;
+        sqe.off = reinterpret_cast<uintptr_t>(result);
+        sqe.statx_flags = static_cast<uint32_t>(flags);
+    }
+
+    static void prepOpenat(io_uring_sqe& sqe, int dirFd, const char* path, int flags, mode_t mode) {
+        sqe.opcode = IORING_OP_OPENAT;
+        sqe.fd = dirFd;
+        sqe.addr = reinterpret_cast<uintptr_t>(path);
+        sqe.len = mode;
+        sqe.open_flags = static_cast<uint32_t>(flags);
+    }
+
+    static void prepRead(io_uring_sqe& sqe, int fd, void* buffer, unsigned length, uint64_t offset) {
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uintptr_t>(buffer);
+        sqe.len = length;
+        sqe.off = offset;
+    }
+
+    static void prepWrite(io_uring_sqe& sqe, int fd, const void* buffer, unsigned length, uint64_t offset) {
+        sqe.opcode = IORING_OP_WRITE;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uintptr_t>(buffer);
+        sqe.len = length;
+        sqe.off = offset;
+    }
+
+    static void prepClose(io_uring_sqe& sqe, int fd) {
+        sqe.opcode = IORING_OP_CLOSE;
+        sqe.fd = fd;
+    }
+
+    // datasync: только данные и нужные для их чтения метаданные (fdatasync)
+    static void prepFsync(io_uring_sqe& sqe, int fd, bool datasync) {
+        sqe.opcode = IORING_OP_FSYNC;
+        sqe.fd = fd;
+        sqe.fsync_flags = datasync ? IORING_FSYNC_DATASYNC : 0;
+    }
+
+    static void prepUnlinkat(io_uring_sqe& sqe, int dirFd, const char* path, int flags) {
+        sqe.opcode = IORING_OP_UNLINKAT;
+        sqe.fd = dirFd;
+        sqe.addr = reinterpret_cast<uintptr_t>(path);
+        sqe.unlink_flags = static_cast<uint32_t>(flags);
+    }
+
+    static void prepRenameat(io_uring_sqe& sqe, int oldDirFd, const char* oldPath, int newDirFd, const char* newPath, unsigned flags = 0) {
+        sqe.opcode = IORING_OP_RENAMEAT;
+        sqe.fd = oldDirFd;
+        sqe.addr = reinterpret_cast<uintptr_t>(oldPath);
+        sqe.len = static_cast<uint32_t>(newDirFd);
+        sqe.addr2 = reinterpret_cast<uintptr_t>(newPath);
+        sqe.rename_flags = flags;
+    }
+
+    // Выполняет count операций, держа в полёте не больше depth().
+    // prepare(i, slot, sqe) заполняет запрос номер i; slot < depth() свободен до его завершения,
+    // по нему удобно раздавать буферы. complete(i, slot, result) получает результат (< 0 - -errno).
+    template <typename Prepare, typename Complete>
+    void run(size_t count, Prepare prepare, Complete complete) {
+        std::vector<uint32_t> freeSlots(sqEntries);
+        std::vector<size_t> slotIndex(sqEntries);
+        for (uint32_t slot = 0; slot < sqEntries; slot++) {
+            freeSlots[slot] = sqEntries - 1 - slot;
+        }
+
+        size_t next = 0;
+        size_t inFlight = 0;
+        unsigned toSubmit = 0;
+        // Исключение из prepare/complete не должно оставить запросы в кольце:
+        // новые больше не отправляются, уже отправленные дожидаются завершения
+        std::exception_ptr error;
+        while ((!error && next < count) || inFlight > 0) {
+            while (!error && next < count && !freeSlots.empty()) {
+                uint32_t slot = freeSlots.back();
+                freeSlots.pop_back();
+                io_uring_sqe& sqe = nextSqe();
+                slotIndex[slot] = next;
+                inFlight++;
+                toSubmit++;
+                try {
+                    prepare(next, slot, sqe);
+                }
+                catch (...) {
+                    error = std::current_exception();
+                    std::memset(&sqe, 0, sizeof(sqe));
+                    sqe.opcode = IORING_OP_NOP;
+                }
+                sqe.user_data = slot;
+                next++;
+            }
+
+            toSubmit = enter(toSubmit, inFlight > 0 ? 1 : 0);
+
+            unsigned head = *cqHead;
+            const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++) {
+                const io_uring_cqe& cqe = cqes[head & cqMask];
+                const uint32_t slot = static_cast<uint32_t>(cqe.user_data);
+                const int result = cqe.res;
+                __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+                freeSlots.push_back(slot);
+                inFlight--;
+                if (error) {
+                    continue;
+                }
+                try {
+                    complete(slotIndex[slot], slot, result);
+                }
+                catch (...) {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    int ringFd = -1;
+    unsigned sqEntries = 0;
+    void* sqRing = MAP_FAILED;
+    void* cqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqeTail = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    static bool& enabledFlag() {
+        static bool flag = [] {
+            const char* value = std::getenv("FM_IO_URING");
+            return !(value && std::strcmp(value, "0") == 0);
+        }();
+        return flag;
+    }
+
+public:
+    // Выключатель для сравнения с блокирующим путём; по умолчанию FM_IO_URING=0 отключает кольцо
+    static bool enabled() {
+        return enabledFlag();
+    }
+
+    static void setEnabled(bool value) {
+        enabledFlag() = value;
+    }
+
+    // Проверка один раз на процесс: кольцо создаётся и ядро подтверждает все используемые операции
+    static bool supported() {
+        static const bool result = probe();
+        return result;
+    }
+
+private:
+    static bool probe() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        int fd = static_cast<int>(::syscall(__NR_io_uring_setup, 4, &params));
+        if (fd < 0) {
+            return false;
+        }
+        const size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        std::vector<unsigned char> buffer(size, 0);
+        auto* probeData = reinterpret_cast<io_uring_probe*>(buffer.data());
+        bool ok = ::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probeData, 256) == 0;
+        if (ok) {
+            for (unsigned op : { IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE,
+                IORING_OP_CLOSE, IORING_OP_UNLINKAT, IORING_OP_RENAMEAT, IORING_OP_FSYNC }) {
+                if (op > probeData->last_op || !(probeData->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                    ok = false;
+                }
+            }
+        }
+        ::close(fd);
+        return ok;
+    }
+
+    void mapRings(const io_uring_params& params) {
+        sqEntries = params.sq_entries;
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "mmap io_uring");
+        }
+        if (single) {
+            cqRing = sqRing;
+        }
+        else {
+            cqRing = ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) {
+                throw std::system_error(errno, std::generic_category(), "mmap io_uring");
+            }
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqeMemory = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqeMemory == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "mmap io_uring");
+        }
+        sqes = static_cast<io_uring_sqe*>(sqeMemory);
+
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqeTail = *sqTail;
+        // Запросы берутся из sqes по порядку, поэтому массив индексов заполняется один раз
+        unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        for (unsigned i = 0; i < params.sq_entries; i++) {
+            array[i] = i;
+        }
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    void unmapRings() {
+        if (sqes != MAP_FAILED) {
+            ::munmap(sqes, sqesSize);
+        }
+        if (cqRing != MAP_FAILED && cqRing != sqRing) {
+            ::munmap(cqRing, cqRingSize);
+        }
+        if (sqRing != MAP_FAILED) {
+            ::munmap(sqRing, sqRingSize);
+        }
+    }
+
+    // run() занимает не больше sqEntries слотов, поэтому место в очереди всегда есть
+    io_uring_sqe& nextSqe() {
+        io_uring_sqe& sqe = sqes[sqeTail & sqMask];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqeTail++;
+        return sqe;
+    }
+
+    // Отправляет подготовленные запросы и ждёт хотя бы waitFor завершений; возвращает неотправленный остаток
+    unsigned enter(unsigned toSubmit, unsigned waitFor) {
+        __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+        while (true) {
+            long submitted = ::syscall(__NR_io_uring_enter, ringFd, toSubmit, waitFor, IORING_ENTER_GETEVENTS, nullptr, 0);
+            FM_COUNT(Syscalls, 1);
+            if (submitted >= 0) {
+                FM_COUNT(RingOps, submitted);
+                return toSubmit - static_cast<unsigned>(submitted);
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EBUSY) {
+                // Ядру не хватило ресурсов: хотя бы одно завершение освободит место
+                if (__atomic_load_n(cqTail, __ATOMIC_ACQUIRE) != *cqHead) {
+                    return toSubmit;
+                }
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+        }
+    }
+#else
+    static IoRing* forThread() {
+        return nullptr;
+    }
+
+    static bool enabled() {
+        return false;
+    }
+
+    static void setEnabled(bool) {}
+
+    static bool supported() {
+        return false;
+    }
+#endif
+};
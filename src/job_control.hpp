@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+
+// Отмена операции через JobControl::cancel()
+class OperationCancelled : public std::runtime_error {
+public:
+    OperationCancelled() : std::runtime_error("операция отменена") {}
+};
+
+struct JobProgress {
+    uint64_t entries = 0;
+    uint64_t bytes = 0;
+    uint64_t totalEntries = 0;  // 0 - объём работы неизвестен
+    uint64_t totalBytes = 0;
+    double seconds = 0;
+
+    // Оставшееся время по байтам, если известен их итог, иначе по элементам; < 0 - оценки нет
+    double etaSeconds() const {
+        double done = 0;
+        if (totalBytes > 0) {
+            done = static_cast<double>(bytes) / totalBytes;
+        }
+        else if (totalEntries > 0) {
+            done = static_cast<double>(entries) / totalEntries;
+        }
+        if (done <= 0 || seconds <= 0) {
+            return -1;
+        }
+        return seconds * (1 - std::min(done, 1.0)) / done;
+    }
+};
+
+// Управление фоновой операцией: кооперативная отмена, прогресс и ограничение скорости.
+// Обходчик и движки копирования и удаления вызывают checkpoint() в своих циклах из любых потоков:
+// он учитывает сделанную работу, бросает OperationCancelled после cancel() и притормаживает
+// вызывающий поток, если операция обгоняет заданный лимит. Лимит соблюдается в среднем
+// с начала операции: на паузу уходит разница между ожидаемым и фактическим временем.
+class JobControl {
+public:
+    JobControl() = default;
+    JobControl(const JobControl&) = delete;
+    JobControl& operator=(const JobControl&) = delete;
+
+    void cancel() {
+        cancelRequested.store(true, std::memory_order_relaxed);
+    }
+
+    bool cancelled() const {
+        return cancelRequested.load(std::memory_order_relaxed);
+    }
+
+    // 0 - без ограничения; можно менять во время работы
+    void setLimits(uint64_t bytesPerSecond, uint64_t entriesPerSecond) {
+        byteLimit.store(bytesPerSecond, std::memory_order_relaxed);
+        entryLimit.store(entriesPerSecond, std::memory_order_relaxed);
+        // Отсчёт заново: работа до смены лимита не даёт ни долга, ни запаса
+        limitStart.store(now(), std::memory_order_relaxed);
+        entriesAtLimit.store(entriesDone.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        bytesAtLimit.store(bytesDone.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    uint64_t bytesPerSecond() const {
+        return byteLimit.load(std::memory_order_relaxed);
+    }
+
+    uint64_t entriesPerSecond() const {
+        return entryLimit.load(std::memory_order_relaxed);
+    }
+
+    // Объём работы для оценки оставшегося времени
+    void setTotals(uint64_t entries, uint64_t bytes) {
+        totalEntries.store(entries, std::memory_order_relaxed);
+        totalBytes.store(bytes, std::memory_order_relaxed);
+    }
+
+    void checkpoint(uint64_t entries, uint64_t bytes) {
+        if (cancelled()) {
+            throw OperationCancelled();
+        }
+        const uint64_t entriesTotal = entriesDone.fetch_add(entries, std::memory_order_relaxed) + entries;
+        const uint64_t bytesTotal = bytesDone.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        const uint64_t bytesLimit = byteLimit.load(std::memory_order_relaxed);
+        const uint64_t entriesLimit = entryLimit.load(std::memory_order_relaxed);
+        if (bytesLimit == 0 && entriesLimit == 0) {
+            return;
+        }
+
+        double due = 0;
+        if (bytesLimit > 0) {
+            due = std::max(due, static_cast<double>(bytesTotal - bytesAtLimit.load(std::memory_order_relaxed)) / bytesLimit);
+        }
+        if (entriesLimit > 0) {
+            due = std::max(due, static_cast<double>(entriesTotal - entriesAtLimit.load(std::memory_order_relaxed)) / entriesLimit);
+        }
+        const auto wakeAt = limitStart.load(std::memory_order_relaxed)
+            + static_cast<int64_t>(due * 1e9);
+        // Сон короткими отрезками, чтобы отмена срабатывала сразу
+        for (int64_t current = now(); current < wakeAt; current = now()) {
+            if (cancelled()) {
+                throw OperationCancelled();
+            }
+            std::this_thread::sleep_for(std::chrono::nanoseconds(std::min<int64_t>(wakeAt - current, MaxSleep)));
+        }
+    }
+
+    JobProgress progress() const {
+        JobProgress snapshot;
+        snapshot.entries = entriesDone.load(std::memory_order_relaxed);
+        snapshot.bytes = bytesDone.load(std::memory_order_relaxed);
+        snapshot.totalEntries = totalEntries.load(std::memory_order_relaxed);
+        snapshot.totalBytes = totalBytes.load(std::memory_order_relaxed);
+        snapshot.seconds = (now() - started) / 1e9;
+        return snapshot;
+    }
+
+private:
+    static constexpr int64_t MaxSleep = 50'000'000;  // нс
+
+    std::atomic<bool> cancelRequested{ false };
+    std::atomic<uint64_t> entriesDone{ 0 };
+    std::atomic<uint64_t> bytesDone{ 0 };
+    std::atomic<uint64_t> totalEntries{ 0 };
+    std::atomic<uint64_t> totalBytes{ 0 };
+    std::atomic<uint64_t> byteLimit{ 0 };
+    std::atomic<uint64_t> entryLimit{ 0 };
+    std::atomic<int64_t> limitStart{ now() };
+    std::atomic<uint64_t> entriesAtLimit{ 0 };
+    std::atomic<uint64_t> bytesAtLimit{ 0 };
+    const int64_t started = now();
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "job_control.hpp"
+#include "progress.hpp"
+#include "thread_pool.hpp"
+
+enum class JobState {
+    Queued,
+    Running,
+    Done,
+    Failed,
+    Cancelled
+};
+
+inline const char* jobStateName(JobState state) {
+    switch (state) {
+    case JobState::Queued: return "в очереди";
+    case JobState::Running: return "выполняется";
+    case JobState::Done: return "готово";
+    case JobState::Failed: return "ошибка";
+    case JobState::Cancelled: return "отменено";
+    default: return "?";
+    }
+}
+
+struct JobInfo {
+    unsigned id = 0;
+    std::string command;
+    JobState state = JobState::Queued;
+    JobProgress progress;
+    uint64_t bytesPerSecond = 0;
+    uint64_t entriesPerSecond = 0;
+};
+
+// Фоновые задачи оболочки (команды с & в конце). Задачи выполняются пулом из нескольких
+// потоков, лишние ждут в очереди. Вывод задачи копится в памяти (не больше OutputLimit)
+// и показывается одним отчётом после завершения, чтобы не перемешиваться с приглашением.
+// Отмена кооперативная: задача сама проверяет свой JobControl в циклах.
+class JobScheduler {
+public:
+    using Body = std::function<void(JobControl&, std::ostream&)>;
+
+    static constexpr size_t OutputLimit = 1 << 20;
+
+    explicit JobScheduler(unsigned slots = 2) : pool(std::max(1u, slots), 1024) {}
+
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    // Незавершённые задачи отменяются; пул дожидается их выхода
+    ~JobScheduler() {
+        cancelAll();
+    }
+
+    unsigned submit(const std::string& command, Body body) {
+        auto job = std::make_shared<Job>();
+        job->command = command;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job->id = nextId++;
+            jobs[job->id] = job;
+        }
+        pool.submit([this, job, body = std::move(body)] {
+            run(*job, body);
+            });
+        return job->id;
+    }
+
+    std::vector<JobInfo> list() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<JobInfo> result;
+        for (const auto& item : jobs) {
+            const Job& job = *item.second;
+            JobInfo info;
+            info.id = job.id;
+            info.command = job.command;
+            info.state = job.state;
+            info.progress = job.control.progress();
+            info.bytesPerSecond = job.control.bytesPerSecond();
+            info.entriesPerSecond = job.control.entriesPerSecond();
+            result.push_back(std::move(info));
+        }
+        return result;
+    }
+
+    // false - задачи с таким номером нет
+    bool cancel(unsigned id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = jobs.find(id);
+        if (it == jobs.end()) {
+            return false;
+        }
+        it->second->control.cancel();
+        return true;
+    }
+
+    void cancelAll() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& item : jobs) {
+            item.second->control.cancel();
+        }
+    }
+
+    bool setLimits(unsigned id, uint64_t bytesPerSecond, uint64_t entriesPerSecond) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = jobs.find(id);
+        if (it == jobs.end()) {
+            return false;
+        }
+        it->second->control.setLimits(bytesPerSecond, entriesPerSecond);
+        return true;
+    }
+
+    // Ждёт завершения задачи, периодически отдавая её прогресс в onProgress, и возвращает отчёт.
+    // Отчёт забирается: takeReports() его уже не покажет. Пустая строка - задачи нет
+    std::string wait(unsigned id, const std::function<void(const JobProgress&)>& onProgress = {}) {
+        std::shared_ptr<Job> job;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = jobs.find(id);
+            if (it == jobs.end()) {
+                return {};
+            }
+            job = it->second;
+        }
+        {
+            ProgressTicker ticker(std::chrono::milliseconds(500), onProgress
+                ? std::function<void()>([&] { onProgress(job->control.progress()); })
+                : std::function<void()>());
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&] { return job->state != JobState::Queued && job->state != JobState::Running; });
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.erase(id);
+        return report(*job);
+    }
+
+    // Ждёт все задачи, не забирая отчётов
+    void waitAll() {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] {
+            return std::none_of(jobs.begin(), jobs.end(), [](const auto& item) {
+                return item.second->state == JobState::Queued || item.second->state == JobState::Running;
+                });
+            });
+    }
+
+    bool busy() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::any_of(jobs.begin(), jobs.end(), [](const auto& item) {
+            return item.second->state == JobState::Queued || item.second->state == JobState::Running;
+            });
+    }
+
+    // Отчёты задач, завершившихся с прошлого вызова; сами задачи убираются из списка
+    std::vector<std::string> takeReports() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::string> result;
+        for (auto it = jobs.begin(); it != jobs.end();) {
+            const Job& job = *it->second;
+            if (job.state == JobState::Queued || job.state == JobState::Running) {
+                ++it;
+                continue;
+            }
+            result.push_back(report(job));
+            it = jobs.erase(it);
+        }
+        return result;
+    }
+
+private:
+    // Буфер вывода задачи: хранит первые OutputLimit байт, остальное только считает
+    class OutputBuffer : public std::streambuf {
+    public:
+        std::string text;
+        uintmax_t dropped = 0;
+
+    protected:
+        int overflow(int c) override {
+            if (c != traits_type::eof()) {
+                char ch = static_cast<char>(c);
+                xsputn(&ch, 1);
+            }
+            return c;
+        }
+
+        std::streamsize xsputn(const char* data, std::streamsize count) override {
+            const size_t room = OutputLimit - std::min(text.size(), OutputLimit);
+            const size_t kept = std::min(room, static_cast<size_t>(count));
+            text.append(data, kept);
+            dropped += static_cast<uintmax_t>(count) - kept;
+            return count;
+        }
+    };
+
+    struct Job {
+        unsigned id = 0;
+        std::string command;
+        JobState state = JobState::Queued;  // под mutex планировщика
+        JobControl control;
+        OutputBuffer output;
+        std::string error;
+        double seconds = 0;
+    };
+
+    mutable std::mutex mutex;
+    std::condition_variable finished;
+    std::map<unsigned, std::shared_ptr<Job>> jobs;
+    unsigned nextId = 1;
+    ThreadPool pool;  // последним: при разрушении дожидается задач, пока остальные поля живы
+
+    void run(Job& job, const Body& body) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (job.control.cancelled()) {
+                job.state = JobState::Cancelled;
+                finished.notify_all();
+                return;
+            }
+            job.state = JobState::Running;
+        }
+
+        JobState state = JobState::Done;
+        std::string error;
+        try {
+            std::ostream out(&job.output);
+            body(job.control, out);
+        }
+        catch (const OperationCancelled&) {
+            state = JobState::Cancelled;
+        }
+        catch (const std::exception& e) {
+            state = JobState::Failed;
+            error = e.what();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        job.seconds = job.control.progress().seconds;
+        job.error = std::move(error);
+        job.state = state;
+        finished.notify_all();
+    }
+
+    // Вызывается под mutex, задача уже завершена
+    static std::string report(const Job& job) {
+        std::ostringstream text;
+        text << '[' << job.id << "] " << jobStateName(job.state) << ": " << job.command
+            << " (" << std::fixed << std::setprecision(2) << job.seconds << " с)";
+        if (!job.error.empty()) {
+            text << ": " << job.error;
+        }
+        text << '\n' << job.output.text;
+        if (job.output.dropped > 0) {
+            text << "... вывод обрезан, не показано байт: " << job.output.dropped << '\n';
+        }
+        std::string result = text.str();
+        if (!result.empty() && result.back() == '\n') {
+            result.pop_back();
+        }
+        return result;
+    }
+};
@@ -0,0 +1,579 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "instrumentation.hpp"
+#include "io_ring.hpp"
+#include "walker.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Форматирование времени "YYYY-MM-DD HH:MM:SS" без выделения памяти.
+// localtime вызывается один раз на 15-минутный блок: все часовые пояса и переходы
+// на летнее время кратны 15 минутам, поэтому внутри блока меняются только минуты и секунды
+class TimeFormatter {
+public:
+    static constexpr size_t Length = 19;
+
+    // Записывает ровно Length символов в out
+    void format(std::time_t time, char* out) {
+        const std::time_t block = floorDiv(time, 900);
+        Slot& slot = slots[static_cast<size_t>(block) % SlotCount];
+        if (!slot.valid || slot.block != block) {
+            fill(slot, block);
+        }
+        if (!slot.aligned) {
+            // Исторические смещения вроде местного среднего времени не кратны минуте
+            formatSlow(time, out);
+            return;
+        }
+        std::memcpy(out, slot.prefix, 14);
+        const int offset = static_cast<int>(time - block * 900);
+        const int minute = slot.minute + offset / 60;
+        const int second = offset % 60;
+        out[14] = static_cast<char>('0' + minute / 10);
+        out[15] = static_cast<char>('0' + minute % 10);
+        out[16] = ':';
+        out[17] = static_cast<char>('0' + second / 10);
+        out[18] = static_cast<char>('0' + second % 10);
+    }
+
+private:
+    static constexpr size_t SlotCount = 256;
+
+    struct Slot {
+        bool valid = false;
+        bool aligned = true;
+        std::time_t block = 0;
+        char prefix[14] = {};  // "YYYY-MM-DD HH:"
+        int minute = 0;
+    };
+
+    Slot slots[SlotCount];
+
+    static std::time_t floorDiv(std::time_t value, std::time_t divisor) {
+        std::time_t quotient = value / divisor;
+        return (value % divisor < 0) ? quotient - 1 : quotient;
+    }
+
+    static void digits(char* out, int value, int width) {
+        for (int i = width - 1; i >= 0; i--) {
+            out[i] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+    }
+
+    static std::tm local(std::time_t time) {
+        std::tm tm = {};
+#ifdef _WIN32
+        localtime_s(&tm, &time);
+#else
+        localtime_r(&time, &tm);
+#endif
+        return tm;
+    }
+
+    static void writePrefix(char* out, const std::tm& tm) {
+        digits(out, (tm.tm_year + 1900) % 10000, 4);
+        out[4] = '-';
+        digits(out + 5, tm.tm_mon + 1, 2);
+        out[7] = '-';
+        digits(out + 8, tm.tm_mday, 2);
+        out[10] = ' ';
+        digits(out + 11, tm.tm_hour, 2);
+        out[13] = ':';
+    }
+
+    static void formatSlow(std::time_t time, char* out) {
+        std::tm tm = local(time);
+        writePrefix(out, tm);
+        digits(out + 14, tm.tm_min, 2);
+        out[16] = ':';
+        digits(out + 17, tm.tm_sec, 2);
+    }
+
+    static void fill(Slot& slot, std::time_t block) {
+        std::tm tm = local(block * 900);
+        writePrefix(slot.prefix, tm);
+        slot.minute = tm.tm_min;
+        slot.aligned = tm.tm_sec == 0 && tm.tm_min % 15 == 0;
+        slot.block = block;
+        slot.valid = true;
+    }
+};
+
+// Содержимое одной директории в виде структуры массивов: имена лежат в одном блоке,
+// метаданные собираются один раз на элемент (statx на Linux), сортировка идёт
+// по заранее вычисленным ключам, а не через is_directory() в компараторе
+class DirectoryListing {
+public:
+    enum Kind : uint8_t {
+        Dir = 0,
+        File = 1,
+        Broken = 2  // метаданные получить не удалось
+    };
+
+    // withMetadata - собрать размер и время; иначе нужен только признак папки
+    void load(const fs::path& directory, bool withMetadata, unsigned threads = 0) {
+        clear();
+        detailed = withMetadata;
+        WalkOptions options;
+        options.threads = 1;
+        options.maxDepth = 1;
+        options.stopOnError = true;
+        options.batchSize = 4096;
+        ParallelWalker walker(options);
+        walker.walk(directory, [this](const WalkDir&, std::vector<WalkEntry>& entries) {
+            for (const auto& entry : entries) {
+                std::string_view name = entry.name();
+                nameOffsets.push_back(static_cast<uint32_t>(names.size()));
+                nameLengths.push_back(static_cast<uint32_t>(name.size()));
+                names.append(name.data(), name.size());
+                names += '\0';
+                types.push_back(entry.type);
+            }
+            });
+
+        const size_t count = types.size();
+        kinds.assign(count, File);
+        sizes.assign(count, 0);
+        mtimes.assign(count, 0);
+        collectMetadata(directory, withMetadata, threads);
+
+        // Ключ сортировки: папки первыми, затем первые 8 байт имени в порядке big-endian
+        keys.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            uint64_t prefix = 0;
+            std::string_view entryName = name(i);
+            for (size_t b = 0; b < 8; b++) {
+                prefix = (prefix << 8) | (b < entryName.size() ? static_cast<unsigned char>(entryName[b]) : 0);
+            }
+            keys[i] = prefix;
+        }
+    }
+
+    size_t size() const {
+        return kinds.size();
+    }
+
+    // Собраны ли размеры и время изменения (load с withMetadata)
+    bool hasMetadata() const {
+        return detailed;
+    }
+
+    // Приблизительный объём памяти, занятый списком
+    size_t memoryUsage() const {
+        return sizeof(*this) + names.capacity()
+            + (nameOffsets.capacity() + nameLengths.capacity()) * sizeof(uint32_t)
+            + types.capacity() * sizeof(EntryType) + kinds.capacity()
+            + (sizes.capacity() + mtimes.capacity() + keys.capacity()) * sizeof(uint64_t);
+    }
+
+    std::string_view name(size_t i) const {
+        return std::string_view(names.data() + nameOffsets[i], nameLengths[i]);
+    }
+
+    Kind kind(size_t i) const {
+        return static_cast<Kind>(kinds[i]);
+    }
+
+    bool isSymlink(size_t i) const {
+        return types[i] == EntryType::Symlink;
+    }
+
+    uint64_t fileSize(size_t i) const {
+        return sizes[i];
+    }
+
+    std::time_t mtime(size_t i) const {
+        return static_cast<std::time_t>(mtimes[i]);
+    }
+
+    // Порядок вывода: сначала папки, потом остальные, внутри - по имени
+    std::vector<uint32_t> sortedOrder() const {
+        std::vector<uint32_t> order(size());
+        for (uint32_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+            return less(a, b);
+            });
+        return order;
+    }
+
+    bool less(uint32_t a, uint32_t b) const {
+        const bool dirA = kinds[a] == Dir;
+        const bool dirB = kinds[b] == Dir;
+        if (dirA != dirB) {
+            return dirA;
+        }
+        if (keys[a] != keys[b]) {
+            return keys[a] < keys[b];
+        }
+        return name(a) < name(b);
+    }
+
+private:
+    bool detailed = false;
+    std::string names;
+    std::vector<uint32_t> nameOffsets;
+    std::vector<uint32_t> nameLengths;
+    std::vector<EntryType> types;
+    std::vector<uint8_t> kinds;
+    std::vector<uint64_t> sizes;
+    std::vector<int64_t> mtimes;
+    std::vector<uint64_t> keys;
+
+    void clear() {
+        names.clear();
+        nameOffsets.clear();
+        nameLengths.clear();
+        types.clear();
+    }
+
+    // Метаданные собираются только там, где не хватает d_type. С io_uring все statx
+    // уходят в кольцо сериями, иначе большие директории делятся между потоками
+    void collectMetadata(const fs::path& directory, bool withMetadata, unsigned threads) {
+        std::vector<uint32_t> pending;
+        for (uint32_t i = 0; i < size(); i++) {
+            if (!withMetadata && (types[i] == EntryType::File || types[i] == EntryType::Directory)) {
+                kinds[i] = types[i] == EntryType::Directory ? Dir : File;
+            }
+            else {
+                pending.push_back(i);
+            }
+        }
+        if (pending.empty()) {
+            return;
+        }
+
+        const size_t count = pending.size();
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        const size_t perThread = 4096;
+        threads = static_cast<unsigned>(std::min<size_t>(threads, (count + perThread - 1) / perThread));
+
+#ifdef __linux__
+        int dirFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd < 0) {
+            throw fs::filesystem_error("Не удалось открыть директорию", directory,
+                std::error_code(errno, std::generic_category()));
+        }
+#else
+        int dirFd = -1;
+#endif
+
+        auto work = [&](size_t begin, size_t end) {
+            FM_SCOPE(Stat, "statx");
+            for (size_t k = begin; k < end; k++) {
+                describe(directory, dirFd, pending[k], withMetadata);
+            }
+        };
+
+        try {
+#if defined(FM_HAVE_IO_URING) && defined(STATX_TYPE)
+            if (IoRing* ring = IoRing::forThread()) {
+                FM_SCOPE(Stat, "statx ring");
+                std::vector<struct statx> results(ring->depth());
+                ring->run(count, [&](size_t k, uint32_t slot, io_uring_sqe& sqe) {
+                    IoRing::prepStatx(sqe, dirFd, cName(pending[k]), AT_NO_AUTOMOUNT, StatxMask, &results[slot]);
+                    }, [&](size_t k, uint32_t slot, int result) {
+                        if (result < 0) {
+                            kinds[pending[k]] = Broken;
+                        }
+                        else {
+                            apply(pending[k], results[slot]);
+                        }
+                    });
+                threads = 0;
+            }
+#endif
+            if (threads == 1) {
+                work(0, count);
+            }
+            else if (threads > 1) {
+                std::vector<std::thread> pool;
+                const size_t chunk = (count + threads - 1) / threads;
+                for (unsigned t = 1; t < threads; t++) {
+                    pool.emplace_back(work, std::min(count, t * chunk), std::min(count, (t + 1) * chunk));
+                }
+                work(0, std::min(count, chunk));
+                for (auto& thread : pool) {
+                    thread.join();
+                }
+            }
+        }
+        catch (...) {
+#ifdef __linux__
+            ::close(dirFd);
+#endif
+            throw;
+        }
+
+#ifdef __linux__
+        ::close(dirFd);
+#endif
+    }
+
+#ifdef STATX_TYPE
+    static constexpr unsigned StatxMask = STATX_TYPE | STATX_SIZE | STATX_MTIME;
+
+    void apply(size_t i, const struct statx& stx) {
+        kinds[i] = S_ISDIR(stx.stx_mode) ? Dir : File;
+        sizes[i] = stx.stx_size;
+        mtimes[i] = stx.stx_mtime.tv_sec;
+    }
+#endif
+
+    // Имя с завершающим нулём: в блоке имён после каждого имени хранится '\0'
+    const char* cName(size_t i) const {
+        return names.data() + nameOffsets[i];
+    }
+
+    // Один системный вызов на элемент. Ссылки разыменовываются, как у directory_entry::is_directory()
+    void describe(const fs::path& directory, int dirFd, size_t i, bool withMetadata) {
+#ifdef __linux__
+        (void)directory;
+        (void)withMetadata;
+        FM_COUNT(Syscalls, 1);
+#ifdef STATX_TYPE
+        struct statx stx;
+        if (::statx(dirFd, cName(i), AT_NO_AUTOMOUNT, StatxMask, &stx) != 0) {
+            kinds[i] = Broken;
+            return;
+        }
+        apply(i, stx);
+#else
+        struct stat st;
+        if (::fstatat(dirFd, cName(i), &st, 0) != 0) {
+            kinds[i] = Broken;
+            return;
+        }
+        kinds[i] = S_ISDIR(st.st_mode) ? Dir : File;
+        sizes[i] = static_cast<uint64_t>(st.st_size);
+        mtimes[i] = st.st_mtime;
+#endif
+#else
+        (void)dirFd;
+        std::error_code ec;
+        fs::directory_entry entry(directory / std::string(name(i)), ec);
+        bool isDir = entry.is_directory(ec);
+        if (ec) {
+            kinds[i] = Broken;
+            return;
+        }
+        kinds[i] = isDir ? Dir : File;
+        if (withMetadata) {
+            if (!isDir) {
+                sizes[i] = entry.file_size(ec);
+            }
+            auto time = entry.last_write_time(ec);
+            if (ec) {
+                kinds[i] = Broken;
+                return;
+            }
+            mtimes[i] = std::chrono::system_clock::to_time_t(std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+                time - fs::file_time_type::clock::now() + std::chrono::system_clock::now()));
+        }
+#endif
+    }
+};
+
+// Позиция постраничного просмотра: последний показанный элемент в порядке сортировки
+// (папки первыми, затем по имени). Следующая страница - элементы строго после него,
+// поэтому курсор остаётся верным, даже если папку между вызовами дополнили или почистили
+struct ListingCursor {
+    fs::path directory;
+    bool valid = false;
+    bool dir = false;
+    std::string name;
+    size_t position = 0;  // сколько элементов уже показано (для подписи "с N по M")
+};
+
+// Окно отсортированного списка: элементы с first по first + items.size()
+struct ListingPage {
+    struct Item {
+        std::string name;
+        DirectoryListing::Kind kind = DirectoryListing::File;
+        uint64_t size = 0;
+        std::time_t mtime = 0;
+    };
+
+    std::vector<Item> items;
+    size_t first = 0;
+    size_t total = 0;       // элементов в папке
+    size_t peakHeld = 0;    // наибольшее число элементов в памяти за время чтения
+    ListingCursor next;     // курсор после последнего элемента окна
+};
+
+// Одна страница большой директории без загрузки и сортировки всего списка.
+// Имена идут пачками getdents64 через ParallelWalker; в памяти держится только куча
+// из skip + count наименьших элементов после курсора (top-k), остальные сразу
+// отбрасываются. stat нужен при чтении только ссылкам и элементам без d_type,
+// размер и время - только элементам окна.
+class DirectoryPager {
+public:
+    static ListingPage read(const fs::path& directory, const ListingCursor* after, size_t skip, size_t count,
+        bool withMetadata) {
+        ListingPage page;
+        const size_t limit = skip + count;
+        std::vector<ListingPage::Item> heap;
+        heap.reserve(std::min<size_t>(limit, 1 << 16));
+        size_t before = 0;
+        const bool resume = after && after->valid;
+
+        WalkOptions options;
+        options.threads = 1;
+        options.maxDepth = 1;
+        options.stopOnError = true;
+        options.batchSize = 4096;
+        ParallelWalker walker(options);
+        walker.walk(directory, [&](const WalkDir& dir, std::vector<WalkEntry>& entries) {
+            for (const auto& entry : entries) {
+                page.total++;
+                const DirectoryListing::Kind kind = resolveKind(directory, dir.fd, entry);
+                const bool isDir = kind == DirectoryListing::Dir;
+                const std::string_view name = entry.name();
+                if (resume && !less(after->dir, after->name, isDir, name)) {
+                    before++;
+                    continue;
+                }
+                if (limit == 0) {
+                    continue;
+                }
+                if (heap.size() == limit) {
+                    // Вершина кучи - наибольший из отобранных
+                    const auto& top = heap.front();
+                    if (!less(isDir, name, top.kind == DirectoryListing::Dir, top.name)) {
+                        continue;
+                    }
+                    std::pop_heap(heap.begin(), heap.end(), itemLess);
+                    heap.pop_back();
+                }
+                ListingPage::Item item;
+                item.name.assign(name.data(), name.size());
+                item.kind = kind;
+                heap.push_back(std::move(item));
+                std::push_heap(heap.begin(), heap.end(), itemLess);
+                page.peakHeld = std::max(page.peakHeld, heap.size());
+            }
+            });
+
+        std::sort_heap(heap.begin(), heap.end(), itemLess);
+        if (heap.size() > skip) {
+            page.items.assign(std::make_move_iterator(heap.begin() + static_cast<std::ptrdiff_t>(skip)),
+                std::make_move_iterator(heap.end()));
+        }
+        page.first = before + std::min(skip, heap.size());
+
+        if (withMetadata) {
+            FM_SCOPE(Stat, "statx page");
+            describeItems(directory, page.items);
+        }
+
+        page.next.directory = directory;
+        if (!page.items.empty()) {
+            page.next.valid = true;
+            page.next.dir = page.items.back().kind == DirectoryListing::Dir;
+            page.next.name = page.items.back().name;
+            page.next.position = page.first + page.items.size();
+        }
+        else if (resume) {
+            page.next = *after;
+        }
+        return page;
+    }
+
+private:
+    static bool less(bool dirA, std::string_view nameA, bool dirB, std::string_view nameB) {
+        if (dirA != dirB) {
+            return dirA;
+        }
+        return nameA < nameB;
+    }
+
+    static bool itemLess(const ListingPage::Item& a, const ListingPage::Item& b) {
+        return less(a.kind == DirectoryListing::Dir, a.name, b.kind == DirectoryListing::Dir, b.name);
+    }
+
+    // Папка или нет - по d_type; ссылки разыменовываются, как в DirectoryListing
+    static DirectoryListing::Kind resolveKind(const fs::path& directory, int dirFd, const WalkEntry& entry) {
+        if (entry.type == EntryType::Directory) {
+            return DirectoryListing::Dir;
+        }
+        if (entry.type == EntryType::File || entry.type == EntryType::Other) {
+            return DirectoryListing::File;
+        }
+#ifdef __linux__
+        if (dirFd >= 0) {
+            FM_COUNT(Syscalls, 1);
+            struct stat st;
+            if (::fstatat(dirFd, entry.cName(), &st, 0) != 0) {
+                return DirectoryListing::Broken;
+            }
+            return S_ISDIR(st.st_mode) ? DirectoryListing::Dir : DirectoryListing::File;
+        }
+#else
+        (void)dirFd;
+#endif
+        std::error_code ec;
+        bool isDir = fs::is_directory(directory / std::string(entry.name()), ec);
+        return ec && ec != std::errc::no_such_file_or_directory ? DirectoryListing::Broken
+            : isDir ? DirectoryListing::Dir : DirectoryListing::File;
+    }
+
+    static void describeItems(const fs::path& directory, std::vector<ListingPage::Item>& items) {
+#ifdef __linux__
+        int dirFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd < 0) {
+            throw fs::filesystem_error("Не удалось открыть директорию", directory,
+                std::error_code(errno, std::generic_category()));
+        }
+        for (auto& item : items) {
+            FM_COUNT(Syscalls, 1);
+            struct stat st;
+            if (::fstatat(dirFd, item.name.c_str(), &st, 0) != 0) {
+                item.kind = DirectoryListing::Broken;
+                continue;
+            }
+            item.size = static_cast<uint64_t>(st.st_size);
+            item.mtime = st.st_mtime;
+        }
+        ::close(dirFd);
+#else
+        for (auto& item : items) {
+            std::error_code ec;
+            fs::directory_entry entry(directory / item.name, ec);
+            if (!ec && !entry.is_directory(ec)) {
+                item.size = entry.file_size(ec);
+            }
+            auto time = entry.last_write_time(ec);
+            if (ec) {
+                item.kind = DirectoryListing::Broken;
+                continue;
+            }
+            item.mtime = std::chrono::system_clock::to_time_t(std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+                time - fs::file_time_type::clock::now() + std::chrono::system_clock::now()));
+        }
+#endif
+    }
+};
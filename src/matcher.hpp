@@ -0,0 +1,473 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FM_MATCHER_X86 1
+#include <immintrin.h>
+#endif
+
+enum class MatchMode {
+    Substring,  // подстрока в имени
+    Glob,       // *.log, file-?.txt, [a-z]*, **/build/*
+    Regex       // ECMAScript, компилируется один раз
+};
+
+enum class SimdLevel {
+    Auto,
+    Scalar,
+    Sse42,
+    Avx2
+};
+
+inline const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Avx2: return "avx2";
+    case SimdLevel::Sse42: return "sse4.2";
+    case SimdLevel::Scalar: return "scalar";
+    default: return "auto";
+    }
+}
+
+struct MatchOptions {
+    MatchMode mode = MatchMode::Substring;
+    bool ignoreCase = false;
+    SimdLevel simd = SimdLevel::Auto;  // принудительный уровень (для бенчмарка)
+};
+
+// Приведение к нижнему регистру для ASCII и двухбайтовых UTF-8 символов
+// латиницы-1, греческого и кириллицы. Длина в байтах не меняется.
+inline void foldCase(std::string_view in, std::string& out) {
+    out.resize(in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(in[i]);
+        if (c < 0x80) {
+            out[i] = static_cast<char>(c >= 'A' && c <= 'Z' ? c | 0x20 : c);
+            continue;
+        }
+        if ((c & 0xE0) == 0xC0 && i + 1 < in.size() && (static_cast<unsigned char>(in[i + 1]) & 0xC0) == 0x80) {
+            unsigned cp = ((c & 0x1Fu) << 6) | (static_cast<unsigned char>(in[i + 1]) & 0x3Fu);
+            if ((cp >= 0x00C0 && cp <= 0x00DE && cp != 0x00D7)
+                || (cp >= 0x0391 && cp <= 0x03A9 && cp != 0x03A2)
+                || (cp >= 0x0410 && cp <= 0x042F)) {
+                cp += 0x20;
+            }
+            else if (cp >= 0x0400 && cp <= 0x040F) {
+                cp += 0x50;
+            }
+            out[i] = static_cast<char>(0xC0 | (cp >> 6));
+            out[i + 1] = static_cast<char>(0x80 | (cp & 0x3F));
+            i++;
+            continue;
+        }
+        out[i] = static_cast<char>(c);
+    }
+}
+
+// Сопоставление имён с шаблоном, скомпилированным один раз.
+// Работает со string_view на сырые байты имени (d_name), поэтому на каждый элемент
+// ничего не выделяется: регистронезависимый режим с не-ASCII шаблоном переиспользует
+// буфер потока. Поиск подстроки выбирает AVX2/SSE4.2/скалярный путь при запуске.
+class Matcher {
+public:
+    explicit Matcher(const std::string& pattern, MatchOptions options = {})
+        : source(pattern), options(options) {
+        level = options.simd == SimdLevel::Auto ? detectSimd() : options.simd;
+
+        std::string folded = pattern;
+        if (options.ignoreCase) {
+            foldCase(pattern, folded);
+        }
+        asciiNeedle = std::all_of(folded.begin(), folded.end(), [](char c) {
+            return static_cast<unsigned char>(c) < 0x80;
+            });
+
+        switch (options.mode) {
+        case MatchMode::Substring:
+            needle = folded;
+            break;
+        case MatchMode::Glob:
+            compileGlob(folded);
+            break;
+        case MatchMode::Regex:
+            regex = std::regex(pattern, options.ignoreCase
+                ? std::regex::ECMAScript | std::regex::optimize | std::regex::icase
+                : std::regex::ECMAScript | std::regex::optimize);
+            break;
+        }
+    }
+
+    const std::string& pattern() const {
+        return source;
+    }
+
+    MatchMode mode() const {
+        return options.mode;
+    }
+
+    SimdLevel simd() const {
+        return level;
+    }
+
+    // Шаблон со слешем сопоставляется с путём относительно корня поиска, а не с именем
+    bool needsPath() const {
+        return options.mode == MatchMode::Glob && globHasSlash;
+    }
+
+    // Точная подстрока: её можно искать по триграммам индекса или предфильтром по содержимому
+    bool isLiteral() const {
+        return options.mode == MatchMode::Substring && !options.ignoreCase;
+    }
+
+    const std::string& literal() const {
+        return needle;
+    }
+
+    bool matches(std::string_view text) const {
+        switch (options.mode) {
+        case MatchMode::Substring:
+            return find(text) != std::string_view::npos;
+        case MatchMode::Glob:
+            if (options.ignoreCase) {
+                thread_local std::string folded;
+                foldCase(text, folded);
+                return globMatch(0, folded, 0);
+            }
+            return globMatch(0, text, 0);
+        case MatchMode::Regex:
+            return std::regex_search(text.begin(), text.end(), regex);
+        }
+        return false;
+    }
+
+    // Может ли glob совпасть с каким-нибудь путём внутри папки dir (путь от корня поиска,
+    // без завершающего '/'). false - поддерево можно не обходить; другие режимы всегда true
+    bool mayMatchInside(std::string_view dir) const {
+        if (options.mode != MatchMode::Glob) {
+            return true;
+        }
+        thread_local std::string prefix;
+        if (options.ignoreCase) {
+            foldCase(dir, prefix);
+        }
+        else {
+            prefix.assign(dir.data(), dir.size());
+        }
+        prefix += '/';
+        return globMatch(0, prefix, 0, true);
+    }
+
+    // Позиция первого вхождения подстроки (режим Substring)
+    size_t find(std::string_view text) const {
+        if (needle.empty()) {
+            return 0;
+        }
+        if (!options.ignoreCase) {
+            return findRaw(text.data(), text.size(), false);
+        }
+        if (asciiNeedle) {
+            return findRaw(text.data(), text.size(), true);
+        }
+        thread_local std::string folded;
+        foldCase(text, folded);
+        return findRaw(folded.data(), folded.size(), false);
+    }
+
+    static SimdLevel detectSimd() {
+#ifdef FM_MATCHER_X86
+        static const SimdLevel detected = [] {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                return SimdLevel::Avx2;
+            }
+            if (__builtin_cpu_supports("sse4.2")) {
+                return SimdLevel::Sse42;
+            }
+            return SimdLevel::Scalar;
+        }();
+        return detected;
+#else
+        return SimdLevel::Scalar;
+#endif
+    }
+
+private:
+    enum class GlobOp : unsigned char {
+        Literal,     // один байт
+        AnyChar,     // ? - один символ UTF-8, кроме '/'
+        AnySeq,      // * - любая последовательность без '/'
+        AnyDirs,     // **/ - ноль или больше папок
+        AnyPath,     // ** - любая последовательность, включая '/'
+        Class        // [...] - один байт из набора
+    };
+
+    struct GlobToken {
+        GlobOp op = GlobOp::Literal;
+        char byte = 0;
+        bool negated = false;
+        std::vector<std::pair<unsigned char, unsigned char>> ranges;
+    };
+
+    std::string source;
+    MatchOptions options;
+    SimdLevel level = SimdLevel::Scalar;
+    std::string needle;
+    bool asciiNeedle = true;
+    std::vector<GlobToken> glob;
+    bool globHasSlash = false;
+    std::regex regex;
+
+    static bool equalIgnoreCase(const char* a, const char* lowered, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            unsigned char c = static_cast<unsigned char>(a[i]);
+            if (c >= 'A' && c <= 'Z') {
+                c |= 0x20;
+            }
+            if (c != static_cast<unsigned char>(lowered[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool candidate(const char* at, bool ascii) const {
+        return ascii
+            ? equalIgnoreCase(at, needle.data(), needle.size())
+            : std::memcmp(at, needle.data(), needle.size()) == 0;
+    }
+
+    size_t findScalar(const char* text, size_t length, size_t from, bool ascii) const {
+        const size_t k = needle.size();
+        if (length < k) {
+            return std::string_view::npos;
+        }
+        if (!ascii) {
+            size_t found = std::string_view(text, length).find(needle, from);
+            return found;
+        }
+        for (size_t i = from; i + k <= length; i++) {
+            if (candidate(text + i, true)) {
+                return i;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+    // Регистронезависимый ASCII-режим: буква сравнивается после OR 0x20,
+    // остальные кандидаты всё равно проверяются полностью
+    static unsigned char foldBit(char c) {
+        return (c >= 'a' && c <= 'z') ? 0x20 : 0x00;
+    }
+
+#ifdef FM_MATCHER_X86
+    // Поиск по первому и последнему байту подстроки блоками по 32 байта (идея W. Muła)
+    __attribute__((target("avx2")))
+    size_t findAvx2(const char* text, size_t length, bool ascii) const {
+        const size_t k = needle.size();
+        const __m256i first = _mm256_set1_epi8(needle[0]);
+        const __m256i last = _mm256_set1_epi8(needle[k - 1]);
+        const __m256i firstFold = _mm256_set1_epi8(static_cast<char>(ascii ? foldBit(needle[0]) : 0));
+        const __m256i lastFold = _mm256_set1_epi8(static_cast<char>(ascii ? foldBit(needle[k - 1]) : 0));
+
+        size_t i = 0;
+        for (; i + k - 1 + 32 <= length; i += 32) {
+            __m256i blockFirst = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i)), firstFold);
+            __m256i blockLast = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + k - 1)), lastFold);
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast))));
+            while (mask != 0) {
+                size_t at = i + static_cast<size_t>(__builtin_ctz(mask));
+                if (candidate(text + at, ascii)) {
+                    return at;
+                }
+                mask &= mask - 1;
+            }
+        }
+        return findSse(text, length, i, ascii);
+    }
+
+    __attribute__((target("sse4.2")))
+    size_t findSse(const char* text, size_t length, size_t from, bool ascii) const {
+        const size_t k = needle.size();
+        const __m128i first = _mm_set1_epi8(needle[0]);
+        const __m128i last = _mm_set1_epi8(needle[k - 1]);
+        const __m128i firstFold = _mm_set1_epi8(static_cast<char>(ascii ? foldBit(needle[0]) : 0));
+        const __m128i lastFold = _mm_set1_epi8(static_cast<char>(ascii ? foldBit(needle[k - 1]) : 0));
+
+        size_t i = from;
+        for (; i + k - 1 + 16 <= length; i += 16) {
+            __m128i blockFirst = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)), firstFold);
+            __m128i blockLast = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + k - 1)), lastFold);
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast))));
+            while (mask != 0) {
+                size_t at = i + static_cast<size_t>(__builtin_ctz(mask));
+                if (candidate(text + at, ascii)) {
+                    return at;
+                }
+                mask &= mask - 1;
+            }
+        }
+        return findScalar(text, length, i, ascii);
+    }
+#endif
+
+    size_t findRaw(const char* text, size_t length, bool ascii) const {
+        if (length < needle.size()) {
+            return std::string_view::npos;
+        }
+#ifdef FM_MATCHER_X86
+        if (level == SimdLevel::Avx2) {
+            return findAvx2(text, length, ascii);
+        }
+        if (level == SimdLevel::Sse42) {
+            return findSse(text, length, 0, ascii);
+        }
+#endif
+        return findScalar(text, length, 0, ascii);
+    }
+
+    void compileGlob(const std::string& pattern) {
+        for (size_t i = 0; i < pattern.size(); i++) {
+            char c = pattern[i];
+            GlobToken token;
+            if (c == '*') {
+                if (i + 1 < pattern.size() && pattern[i + 1] == '*') {
+                    i++;
+                    globHasSlash = true;
+                    if (i + 1 < pattern.size() && pattern[i + 1] == '/') {
+                        i++;
+                        token.op = GlobOp::AnyDirs;
+                    }
+                    else {
+                        token.op = GlobOp::AnyPath;
+                    }
+                }
+                else {
+                    token.op = GlobOp::AnySeq;
+                }
+            }
+            else if (c == '?') {
+                token.op = GlobOp::AnyChar;
+            }
+            else if (c == '[' && pattern.find(']', i + 2) != std::string::npos) {
+                token.op = GlobOp::Class;
+                size_t j = i + 1;
+                if (pattern[j] == '!' || pattern[j] == '^') {
+                    token.negated = true;
+                    j++;
+                }
+                // ']' сразу после '[' - обычный символ набора
+                for (bool firstInClass = true; j < pattern.size() && (pattern[j] != ']' || firstInClass); j++) {
+                    firstInClass = false;
+                    unsigned char low = static_cast<unsigned char>(pattern[j]);
+                    unsigned char high = low;
+                    if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+                        high = static_cast<unsigned char>(pattern[j + 2]);
+                        j += 2;
+                    }
+                    token.ranges.emplace_back(low, high);
+                }
+                i = j;
+            }
+            else {
+                if (c == '\\' && i + 1 < pattern.size()) {
+                    c = pattern[++i];
+                }
+                if (c == '/') {
+                    globHasSlash = true;
+                }
+                token.byte = c;
+            }
+            glob.push_back(std::move(token));
+        }
+    }
+
+    static size_t utf8Length(unsigned char lead) {
+        return lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 1;
+    }
+
+    // Сопоставление с возвратами; шаблоны и имена короткие, поэтому рекурсия неглубокая.
+    // partial: text - начало пути, успех - если текст кончился раньше шаблона
+    bool globMatch(size_t t, std::string_view text, size_t p, bool partial = false) const {
+        while (t < glob.size()) {
+            const GlobToken& token = glob[t];
+            switch (token.op) {
+            case GlobOp::Literal:
+                if (p >= text.size()) {
+                    return partial;
+                }
+                if (text[p] != token.byte) {
+                    return false;
+                }
+                p++;
+                break;
+            case GlobOp::AnyChar:
+                if (p >= text.size()) {
+                    return partial;
+                }
+                if (text[p] == '/') {
+                    return false;
+                }
+                p += std::min(utf8Length(static_cast<unsigned char>(text[p])), text.size() - p);
+                break;
+            case GlobOp::Class: {
+                if (p >= text.size()) {
+                    return partial;
+                }
+                unsigned char c = static_cast<unsigned char>(text[p]);
+                bool inSet = false;
+                for (const auto& [low, high] : token.ranges) {
+                    if (c >= low && c <= high) {
+                        inSet = true;
+                        break;
+                    }
+                }
+                if (inSet == token.negated || c == '/') {
+                    return false;
+                }
+                p++;
+                break;
+            }
+            case GlobOp::AnySeq:
+            case GlobOp::AnyPath: {
+                const bool crossDirs = token.op == GlobOp::AnyPath;
+                if (t + 1 == glob.size()) {
+                    return crossDirs || text.find('/', p) == std::string_view::npos;
+                }
+                // Если дальше литерал, пробуем только позиции с этим байтом
+                const GlobToken& next = glob[t + 1];
+                for (size_t q = p; q <= text.size(); q++) {
+                    if ((next.op != GlobOp::Literal || (q < text.size() ? text[q] == next.byte : partial))
+                        && globMatch(t + 1, text, q, partial)) {
+                        return true;
+                    }
+                    if (!crossDirs && q < text.size() && text[q] == '/') {
+                        break;
+                    }
+                }
+                return false;
+            }
+            case GlobOp::AnyDirs:
+                if (globMatch(t + 1, text, p, partial)) {
+                    return true;
+                }
+                for (size_t q = p; q < text.size(); q++) {
+                    if (text[q] == '/' && globMatch(t + 1, text, q + 1, partial)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            t++;
+        }
+        // Шаблон кончился: путь длиннее начала с ним уже не совпадёт
+        return !partial && p == text.size();
+    }
+};
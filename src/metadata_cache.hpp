@@ -0,0 +1,354 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "listing.hpp"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+struct MetadataCacheStats {
+    uintmax_t hits = 0;
+    uintmax_t misses = 0;
+    uintmax_t invalidations = 0;
+    uintmax_t evictions = 0;
+    uintmax_t overflows = 0;
+    size_t directories = 0;
+    size_t watches = 0;
+    size_t bytes = 0;
+    size_t budget = 0;
+};
+
+// Кэш содержимого директорий в памяти процесса: список элементов с результатами statx.
+// Каждая закэшированная папка находится под наблюдением inotify; события разбираются
+// перед каждым обращением, поэтому изменение папки (в том числе нашими же командами)
+// сбрасывает её запись до того, как устаревшие данные могут быть выданы.
+// Создание и удаление элементов сбрасывает и запись родителя: там показано время изменения папки.
+// Объём ограничен бюджетом памяти, лишнее вытесняется по давности использования (LRU).
+// Без inotify (не Linux или нет ресурсов) кэш ничего не хранит и каждый раз читает ФС.
+class MetadataCache {
+public:
+    enum class Presence {
+        Unknown,  // папка не в кэше - нужно спросить ФС
+        Absent,
+        Present
+    };
+
+    struct EntryInfo {
+        Presence presence = Presence::Unknown;
+        DirectoryListing::Kind kind = DirectoryListing::File;
+        bool symlink = false;
+        bool hasMetadata = false;  // size и mtime заполнены
+        uint64_t size = 0;
+        std::time_t mtime = 0;
+    };
+
+    explicit MetadataCache(size_t budgetBytes = 64 << 20) : budget(budgetBytes) {
+#ifdef __linux__
+        inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    }
+
+    MetadataCache(const MetadataCache&) = delete;
+    MetadataCache& operator=(const MetadataCache&) = delete;
+
+    ~MetadataCache() {
+#ifdef __linux__
+        if (inotifyFd >= 0) {
+            ::close(inotifyFd);
+        }
+#endif
+    }
+
+    bool enabled() const {
+        return inotifyFd >= 0;
+    }
+
+    // Содержимое папки из кэша или с диска. Подробный список годится и для простого запроса
+    std::shared_ptr<const DirectoryListing> listing(const fs::path& directory, bool withMetadata) {
+        drainEvents();
+        const std::string key = keyFor(directory);
+        auto it = entries.find(key);
+        if (it != entries.end() && (it->second.listing->hasMetadata() || !withMetadata)) {
+            counters.hits++;
+            touch(it->second);
+            return it->second.listing;
+        }
+        counters.misses++;
+        if (it != entries.end()) {
+            invalidate(key, false);
+        }
+
+        // Наблюдение ставится до чтения: изменения во время чтения не потеряются
+        int wd = watch(key);
+        auto fresh = std::make_shared<DirectoryListing>();
+        loadingKey = &key;
+        loadingDirty = false;
+        try {
+            fresh->load(directory, withMetadata);
+            drainEvents();
+        }
+        catch (...) {
+            loadingKey = nullptr;
+            unwatch(wd, key);
+            throw;
+        }
+        loadingKey = nullptr;
+        if (wd >= 0 && loadingDirty) {
+            // Папку успели изменить, пока она читалась: результат отдаётся, но не кэшируется
+            unwatch(wd, key);
+        }
+        else if (wd >= 0) {
+            store(key, wd, fresh);
+        }
+        return fresh;
+    }
+
+    // Сведения об элементе по кэшу родительской папки; на диск не обращается
+    EntryInfo lookup(const fs::path& directory, const std::string& name) {
+        EntryInfo info;
+        if (name.empty() || name == "." || name == ".." || name.find_first_of("/\\") != std::string::npos) {
+            return info;
+        }
+        drainEvents();
+        auto it = entries.find(keyFor(directory));
+        if (it == entries.end()) {
+            counters.misses++;
+            return info;
+        }
+        Entry& entry = it->second;
+        counters.hits++;
+        touch(entry);
+        if (entry.byName.empty() && entry.listing->size() > 0) {
+            entry.byName.reserve(entry.listing->size());
+            for (uint32_t i = 0; i < entry.listing->size(); i++) {
+                entry.byName.emplace(entry.listing->name(i), i);
+            }
+        }
+        auto found = entry.byName.find(name);
+        if (found == entry.byName.end()) {
+            info.presence = Presence::Absent;
+            return info;
+        }
+        const DirectoryListing& listing = *entry.listing;
+        const uint32_t i = found->second;
+        if (listing.kind(i) == DirectoryListing::Broken) {
+            // Битая ссылка и т.п.: пусть решает ФС
+            return info;
+        }
+        info.presence = Presence::Present;
+        info.kind = listing.kind(i);
+        info.symlink = listing.isSymlink(i);
+        info.hasMetadata = listing.hasMetadata();
+        info.size = listing.fileSize(i);
+        info.mtime = listing.mtime(i);
+        return info;
+    }
+
+    MetadataCacheStats stats() {
+        drainEvents();
+        MetadataCacheStats result = counters;
+        result.directories = entries.size();
+        result.watches = watchedKeys.size();
+        result.bytes = usedBytes;
+        result.budget = budget;
+        return result;
+    }
+
+    void clear() {
+        while (!lru.empty()) {
+            invalidate(lru.back());
+        }
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<const DirectoryListing> listing;
+        std::unordered_map<std::string_view, uint32_t> byName;  // строится при первом lookup
+        std::list<std::string>::iterator position;
+        size_t bytes = 0;
+        int wd = -1;
+    };
+
+    int inotifyFd = -1;
+    size_t budget;
+    size_t usedBytes = 0;
+    MetadataCacheStats counters;
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> lru;  // в начале - недавно использованные
+    std::unordered_map<int, std::vector<std::string>> watchedKeys;
+    const std::string* loadingKey = nullptr;  // папка, которая сейчас читается
+    bool loadingDirty = false;
+
+    static std::string keyFor(const fs::path& directory) {
+        std::string key = directory.lexically_normal().string();
+        while (key.size() > 1 && (key.back() == '/' || key.back() == '\\')) {
+            key.pop_back();
+        }
+        return key;
+    }
+
+    void touch(Entry& entry) {
+        lru.splice(lru.begin(), lru, entry.position);
+    }
+
+    int watch(const std::string& key) {
+#ifdef __linux__
+        if (inotifyFd < 0) {
+            return -1;
+        }
+        int wd = ::inotify_add_watch(inotifyFd, key.c_str(),
+            IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB
+            | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK);
+        if (wd < 0) {
+            return -1;
+        }
+        auto& keys = watchedKeys[wd];
+        if (std::find(keys.begin(), keys.end(), key) == keys.end()) {
+            keys.push_back(key);
+        }
+        return wd;
+#else
+        (void)key;
+        return -1;
+#endif
+    }
+
+    void unwatch(int wd, const std::string& key) {
+        auto it = watchedKeys.find(wd);
+        if (it == watchedKeys.end()) {
+            return;
+        }
+        auto& keys = it->second;
+        keys.erase(std::remove(keys.begin(), keys.end(), key), keys.end());
+        if (keys.empty()) {
+            watchedKeys.erase(it);
+#ifdef __linux__
+            ::inotify_rm_watch(inotifyFd, wd);
+#endif
+        }
+    }
+
+    void store(const std::string& key, int wd, std::shared_ptr<const DirectoryListing> listing) {
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            usedBytes -= it->second.bytes;
+            lru.erase(it->second.position);
+            entries.erase(it);
+        }
+        const size_t bytes = listing->memoryUsage() + key.size() * 2
+            + listing->size() * (sizeof(std::string_view) + sizeof(uint32_t) + 2 * sizeof(void*));
+        if (bytes > budget) {
+            unwatch(wd, key);
+            return;
+        }
+        lru.push_front(key);
+        Entry& entry = entries[key];
+        entry.listing = std::move(listing);
+        entry.position = lru.begin();
+        entry.bytes = bytes;
+        entry.wd = wd;
+        usedBytes += bytes;
+
+        while (usedBytes > budget && lru.size() > 1) {
+            counters.evictions++;
+            invalidate(lru.back(), false);
+        }
+    }
+
+    void invalidate(const std::string& key, bool counted = true) {
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            return;
+        }
+        if (counted) {
+            counters.invalidations++;
+        }
+        // key может ссылаться на элемент lru, который сейчас будет удалён
+        const std::string name = key;
+        const int wd = it->second.wd;
+        usedBytes -= it->second.bytes;
+        lru.erase(it->second.position);
+        entries.erase(it);
+        unwatch(wd, name);
+    }
+
+    // Разбор накопившихся событий inotify без ожидания
+    void drainEvents() {
+#ifdef __linux__
+        if (inotifyFd < 0 || watchedKeys.empty()) {
+            return;
+        }
+        alignas(struct inotify_event) char buffer[16384];
+        while (true) {
+            ssize_t length = ::read(inotifyFd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                if (length < 0 && errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            for (ssize_t offset = 0; offset < length;) {
+                const auto* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+                offset += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+                handleEvent(*event);
+            }
+        }
+#endif
+    }
+
+#ifdef __linux__
+    void handleEvent(const struct inotify_event& event) {
+        if (event.mask & IN_Q_OVERFLOW) {
+            // События потеряны: доверять нельзя ничему
+            counters.overflows++;
+            clear();
+            return;
+        }
+        auto it = watchedKeys.find(event.wd);
+        if (it == watchedKeys.end()) {
+            return;
+        }
+        if (loadingKey && std::find(it->second.begin(), it->second.end(), *loadingKey) != it->second.end()) {
+            loadingDirty = true;
+        }
+        if (event.mask & IN_IGNORED) {
+            // Ядро само сняло наблюдение (папка удалена или размонтирована)
+            std::vector<std::string> keys = it->second;
+            watchedKeys.erase(it);
+            for (const auto& key : keys) {
+                auto entry = entries.find(key);
+                if (entry != entries.end()) {
+                    entry->second.wd = -1;
+                    invalidate(key);
+                }
+            }
+            return;
+        }
+
+        const bool structural = (event.mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+            | IN_DELETE_SELF | IN_MOVE_SELF)) != 0;
+        std::vector<std::string> keys = it->second;
+        for (const auto& key : keys) {
+            invalidate(key);
+            if (structural) {
+                invalidate(keyFor(fs::path(key).parent_path()));
+            }
+        }
+    }
+#endif
+};
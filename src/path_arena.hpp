@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Пути одной операции в виде дерева: узел - индекс родителя и имя в блоках арены
+// (16 байт на узел плюс само имя), полный путь собирается только по запросу.
+// Узел 0 - корень, его имя - путь корня целиком. С ParallelWalker удобно ставить
+// директориям метку tag = номер узла: она вернётся как WalkDir::tag для их пачек.
+// Не потокобезопасна: параллельные обработчики добавляют узлы под своей блокировкой
+// (одной на пачку). Чтение после заполнения можно вести из любых потоков.
+class PathArena {
+public:
+    using Id = uint32_t;
+    static constexpr Id None = UINT32_MAX;
+
+    explicit PathArena(std::string_view root = {}) {
+        nodes.push_back(Node{ store(root), None, static_cast<uint32_t>(root.size()) });
+    }
+
+    Id add(Id parent, std::string_view name) {
+        nodes.push_back(Node{ store(name), parent, static_cast<uint32_t>(name.size()) });
+        return static_cast<Id>(nodes.size() - 1);
+    }
+
+    std::string_view name(Id id) const {
+        return std::string_view(nodes[id].name, nodes[id].length);
+    }
+
+    Id parent(Id id) const {
+        return nodes[id].parent;
+    }
+
+    void appendPath(Id id, std::string& out) const {
+        // Цепочка от узла до корня, затем имена в обратном порядке
+        Id chain[MaxDepth];
+        size_t depth = 0;
+        size_t length = 0;
+        for (Id current = id; current != None && depth < MaxDepth; current = nodes[current].parent) {
+            chain[depth++] = current;
+            length += nodes[current].length + 1;
+        }
+        out.reserve(out.size() + length);
+        for (size_t i = depth; i-- > 0;) {
+            if (i + 1 < depth && !out.empty() && out.back() != '/' && out.back() != '\\') {
+                out += fs::path::preferred_separator;
+            }
+            out.append(nodes[chain[i]].name, nodes[chain[i]].length);
+        }
+    }
+
+    std::string path(Id id) const {
+        std::string result;
+        appendPath(id, result);
+        return result;
+    }
+
+    size_t size() const {
+        return nodes.size();
+    }
+
+    size_t memoryUsage() const {
+        return nodes.capacity() * sizeof(Node) + blocks.size() * BlockSize + oversized;
+    }
+
+private:
+    static constexpr size_t BlockSize = 64 * 1024;
+    static constexpr size_t MaxDepth = 4096;  // PATH_MAX / 2: глубже пути не бывает
+
+    struct Node {
+        const char* name;
+        Id parent;
+        uint32_t length;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<std::unique_ptr<char[]>> large;  // длинные имена (в основном путь корня)
+    size_t used = 0;
+    size_t oversized = 0;
+
+    // Имена не перемещаются: блоки только добавляются
+    const char* store(std::string_view name) {
+        if (name.size() > BlockSize / 4) {
+            large.push_back(std::make_unique<char[]>(name.size()));
+            oversized += name.size();
+            std::memcpy(large.back().get(), name.data(), name.size());
+            return large.back().get();
+        }
+        if (blocks.empty() || used + name.size() > BlockSize) {
+            blocks.push_back(std::make_unique<char[]>(BlockSize));
+            used = 0;
+        }
+        char* stored = blocks.back().get() + used;
+        std::memcpy(stored, name.data(), name.size());
+        used += name.size();
+        return stored;
+    }
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Периодический вызов tick из отдельного потока, пока объект жив.
+// Используется движками копирования и удаления для вывода прогресса
+class ProgressTicker {
+public:
+    ProgressTicker(std::chrono::milliseconds interval, std::function<void()> tick)
+        : interval(interval), tick(std::move(tick)) {
+        if (this->tick) {
+            thread = std::thread([this] { run(); });
+        }
+    }
+
+    ProgressTicker(const ProgressTicker&) = delete;
+    ProgressTicker& operator=(const ProgressTicker&) = delete;
+
+    ~ProgressTicker() {
+        if (!thread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        wakeup.notify_one();
+        thread.join();
+    }
+
+private:
+    std::chrono::milliseconds interval;
+    std::function<void()> tick;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool done = false;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wakeup.wait_for(lock, interval, [this] { return done; })) {
+            tick();
+        }
+    }
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Кольцевая очередь без блокировок для одного производителя и одного потребителя.
+// Ёмкость округляется вверх до степени двойки; индексы растут монотонно, позиция
+// в кольце - младшие биты. Счётчики разнесены по разным строкам кэша, чтобы потоки
+// не мешали друг другу при каждом push/pop.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : slots(roundUp(capacity)), mask(slots.size() - 1) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Только из потока-производителя; false - очередь заполнена, value не тронут
+    bool push(T&& value) {
+        const size_t position = head.load(std::memory_order_relaxed);
+        if (position - tail.load(std::memory_order_acquire) == slots.size()) {
+            return false;
+        }
+        slots[position & mask] = std::move(value);
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Только из потока-потребителя; false - очередь пуста
+    bool pop(T& out) {
+        const size_t position = tail.load(std::memory_order_relaxed);
+        if (position == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        out = std::move(slots[position & mask]);
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Приблизительно, если очередь в этот момент меняется
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return slots.size();
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{ 0 };  // следующая запись
+    alignas(64) std::atomic<size_t> tail{ 0 };  // следующее чтение
+
+    static size_t roundUp(size_t capacity) {
+        size_t result = 2;
+        while (result < capacity) {
+            result <<= 1;
+        }
+        return result;
+    }
+};
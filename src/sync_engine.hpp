@@ -0,0 +1,768 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "copy_engine.hpp"
+#include "delete_engine.hpp"
+#include "file_view.hpp"
+#include "hash.hpp"
+#include "instrumentation.hpp"
+#include "job_control.hpp"
+#include "progress.hpp"
+#include "thread_pool.hpp"
+#include "walker.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+enum class SyncActionKind {
+    CreateDir,  // папки нет в приёмнике
+    Copy,       // файла нет в приёмнике
+    Update,     // файл отличается
+    Link,       // символьная ссылка отсутствует или ведёт в другое место
+    Remove      // лишнее в приёмнике (только с deleteExtra)
+};
+
+struct SyncAction {
+    SyncActionKind kind = SyncActionKind::Copy;
+    std::string path;        // относительно корней
+    uintmax_t size = 0;      // размер файла источника
+    bool replace = false;    // на этом месте в приёмнике объект другого типа
+    bool directory = false;  // Remove: папка удаляется целиком
+    bool delta = false;      // Update: большой файл, переписываются только изменившиеся блоки
+};
+
+struct SyncStats {
+    uintmax_t compared = 0;      // файлов источника сравнено
+    uintmax_t unchanged = 0;
+    uintmax_t directories = 0;   // создано папок
+    uintmax_t copied = 0;        // новых файлов
+    uintmax_t updated = 0;       // изменённых файлов, из них
+    uintmax_t deltaUpdated = 0;  // обновлено поблочно
+    uintmax_t links = 0;
+    uintmax_t removed = 0;
+    uintmax_t bytesPlanned = 0;  // размер новых и изменённых файлов
+    uintmax_t bytesWritten = 0;  // записано данных источника; при поблочном обновлении меньше плана
+    uintmax_t bytesReused = 0;   // блоков старой версии, оставшихся на месте
+    uintmax_t errors = 0;
+    double seconds = 0;
+};
+
+struct SyncOptions {
+    unsigned jobs = 0;                     // 0 - по числу ядер
+    bool checksum = false;                 // одинаковые по размеру файлы сравнивать по содержимому, а не по времени
+    bool deleteExtra = false;              // удалять из приёмника то, чего нет в источнике
+    bool dryRun = false;                   // только план и объём, приёмник не меняется
+    uintmax_t deltaThreshold = 8ull << 20; // изменённые файлы не меньше обновляются поблочно
+    size_t blockSize = 1 << 20;            // блок сравнения при поблочном обновлении
+    std::chrono::milliseconds progressInterval{ 500 };
+    std::function<void(const SyncStats&)> onProgress;
+    JobControl* control = nullptr;         // отмена и лимит скорости фоновой задачи
+};
+
+// Синхронизация приёмника с источником. Сначала оба дерева сравниваются параллельным обходом:
+// для каждой папки источника один раз открывается папка-двойник приёмника, и элементы
+// сравниваются fstatat относительно обоих дескрипторов по размеру и времени изменения
+// (или по XXH64 содержимого). По итогам строится план; копируется только то, что в нём есть.
+// Файлы пишутся во временный файл рядом с целью и встают на место rename, поэтому после сбоя
+// в приёмнике остаётся либо старая, либо новая версия. Большой изменённый файл обновляется
+// поблочно: временный файл клонируется (FICLONE) из старой версии, и переписываются только
+// отличающиеся блоки. Без reflink такой файл копируется целиком: иначе вышло бы больше записи.
+class SyncEngine {
+public:
+    explicit SyncEngine(SyncOptions options = {}) : options(options) {
+        if (this->options.jobs == 0) {
+            this->options.jobs = std::max(1u, std::thread::hardware_concurrency());
+        }
+        this->options.blockSize = std::max<size_t>(this->options.blockSize, 4096);
+    }
+
+    // Сравнивает деревья и, если это не пробный прогон, приводит приёмник к источнику.
+    // Возвращает план, отсортированный по путям. Ошибки отдельных файлов не прерывают работу:
+    // они считаются в stats().errors, первые из них доступны через errors()
+    const std::vector<SyncAction>& sync(const fs::path& source, const fs::path& destination) {
+        started = std::chrono::steady_clock::now();
+        ProgressTicker ticker(options.progressInterval, options.onProgress
+            ? std::function<void()>([this] { options.onProgress(stats()); })
+            : std::function<void()>());
+
+        sourceRoot = trimmed(source.string());
+        destRoot = trimmed(destination.string());
+        actions.clear();
+        {
+            FM_SCOPE(Traversal, "sync compare");
+            compare();
+            if (options.deleteExtra && fs::is_directory(destination)) {
+                findExtra();
+            }
+        }
+        std::sort(actions.begin(), actions.end(), [](const SyncAction& a, const SyncAction& b) {
+            return a.path < b.path;
+            });
+        uintmax_t planned = 0;
+        for (const auto& action : actions) {
+            if (action.kind == SyncActionKind::Copy || action.kind == SyncActionKind::Update) {
+                planned += action.size;
+            }
+        }
+        bytesPlanned.store(planned, std::memory_order_relaxed);
+        if (!options.dryRun) {
+            if (options.control) {
+                options.control->setTotals(0, planned);
+            }
+            apply(destination);
+        }
+        return actions;
+    }
+
+    const std::vector<SyncAction>& plan() const {
+        return actions;
+    }
+
+    SyncStats stats() const {
+        SyncStats result;
+        result.compared = compared.load(std::memory_order_relaxed);
+        result.unchanged = unchanged.load(std::memory_order_relaxed);
+        result.directories = directoriesCreated.load(std::memory_order_relaxed);
+        result.copied = filesCopied.load(std::memory_order_relaxed);
+        result.updated = filesUpdated.load(std::memory_order_relaxed);
+        result.deltaUpdated = deltaUpdated.load(std::memory_order_relaxed);
+        result.links = linksCreated.load(std::memory_order_relaxed);
+        result.removed = removedCount.load(std::memory_order_relaxed);
+        result.bytesPlanned = bytesPlanned.load(std::memory_order_relaxed);
+        result.bytesWritten = copier.progress().bytes + deltaWritten.load(std::memory_order_relaxed);
+        result.bytesReused = bytesReused.load(std::memory_order_relaxed);
+        result.errors = errorCount.load(std::memory_order_relaxed);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return result;
+    }
+
+    // Первые MaxErrors сообщений об ошибках
+    std::vector<std::string> errors() const {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        return errorMessages;
+    }
+
+private:
+    static constexpr size_t MaxErrors = 20;
+
+    SyncOptions options;
+    CopyEngine copier{ copyOptions(options) };
+    std::string sourceRoot;
+    std::string destRoot;
+    std::mutex actionsMutex;
+    std::vector<SyncAction> actions;
+    std::atomic<uintmax_t> bytesPlanned{ 0 };
+    std::atomic<uintmax_t> compared{ 0 };
+    std::atomic<uintmax_t> unchanged{ 0 };
+    std::atomic<uintmax_t> directoriesCreated{ 0 };
+    std::atomic<uintmax_t> filesCopied{ 0 };
+    std::atomic<uintmax_t> filesUpdated{ 0 };
+    std::atomic<uintmax_t> deltaUpdated{ 0 };
+    std::atomic<uintmax_t> linksCreated{ 0 };
+    std::atomic<uintmax_t> removedCount{ 0 };
+    std::atomic<uintmax_t> deltaWritten{ 0 };
+    std::atomic<uintmax_t> bytesReused{ 0 };
+    std::atomic<uintmax_t> errorCount{ 0 };
+    mutable std::mutex errorMutex;
+    std::vector<std::string> errorMessages;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    static CopyOptions copyOptions(const SyncOptions& options) {
+        CopyOptions result;
+        result.jobs = options.jobs;
+        result.control = options.control;
+        return result;
+    }
+
+    static std::string trimmed(std::string path) {
+        while (path.size() > 1 && (path.back() == '/' || path.back() == '\\')) {
+            path.pop_back();
+        }
+        return path;
+    }
+
+    // Путь папки обхода относительно корня: "" для корня, иначе без ведущего разделителя
+    static std::string relativeDir(const std::string& dirPath, size_t rootLength) {
+        if (dirPath.size() <= rootLength) {
+            return {};
+        }
+        return dirPath.substr(rootLength + 1);
+    }
+
+    static std::string join(const std::string& dir, std::string_view name) {
+        std::string result = dir;
+        if (!result.empty()) {
+            result += fs::path::preferred_separator;
+        }
+        result.append(name.data(), name.size());
+        return result;
+    }
+
+    std::string sourcePath(const std::string& relative) const {
+        return relative.empty() ? sourceRoot : sourceRoot + fs::path::preferred_separator + relative;
+    }
+
+    std::string destPath(const std::string& relative) const {
+        return relative.empty() ? destRoot : destRoot + fs::path::preferred_separator + relative;
+    }
+
+    void failed(const std::string& what) {
+        errorCount.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (errorMessages.size() < MaxErrors) {
+            errorMessages.push_back(what);
+        }
+    }
+
+    static uint64_t contentHash(const std::string& path) {
+        FileView view(path);
+        Xxh64 state;
+        view.forEachChunk([&](std::string_view chunk) {
+            state.update(chunk);
+            return true;
+            });
+        return state.digest();
+    }
+
+#ifdef __linux__
+    // Дескриптор, закрывающийся при выходе из области видимости
+    class Fd {
+    public:
+        explicit Fd(int fd) : fd(fd) {}
+        Fd(const Fd&) = delete;
+        Fd& operator=(const Fd&) = delete;
+        ~Fd() {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        int get() const {
+            return fd;
+        }
+        int release() {
+            int result = fd;
+            fd = -1;
+            return result;
+        }
+
+    private:
+        int fd;
+    };
+
+    static fs::filesystem_error systemError(const char* what, const std::string& path, int code) {
+        return fs::filesystem_error(what, path, std::error_code(code, std::generic_category()));
+    }
+
+    static std::string linkTarget(int dirFd, const char* name) {
+        char buffer[4096];
+        ssize_t n = ::readlinkat(dirFd, name, buffer, sizeof(buffer));
+        return n < 0 ? std::string() : std::string(buffer, static_cast<size_t>(n));
+    }
+
+    // Элементы одной папки источника сравниваются с папкой-двойником приёмника
+    void compare() {
+        WalkOptions walkOptions;
+        walkOptions.threads = options.jobs;
+        walkOptions.stopOnError = true;
+        walkOptions.control = options.control;
+        ParallelWalker walker(walkOptions);
+        walker.walk(sourceRoot, [&](const WalkDir& dir, std::vector<WalkEntry>& entries) {
+            const std::string relative = relativeDir(dir.path, sourceRoot.size());
+            const std::string destDir = destPath(relative);
+            // Папки приёмника может не быть (или на её месте файл): тогда всё в пачке - новое
+            Fd destFd(::open(destDir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+            FM_COUNT(Syscalls, 1);
+            std::vector<SyncAction> found;
+            for (const auto& entry : entries) {
+                struct stat src;
+                const int srcFd = dir.fd >= 0 ? dir.fd : AT_FDCWD;
+                const std::string fullName = dir.fd >= 0 ? std::string() : entry.path();
+                const char* srcName = dir.fd >= 0 ? entry.cName() : fullName.c_str();
+                FM_COUNT(Syscalls, 2);
+                if (::fstatat(srcFd, srcName, &src, AT_SYMLINK_NOFOLLOW) != 0) {
+                    failed(entry.path() + ": " + std::strerror(errno));
+                    continue;
+                }
+                struct stat dst;
+                const bool exists = destFd.get() >= 0
+                    && ::fstatat(destFd.get(), entry.cName(), &dst, AT_SYMLINK_NOFOLLOW) == 0;
+
+                SyncAction action;
+                action.path = join(relative, entry.name());
+                if (S_ISDIR(src.st_mode)) {
+                    if (exists && S_ISDIR(dst.st_mode)) {
+                        continue;
+                    }
+                    action.kind = SyncActionKind::CreateDir;
+                    action.replace = exists;
+                }
+                else if (S_ISLNK(src.st_mode)) {
+                    if (exists && S_ISLNK(dst.st_mode)
+                        && linkTarget(srcFd, srcName) == linkTarget(destFd.get(), entry.cName())) {
+                        continue;
+                    }
+                    action.kind = SyncActionKind::Link;
+                    action.replace = exists;
+                }
+                else if (S_ISREG(src.st_mode)) {
+                    compared.fetch_add(1, std::memory_order_relaxed);
+                    action.size = static_cast<uintmax_t>(src.st_size);
+                    if (!exists) {
+                        action.kind = SyncActionKind::Copy;
+                    }
+                    else if (!S_ISREG(dst.st_mode)) {
+                        action.kind = SyncActionKind::Copy;
+                        action.replace = true;
+                    }
+                    else {
+                        if (same(src, dst, entry, destDir)) {
+                            unchanged.fetch_add(1, std::memory_order_relaxed);
+                            continue;
+                        }
+                        action.kind = SyncActionKind::Update;
+                        action.delta = action.size >= options.deltaThreshold;
+                    }
+                }
+                else {
+                    // Устройства, каналы и сокеты не переносятся
+                    continue;
+                }
+                found.push_back(std::move(action));
+            }
+            if (!found.empty()) {
+                std::lock_guard<std::mutex> lock(actionsMutex);
+                std::move(found.begin(), found.end(), std::back_inserter(actions));
+            }
+            });
+    }
+
+    bool same(const struct stat& src, const struct stat& dst, const WalkEntry& entry, const std::string& destDir) {
+        if (src.st_size != dst.st_size) {
+            return false;
+        }
+        if (!options.checksum) {
+            return src.st_mtim.tv_sec == dst.st_mtim.tv_sec && src.st_mtim.tv_nsec == dst.st_mtim.tv_nsec;
+        }
+        if (src.st_size == 0) {
+            return true;
+        }
+        FM_SCOPE(Io, "sync checksum");
+        try {
+            return contentHash(entry.path()) == contentHash(join(destDir, entry.name()));
+        }
+        catch (const std::exception&) {
+            // Не прочиталось - пусть копирование покажет настоящую ошибку
+            return false;
+        }
+    }
+
+    // Лишнее в приёмнике: элементы, которых нет в папке-двойнике источника
+    void findExtra() {
+        WalkOptions walkOptions;
+        walkOptions.threads = options.jobs;
+        walkOptions.control = options.control;
+        ParallelWalker walker(walkOptions);
+        walker.walk(destRoot, [&](const WalkDir& dir, std::vector<WalkEntry>& entries) {
+            const std::string relative = relativeDir(dir.path, destRoot.size());
+            FM_COUNT(Syscalls, 1);
+            Fd srcFd(::open(sourcePath(relative).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+            if (srcFd.get() < 0) {
+                // Папки нет в источнике: её целиком удаляет (или заменяет) действие для родителя
+                return;
+            }
+            std::vector<SyncAction> found;
+            for (const auto& entry : entries) {
+                struct stat st;
+                FM_COUNT(Syscalls, 1);
+                if (::fstatat(srcFd.get(), entry.cName(), &st, AT_SYMLINK_NOFOLLOW) == 0 || errno != ENOENT) {
+                    continue;
+                }
+                SyncAction action;
+                action.kind = SyncActionKind::Remove;
+                action.path = join(relative, entry.name());
+                action.directory = entry.isDirectory();
+                found.push_back(std::move(action));
+            }
+            if (!found.empty()) {
+                std::lock_guard<std::mutex> lock(actionsMutex);
+                std::move(found.begin(), found.end(), std::back_inserter(actions));
+            }
+            });
+    }
+
+    // Временное имя рядом с целью: rename в пределах папки атомарен
+    static std::string tempPath(const std::string& target) {
+        const size_t slash = target.find_last_of('/');
+        const size_t nameStart = slash == std::string::npos ? 0 : slash + 1;
+        return target.substr(0, nameStart) + ".~" + target.substr(nameStart) + ".sync-" + std::to_string(::getpid());
+    }
+
+    void setTimes(int fd, const struct stat& st, const std::string& path) {
+        const struct timespec times[2] = { st.st_atim, st.st_mtim };
+        if (::futimens(fd, times) != 0) {
+            throw systemError("Не удалось задать время изменения", path, errno);
+        }
+    }
+
+    // Новый или изменённый файл целиком: копия во временный файл, время источника, rename
+    void copyFile(const std::string& from, const std::string& to) {
+        struct stat st;
+        if (::stat(from.c_str(), &st) != 0) {
+            throw systemError("Не удалось получить атрибуты", from, errno);
+        }
+        const std::string temp = tempPath(to);
+        ::unlink(temp.c_str());  // след прерванного запуска
+        copier.copyEntry(from, temp);
+        try {
+            Fd out(::open(temp.c_str(), O_WRONLY | O_CLOEXEC));
+            if (out.get() < 0) {
+                throw systemError("Не удалось открыть файл", temp, errno);
+            }
+            setTimes(out.get(), st, temp);
+            FM_COUNT(Syscalls, 4);
+            if (::rename(temp.c_str(), to.c_str()) != 0) {
+                throw systemError("Не удалось заменить файл", to, errno);
+            }
+        }
+        catch (...) {
+            ::unlink(temp.c_str());
+            throw;
+        }
+    }
+
+    // Поблочное обновление; false - клонировать старую версию нельзя, нужен copyFile
+    bool updateBlocks(const std::string& from, const std::string& to) {
+        FM_SCOPE(Io, "sync delta");
+        Fd in(::open(from.c_str(), O_RDONLY | O_CLOEXEC));
+        if (in.get() < 0) {
+            throw systemError("Не удалось открыть источник", from, errno);
+        }
+        struct stat st;
+        if (::fstat(in.get(), &st) != 0) {
+            throw systemError("Не удалось получить атрибуты", from, errno);
+        }
+        Fd old(::open(to.c_str(), O_RDONLY | O_CLOEXEC));
+        struct stat oldSt;
+        if (old.get() < 0 || ::fstat(old.get(), &oldSt) != 0) {
+            return false;
+        }
+        const std::string temp = tempPath(to);
+        ::unlink(temp.c_str());
+        Fd out(::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777));
+        if (out.get() < 0) {
+            throw systemError("Не удалось создать файл", temp, errno);
+        }
+        FM_COUNT(Syscalls, 6);
+        if (::ioctl(out.get(), FICLONE, old.get()) != 0) {
+            ::unlink(temp.c_str());
+            return false;
+        }
+
+        try {
+            const uintmax_t size = static_cast<uintmax_t>(st.st_size);
+            const uintmax_t oldSize = static_cast<uintmax_t>(oldSt.st_size);
+            if (::ftruncate(out.get(), static_cast<off_t>(size)) != 0) {
+                throw systemError("Не удалось задать размер файла", temp, errno);
+            }
+            thread_local std::vector<char> fresh;
+            thread_local std::vector<char> stale;
+            fresh.resize(options.blockSize);
+            stale.resize(options.blockSize);
+            for (uintmax_t offset = 0; offset < size; offset += options.blockSize) {
+                const size_t length = static_cast<size_t>(std::min<uintmax_t>(options.blockSize, size - offset));
+                readBlock(in.get(), fresh.data(), length, offset, from);
+                bool equal = false;
+                if (offset + length <= oldSize) {
+                    readBlock(old.get(), stale.data(), length, offset, to);
+                    equal = std::memcmp(fresh.data(), stale.data(), length) == 0;
+                }
+                if (equal) {
+                    bytesReused.fetch_add(length, std::memory_order_relaxed);
+                }
+                else {
+                    writeBlock(out.get(), fresh.data(), length, offset, temp);
+                    deltaWritten.fetch_add(length, std::memory_order_relaxed);
+                    FM_COUNT(Bytes, length);
+                }
+                if (options.control) {
+                    options.control->checkpoint(0, length);
+                }
+            }
+            ::fchmod(out.get(), st.st_mode & 07777);
+            setTimes(out.get(), st, temp);
+            if (::rename(temp.c_str(), to.c_str()) != 0) {
+                throw systemError("Не удалось заменить файл", to, errno);
+            }
+        }
+        catch (...) {
+            ::unlink(temp.c_str());
+            throw;
+        }
+        return true;
+    }
+
+    static void readBlock(int fd, char* buffer, size_t length, uintmax_t offset, const std::string& path) {
+        for (size_t done = 0; done < length;) {
+            FM_COUNT(Syscalls, 1);
+            ssize_t n = ::pread(fd, buffer + done, length - done, static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                throw systemError("Ошибка чтения", path, n < 0 ? errno : EIO);
+            }
+            done += static_cast<size_t>(n);
+        }
+    }
+
+    static void writeBlock(int fd, const char* buffer, size_t length, uintmax_t offset, const std::string& path) {
+        for (size_t done = 0; done < length;) {
+            FM_COUNT(Syscalls, 1);
+            ssize_t n = ::pwrite(fd, buffer + done, length - done, static_cast<off_t>(offset + done));
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw systemError("Ошибка записи", path, errno);
+            }
+            done += static_cast<size_t>(n);
+        }
+    }
+
+    // Новая ссылка создаётся под временным именем и встаёт на место rename
+    void copyLink(const std::string& from, const std::string& to) {
+        char buffer[4096];
+        ssize_t n = ::readlink(from.c_str(), buffer, sizeof(buffer) - 1);
+        if (n < 0) {
+            throw systemError("Не удалось прочитать ссылку", from, errno);
+        }
+        buffer[n] = '\0';
+        const std::string temp = tempPath(to);
+        ::unlink(temp.c_str());
+        if (::symlink(buffer, temp.c_str()) != 0) {
+            throw systemError("Не удалось создать ссылку", temp, errno);
+        }
+        if (::rename(temp.c_str(), to.c_str()) != 0) {
+            const int code = errno;
+            ::unlink(temp.c_str());
+            throw systemError("Не удалось заменить ссылку", to, code);
+        }
+    }
+#else
+    // Переносимый вариант: сравнение через fs::directory_iterator, без поблочного обновления
+    void compare() {
+        std::vector<SyncAction> found;
+        for (auto it = fs::recursive_directory_iterator(sourceRoot); it != fs::recursive_directory_iterator(); ++it) {
+            if (options.control) {
+                options.control->checkpoint(1, 0);
+            }
+            const std::string relative = fs::relative(it->path(), sourceRoot).string();
+            const fs::path target = destPath(relative);
+            std::error_code ec;
+            const fs::file_status dst = fs::symlink_status(target, ec);
+            const bool exists = !ec && fs::exists(dst);
+            SyncAction action;
+            action.path = relative;
+            if (it->is_symlink()) {
+                if (exists && fs::is_symlink(dst) && fs::read_symlink(it->path()) == fs::read_symlink(target)) {
+                    continue;
+                }
+                action.kind = SyncActionKind::Link;
+                action.replace = exists;
+            }
+            else if (it->is_directory()) {
+                if (exists && fs::is_directory(dst)) {
+                    continue;
+                }
+                action.kind = SyncActionKind::CreateDir;
+                action.replace = exists;
+            }
+            else if (it->is_regular_file()) {
+                compared.fetch_add(1, std::memory_order_relaxed);
+                action.size = it->file_size();
+                if (!exists || !fs::is_regular_file(dst)) {
+                    action.kind = SyncActionKind::Copy;
+                    action.replace = exists;
+                }
+                else {
+                    const bool equal = action.size == fs::file_size(target) && (options.checksum
+                        ? contentHash(it->path().string()) == contentHash(target.string())
+                        : it->last_write_time() == fs::last_write_time(target));
+                    if (equal) {
+                        unchanged.fetch_add(1, std::memory_order_relaxed);
+                        continue;
+                    }
+                    action.kind = SyncActionKind::Update;
+                }
+            }
+            else {
+                continue;
+            }
+            found.push_back(std::move(action));
+        }
+        actions = std::move(found);
+    }
+
+    void findExtra() {
+        for (auto it = fs::recursive_directory_iterator(destRoot); it != fs::recursive_directory_iterator(); ++it) {
+            const std::string relative = fs::relative(it->path(), destRoot).string();
+            std::error_code ec;
+            if (fs::exists(fs::symlink_status(sourcePath(relative), ec))) {
+                continue;
+            }
+            SyncAction action;
+            action.kind = SyncActionKind::Remove;
+            action.path = relative;
+            action.directory = it->is_directory() && !it->is_symlink();
+            if (action.directory) {
+                it.disable_recursion_pending();
+            }
+            actions.push_back(std::move(action));
+        }
+    }
+
+    void copyFile(const std::string& from, const std::string& to) {
+        const std::string temp = to + ".sync-tmp";
+        fs::remove(temp);
+        copier.copyEntry(from, temp);
+        fs::last_write_time(temp, fs::last_write_time(from));
+        fs::rename(temp, to);
+    }
+
+    bool updateBlocks(const std::string&, const std::string&) {
+        return false;
+    }
+
+    void copyLink(const std::string& from, const std::string& to) {
+        fs::remove(to);
+        fs::copy_symlink(from, to);
+    }
+#endif
+
+    // Удаления, затем папки от корня вглубь, затем файлы и ссылки пулом задач
+    void apply(const fs::path& destination) {
+        if (!fs::exists(destination)) {
+            fs::create_directory(destination, sourceRoot);
+            directoriesCreated.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        for (const auto& action : actions) {
+            if (action.kind != SyncActionKind::Remove) {
+                continue;
+            }
+            guarded(action, [&] {
+                removeExisting(destPath(action.path), action.directory);
+                removedCount.fetch_add(1, std::memory_order_relaxed);
+                });
+        }
+
+        // План отсортирован по путям, поэтому родитель создаётся раньше своих папок
+        for (const auto& action : actions) {
+            if (action.kind != SyncActionKind::CreateDir) {
+                continue;
+            }
+            guarded(action, [&] {
+                const std::string target = destPath(action.path);
+                if (action.replace) {
+                    removeExisting(target, false);
+                }
+                fs::create_directory(target, sourcePath(action.path));
+                directoriesCreated.fetch_add(1, std::memory_order_relaxed);
+                });
+        }
+
+        ThreadPool pool(options.jobs, options.jobs * 64);
+        for (const auto& action : actions) {
+            if (action.kind == SyncActionKind::Remove || action.kind == SyncActionKind::CreateDir) {
+                continue;
+            }
+            if (pool.failed()) {
+                break;
+            }
+            pool.submit([this, &action] {
+                guarded(action, [&] {
+                    applyFile(action);
+                    });
+                });
+        }
+        pool.wait();
+    }
+
+    void applyFile(const SyncAction& action) {
+        const std::string from = sourcePath(action.path);
+        const std::string to = destPath(action.path);
+        if (action.replace) {
+            // На месте файла была папка: rename её не заменит
+            removeExisting(to, fs::is_directory(fs::symlink_status(to)));
+        }
+        switch (action.kind) {
+        case SyncActionKind::Link:
+            copyLink(from, to);
+            linksCreated.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case SyncActionKind::Copy:
+            copyFile(from, to);
+            filesCopied.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case SyncActionKind::Update:
+            if (action.delta && updateBlocks(from, to)) {
+                deltaUpdated.fetch_add(1, std::memory_order_relaxed);
+            }
+            else {
+                copyFile(from, to);
+            }
+            filesUpdated.fetch_add(1, std::memory_order_relaxed);
+            break;
+        default:
+            break;
+        }
+        FM_COUNT(Entries, 1);
+    }
+
+    void removeExisting(const std::string& path, bool directory) {
+        if (directory) {
+            DeleteOptions deleteOptions;
+            deleteOptions.threads = options.jobs;
+            deleteOptions.control = options.control;
+            DeleteEngine(deleteOptions).remove(path);
+        }
+        else {
+            fs::remove(path);
+        }
+    }
+
+    // Ошибка одного действия записывается и не останавливает остальные; отмена - останавливает
+    template <typename F>
+    void guarded(const SyncAction& action, F f) {
+        try {
+            f();
+        }
+        catch (const OperationCancelled&) {
+            throw;
+        }
+        catch (const std::exception& e) {
+            failed(action.path + ": " + e.what());
+        }
+    }
+};
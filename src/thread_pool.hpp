@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул потоков с ограниченной очередью: submit ждёт, пока в очереди не освободится место,
+// поэтому производитель не может уйти далеко вперёд исполнителей.
+// Первое исключение из задачи запоминается и пробрасывается из wait().
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads = 0, size_t maxQueue = 0) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        capacity = maxQueue ? maxQueue : threads * 4;
+        for (unsigned i = 0; i < threads; i++) {
+            workers.emplace_back(&ThreadPool::workerLoop, this);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        taskReady.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    unsigned size() const {
+        return static_cast<unsigned>(workers.size());
+    }
+
+    void submit(std::function<void()> task) {
+        std::unique_lock<std::mutex> lock(mutex);
+        spaceReady.wait(lock, [this] { return tasks.size() < capacity; });
+        tasks.push_back(std::move(task));
+        active++;
+        lock.unlock();
+        taskReady.notify_one();
+    }
+
+    // Ждёт завершения всех отправленных задач
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        allDone.wait(lock, [this] { return active == 0; });
+        if (firstError) {
+            std::exception_ptr error = firstError;
+            firstError = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Была ли ошибка в одной из задач (чтобы не ставить новые)
+    bool failed() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return firstError != nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskReady;
+    std::condition_variable spaceReady;
+    std::condition_variable allDone;
+    size_t capacity = 0;
+    size_t active = 0;
+    bool stopping = false;
+    std::exception_ptr firstError;
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                taskReady.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            spaceReady.notify_one();
+
+            std::exception_ptr error;
+            try {
+                task();
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (error && !firstError) {
+                firstError = error;
+            }
+            if (--active == 0) {
+                allDone.notify_all();
+            }
+        }
+    }
+};
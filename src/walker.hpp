@@ -0,0 +1,511 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "instrumentation.hpp"
+#include "job_control.hpp"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Тип элемента директории (без разыменования символических ссылок)
+enum class EntryType : unsigned char {
+    Unknown,
+    File,
+    Directory,
+    Symlink,
+    Other
+};
+
+// Элемент обхода без собственных строк: имя лежит в общем буфере пачки рабочего потока
+// (с завершающим '\0'), путь папки - в её задаче. Полный путь собирается только по запросу,
+// поэтому обход, которому нужны одни имена, не выделяет память на каждый элемент.
+// Имя и путь действительны только во время вызова обработчика: сохранять нужно копии
+// или узлы PathArena (см. path_arena.hpp).
+struct WalkEntry {
+    const char* nameData = nullptr;
+    uint32_t nameLength = 0;
+    EntryType type = EntryType::Unknown;
+    unsigned depth = 0;
+    const std::string* dirPath = nullptr;
+    uint64_t tag = 0;  // метка, которую обработчик может поставить директории; вернётся в WalkDir::tag
+    bool prune = false;  // обработчик ставит директории, чтобы не спускаться в неё
+
+    std::string_view name() const {
+        return std::string_view(nameData, nameLength);
+    }
+
+    // Имя для *at-вызовов относительно WalkDir::fd
+    const char* cName() const {
+        return nameData;
+    }
+
+    void appendPath(std::string& out) const {
+        out += *dirPath;
+        if (dirPath->empty() || (dirPath->back() != '/' && dirPath->back() != '\\')) {
+            out += fs::path::preferred_separator;
+        }
+        out.append(nameData, nameLength);
+    }
+
+    std::string path() const {
+        std::string result;
+        result.reserve(dirPath->size() + 1 + nameLength);
+        appendPath(result);
+        return result;
+    }
+
+    bool isDirectory() const {
+        return type == EntryType::Directory;
+    }
+};
+
+// Директория, элементы которой передаются обработчику.
+// fd открыт только на время вызова обработчика (-1, если платформа не даёт дескрипторов)
+struct WalkDir {
+    const std::string& path;
+    int fd;
+    unsigned depth;
+    uint64_t tag;  // метка элемента этой директории из пачки родителя (у корня - 0)
+};
+
+struct WalkOptions {
+    unsigned threads = 0;          // 0 - по числу ядер
+    size_t batchSize = 512;        // максимум элементов в одной пачке
+    bool followSymlinks = false;   // спускаться в ссылки на директории
+    bool stopOnError = false;      // бросать исключение, если директорию не удалось прочитать
+    unsigned maxDepth = 0;         // 0 - без ограничения, 1 - только сама директория
+    JobControl* control = nullptr; // отмена, прогресс и лимит скорости фоновой задачи
+};
+
+struct WalkStats {
+    size_t directories = 0;
+    size_t entries = 0;
+    size_t errors = 0;
+};
+
+// Дескриптор открытой директории, живёт пока его используют дочерние задачи
+class DirHandle {
+public:
+    explicit DirHandle(int fd) : fd(fd) {}
+
+    DirHandle(const DirHandle&) = delete;
+    DirHandle& operator=(const DirHandle&) = delete;
+
+    ~DirHandle() {
+#ifdef __linux__
+        if (fd >= 0) {
+            ::close(fd);
+        }
+#endif
+    }
+
+    int get() const {
+        return fd;
+    }
+
+private:
+    int fd;
+};
+
+// Параллельный обход дерева директорий.
+// Каждый поток держит свою деку необработанных директорий: свои задачи берёт с конца,
+// чужие крадёт с начала. На Linux директории читаются через openat/getdents64,
+// тип элемента берётся из d_type, stat нужен только при DT_UNKNOWN.
+// Обработчик вызывается параллельно из рабочих потоков пачками элементов одной директории
+// и всегда раньше, чем начнётся обход вложенных директорий из этой пачки.
+// Обработчик не должен менять размер пачки: по позициям в ней вложенным директориям
+// передаются метки tag и флаги prune.
+class ParallelWalker {
+public:
+    using BatchHandler = std::function<void(const WalkDir&, std::vector<WalkEntry>&)>;
+
+    explicit ParallelWalker(WalkOptions options = {}) : options(options) {}
+
+    // Досрочная остановка обхода (можно вызывать из обработчика)
+    void requestStop() {
+        stopped.store(true, std::memory_order_relaxed);
+    }
+
+    WalkStats walk(const fs::path& root, const BatchHandler& onBatch) {
+        unsigned threadCount = options.threads;
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        handler = &onBatch;
+        stopped.store(false);
+        firstError = nullptr;
+        directories.store(0);
+        entries.store(0);
+        errors.store(0);
+
+        queues.clear();
+        for (unsigned i = 0; i < threadCount; i++) {
+            queues.push_back(std::make_unique<WorkerQueue>());
+        }
+
+        std::string rootPath = root.string();
+        if (rootPath.size() > 1 && (rootPath.back() == '/' || rootPath.back() == '\\')) {
+            rootPath.pop_back();
+        }
+        pending.store(1);
+        queues[0]->tasks.push_back(DirTask{ nullptr, rootPath, 0, 0 });
+
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < threadCount; i++) {
+            threads.emplace_back(&ParallelWalker::workerLoop, this, i);
+        }
+        workerLoop(0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        handler = nullptr;
+        if (firstError) {
+            std::rethrow_exception(firstError);
+        }
+
+        WalkStats stats;
+        stats.directories = directories.load();
+        stats.entries = entries.load();
+        stats.errors = errors.load();
+        return stats;
+    }
+
+private:
+    struct DirTask {
+        std::shared_ptr<DirHandle> parent;
+        std::string path;
+        size_t nameOffset;
+        unsigned depth;
+        size_t batchIndex = 0;  // позиция в пачке родителя, откуда берётся метка
+        uint64_t tag = 0;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<DirTask> tasks;
+    };
+
+    // Буферы, принадлежащие одному рабочему потоку
+    struct WorkerState {
+        unsigned index = 0;
+        std::vector<WalkEntry> batch;
+        std::string names;                // имена пачки подряд, каждое с '\0'
+        std::vector<uint32_t> nameOffsets;
+        std::vector<DirTask> subdirs;
+        std::vector<char> buffer;
+    };
+
+    WalkOptions options;
+    const BatchHandler* handler = nullptr;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::atomic<size_t> pending{ 0 };
+    std::atomic<bool> stopped{ false };
+    std::atomic<size_t> directories{ 0 };
+    std::atomic<size_t> entries{ 0 };
+    std::atomic<size_t> errors{ 0 };
+    std::mutex idleMutex;
+    std::condition_variable idleCv;
+    std::mutex errorMutex;
+    std::exception_ptr firstError;
+
+    void workerLoop(unsigned index) {
+        WorkerState state;
+        state.index = index;
+        state.batch.reserve(options.batchSize);
+#ifdef __linux__
+        state.buffer.resize(64 * 1024);
+#endif
+
+        while (true) {
+            DirTask task;
+            if (popLocal(index, task) || steal(index, task)) {
+                if (!stopped.load(std::memory_order_relaxed)) {
+                    try {
+                        processDirectory(task, state);
+                    }
+                    catch (...) {
+                        fail(std::current_exception());
+                    }
+                }
+                state.batch.clear();
+                state.subdirs.clear();
+                if (pending.fetch_sub(1) == 1) {
+                    std::lock_guard<std::mutex> lock(idleMutex);
+                    idleCv.notify_all();
+                }
+                continue;
+            }
+
+            if (pending.load() == 0) {
+                break;
+            }
+            std::unique_lock<std::mutex> lock(idleMutex);
+            idleCv.wait_for(lock, std::chrono::milliseconds(1));
+        }
+    }
+
+    bool popLocal(unsigned index, DirTask& task) {
+        WorkerQueue& queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(unsigned index, DirTask& task) {
+        for (size_t offset = 1; offset < queues.size(); offset++) {
+            WorkerQueue& victim = *queues[(index + offset) % queues.size()];
+            std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+            if (!lock.owns_lock() || victim.tasks.empty()) {
+                continue;
+            }
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void fail(std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!firstError) {
+            firstError = error;
+        }
+        stopped.store(true);
+    }
+
+    void reportError(const std::string& path, int code) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+        FM_COUNT(Errors, 1);
+        if (options.stopOnError) {
+            throw fs::filesystem_error("Не удалось прочитать директорию", fs::path(path),
+                std::error_code(code, std::generic_category()));
+        }
+    }
+
+    // Отдаёт накопленную пачку обработчику и только после этого публикует вложенные директории
+    void flush(const DirTask& task, int fd, WorkerState& state) {
+        if (options.control) {
+            options.control->checkpoint(state.batch.size(), 0);
+        }
+        if (!state.batch.empty()) {
+            entries.fetch_add(state.batch.size(), std::memory_order_relaxed);
+            FM_COUNT(Entries, state.batch.size());
+            // Буфер имён мог переместиться при росте: указатели проставляются перед вызовом
+            for (size_t i = 0; i < state.batch.size(); i++) {
+                state.batch[i].nameData = state.names.data() + state.nameOffsets[i];
+                state.batch[i].dirPath = &task.path;
+            }
+            WalkDir dir{ task.path, fd, task.depth, task.tag };
+            (*handler)(dir, state.batch);
+            bool pruned = false;
+            for (auto& subdir : state.subdirs) {
+                if (subdir.batchIndex < state.batch.size()) {
+                    subdir.tag = state.batch[subdir.batchIndex].tag;
+                    pruned = pruned || state.batch[subdir.batchIndex].prune;
+                }
+            }
+            if (pruned) {
+                state.subdirs.erase(std::remove_if(state.subdirs.begin(), state.subdirs.end(), [&](const DirTask& subdir) {
+                    return subdir.batchIndex < state.batch.size() && state.batch[subdir.batchIndex].prune;
+                    }), state.subdirs.end());
+            }
+            state.batch.clear();
+            state.names.clear();
+            state.nameOffsets.clear();
+        }
+        if (state.subdirs.empty()) {
+            return;
+        }
+
+        pending.fetch_add(state.subdirs.size());
+        {
+            WorkerQueue& queue = *queues[state.index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            for (auto& subdir : state.subdirs) {
+                queue.tasks.push_back(std::move(subdir));
+            }
+        }
+        state.subdirs.clear();
+        idleCv.notify_all();
+    }
+
+    void addEntry(const DirTask& task, std::string_view name, EntryType type,
+        const std::shared_ptr<DirHandle>& handle, int fd, WorkerState& state) {
+        WalkEntry entry;
+        entry.nameLength = static_cast<uint32_t>(name.size());
+        entry.type = type;
+        entry.depth = task.depth + 1;
+        state.nameOffsets.push_back(static_cast<uint32_t>(state.names.size()));
+        state.names.append(name.data(), name.size());
+        state.names += '\0';
+
+        // Полный путь строится только для директорий: по нему открывается задача и сообщаются ошибки
+        if (type == EntryType::Directory && (options.maxDepth == 0 || entry.depth < options.maxDepth)) {
+            DirTask subdir{ handle, task.path, 0, entry.depth, state.batch.size() };
+            if (subdir.path.empty() || (subdir.path.back() != '/' && subdir.path.back() != '\\')) {
+                subdir.path += fs::path::preferred_separator;
+            }
+            subdir.nameOffset = subdir.path.size();
+            subdir.path += name;
+            state.subdirs.push_back(std::move(subdir));
+        }
+        state.batch.push_back(entry);
+
+        if (state.batch.size() >= options.batchSize) {
+            flush(task, fd, state);
+        }
+    }
+
+#ifdef __linux__
+    struct LinuxDirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+
+    static EntryType fromDirentType(unsigned char type) {
+        switch (type) {
+        case DT_REG: return EntryType::File;
+        case DT_DIR: return EntryType::Directory;
+        case DT_LNK: return EntryType::Symlink;
+        case DT_UNKNOWN: return EntryType::Unknown;
+        default: return EntryType::Other;
+        }
+    }
+
+    static EntryType fromMode(mode_t mode) {
+        if (S_ISREG(mode)) return EntryType::File;
+        if (S_ISDIR(mode)) return EntryType::Directory;
+        if (S_ISLNK(mode)) return EntryType::Symlink;
+        return EntryType::Other;
+    }
+
+    void processDirectory(const DirTask& task, WorkerState& state) {
+        int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+        if (!options.followSymlinks && task.parent) {
+            flags |= O_NOFOLLOW;
+        }
+
+        int fd;
+        {
+            FM_SCOPE(Traversal, "open dir");
+            FM_COUNT(Syscalls, 1);
+            fd = task.parent
+                ? ::openat(task.parent->get(), task.path.c_str() + task.nameOffset, flags)
+                : ::open(task.path.c_str(), flags);
+        }
+        if (fd < 0) {
+            reportError(task.path, errno);
+            return;
+        }
+        auto handle = std::make_shared<DirHandle>(fd);
+        directories.fetch_add(1, std::memory_order_relaxed);
+
+        while (!stopped.load(std::memory_order_relaxed)) {
+            long bytes;
+            {
+                // Только сам вызов: обработчик пачки работает в своих фазах
+                FM_SCOPE(Traversal, "getdents64");
+                FM_COUNT(Syscalls, 1);
+                bytes = ::syscall(SYS_getdents64, fd, state.buffer.data(), state.buffer.size());
+            }
+            if (bytes < 0) {
+                reportError(task.path, errno);
+                break;
+            }
+            if (bytes == 0) {
+                break;
+            }
+
+            for (long offset = 0; offset < bytes;) {
+                auto* dirent = reinterpret_cast<LinuxDirent64*>(state.buffer.data() + offset);
+                offset += dirent->d_reclen;
+
+                const char* name = dirent->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                    continue;
+                }
+
+                EntryType type = fromDirentType(dirent->d_type);
+                if (type == EntryType::Unknown || (type == EntryType::Symlink && options.followSymlinks)) {
+                    struct stat st;
+                    int statFlags = type == EntryType::Unknown ? AT_SYMLINK_NOFOLLOW : 0;
+                    FM_COUNT(Syscalls, 1);
+                    if (::fstatat(fd, name, &st, statFlags) == 0) {
+                        type = fromMode(st.st_mode);
+                    }
+                }
+                addEntry(task, name, type, handle, fd, state);
+            }
+        }
+
+        flush(task, fd, state);
+    }
+#else
+    void processDirectory(const DirTask& task, WorkerState& state) {
+        std::error_code ec;
+        fs::directory_iterator it(fs::path(task.path), fs::directory_options::skip_permission_denied, ec);
+        if (ec) {
+            reportError(task.path, ec.value());
+            return;
+        }
+        directories.fetch_add(1, std::memory_order_relaxed);
+
+        for (; it != fs::directory_iterator(); it.increment(ec)) {
+            if (stopped.load(std::memory_order_relaxed)) {
+                break;
+            }
+            const fs::directory_entry& entry = *it;
+            fs::file_status status = options.followSymlinks ? entry.status(ec) : entry.symlink_status(ec);
+
+            EntryType type = EntryType::Other;
+            switch (status.type()) {
+            case fs::file_type::regular: type = EntryType::File; break;
+            case fs::file_type::directory: type = EntryType::Directory; break;
+            case fs::file_type::symlink: type = EntryType::Symlink; break;
+            case fs::file_type::none:
+            case fs::file_type::unknown: type = EntryType::Unknown; break;
+            default: break;
+            }
+            addEntry(task, entry.path().filename().string(), type, nullptr, -1, state);
+        }
+        if (ec) {
+            reportError(task.path, ec.value());
+        }
+
+        flush(task, -1, state);
+    }
+#endif
+};
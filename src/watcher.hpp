@@ -0,0 +1,578 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "command_line.hpp"
+#include "instrumentation.hpp"
+#include "spsc_ring.hpp"
+#include "walker.hpp"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Всё, что случилось с одним путём за окно объединения
+struct WatchEvent {
+    enum Change : uint16_t {
+        Created = 1 << 0,
+        Deleted = 1 << 1,
+        Modified = 1 << 2,
+        Written = 1 << 3,    // закрыт после записи: файл дописан целиком
+        MovedIn = 1 << 4,
+        MovedOut = 1 << 5,
+        Attrib = 1 << 6,
+        Rescanned = 1 << 7,  // найден пересканированием после переполнения очереди
+        Overflow = 1 << 8    // очередь ядра переполнилась, часть событий потеряна
+    };
+
+    std::string path;        // относительно корня наблюдения, "" - сам корень
+    uint16_t changes = 0;
+    bool directory = false;
+    uint32_t count = 0;      // сколько событий ядра слито в это
+    std::time_t time = 0;    // когда событие отдано потребителю
+};
+
+// Изменения через запятую: по-русски для консоли или идентификаторами для JSON
+inline std::string watchChangeNames(uint16_t changes, bool identifiers) {
+    static const struct {
+        uint16_t bit;
+        const char* text;
+        const char* id;
+    } names[] = {
+        { WatchEvent::Created, "создан", "created" },
+        { WatchEvent::MovedIn, "перемещён сюда", "moved_in" },
+        { WatchEvent::Modified, "изменён", "modified" },
+        { WatchEvent::Written, "записан", "written" },
+        { WatchEvent::Attrib, "атрибуты", "attrib" },
+        { WatchEvent::MovedOut, "перемещён отсюда", "moved_out" },
+        { WatchEvent::Deleted, "удалён", "deleted" },
+        { WatchEvent::Rescanned, "найден при пересканировании", "rescanned" },
+        { WatchEvent::Overflow, "переполнение очереди событий", "overflow" },
+    };
+    std::string result;
+    for (const auto& name : names) {
+        if (changes & name.bit) {
+            if (!result.empty()) {
+                result += identifiers ? "," : ", ";
+            }
+            result += identifiers ? jsonString(name.id) : name.text;
+        }
+    }
+    return result;
+}
+
+inline std::tm watchLocalTime(std::time_t time) {
+    std::tm tm = {};
+#ifdef _WIN32
+    localtime_s(&tm, &time);
+#else
+    localtime_r(&time, &tm);
+#endif
+    return tm;
+}
+
+// Строка события для консоли: "[12:00:01] spool/a.csv: создан, записан (5)"
+inline void appendWatchLine(std::string& out, const WatchEvent& event) {
+    char stamp[16];
+    std::tm tm = watchLocalTime(event.time);
+    std::strftime(stamp, sizeof(stamp), "[%H:%M:%S] ", &tm);
+    out += stamp;
+    out += event.path.empty() ? "." : event.path;
+    if (event.directory && !event.path.empty()) {
+        out += '/';
+    }
+    out += ": ";
+    out += watchChangeNames(event.changes, false);
+    if (event.count > 1) {
+        out += " (" + std::to_string(event.count) + ")";
+    }
+    out += '\n';
+}
+
+// Событие одной строкой JSON для пакетного режима
+inline std::string watchEventJson(const WatchEvent& event) {
+    char stamp[32];
+    std::tm tm = watchLocalTime(event.time);
+    std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+    return std::string("{\"time\":\"") + stamp + "\",\"path\":" + jsonString(event.path)
+        + ",\"dir\":" + (event.directory ? "true" : "false")
+        + ",\"changes\":[" + watchChangeNames(event.changes, true) + "]"
+        + ",\"count\":" + std::to_string(event.count) + '}';
+}
+
+struct WatchOptions {
+    bool recursive = false;
+    std::chrono::milliseconds window{ 200 };  // события одного пути за окно сливаются в одно
+    size_t queueCapacity = 4096;              // кольцо между наблюдателем и потребителем
+};
+
+struct WatchStats {
+    uint64_t kernelEvents = 0;
+    uint64_t delivered = 0;
+    uint64_t overflows = 0;
+    uint64_t rescannedDirs = 0;  // папок перечитано после переполнения
+    uint64_t watchErrors = 0;    // папки, на которые не удалось поставить наблюдение
+    size_t watches = 0;
+};
+
+// Наблюдение за папкой через inotify. Отдельный поток читает события ядра, сливает
+// события одного пути за окно и передаёт их потребителю через кольцо без блокировок.
+// При recursive наблюдение ставится на все вложенные папки, в том числе на новые:
+// их содержимое, появившееся раньше наблюдения, выдаётся как созданное.
+// Если очередь ядра переполнилась, перечитываются только папки, изменённые с момента,
+// когда очередь в последний раз была пуста.
+// Наблюдение доступно только на Linux; на других платформах конструктор бросает исключение.
+class DirectoryWatcher {
+public:
+    DirectoryWatcher(const fs::path& directory, WatchOptions options = {})
+        : options(options), ring(options.queueCapacity) {
+        rootString = directory.lexically_normal().string();
+        while (rootString.size() > 1 && rootString.back() == '/') {
+            rootString.pop_back();
+        }
+#ifdef __linux__
+        fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) {
+            throw fs::filesystem_error("Не удалось создать inotify", directory, std::error_code(errno, std::generic_category()));
+        }
+        drainedAt = std::chrono::system_clock::now();
+        if (!addWatch("")) {
+            const int code = errno;
+            ::close(fd);
+            throw fs::filesystem_error("Не удалось поставить наблюдение", directory, std::error_code(code, std::generic_category()));
+        }
+        if (options.recursive) {
+            addTree("", false);
+        }
+#else
+        throw std::runtime_error("наблюдение за папками поддерживается только на Linux (inotify)");
+#endif
+    }
+
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    ~DirectoryWatcher() {
+        stop();
+#ifdef __linux__
+        ::close(fd);
+#endif
+    }
+
+    void start() {
+        if (!worker.joinable()) {
+            worker = std::thread([this] { run(); });
+        }
+    }
+
+    // Накопленные, но ещё не отданные события отправляются в кольцо перед выходом
+    void stop() {
+        stopping.store(true, std::memory_order_relaxed);
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    // Только из одного потока-потребителя; false - готовых событий нет
+    bool next(WatchEvent& event) {
+        return ring.pop(event);
+    }
+
+    // Поток наблюдения завершился сам: корень удалён или перемещён, либо ошибка
+    bool finished() const {
+        return done.load(std::memory_order_acquire);
+    }
+
+    std::string failure() const {
+        std::lock_guard<std::mutex> lock(watchMutex);
+        return error;
+    }
+
+    WatchStats stats() const {
+        WatchStats result;
+        result.kernelEvents = kernelEvents.load();
+        result.delivered = delivered.load();
+        result.overflows = overflows.load();
+        result.rescannedDirs = rescannedDirs.load();
+        result.watchErrors = watchErrors.load();
+        std::lock_guard<std::mutex> lock(watchMutex);
+        result.watches = watches.size();
+        return result;
+    }
+
+    // Цикл потребителя: готовые события отдаются пачками; wait ждёт (недолго, порядка
+    // окна) и возвращает true, когда пора остановиться. После остановки отдаётся остаток
+    template <typename Deliver, typename Wait>
+    void consume(Deliver&& deliver, Wait&& wait) {
+        std::vector<WatchEvent> batch;
+        WatchEvent event;
+        while (true) {
+            while (next(event)) {
+                batch.push_back(std::move(event));
+            }
+            if (!batch.empty()) {
+                deliver(batch);
+                batch.clear();
+            }
+            if (finished() || wait()) {
+                break;
+            }
+        }
+        stop();
+        while (next(event)) {
+            batch.push_back(std::move(event));
+        }
+        if (!batch.empty()) {
+            deliver(batch);
+        }
+    }
+
+private:
+    WatchOptions options;
+    std::string rootString;
+    SpscRing<WatchEvent> ring;
+    std::thread worker;
+    std::atomic<bool> stopping{ false };
+    std::atomic<bool> done{ false };
+    std::atomic<uint64_t> kernelEvents{ 0 }, delivered{ 0 }, overflows{ 0 }, rescannedDirs{ 0 }, watchErrors{ 0 };
+
+    mutable std::mutex watchMutex;                  // watches и error: их читает stats() из потребителя
+    std::unordered_map<int, std::string> watches;   // wd -> путь папки от корня
+    std::string error;
+    int fd = -1;
+
+    // Окно объединения: события в порядке первого появления пути
+    std::vector<WatchEvent> pending;
+    std::unordered_map<std::string, size_t> pendingIndex;
+    std::chrono::steady_clock::time_point windowStart;
+    std::chrono::system_clock::time_point drainedAt;  // очередь ядра была пуста в этот момент
+    std::chrono::system_clock::time_point rescannedAt;  // начало последнего пересканирования
+
+    std::string fullPath(const std::string& relative) const {
+        return relative.empty() ? rootString : rootString + '/' + relative;
+    }
+
+    static std::string join(const std::string& dir, const char* name) {
+        return dir.empty() ? std::string(name) : dir + '/' + name;
+    }
+
+    void note(std::string path, uint16_t change, bool directory) {
+        auto it = pendingIndex.find(path);
+        if (it != pendingIndex.end()) {
+            WatchEvent& event = pending[it->second];
+            event.changes |= change;
+            event.directory = event.directory || directory;
+            event.count++;
+            return;
+        }
+        if (pending.empty()) {
+            windowStart = std::chrono::steady_clock::now();
+        }
+        pendingIndex.emplace(path, pending.size());
+        WatchEvent event;
+        event.path = std::move(path);
+        event.changes = change;
+        event.directory = directory;
+        event.count = 1;
+        pending.push_back(std::move(event));
+    }
+
+    // Окно закрыто: события уходят в кольцо. Если потребитель не успевает, остаток
+    // ждёт следующего окна и продолжает сливаться, а не теряется
+    void flush() {
+        const std::time_t now = std::time(nullptr);
+        size_t sent = 0;
+        while (sent < pending.size()) {
+            pending[sent].time = now;
+            if (!ring.push(std::move(pending[sent]))) {
+                break;
+            }
+            sent++;
+        }
+        delivered.fetch_add(sent, std::memory_order_relaxed);
+        pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(sent));
+        pendingIndex.clear();
+        for (size_t i = 0; i < pending.size(); i++) {
+            pendingIndex.emplace(pending[i].path, i);
+        }
+        windowStart = std::chrono::steady_clock::now();
+    }
+
+#ifdef __linux__
+    static constexpr uint32_t WatchMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM
+        | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+    // Тот же wd возвращается, если папка уже под наблюдением (перемещение внутри дерева)
+    bool addWatch(const std::string& relative) {
+        FM_COUNT(Syscalls, 1);
+        const int wd = ::inotify_add_watch(fd, fullPath(relative).c_str(), WatchMask);
+        if (wd < 0) {
+            watchErrors.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(watchMutex);
+        watches[wd] = relative;
+        return true;
+    }
+
+    // Наблюдение за всеми папками под relative. Обработчик обхода вызывается до спуска
+    // во вложенные папки, поэтому наблюдение встаёт раньше, чем папка прочитана.
+    // report: найденное выдаётся как созданное (новая папка, которую уже успели заполнить)
+    void addTree(const std::string& relative, bool report) {
+        const size_t offset = rootString.size() + (rootString.back() == '/' ? 0 : 1);
+        std::mutex foundMutex;
+        std::vector<std::pair<std::string, bool>> found;
+        WalkOptions walkOptions;
+        walkOptions.threads = report ? 1 : 0;
+        ParallelWalker walker(walkOptions);
+        walker.walk(fullPath(relative), [&](const WalkDir&, std::vector<WalkEntry>& entries) {
+            std::string path;
+            for (const auto& entry : entries) {
+                if (!entry.isDirectory() && !report) {
+                    continue;
+                }
+                path.clear();
+                entry.appendPath(path);
+                std::string child = path.substr(std::min(offset, path.size()));
+                if (entry.isDirectory()) {
+                    addWatch(child);
+                }
+                if (report) {
+                    std::lock_guard<std::mutex> lock(foundMutex);
+                    found.emplace_back(std::move(child), entry.isDirectory());
+                }
+            }
+            });
+        for (auto& item : found) {
+            note(std::move(item.first), WatchEvent::Created, item.second);
+        }
+    }
+
+    // Папка ушла из дерева: наблюдение снимается с неё и со всех вложенных
+    void forget(const std::string& relative) {
+        std::lock_guard<std::mutex> lock(watchMutex);
+        for (auto it = watches.begin(); it != watches.end();) {
+            const std::string& path = it->second;
+            if (path == relative || (path.size() > relative.size() && path.compare(0, relative.size(), relative) == 0
+                && path[relative.size()] == '/')) {
+                ::inotify_rm_watch(fd, it->first);
+                it = watches.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    // Время последнего изменения данных или inode в наносекундах эпохи
+    static int64_t changedAt(const struct stat& st) {
+        const int64_t modified = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        const int64_t changed = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+        return std::max(modified, changed);
+    }
+
+    // После переполнения: читаются только папки, у которых mtime или ctime не раньше since;
+    // в них выдаётся всё, что менялось с того же момента. Удаления так не видны -
+    // о них говорит событие Overflow у корня
+    void rescanChanged(int64_t since) {
+        std::vector<std::string> dirs;
+        std::unordered_set<std::string> watched;
+        {
+            std::lock_guard<std::mutex> lock(watchMutex);
+            for (const auto& item : watches) {
+                dirs.push_back(item.second);
+                watched.insert(item.second);
+            }
+        }
+        for (const auto& dir : dirs) {
+            struct stat st;
+            if (::stat(fullPath(dir).c_str(), &st) != 0 || changedAt(st) < since) {
+                continue;
+            }
+            rescannedDirs.fetch_add(1, std::memory_order_relaxed);
+            const int dirFd = ::open(fullPath(dir).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            DIR* stream = dirFd >= 0 ? ::fdopendir(dirFd) : nullptr;
+            if (!stream) {
+                if (dirFd >= 0) {
+                    ::close(dirFd);
+                }
+                continue;
+            }
+            std::vector<std::string> newDirs;
+            while (struct dirent* item = ::readdir(stream)) {
+                if (std::strcmp(item->d_name, ".") == 0 || std::strcmp(item->d_name, "..") == 0) {
+                    continue;
+                }
+                struct stat entry;
+                if (::fstatat(dirFd, item->d_name, &entry, AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                const bool isDir = S_ISDIR(entry.st_mode);
+                std::string path = join(dir, item->d_name);
+                if (isDir && options.recursive && watched.count(path) == 0) {
+                    newDirs.push_back(path);
+                }
+                if (changedAt(entry) >= since) {
+                    note(std::move(path), WatchEvent::Rescanned, isDir);
+                }
+            }
+            ::closedir(stream);
+            for (const auto& path : newDirs) {
+                if (addWatch(path)) {
+                    addTree(path, true);
+                }
+            }
+        }
+    }
+
+    void handle(const struct inotify_event& event) {
+        kernelEvents.fetch_add(1, std::memory_order_relaxed);
+        if (event.mask & IN_Q_OVERFLOW) {
+            overflows.fetch_add(1, std::memory_order_relaxed);
+            note("", WatchEvent::Overflow, true);
+            // Всё, что изменилось до прошлого пересканирования, уже выдано; запас - на точность времён в ФС
+            const auto since = std::max(drainedAt, rescannedAt) - std::chrono::milliseconds(50);
+            rescannedAt = std::chrono::system_clock::now();
+            rescanChanged(std::chrono::duration_cast<std::chrono::nanoseconds>(since.time_since_epoch()).count());
+            return;
+        }
+
+        std::string dir;
+        {
+            std::lock_guard<std::mutex> lock(watchMutex);
+            auto it = watches.find(event.wd);
+            if (it == watches.end()) {
+                return;
+            }
+            if (event.mask & IN_IGNORED) {
+                watches.erase(it);
+                return;
+            }
+            dir = it->second;
+        }
+        if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+            // Про вложенные папки уже сообщил родитель; без корня наблюдать нечего
+            if (dir.empty()) {
+                note("", (event.mask & IN_DELETE_SELF) ? WatchEvent::Deleted : WatchEvent::MovedOut, true);
+                stopping.store(true, std::memory_order_relaxed);
+            }
+            return;
+        }
+
+        std::string path = event.len > 0 ? join(dir, event.name) : dir;
+        const bool isDir = (event.mask & IN_ISDIR) != 0;
+        uint16_t change = 0;
+        if (event.mask & IN_CREATE) change |= WatchEvent::Created;
+        if (event.mask & IN_DELETE) change |= WatchEvent::Deleted;
+        if (event.mask & IN_MODIFY) change |= WatchEvent::Modified;
+        if (event.mask & IN_CLOSE_WRITE) change |= WatchEvent::Written;
+        if (event.mask & IN_MOVED_FROM) change |= WatchEvent::MovedOut;
+        if (event.mask & IN_MOVED_TO) change |= WatchEvent::MovedIn;
+        if (event.mask & IN_ATTRIB) change |= WatchEvent::Attrib;
+        if (change == 0) {
+            return;
+        }
+        if (options.recursive && isDir) {
+            if (event.mask & (IN_MOVED_FROM | IN_DELETE)) {
+                forget(path);
+            }
+            if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+                note(path, change, true);
+                if (addWatch(path)) {
+                    addTree(path, true);
+                }
+                return;
+            }
+        }
+        note(std::move(path), change, isDir);
+    }
+
+    void readEvents() {
+        alignas(struct inotify_event) char buffer[65536];
+        while (true) {
+            const ssize_t length = ::read(fd, buffer, sizeof(buffer));
+            if (length < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    drainedAt = std::chrono::system_clock::now();
+                    return;
+                }
+                throw std::system_error(errno, std::generic_category(), "чтение событий inotify");
+            }
+            FM_COUNT(Syscalls, 1);
+            for (ssize_t offset = 0; offset < length;) {
+                const auto* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+                offset += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+                handle(*event);
+            }
+        }
+    }
+
+    void run() {
+        try {
+            while (!stopping.load(std::memory_order_relaxed)) {
+                // Без накопленных событий поток просыпается раз в 100 мс, чтобы заметить stop()
+                int timeout = 100;
+                if (!pending.empty()) {
+                    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        windowStart + options.window - std::chrono::steady_clock::now()).count();
+                    timeout = static_cast<int>(std::clamp<long long>(left, 0, 100));
+                }
+                struct pollfd descriptor{ fd, POLLIN, 0 };
+                const int ready = ::poll(&descriptor, 1, timeout);
+                if (ready < 0 && errno != EINTR) {
+                    throw std::system_error(errno, std::generic_category(), "ожидание событий inotify");
+                }
+                if (ready > 0) {
+                    readEvents();
+                }
+                if (!pending.empty() && std::chrono::steady_clock::now() >= windowStart + options.window) {
+                    flush();
+                }
+            }
+        }
+        catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(watchMutex);
+            error = e.what();
+        }
+        if (!pending.empty()) {
+            flush();
+        }
+        done.store(true, std::memory_order_release);
+    }
+#else
+    bool addWatch(const std::string&) {
+        return false;
+    }
+
+    void addTree(const std::string&, bool) {}
+
+    void run() {
+        done.store(true, std::memory_order_release);
+    }
+#endif
+};
@@ -0,0 +1,79 @@
+#!/bin/bash
+# pack/unpack: обмен архивами в обе стороны, вывод не в терминал, фоновая задача,
+# время вне диапазона ustar, ссылки, повторяющиеся пути и пути за пределами папки
+source "$(dirname "$0")/common.sh" "$1"
+
+mkdir -p "$WORK/tree/sub/empty"
+echo hello > "$WORK/tree/a.txt"
+head -c 9000000 /dev/urandom > "$WORK/tree/sub/big"
+for i in $(seq 1 100); do
+    echo "$i" > "$WORK/tree/sub/f$i"
+done
+touch -d '1960-01-01' "$WORK/tree/old"
+touch -d '2400-01-01' "$WORK/tree/future"
+echo outside > "$WORK/target"
+touch -d '2001-01-01' "$WORK/target"
+ln -s "$WORK/target" "$WORK/tree/link"
+ln "$WORK/tree/a.txt" "$WORK/tree/hard"
+
+run "pack tree t.tar" "unpack t.tar u1"
+expect_output "Упаковано: tree -> t.tar"
+expect_output "Распаковано: t.tar"
+diff -r --no-dereference "$WORK/tree" "$WORK/u1/tree" > /dev/null || fail "распакованное дерево отличается"
+for name in old future; do
+    [ "$(stat -c %Y "$WORK/tree/$name")" = "$(stat -c %Y "$WORK/u1/tree/$name")" ] || fail "не сохранилось время: $name"
+done
+[ "$(stat -c %Y "$WORK/target")" = "$(date -d '2001-01-01' +%s)" ] || fail "изменено время цели ссылки вне папки распаковки"
+
+# Архив читается системным tar
+if command -v tar > /dev/null; then
+    tar tf "$WORK/t.tar" > "$WORK/list" || fail "tar не читает архив"
+    grep -qx "tree/sub/big" "$WORK/list" || fail "в архиве нет tree/sub/big"
+fi
+
+# tar.zst, если сборка с zstd
+run "pack tree t.tar.zst"
+if ! grep -qF "zstd недоступно" "$OUT"; then
+    run "unpack t.tar.zst u2"
+    diff -r --no-dereference "$WORK/tree" "$WORK/u2/tree" > /dev/null || fail "распакованное из tar.zst дерево отличается"
+fi
+
+# Фоновая распаковка
+run "unpack t.tar u3 &" "fg"
+expect_output "Распаковано: t.tar"
+expect_same "$WORK/tree/sub/big" "$WORK/u3/tree/sub/big"
+
+if command -v tar > /dev/null; then
+    # Один путь несколько раз (tar -r): побеждает последний, в том числе крупный после мелкого
+    mkdir -p "$WORK/dup"
+    (
+        cd "$WORK/dup"
+        head -c 6000000 /dev/urandom > f && tar cf ../dup.tar f
+        echo small > f && tar rf ../dup.tar f
+        head -c 5000000 /dev/urandom > f && tar rf ../dup.tar f
+    )
+    for i in 1 2 3; do
+        rm -rf "$WORK/u4"
+        run "unpack dup.tar u4"
+        expect_no_output "Ошибок"
+        expect_same "$WORK/dup/f" "$WORK/u4/f"
+    done
+
+fi
+
+# Путь с .. не выходит за пределы папки распаковки (GNU tar такой архив не создаёт)
+if command -v python3 > /dev/null; then
+    python3 - "$WORK/evil.tar" << 'PY'
+import io, sys, tarfile
+with tarfile.open(sys.argv[1], "w", format=tarfile.USTAR_FORMAT) as archive:
+    info = tarfile.TarInfo("../escaped")
+    info.size = 2
+    archive.addfile(info, io.BytesIO(b"x\n"))
+PY
+    mkdir -p "$WORK/u5"
+    run "unpack evil.tar u5/in"
+    expect_output "за пределы папки распаковки"
+    expect_missing "$WORK/u5/escaped"
+fi
+
+finish
@@ -0,0 +1,68 @@
+#!/bin/bash
+# Групповые rm, mv, cp и rename по шаблону: итоговая строка, конфликты, скрытые файлы, группы $1
+source "$(dirname "$0")/common.sh" "$1"
+
+mkdir -p "$WORK/archive" "$WORK/copies" "$WORK/dir.tmp/inner"
+for i in $(seq 1 2000); do
+    : > "$WORK/f$i.tmp"
+done
+for i in $(seq 1 20); do
+    echo "$i" > "$WORK/log-$i.gz"
+done
+for i in 1 2 3; do
+    : > "$WORK/IMG_$i.jpeg"
+done
+: > "$WORK/.hidden.tmp"
+: > "$WORK/dir.tmp/inner/file"
+: > "$WORK/archive/log-7.gz"
+
+# Конфликт имени в папке назначения: ничего не перемещается
+run "mv log-*.gz archive"
+expect_output "Ничего не сделано, конфликтов: 1"
+expect_exists "$WORK/log-1.gz"
+
+run "rm archive/log-7.gz" "mv 'log-*.gz' archive/" "cp archive/log-1*.gz copies"
+expect_output "Перемещено: 20 из 20"
+expect_output "Скопировано: 11 из 11"
+expect_missing "$WORK/log-1.gz"
+expect_same "$WORK/archive/log-12.gz" "$WORK/copies/log-12.gz"
+
+# Новые имена из частей шаблона, затем регулярным выражением
+run "rename 'IMG_*.jpeg' 'photo-\$1.jpg'" "rename -E '^photo-(\\d)\\.jpg\$' 'p\$1.jpg'"
+expect_output "Переименовано: 3 из 3"
+expect_exists "$WORK/p2.jpg"
+expect_missing "$WORK/IMG_2.jpeg"
+
+# Одинаковое новое имя у нескольких элементов: ничего не переименовывается
+run "rename 'p*.jpg' same.jpg"
+expect_output "Ничего не сделано"
+expect_exists "$WORK/p1.jpg"
+expect_missing "$WORK/same.jpg"
+
+# rm по шаблону: файлы и папка с содержимым, скрытые файлы не совпадают с *
+run "rm *.tmp" "rm nothing*" "rm -E '['"
+expect_output "Удалено: 2001 из 2001 (2000 файлов, 1 папок)"
+expect_output "Нет подходящих элементов: nothing*"
+expect_output "Ошибка в регулярном выражении"
+expect_missing "$WORK/f1.tmp"
+expect_missing "$WORK/dir.tmp"
+expect_exists "$WORK/.hidden.tmp"
+
+# Папка назначения сама подходит под шаблон и пропускается
+run "mv [acp]* archive"
+expect_output "Перемещено: 4 из 4 (3 файлов, 1 папок)"
+expect_output "Пропущено: 1"
+expect_exists "$WORK/archive/p3.jpg"
+expect_exists "$WORK/archive/copies/log-1.gz"
+
+# Фоновый rm по шаблону
+run "rm archive/*.gz &" "fg"
+expect_output "Удалено: 20 из 20"
+expect_missing "$WORK/archive/log-3.gz"
+
+# & для одиночного файла: сообщение и удаление сразу
+run "rm archive/p1.jpg &"
+expect_output "только для папок"
+expect_missing "$WORK/archive/p1.jpg"
+
+finish
@@ -0,0 +1,59 @@
+# Общие функции сценарных тестов. Подключается из tests/*_test.sh:
+#   source common.sh <путь к filemanager>
+# Команды подаются в filemanager через stdin, вывод уходит в файл - как в скриптах,
+# без терминала. Каждый тест работает в своей временной папке и кэшах внутри неё.
+
+set -u
+
+FM=$1
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+export XDG_CACHE_HOME="$WORK/.cache"
+OUT="$WORK/out.log"
+failures=0
+
+fail() {
+    echo "FAIL: $*"
+    failures=$((failures + 1))
+}
+
+# run <команда>...: выполняет команды в $WORK и выходит; зависание или падение - ошибка теста
+run() {
+    { echo "cd $WORK"; printf '%s\n' "$@"; echo exit; } | timeout 60 "$FM" > "$OUT" 2>&1
+    local status=$?
+    if [ $status -eq 124 ]; then
+        fail "filemanager завис на командах: $*"
+    elif [ $status -ne 0 ]; then
+        fail "filemanager завершился с кодом $status на командах: $*"
+    fi
+}
+
+# В выводе последнего run есть строка с text
+expect_output() {
+    grep -qF -- "$1" "$OUT" || fail "в выводе нет: $1"
+}
+
+expect_no_output() {
+    ! grep -qF -- "$1" "$OUT" || fail "в выводе лишнее: $1"
+}
+
+expect_same() {
+    cmp -s "$1" "$2" || fail "содержимое различается: $1 и $2"
+}
+
+expect_exists() {
+    [ -e "$1" ] || [ -L "$1" ] || fail "нет: $1"
+}
+
+expect_missing() {
+    [ ! -e "$1" ] && [ ! -L "$1" ] || fail "не должно быть: $1"
+}
+
+finish() {
+    if [ $failures -ne 0 ]; then
+        echo "--- вывод последнего запуска:"
+        cat "$OUT"
+        exit 1
+    fi
+    echo "OK"
+}
@@ -0,0 +1,45 @@
+#!/bin/bash
+# cp: файлы, дерево с мелкими и крупными файлами, ссылками и специальными файлами.
+# Проверяется и пакетный путь io_uring, и блокирующий (FM_IO_URING=0)
+source "$(dirname "$0")/common.sh" "$1"
+
+mkdir -p "$WORK/src/deep/er"
+head -c 3000000 /dev/urandom > "$WORK/src/big"
+for i in $(seq 1 200); do
+    head -c $((i * 31)) /dev/urandom > "$WORK/src/deep/f$i"
+done
+: > "$WORK/src/empty"
+ln -s deep/f1 "$WORK/src/link"
+
+for uring in 1 0; do
+    export FM_IO_URING=$uring
+    rm -rf "$WORK/dst" "$WORK/one"
+    run "cp src dst" "cp src/big one"
+    expect_output "Скопировано: src -> dst"
+    diff -r --no-dereference "$WORK/src" "$WORK/dst" > /dev/null || fail "копия дерева отличается (FM_IO_URING=$uring)"
+    [ "$(readlink "$WORK/dst/link")" = "deep/f1" ] || fail "ссылка скопирована не как ссылка"
+    expect_same "$WORK/src/big" "$WORK/one"
+done
+unset FM_IO_URING
+
+# Источник с завершающим разделителем: содержимое внутри приёмника, а не рядом с ним
+run "cp src/ slash" "cp src// slash2"
+for name in slash slash2; do
+    diff -r --no-dereference "$WORK/src" "$WORK/$name" > /dev/null || fail "копия src/ отличается: $name"
+    expect_missing "$WORK/${name}big"
+    expect_missing "$WORK/${name}deep"
+done
+
+# Канал в дереве и сам по себе: ошибка, а не вечное ожидание открытия
+mkdir -p "$WORK/special"
+mkfifo "$WORK/special/pipe"
+run "cp special special_copy" "cp special/pipe pipe_copy"
+expect_output "Не обычный файл"
+expect_missing "$WORK/pipe_copy"
+
+# Существующий приёмник файла не перезаписывается
+echo old > "$WORK/keep"
+run "cp src/empty keep"
+[ "$(cat "$WORK/keep")" = "old" ] || fail "cp перезаписал существующий файл"
+
+finish
@@ -0,0 +1,37 @@
+#!/bin/bash
+# sync: план без изменений, первая синхронизация, обновление, удаление лишнего, пропуск каналов
+source "$(dirname "$0")/common.sh" "$1"
+
+mkdir -p "$WORK/src/sub" "$WORK/dst"
+echo one > "$WORK/src/a"
+head -c 2000000 /dev/urandom > "$WORK/src/sub/big"
+ln -s a "$WORK/src/link"
+mkfifo "$WORK/src/pipe"
+echo extra > "$WORK/dst/extra"
+
+run "sync -n src dst"
+expect_output "План src -> dst"
+expect_missing "$WORK/dst/a"
+
+run "sync src dst"
+expect_output "Синхронизировано: src -> dst"
+expect_same "$WORK/src/a" "$WORK/dst/a"
+expect_same "$WORK/src/sub/big" "$WORK/dst/sub/big"
+[ "$(readlink "$WORK/dst/link")" = "a" ] || fail "ссылка не перенесена"
+expect_missing "$WORK/dst/pipe"
+expect_exists "$WORK/dst/extra"
+
+# Изменение в середине крупного файла и удаление лишнего в приёмнике
+printf 'patch' | dd of="$WORK/src/sub/big" bs=1 seek=1000000 conv=notrunc status=none
+echo two > "$WORK/src/a"
+run "sync -d src dst"
+expect_output "Синхронизировано: src -> dst"
+expect_same "$WORK/src/a" "$WORK/dst/a"
+expect_same "$WORK/src/sub/big" "$WORK/dst/sub/big"
+expect_missing "$WORK/dst/extra"
+
+# Повторная синхронизация ничего не переписывает
+run "sync -c src dst"
+expect_output "Синхронизировано: src -> dst (новых файлов 0"
+
+finish